@@ -141,23 +141,31 @@ char* GetStringZip(const u_int8_t *buf, unsigned bufLen)
         return NULL;
     }
 
+    char *pstr = GetStringZipEncoded((u_int8_t*)temp, tempLen, bufLen);
+    delete [] temp;
+
+    return pstr;
+}
+
+
+char* GetStringZipEncoded(const u_int8_t *zipBuf, unsigned zipLen, unsigned bufLen)
+{
     // Convert the zipped buffer into an ASCII string
     //
     char     *pstr = NULL;
     unsigned  offset = 4+8+8;
-    unsigned  strLen = (tempLen/2+1)*3+offset+1;
+    unsigned  strLen = (zipLen/2+1)*3+offset+1;
 
     pstr = new char[strLen];
 
-    hex2str((u_int8_t*)temp, tempLen, &pstr[offset], strLen-offset);
-    delete [] temp;
+    hex2str(zipBuf, zipLen, &pstr[offset], strLen-offset);
 
     // Add the Zip header
     pstr[0]='Z'; pstr[1]='I'; pstr[2]='P'; pstr[3]='B';
     pstr[strLen-1] = '\0';
 
     int2hex(bufLen, &pstr[4]);
-    int2hex(tempLen, &pstr[8+4]);
+    int2hex(zipLen, &pstr[8+4]);
 
     return pstr;
 }
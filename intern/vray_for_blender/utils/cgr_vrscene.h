@@ -46,6 +46,8 @@ std::string  GetTransformHex(const BLTransform &tm);
 
 char* GetHex(const u_int8_t *buf, unsigned bufLen);
 char* GetStringZip(const u_int8_t *buf, unsigned bufLen);
+// Encode already zlib compressed @zipBuf as ZIPB string, @bufLen is the uncompressed size
+char* GetStringZipEncoded(const u_int8_t *zipBuf, unsigned zipLen, unsigned bufLen);
 char* GetFloatArrayZip(float *data, size_t size);
 
 int   GetPythonAttrInt(PyObject *propGroup, const char *attrName, int def=0);
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_params_cache.h"
+#include "vfb_binary_sidecar.h"
+#include "utils/cgr_hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <unistd.h>
+#endif
+
+
+using namespace VRayForBlender;
+using namespace VRayForBlender::ParamDesc;
+
+namespace {
+
+/// Appends plain values and length prefixed strings to a byte buffer
+class BlobWriter {
+public:
+	template <typename T>
+	void write(const T &value) {
+		const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+		m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+	}
+
+	void write(const std::string &value) {
+		write(static_cast<uint32_t>(value.size()));
+		m_data.insert(m_data.end(), value.begin(), value.end());
+	}
+
+	const std::vector<uint8_t> & data() const { return m_data; }
+
+private:
+	std::vector<uint8_t> m_data;
+};
+
+/// Reads what BlobWriter wrote, every read fails once the end of the data is reached
+class BlobReader {
+public:
+	BlobReader(const uint8_t *data, uint64_t size)
+	    : m_data(data)
+	    , m_size(size)
+	    , m_offset(0)
+	{}
+
+	template <typename T>
+	bool read(T &value) {
+		if (sizeof(T) > m_size - m_offset) {
+			return false;
+		}
+		memcpy(&value, m_data + m_offset, sizeof(T));
+		m_offset += sizeof(T);
+		return true;
+	}
+
+	bool read(std::string &value) {
+		uint32_t size = 0;
+		if (!read(size) || size > m_size - m_offset) {
+			return false;
+		}
+		value.assign(reinterpret_cast<const char*>(m_data + m_offset), size);
+		m_offset += size;
+		return true;
+	}
+
+	bool atEnd() const { return m_offset == m_size; }
+
+private:
+	const uint8_t *m_data;
+	uint64_t       m_size;
+	uint64_t       m_offset;
+};
+
+void writeAttr(BlobWriter &writer, const AttrDesc &attr)
+{
+	writer.write(attr.name);
+	writer.write(static_cast<int32_t>(attr.type));
+	writer.write(static_cast<int32_t>(attr.options.optionData));
+	writer.write(attr.descRamp.colors);
+	writer.write(attr.descRamp.positions);
+	writer.write(attr.descRamp.interpolations);
+	writer.write(attr.descCurve.positions);
+	writer.write(attr.descCurve.values);
+	writer.write(attr.descCurve.interpolations);
+}
+
+bool readAttr(BlobReader &reader, AttrDesc &attr)
+{
+	int32_t type = 0;
+	int32_t options = 0;
+	const bool valid = reader.read(attr.name) &&
+	                   reader.read(type) &&
+	                   reader.read(options) &&
+	                   reader.read(attr.descRamp.colors) &&
+	                   reader.read(attr.descRamp.positions) &&
+	                   reader.read(attr.descRamp.interpolations) &&
+	                   reader.read(attr.descCurve.positions) &&
+	                   reader.read(attr.descCurve.values) &&
+	                   reader.read(attr.descCurve.interpolations);
+	attr.type = static_cast<AttrType>(type);
+	attr.options = static_cast<AttrOptions>(options);
+	return valid;
+}
+
+} // namespace
+
+
+DescriptionsStamp ParamDesc::GetDescriptionsStamp(std::vector<DescriptionFile> files)
+{
+	std::sort(files.begin(), files.end(), [](const DescriptionFile &a, const DescriptionFile &b) {
+		return a.path < b.path;
+	});
+
+	BlobWriter writer;
+	writer.write(PluginDescriptionsCacheVersion);
+	for (const DescriptionFile &file : files) {
+		writer.write(file.path);
+		writer.write(file.size);
+		writer.write(file.mtime);
+	}
+
+	DescriptionsStamp stamp;
+	MurmurHash3_x64_128(writer.data().data(), writer.data().size(), 42, stamp.hash);
+	return stamp;
+}
+
+
+bool ParamDesc::SavePluginDescriptionsCache(const std::string &fileName, const DescriptionsStamp &stamp, const PluginDescList &descriptions)
+{
+	BlobWriter writer;
+	writer.write(PluginDescriptionsCacheVersion);
+	writer.write(stamp.hash[0]);
+	writer.write(stamp.hash[1]);
+	writer.write(static_cast<uint32_t>(descriptions.size()));
+
+	for (const PluginDesc &desc : descriptions) {
+		writer.write(desc.pluginID);
+		writer.write(static_cast<int32_t>(desc.pluginType));
+		writer.write(static_cast<uint32_t>(desc.attributes.size()));
+		for (const auto &attrIt : desc.attributes) {
+			writeAttr(writer, attrIt.second);
+		}
+	}
+
+	// several Blender instances could be starting at once, so the cache is written next to it's final
+	// location, in a file of this process only, and moved in place only when complete
+	const std::string tmpFileName = fileName + "." + std::to_string(getpid()) + ".tmp";
+	bool written = false;
+	{
+		BinarySidecarWriter sidecar(tmpFileName);
+		BinarySidecar::Entry entry;
+		written = sidecar.good() && sidecar.write(writer.data().data(), writer.data().size(), BinarySidecar::ElementTypeRaw, entry);
+		sidecar.close();
+	}
+
+	if (written) {
+#ifdef _WIN32
+		remove(fileName.c_str());
+#endif
+		written = rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+	}
+	if (!written) {
+		remove(tmpFileName.c_str());
+	}
+	return written;
+}
+
+
+bool ParamDesc::LoadPluginDescriptionsCache(const std::string &fileName, const DescriptionsStamp &stamp, PluginDescList &descriptions)
+{
+	BinarySidecarReader sidecar;
+	if (!sidecar.open(fileName) || sidecar.getCount() != 1) {
+		return false;
+	}
+
+	const BinarySidecar::Entry &entry = sidecar.getEntry(0);
+	BlobReader reader(reinterpret_cast<const uint8_t*>(sidecar.get(entry.offset, entry.length)), entry.length);
+
+	uint32_t version = 0;
+	DescriptionsStamp cacheStamp;
+	uint32_t count = 0;
+	if (!reader.read(version) || version != PluginDescriptionsCacheVersion ||
+	    !reader.read(cacheStamp.hash[0]) || !reader.read(cacheStamp.hash[1]) || !(cacheStamp == stamp) ||
+	    !reader.read(count)) {
+		return false;
+	}
+
+	PluginDescList result;
+	result.reserve(count);
+	for (uint32_t c = 0; c < count; ++c) {
+		result.emplace_back();
+		PluginDesc &desc = result.back();
+
+		int32_t type = 0;
+		uint32_t attrCount = 0;
+		if (!reader.read(desc.pluginID) || !reader.read(type) || !reader.read(attrCount)) {
+			return false;
+		}
+		desc.pluginType = static_cast<PluginType>(type);
+
+		for (uint32_t a = 0; a < attrCount; ++a) {
+			AttrDesc attr;
+			if (!readAttr(reader, attr)) {
+				return false;
+			}
+			// attributes were written in map order, so each one goes at the end
+			desc.attributes.emplace_hint(desc.attributes.end(), attr.name, attr);
+		}
+	}
+
+	if (!reader.atEnd()) {
+		return false;
+	}
+
+	descriptions.swap(result);
+	return true;
+}
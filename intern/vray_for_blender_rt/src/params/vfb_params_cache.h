@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_PARAMS_CACHE_H
+#define VRAY_FOR_BLENDER_PARAMS_CACHE_H
+
+#include "vfb_params_desc.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace VRayForBlender {
+namespace ParamDesc {
+
+typedef std::vector<PluginDesc> PluginDescList;
+
+/// Identifies the set of JSON files a cache was built from
+struct DescriptionsStamp {
+	DescriptionsStamp() {
+		hash[0] = hash[1] = 0;
+	}
+
+	bool operator==(const DescriptionsStamp &other) const {
+		return hash[0] == other.hash[0] && hash[1] == other.hash[1];
+	}
+
+	uint64_t hash[2];
+};
+
+/// One JSON description file, as seen when building the stamp
+struct DescriptionFile {
+	std::string path;  ///< Full path of the file, the cache file name already depends on the descriptions directory
+	uint64_t    size;
+	int64_t     mtime;
+};
+
+/// Stamp of @files, independent of their order
+DescriptionsStamp GetDescriptionsStamp(std::vector<DescriptionFile> files);
+
+/// Version of the serialized descriptions, bump when PluginDesc or AttrDesc change
+const uint32_t PluginDescriptionsCacheVersion = 1;
+
+/// Write @descriptions built from files with @stamp as binary sidecar @fileName
+/// @return false if the file could not be written
+bool SavePluginDescriptionsCache(const std::string &fileName, const DescriptionsStamp &stamp, const PluginDescList &descriptions);
+
+/// Map binary sidecar @fileName and read the descriptions in @descriptions
+/// @return false if the file is missing, damaged or was built from files with a different @stamp,
+///         @descriptions is not changed in that case
+bool LoadPluginDescriptionsCache(const std::string &fileName, const DescriptionsStamp &stamp, PluginDescList &descriptions);
+
+} // namespace ParamDesc
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_PARAMS_CACHE_H
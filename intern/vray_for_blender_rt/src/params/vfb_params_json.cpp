@@ -17,6 +17,10 @@
  */
 
 #include "vfb_params_json.h"
+#include "vfb_params_cache.h"
+
+#include "cgr_config.h"
+#include "utils/cgr_hash.h"
 
 #ifdef _MSC_VER
 #include <boost/config/compiler/visualc.hpp>
@@ -24,6 +28,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <map>
+#include <unordered_map>
 
 #define SKIP_TYPE(attrType) (\
 	attrType == "LIST"     || \
@@ -75,184 +80,255 @@ using namespace VRayForBlender::ParamDesc;
 typedef std::map<std::string, PluginDesc> MapPluginDesc;
 
 
-static MapPluginDesc PluginDescriptions;
+/// All plugin descriptions, the index in the list is the plugin's interned ID
+static PluginDescList PluginDescriptions;
+
+/// Plugin ID to index in PluginDescriptions
+static std::unordered_map<std::string, int> PluginDescriptionIDs;
+
+
+namespace {
+
+/// Parse JSON description @path of plugin @pluginID into @pluginDesc
+void parsePluginFile(const boost::filesystem::path &path, const std::string &pluginID, PluginDesc &pluginDesc)
+{
+	std::ifstream fileStream(path.c_str());
+
+	boost::property_tree::ptree pTree;
+	boost::property_tree::json_parser::read_json(fileStream, pTree);
+
+	pluginDesc.pluginID   = pluginID;
+	pluginDesc.pluginType = ParamDesc::GetPluginTypeFromString(pTree.get_child("Type").data());
+
+	for (auto &v : pTree.get_child("Parameters")) {
+		const std::string &attrName = v.second.get_child("attr").data();
+		const std::string &attrType = v.second.get_child("type").data();
+
+		// NOTE: "skip" means fake attribute and / or that attribute must be handled
+		// manually
+		if (v.second.count("skip")) {
+			if (v.second.get<bool>("skip")) {
+				continue;
+			}
+		}
+
+		AttrDesc &attrDesc = pluginDesc.attributes[attrName];
+		attrDesc.name = attrName;
+		attrDesc.options = AttrOptionNone;
+		if (v.second.count("options")) {
+			const auto options = v.second.get_child("options");
+			for (auto & opt : options) {
+				if (opt.second.data() == "EXPORT_AS_ACOLOR") {
+					attrDesc.options |= AttrOptionExportAsColor;
+				}
+			}
+		}
+		attrDesc.type = AttrTypeInvalid;
+
+		if (attrType == "BOOL") {
+			attrDesc.type = AttrTypeBool;
+		}
+		else if (attrType == "INT") {
+			attrDesc.type = AttrTypeInt;
+		}
+		else if (attrType == "FLOAT") {
+			attrDesc.type = AttrTypeFloat;
+		}
+		else if (attrType == "ENUM") {
+			attrDesc.type = AttrTypeEnum;
+		}
+		else if (attrType == "COLOR") {
+			attrDesc.type = AttrTypeColor;
+		}
+		else if (attrType == "ACOLOR") {
+			attrDesc.type = AttrTypeAColor;
+		}
+		else if (attrType == "MATRIX") {
+			attrDesc.type = AttrTypeMatrix;
+		}
+		else if (attrType == "MATRIX_TEXTURE") {
+			// this is texture that samples matricies but can also accept a single matrix
+			attrDesc.type = AttrTypeMatrix;
+		}
+		else if (attrType == "TRANSFORM") {
+			attrDesc.type = AttrTypeTransform;
+		}
+		else if (attrType == "TRANSFORM_TEXTURE") {
+			// this is texture that samples transforms but can also accept a single transfrom
+			attrDesc.type = AttrTypeTransform;
+		}
+		else if (attrType == "VECTOR") {
+			attrDesc.type = AttrTypeVector;
+		}
+		else if (attrType == "TEXTURE") {
+			attrDesc.type = AttrTypePluginTexture;
+		}
+		else if (attrType == "FLOAT_TEXTURE") {
+			attrDesc.type = AttrTypePluginTextureFloat;
+		}
+		else if (attrType == "INT_TEXTURE") {
+			attrDesc.type = AttrTypePluginTextureInt;
+		}
+		else if (attrType == "STRING") {
+			attrDesc.type = AttrTypeString;
+		}
+		else if (attrType == "PLUGIN") {
+			attrDesc.type = AttrTypePlugin;
+		}
+		else if (attrType == "GEOMETRY") {
+			attrDesc.type = AttrTypePluginGeometry;
+		}
+		else if (attrType == "BRDF") {
+			attrDesc.type = AttrTypePluginBRDF;
+		}
+		else if (attrType == "UVWGEN") {
+			attrDesc.type = AttrTypePluginUvwgen;
+		}
+		else if (attrType == "MATERIAL") {
+			attrDesc.type = AttrTypePluginMaterial;
+		}
+		else if (attrType == "OUTPUT_PLUGIN") {
+			attrDesc.type = AttrTypeOutputPlugin;
+		}
+		else if (attrType == "OUTPUT_COLOR") {
+			attrDesc.type = AttrTypeOutputColor;
+		}
+		else if (attrType == "OUTPUT_TEXTURE") {
+			attrDesc.type = AttrTypeOutputTexture;
+		}
+		else if (attrType == "OUTPUT_FLOAT_TEXTURE") {
+			attrDesc.type = AttrTypeOutputTextureFloat;
+		}
+		else if (attrType == "OUTPUT_INT_TEXTURE") {
+			attrDesc.type = AttrTypeOutputTextureInt;
+		}
+		else if (attrType == "OUTPUT_VECTOR_TEXTURE") {
+			attrDesc.type = AttrTypeOutputTextureVector;
+		}
+		else if (attrType == "OUTPUT_MATRIX_TEXTURE") {
+			attrDesc.type = AttrTypeOutputTextureMatrix;
+		}
+		else if (attrType == "OUTPUT_TRANSFORM_TEXTURE") {
+			attrDesc.type = AttrTypeOutputTextureTransform;
+		}
+		else if (attrType == "LIST") {
+			attrDesc.type = AttrTypeList;
+		}
+		else if (attrType == "PLUGIN_LIST") {
+			attrDesc.type = AttrTypeListPlugin;
+		}
+		else if (attrType == "WIDGET_RAMP") {
+			attrDesc.type = AttrTypeWidgetRamp;
+
+			const auto &rampDesc = v.second.get_child("attrs");
+			if (rampDesc.count("colors")) {
+				attrDesc.descRamp.colors = rampDesc.get_child("colors").data();
+			}
+			if (rampDesc.count("positions")) {
+				attrDesc.descRamp.positions = rampDesc.get_child("positions").data();
+			}
+			if (rampDesc.count("interpolations")) {
+				attrDesc.descRamp.interpolations = rampDesc.get_child("interpolations").data();
+			}
+		}
+		else if (attrType == "WIDGET_CURVE") {
+			attrDesc.type = AttrTypeWidgetCurve;
+
+			const auto &curveDesc = v.second.get_child("attrs");
+			if (curveDesc.count("values")) {
+				attrDesc.descCurve.values = curveDesc.get_child("values").data();
+			}
+			if (curveDesc.count("positions")) {
+				attrDesc.descCurve.positions = curveDesc.get_child("positions").data();
+			}
+			if (curveDesc.count("interpolations")) {
+				attrDesc.descCurve.interpolations = curveDesc.get_child("interpolations").data();
+			}
+		}
+	}
+}
+
+/// Cache of the descriptions in @dirPath, in the temp directory so the add-on directory does not have to be writable
+std::string getCacheFileName(const std::string &dirPath)
+{
+	char hash[16];
+	snprintf(hash, sizeof(hash), "%08x", HashCode(dirPath.c_str()));
+
+	const boost::filesystem::path cachePath = boost::filesystem::temp_directory_path() / ("vfb_plugin_descriptions_" + std::string(hash) + ".bin");
+	return cachePath.string();
+}
+
+} // namespace
 
 
 void VRayForBlender::InitPluginDescriptions(const std::string &dirPath)
 {
+	// only the file stats are needed to check if the cache is valid, the JSON is parsed only when it's not
+	std::vector<boost::filesystem::path> paths;
+	std::vector<DescriptionFile> files;
+
 	boost::filesystem::recursive_directory_iterator pIt(dirPath);
 	boost::filesystem::recursive_directory_iterator end;
 
 	for (; pIt != end; ++pIt) {
 		const boost::filesystem::path &path = *pIt;
 		if (path.extension() == ".json") {
+			paths.push_back(path);
+			files.push_back({path.string(),
+			                 static_cast<uint64_t>(boost::filesystem::file_size(path)),
+			                 static_cast<int64_t>(boost::filesystem::last_write_time(path))});
+		}
+	}
+
+	const DescriptionsStamp stamp = GetDescriptionsStamp(files);
+	const std::string cacheFileName = getCacheFileName(dirPath);
+
+	PluginDescList descriptions;
+	if (!LoadPluginDescriptionsCache(cacheFileName, stamp, descriptions)) {
+		MapPluginDesc descriptionsMap;
+		for (const boost::filesystem::path &path : paths) {
 			// NOTE: Filename is plugin ID
 #ifdef _WIN32
 			const std::string &fileName = path.stem().string();
 #else
 			const std::string &fileName = path.stem().c_str();
 #endif
-			std::ifstream fileStream(path.c_str());
+			parsePluginFile(path, fileName, descriptionsMap[fileName]);
+		}
 
-			boost::property_tree::ptree pTree;
-			boost::property_tree::json_parser::read_json(fileStream, pTree);
+		descriptions.reserve(descriptionsMap.size());
+		for (auto &descIt : descriptionsMap) {
+			descriptions.push_back(std::move(descIt.second));
+		}
 
-			PluginDesc &pluginDesc = PluginDescriptions[fileName];
-			pluginDesc.pluginID   = fileName;
-			pluginDesc.pluginType = ParamDesc::GetPluginTypeFromString(pTree.get_child("Type").data());
+		if (!SavePluginDescriptionsCache(cacheFileName, stamp, descriptions)) {
+			PRINT_WARN("Failed to write plugin descriptions cache \"%s\"", cacheFileName.c_str());
+		}
+	}
 
-			for (auto &v : pTree.get_child("Parameters")) {
-				const std::string &attrName = v.second.get_child("attr").data();
-				const std::string &attrType = v.second.get_child("type").data();
+	PluginDescriptions.swap(descriptions);
+	PluginDescriptionIDs.clear();
+	for (int c = 0; c < static_cast<int>(PluginDescriptions.size()); ++c) {
+		PluginDescriptionIDs[PluginDescriptions[c].pluginID] = c;
+	}
+}
 
-				// NOTE: "skip" means fake attribute and / or that attribute must be handled
-				// manually
-				if (v.second.count("skip")) {
-					if (v.second.get<bool>("skip")) {
-						continue;
-					}
-				}
 
-				AttrDesc &attrDesc = pluginDesc.attributes[attrName];
-				attrDesc.name = attrName;
-				attrDesc.options = AttrOptionNone;
-				if (v.second.count("options")) {
-					const auto options = v.second.get_child("options");
-					for (auto & opt : options) {
-						if (opt.second.data() == "EXPORT_AS_ACOLOR") {
-							attrDesc.options |= AttrOptionExportAsColor;
-						}
-					}
-				}
-				attrDesc.type = AttrTypeInvalid;
+int VRayForBlender::GetPluginDescriptionID(const std::string &pluginID)
+{
+	const auto idIt = PluginDescriptionIDs.find(pluginID);
+	return idIt == PluginDescriptionIDs.end() ? -1 : idIt->second;
+}
 
-				if (attrType == "BOOL") {
-					attrDesc.type = AttrTypeBool;
-				}
-				else if (attrType == "INT") {
-					attrDesc.type = AttrTypeInt;
-				}
-				else if (attrType == "FLOAT") {
-					attrDesc.type = AttrTypeFloat;
-				}
-				else if (attrType == "ENUM") {
-					attrDesc.type = AttrTypeEnum;
-				}
-				else if (attrType == "COLOR") {
-					attrDesc.type = AttrTypeColor;
-				}
-				else if (attrType == "ACOLOR") {
-					attrDesc.type = AttrTypeAColor;
-				}
-				else if (attrType == "MATRIX") {
-					attrDesc.type = AttrTypeMatrix;
-				}
-				else if (attrType == "MATRIX_TEXTURE") {
-					// this is texture that samples matricies but can also accept a single matrix
-					attrDesc.type = AttrTypeMatrix;
-				}
-				else if (attrType == "TRANSFORM") {
-					attrDesc.type = AttrTypeTransform;
-				}
-				else if (attrType == "TRANSFORM_TEXTURE") {
-					// this is texture that samples transforms but can also accept a single transfrom
-					attrDesc.type = AttrTypeTransform;
-				}
-				else if (attrType == "VECTOR") {
-					attrDesc.type = AttrTypeVector;
-				}
-				else if (attrType == "TEXTURE") {
-					attrDesc.type = AttrTypePluginTexture;
-				}
-				else if (attrType == "FLOAT_TEXTURE") {
-					attrDesc.type = AttrTypePluginTextureFloat;
-				}
-				else if (attrType == "INT_TEXTURE") {
-					attrDesc.type = AttrTypePluginTextureInt;
-				}
-				else if (attrType == "STRING") {
-					attrDesc.type = AttrTypeString;
-				}
-				else if (attrType == "PLUGIN") {
-					attrDesc.type = AttrTypePlugin;
-				}
-				else if (attrType == "GEOMETRY") {
-					attrDesc.type = AttrTypePluginGeometry;
-				}
-				else if (attrType == "BRDF") {
-					attrDesc.type = AttrTypePluginBRDF;
-				}
-				else if (attrType == "UVWGEN") {
-					attrDesc.type = AttrTypePluginUvwgen;
-				}
-				else if (attrType == "MATERIAL") {
-					attrDesc.type = AttrTypePluginMaterial;
-				}
-				else if (attrType == "OUTPUT_PLUGIN") {
-					attrDesc.type = AttrTypeOutputPlugin;
-				}
-				else if (attrType == "OUTPUT_COLOR") {
-					attrDesc.type = AttrTypeOutputColor;
-				}
-				else if (attrType == "OUTPUT_TEXTURE") {
-					attrDesc.type = AttrTypeOutputTexture;
-				}
-				else if (attrType == "OUTPUT_FLOAT_TEXTURE") {
-					attrDesc.type = AttrTypeOutputTextureFloat;
-				}
-				else if (attrType == "OUTPUT_INT_TEXTURE") {
-					attrDesc.type = AttrTypeOutputTextureInt;
-				}
-				else if (attrType == "OUTPUT_VECTOR_TEXTURE") {
-					attrDesc.type = AttrTypeOutputTextureVector;
-				}
-				else if (attrType == "OUTPUT_MATRIX_TEXTURE") {
-					attrDesc.type = AttrTypeOutputTextureMatrix;
-				}
-				else if (attrType == "OUTPUT_TRANSFORM_TEXTURE") {
-					attrDesc.type = AttrTypeOutputTextureTransform;
-				}
-				else if (attrType == "LIST") {
-					attrDesc.type = AttrTypeList;
-				}
-				else if (attrType == "PLUGIN_LIST") {
-					attrDesc.type = AttrTypeListPlugin;
-				}
-				else if (attrType == "WIDGET_RAMP") {
-					attrDesc.type = AttrTypeWidgetRamp;
-
-					const auto &rampDesc = v.second.get_child("attrs");
-					if (rampDesc.count("colors")) {
-						attrDesc.descRamp.colors = rampDesc.get_child("colors").data();
-					}
-					if (rampDesc.count("positions")) {
-						attrDesc.descRamp.positions = rampDesc.get_child("positions").data();
-					}
-					if (rampDesc.count("interpolations")) {
-						attrDesc.descRamp.interpolations = rampDesc.get_child("interpolations").data();
-					}
-				}
-				else if (attrType == "WIDGET_CURVE") {
-					attrDesc.type = AttrTypeWidgetCurve;
-
-					const auto &curveDesc = v.second.get_child("attrs");
-					if (curveDesc.count("values")) {
-						attrDesc.descCurve.values = curveDesc.get_child("values").data();
-					}
-					if (curveDesc.count("positions")) {
-						attrDesc.descCurve.positions = curveDesc.get_child("positions").data();
-					}
-					if (curveDesc.count("interpolations")) {
-						attrDesc.descCurve.interpolations = curveDesc.get_child("interpolations").data();
-					}
-				}
-			}
-		}
-	}
+
+const VRayForBlender::ParamDesc::PluginDesc& VRayForBlender::GetPluginDescription(int id)
+{
+	static const PluginDesc unknownDesc;
+	return id >= 0 && id < static_cast<int>(PluginDescriptions.size()) ? PluginDescriptions[id] : unknownDesc;
 }
 
 
 const VRayForBlender::ParamDesc::PluginDesc& VRayForBlender::GetPluginDescription(const std::string &pluginID)
 {
-	return PluginDescriptions[pluginID];
+	return GetPluginDescription(GetPluginDescriptionID(pluginID));
 }
@@ -24,8 +24,17 @@
 
 namespace VRayForBlender {
 
+/// Load the descriptions of all plugins from the JSON files in @dirPath
+/// The parsed descriptions are cached in a binary file, which is used instead of the JSON files while they don't change
 void InitPluginDescriptions(const std::string &dirPath);
 
+/// Interned ID of @pluginID, -1 if there is no description for it
+int GetPluginDescriptionID(const std::string &pluginID);
+
+/// Description of the plugin with interned @id, empty description for unknown IDs
+const ParamDesc::PluginDesc& GetPluginDescription(int id);
+
+/// Description of @pluginID, empty description for unknown plugins
 const ParamDesc::PluginDesc& GetPluginDescription(const std::string &pluginID);
 
 } // namespace VRayForBlender
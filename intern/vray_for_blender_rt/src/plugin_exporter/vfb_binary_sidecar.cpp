@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_binary_sidecar.h"
+
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+using namespace VRayForBlender;
+using namespace VRayForBlender::BinarySidecar;
+
+uint32_t BinarySidecar::elementSize(ElementType type)
+{
+	switch (type) {
+	case ElementTypeInt: return sizeof(int32_t);
+	case ElementTypeFloat: return sizeof(float);
+	case ElementTypeVector: return 3 * sizeof(float);
+	case ElementTypeColor: return 3 * sizeof(float);
+	default: return 1;
+	}
+}
+
+BinarySidecarWriter::BinarySidecarWriter(const std::string &fileName)
+	: m_fileName(fileName)
+	, m_file(fopen(fileName.c_str(), "wb"))
+	, m_offset(0)
+{
+	if (!m_file) {
+		return;
+	}
+
+	// header page is rewritten on close with the table of contents position
+	std::vector<uint8_t> page(PageSize, 0);
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.pageSize = PageSize;
+	memcpy(page.data(), &header, sizeof(header));
+
+	if (fwrite(page.data(), 1, PageSize, m_file) != PageSize) {
+		fclose(m_file);
+		m_file = nullptr;
+		return;
+	}
+	m_offset = PageSize;
+}
+
+BinarySidecarWriter::~BinarySidecarWriter()
+{
+	close();
+}
+
+bool BinarySidecarWriter::write(const void *data, uint64_t length, ElementType type, Entry &entry)
+{
+	if (!m_file) {
+		return false;
+	}
+
+	// pad previous payload so this one starts on page boundary
+	const uint64_t padding = (PageSize - m_offset % PageSize) % PageSize;
+	if (padding) {
+		static const uint8_t zeros[PageSize] = {0};
+		if (fwrite(zeros, 1, padding, m_file) != padding) {
+			return false;
+		}
+		m_offset += padding;
+	}
+
+	if (length && fwrite(data, 1, length, m_file) != length) {
+		return false;
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	entry.offset = m_offset;
+	entry.length = length;
+	entry.elementType = type;
+
+	m_entries.push_back(entry);
+	m_offset += length;
+	return true;
+}
+
+bool BinarySidecarWriter::flush()
+{
+	if (!m_file) {
+		return false;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.pageSize = PageSize;
+	header.tocOffset = m_offset;
+	header.tocCount = m_entries.size();
+
+	const long tocBytes = static_cast<long>(m_entries.size() * sizeof(Entry));
+	bool ok = m_entries.empty() || fwrite(m_entries.data(), sizeof(Entry), m_entries.size(), m_file) == m_entries.size();
+
+	// header is at the begining so the offset fits in long even on 32 bit platforms
+	ok = ok && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, m_file) == 1 && fflush(m_file) == 0;
+
+	// next payload overwrites the table of contents, it's written again after it, seek relative to the end
+	// since the payloads could be past what long can hold
+	ok = fseek(m_file, -tocBytes, SEEK_END) == 0 && ok;
+	return ok;
+}
+
+void BinarySidecarWriter::close()
+{
+	if (!m_file) {
+		return;
+	}
+
+	flush();
+
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+BinarySidecarReader::BinarySidecarReader()
+	: m_data(nullptr)
+	, m_size(0)
+#ifdef _WIN32
+	, m_fileHandle(nullptr)
+	, m_mapHandle(nullptr)
+#endif
+{}
+
+BinarySidecarReader::~BinarySidecarReader()
+{
+	close();
+}
+
+bool BinarySidecarReader::open(const std::string &fileName)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!map) {
+		CloseHandle(file);
+		return false;
+	}
+	m_data = reinterpret_cast<const uint8_t *>(MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data) {
+		CloseHandle(map);
+		CloseHandle(file);
+		return false;
+	}
+	m_fileHandle = file;
+	m_mapHandle = map;
+	m_size = size.QuadPart;
+#else
+	const int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping keeps its own reference to the file
+	::close(fd);
+	if (mem == MAP_FAILED) {
+		return false;
+	}
+	m_data = reinterpret_cast<const uint8_t *>(mem);
+	m_size = st.st_size;
+#endif
+
+	bool valid = m_size >= PageSize;
+	Header header;
+	if (valid) {
+		memcpy(&header, m_data, sizeof(header));
+		valid = memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+		        header.version == Version &&
+		        header.pageSize == PageSize &&
+		        header.tocOffset >= PageSize &&
+		        header.tocOffset <= m_size &&
+		        header.tocCount <= (m_size - header.tocOffset) / sizeof(Entry);
+	}
+
+	if (valid) {
+		m_entries.resize(header.tocCount);
+		if (header.tocCount) {
+			memcpy(m_entries.data(), m_data + header.tocOffset, header.tocCount * sizeof(Entry));
+		}
+
+		std::sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) {
+			return a.offset < b.offset;
+		});
+
+		// payloads must be page aligned, inside the data section and not overlap each other
+		uint64_t end = PageSize;
+		for (const Entry &entry : m_entries) {
+			if (entry.offset % PageSize || entry.offset < end ||
+			    entry.length > header.tocOffset - entry.offset ||
+			    entry.length % elementSize(static_cast<ElementType>(entry.elementType))) {
+				valid = false;
+				break;
+			}
+			end = entry.offset + entry.length;
+		}
+	}
+
+	if (!valid) {
+		close();
+	}
+
+	return valid;
+}
+
+void BinarySidecarReader::close()
+{
+	if (m_data) {
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapHandle);
+		CloseHandle(m_fileHandle);
+		m_mapHandle = nullptr;
+		m_fileHandle = nullptr;
+#else
+		munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_entries.clear();
+}
+
+bool BinarySidecarReader::validate(uint64_t offset, uint64_t length) const
+{
+	if (!m_data) {
+		return false;
+	}
+
+	auto iter = std::lower_bound(m_entries.begin(), m_entries.end(), offset, [](const Entry &entry, uint64_t value) {
+		return entry.offset < value;
+	});
+
+	return iter != m_entries.end() && iter->offset == offset && iter->length == length;
+}
+
+const void * BinarySidecarReader::get(uint64_t offset, uint64_t length) const
+{
+	return validate(offset, length) ? m_data + offset : nullptr;
+}
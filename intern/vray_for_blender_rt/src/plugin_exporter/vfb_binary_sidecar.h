@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_BINARY_SIDECAR_H
+#define VRAY_FOR_BLENDER_BINARY_SIDECAR_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace VRayForBlender {
+
+/// Layout of the binary sidecar file written next to a .vrscene
+/// [header page][payload 0 (page aligned)][payload 1 (page aligned)]...[table of contents]
+/// The .vrscene references payloads by byte offset and length, so a reader can
+/// map the file and use the arrays in place
+namespace BinarySidecar {
+
+/// Alignment of each payload inside the file
+const uint32_t PageSize = 4096;
+
+/// Magic at the begining of each sidecar file
+const char Magic[8] = {'V', 'F', 'B', 'B', 'I', 'N', '0', '1'};
+
+/// Version of the file layout
+const uint32_t Version = 1;
+
+/// Element type stored in a payload, used to validate the length on read
+enum ElementType {
+	ElementTypeRaw = 0,
+	ElementTypeInt,
+	ElementTypeFloat,
+	ElementTypeVector,
+	ElementTypeColor,
+};
+
+/// Size in bytes of one element of @type, 1 for raw payloads
+uint32_t elementSize(ElementType type);
+
+/// File header, occupies the first page of the file
+struct Header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t pageSize;
+	uint64_t tocOffset;  ///< Offset of the table of contents, 0 until the file is flushed or closed
+	uint64_t tocCount;   ///< Number of entries in the table of contents
+};
+
+/// One entry of the table of contents
+struct Entry {
+	uint64_t offset;      ///< Offset of the payload from the begining of the file
+	uint64_t length;      ///< Length of the payload in bytes
+	uint32_t elementType; ///< ElementType of the payload
+	uint32_t reserved;
+};
+
+} // namespace BinarySidecar
+
+/// Appends page aligned payloads to a sidecar file
+/// Not thread safe, meant to be owned by a single PluginWriter
+class BinarySidecarWriter {
+public:
+	BinarySidecarWriter(const std::string &fileName);
+	~BinarySidecarWriter();
+
+	BinarySidecarWriter(const BinarySidecarWriter &) = delete;
+	BinarySidecarWriter & operator=(const BinarySidecarWriter &) = delete;
+
+	bool good() const { return m_file != nullptr; }
+
+	/// Path used to open the file
+	const std::string & getFileName() const { return m_fileName; }
+
+	/// Write @length bytes from @data as new payload
+	/// @return true and the payload's entry on success
+	bool write(const void *data, uint64_t length, BinarySidecar::ElementType type, BinarySidecar::Entry &entry);
+
+	/// Write the table of contents and the header, so the file can be read with the payloads written so far
+	/// Payloads can still be added, the table of contents is then written again by the next flush or close
+	/// @return false if writing failed
+	bool flush();
+
+	/// Flush and close the file, no payloads can be added after this
+	void close();
+
+private:
+	std::string                        m_fileName; ///< Path to the sidecar
+	FILE                              *m_file; ///< Open file, nullptr on failure or after close
+	uint64_t                           m_offset; ///< Current end of file
+	std::vector<BinarySidecar::Entry>  m_entries; ///< All payloads written so far
+};
+
+/// Maps a sidecar file in memory and gives access to payloads without copying
+class BinarySidecarReader {
+public:
+	BinarySidecarReader();
+	~BinarySidecarReader();
+
+	BinarySidecarReader(const BinarySidecarReader &) = delete;
+	BinarySidecarReader & operator=(const BinarySidecarReader &) = delete;
+
+	/// Map @fileName and validate header and table of contents
+	/// @return false if file can't be mapped or is not a valid sidecar
+	bool open(const std::string &fileName);
+
+	/// Unmap the file, all pointers returned by get become invalid
+	void close();
+
+	bool good() const { return m_data != nullptr; }
+
+	/// Number of payloads in the table of contents
+	int getCount() const { return m_entries.size(); }
+
+	/// Entry at @index in the table of contents
+	const BinarySidecar::Entry & getEntry(int index) const { return m_entries[index]; }
+
+	/// Check if @offset and @length are a payload listed in the table of contents
+	/// and if they lie completely inside the mapped file
+	bool validate(uint64_t offset, uint64_t length) const;
+
+	/// Pointer to payload inside the mapped file, nullptr if @offset and @length don't pass validate
+	const void * get(uint64_t offset, uint64_t length) const;
+
+	/// Typed access to payload, nullptr if the payload's type does not match T's size
+	template <typename T>
+	const T * getArray(uint64_t offset, uint64_t length) const {
+		if (length % sizeof(T)) {
+			return nullptr;
+		}
+		return reinterpret_cast<const T *>(get(offset, length));
+	}
+
+private:
+	const uint8_t                     *m_data; ///< Start of the mapping
+	uint64_t                           m_size; ///< Size of the mapping
+	std::vector<BinarySidecar::Entry>  m_entries; ///< Table of contents, sorted by offset
+#ifdef _WIN32
+	void                              *m_fileHandle;
+	void                              *m_mapHandle;
+#endif
+};
+
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_BINARY_SIDECAR_H
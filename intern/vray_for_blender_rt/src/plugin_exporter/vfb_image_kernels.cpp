@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_image_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#  define VFB_KERNELS_X86
+#  include <emmintrin.h>
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define VFB_TARGET_AVX2
+#  else
+#    define VFB_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#endif
+
+using namespace VRayForBlender;
+using namespace VRayForBlender::ImageKernels;
+
+namespace {
+
+typedef void (*RowKernel)(float *dest, int destChannels, const float *source, int sourceChannels,
+                          int width, int flags, float clampMax, float clampValue);
+
+void convertRowScalar(float *dest, int destChannels, const float *source, int sourceChannels,
+                      int width, int flags, float clampMax, float clampValue)
+{
+	const int colorChannels = std::min(destChannels, 3);
+	const bool clamp = flags & Clamp;
+	const bool resetAlpha = flags & ResetAlpha;
+
+	for (int p = 0; p < width; ++p) {
+		const float *sourcePixel = source + p * sourceChannels;
+		float *destPixel = dest + p * destChannels;
+
+		for (int c = 0; c < colorChannels; ++c) {
+			const float value = sourcePixel[c];
+			destPixel[c] = clamp && value > clampMax ? clampValue : value;
+		}
+		if (destChannels == 4) {
+			destPixel[3] = resetAlpha ? 1.0f : sourcePixel[3];
+		}
+	}
+}
+
+#ifdef VFB_KERNELS_X86
+
+/// Replace the lanes of @v selected in @mask that are above @max with @value
+inline __m128 clampSSE2(__m128 v, __m128 mask, __m128 max, __m128 value)
+{
+	const __m128 over = _mm_and_ps(_mm_cmpgt_ps(v, max), mask);
+	return _mm_or_ps(_mm_and_ps(over, value), _mm_andnot_ps(over, v));
+}
+
+void convertRowSSE2(float *dest, int destChannels, const float *source, int sourceChannels,
+                    int width, int flags, float clampMax, float clampValue)
+{
+	const bool clamp = flags & Clamp;
+	const __m128 max = _mm_set1_ps(clampMax);
+	const __m128 value = _mm_set1_ps(clampValue);
+	const __m128 allMask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	// RGB lanes of one RGBA pixel
+	const __m128 colorMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	const __m128 alphaOne = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+	int p = 0;
+	if (sourceChannels == 4 && destChannels == 4) {
+		const bool resetAlpha = flags & ResetAlpha;
+		for (; p < width; ++p) {
+			__m128 pixel = _mm_loadu_ps(source + p * 4);
+			if (clamp) {
+				pixel = clampSSE2(pixel, colorMask, max, value);
+			}
+			if (resetAlpha) {
+				pixel = _mm_or_ps(_mm_and_ps(pixel, colorMask), alphaOne);
+			}
+			_mm_storeu_ps(dest + p * 4, pixel);
+		}
+	}
+	else if (sourceChannels == 4 && destChannels == 3) {
+		for (; p + 4 <= width; p += 4) {
+			const float *src = source + p * 4;
+			__m128 p0 = _mm_loadu_ps(src);
+			__m128 p1 = _mm_loadu_ps(src + 4);
+			__m128 p2 = _mm_loadu_ps(src + 8);
+			__m128 p3 = _mm_loadu_ps(src + 12);
+			if (clamp) {
+				p0 = clampSSE2(p0, colorMask, max, value);
+				p1 = clampSSE2(p1, colorMask, max, value);
+				p2 = clampSSE2(p2, colorMask, max, value);
+				p3 = clampSSE2(p3, colorMask, max, value);
+			}
+			// pack 4 RGBA pixels into r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+			const __m128 b0r1 = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0, 0, 2, 2));
+			const __m128 b2r3 = _mm_shuffle_ps(p2, p3, _MM_SHUFFLE(0, 0, 2, 2));
+			float *dst = dest + p * 3;
+			_mm_storeu_ps(dst,     _mm_shuffle_ps(p0, b0r1, _MM_SHUFFLE(2, 0, 1, 0)));
+			_mm_storeu_ps(dst + 4, _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(1, 0, 2, 1)));
+			_mm_storeu_ps(dst + 8, _mm_shuffle_ps(b2r3, p3, _MM_SHUFFLE(2, 1, 2, 0)));
+		}
+	}
+	else if (sourceChannels == 4 && destChannels == 1) {
+		for (; p + 4 <= width; p += 4) {
+			const float *src = source + p * 4;
+			const __m128 r01 = _mm_shuffle_ps(_mm_loadu_ps(src),     _mm_loadu_ps(src + 4),  _MM_SHUFFLE(0, 0, 0, 0));
+			const __m128 r23 = _mm_shuffle_ps(_mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12), _MM_SHUFFLE(0, 0, 0, 0));
+			__m128 bw = _mm_shuffle_ps(r01, r23, _MM_SHUFFLE(2, 0, 2, 0));
+			if (clamp) {
+				bw = clampSSE2(bw, allMask, max, value);
+			}
+			_mm_storeu_ps(dest + p, bw);
+		}
+	}
+	else if (sourceChannels == destChannels && destChannels < 4) {
+		// all channels are color, so the row is processed as flat array
+		const int count = width * destChannels;
+		int c = 0;
+		for (; c + 4 <= count; c += 4) {
+			__m128 values = _mm_loadu_ps(source + c);
+			if (clamp) {
+				values = clampSSE2(values, allMask, max, value);
+			}
+			_mm_storeu_ps(dest + c, values);
+		}
+		for (; c < count; ++c) {
+			dest[c] = clamp && source[c] > clampMax ? clampValue : source[c];
+		}
+		p = width;
+	}
+
+	if (p < width) {
+		convertRowScalar(dest + p * destChannels, destChannels, source + p * sourceChannels, sourceChannels,
+		                 width - p, flags, clampMax, clampValue);
+	}
+}
+
+VFB_TARGET_AVX2 void convertRowAVX2(float *dest, int destChannels, const float *source, int sourceChannels,
+                                    int width, int flags, float clampMax, float clampValue)
+{
+	const bool clamp = flags & Clamp;
+	const __m256 max = _mm256_set1_ps(clampMax);
+	const __m256 value = _mm256_set1_ps(clampValue);
+
+	int p = 0;
+	if (sourceChannels == 4 && destChannels == 4) {
+		const bool resetAlpha = flags & ResetAlpha;
+		// RGB lanes of two RGBA pixels
+		const __m256 colorMask = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+		const __m256 alphaOne = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+
+		for (; p + 2 <= width; p += 2) {
+			__m256 pixels = _mm256_loadu_ps(source + p * 4);
+			if (clamp) {
+				const __m256 over = _mm256_and_ps(_mm256_cmp_ps(pixels, max, _CMP_GT_OQ), colorMask);
+				pixels = _mm256_blendv_ps(pixels, value, over);
+			}
+			if (resetAlpha) {
+				pixels = _mm256_or_ps(_mm256_and_ps(pixels, colorMask), alphaOne);
+			}
+			_mm256_storeu_ps(dest + p * 4, pixels);
+		}
+	}
+	else if (sourceChannels == destChannels && destChannels < 4) {
+		const int count = width * destChannels;
+		int c = 0;
+		for (; c + 8 <= count; c += 8) {
+			__m256 values = _mm256_loadu_ps(source + c);
+			if (clamp) {
+				values = _mm256_blendv_ps(values, value, _mm256_cmp_ps(values, max, _CMP_GT_OQ));
+			}
+			_mm256_storeu_ps(dest + c, values);
+		}
+		for (; c < count; ++c) {
+			dest[c] = clamp && source[c] > clampMax ? clampValue : source[c];
+		}
+		p = width;
+	}
+
+	if (p < width) {
+		convertRowSSE2(dest + p * destChannels, destChannels, source + p * sourceChannels, sourceChannels,
+		               width - p, flags, clampMax, clampValue);
+	}
+}
+
+bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	const bool osxsave = info[2] & (1 << 27);
+	const bool avx = info[2] & (1 << 28);
+	__cpuidex(info, 7, 0);
+	const bool avx2 = info[1] & (1 << 5);
+	// the OS must also save the ymm registers
+	return osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // VFB_KERNELS_X86
+
+InstructionSet detectInstructionSet()
+{
+#ifdef VFB_KERNELS_X86
+	return cpuHasAVX2() ? AVX2 : SSE2;
+#else
+	return Scalar;
+#endif
+}
+
+InstructionSet supportedInstructionSet()
+{
+	static const InstructionSet supported = detectInstructionSet();
+	return supported;
+}
+
+std::atomic<int> activeInstructionSet(-1);
+
+RowKernel getRowKernel()
+{
+	switch (getInstructionSet()) {
+#ifdef VFB_KERNELS_X86
+	case AVX2: return convertRowAVX2;
+	case SSE2: return convertRowSSE2;
+#endif
+	default: return convertRowScalar;
+	}
+}
+
+} // namespace
+
+
+InstructionSet ImageKernels::getInstructionSet()
+{
+	const int active = activeInstructionSet;
+	return active < 0 ? supportedInstructionSet() : static_cast<InstructionSet>(active);
+}
+
+InstructionSet ImageKernels::setInstructionSet(InstructionSet set)
+{
+	const InstructionSet used = std::min(set, supportedInstructionSet());
+	activeInstructionSet = used;
+	return used;
+}
+
+const char * ImageKernels::getInstructionSetName(InstructionSet set)
+{
+	switch (set) {
+	case Scalar: return "Scalar";
+	case SSE2: return "SSE2";
+	case AVX2: return "AVX2";
+	default: return "Unknown";
+	}
+}
+
+void ImageKernels::convert(
+	float *dest, int destStride, int destChannels,
+	const float *source, int sourceStride, int sourceChannels,
+	int width, int height, int flags, float clampMax, float clampValue)
+{
+	assert((sourceChannels == destChannels || sourceChannels == 4) && "Unsupported channel conversion");
+	assert((dest != source || !(flags & Flip)) && "Can't flip in place");
+
+	const RowKernel kernel = getRowKernel();
+	for (int r = 0; r < height; ++r) {
+		const int destRow = (flags & Flip) ? height - 1 - r : r;
+		kernel(dest + destRow * destStride, destChannels, source + r * sourceStride, sourceChannels,
+		       width, flags, clampMax, clampValue);
+	}
+}
+
+void ImageKernels::flipRows(float *pixels, int rowSize, int height)
+{
+	for (int r = 0; r < height / 2; ++r) {
+		float *top = pixels + r * rowSize;
+		float *bottom = pixels + (height - 1 - r) * rowSize;
+		// swap without temporary row, the compiler vectorizes this loop
+		std::swap_ranges(top, top + rowSize, bottom);
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_IMAGE_KERNELS_H
+#define VRAY_FOR_BLENDER_IMAGE_KERNELS_H
+
+namespace VRayForBlender {
+namespace ImageKernels {
+
+enum Flags {
+	None       = 0,
+	Flip       = 1 << 0, ///< write the source rows in reverse order
+	Clamp      = 1 << 1, ///< replace color values above clampMax with clampValue, alpha is not clamped
+	ResetAlpha = 1 << 2, ///< set alpha to 1.0, only for 4 channel destination
+};
+
+/// Implementations of the kernels, higher values are faster
+enum InstructionSet {
+	Scalar = 0,
+	SSE2,
+	AVX2,
+};
+
+/// Instruction set currently used by the kernels, the best one supported by both the build and the cpu by default
+InstructionSet getInstructionSet();
+
+/// Use @set instead of the detected instruction set, clamped to what the cpu supports
+/// @return the instruction set that will be used
+InstructionSet setInstructionSet(InstructionSet set);
+
+const char * getInstructionSetName(InstructionSet set);
+
+/// Convert @height rows of @width pixels from @source to @dest in one pass
+/// @sourceChannels must be equal to @destChannels or 4, in which case the first @destChannels of each
+/// source pixel are taken, e.g. RGBA -> RGB or RGBA -> BW
+/// @dest can be equal to @source for in place conversion, if the channels and strides are the same and Flip is not used
+/// @param destStride - floats between the start of two rows in @dest
+/// @param sourceStride - floats between the start of two rows in @source
+/// @param flags - combination of Flags
+void convert(
+	float *dest, int destStride, int destChannels,
+	const float *source, int sourceStride, int sourceChannels,
+	int width, int height, int flags, float clampMax = 1.0f, float clampValue = 1.0f
+);
+
+/// Reverse the order of @height rows of @rowSize floats in place
+void flipRows(float *pixels, int rowSize, int height);
+
+} // namespace ImageKernels
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_IMAGE_KERNELS_H
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_jpeg_decoder.h"
+#include "cgr_config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "jpeglib.h"
+#include <setjmp.h>
+
+using namespace VRayForBlender;
+
+namespace {
+
+/// Start of image marker, jpeglib.h defines only RST0 and EOI
+const int JPEG_SOI = 0xD8;
+
+struct JpegErrorManager {
+	jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+};
+
+void jpegErrorExit(j_common_ptr cinfo) {
+	JpegErrorManager * myerr = (JpegErrorManager*)cinfo->err;
+	char jpegErrMsg[JMSG_LENGTH_MAX + 1];
+	(*cinfo->err->format_message) (cinfo, jpegErrMsg);
+	PRINT_WARN("Error in jpeg decompress [%s]!", jpegErrMsg);
+	longjmp(myerr->setjmp_buffer, 1);
+}
+
+
+void init_source(j_decompress_ptr) {}
+
+boolean fill_input_buffer(j_decompress_ptr cinfo) {
+	// data ended before EOI, feed a fake one instead of writing over the caller's buffer
+	static const JOCTET fakeEOI[2] = {(JOCTET)0xFF, (JOCTET)JPEG_EOI};
+
+	cinfo->src->next_input_byte = fakeEOI;
+	cinfo->src->bytes_in_buffer = 2;
+
+	return TRUE;
+}
+
+void skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
+	struct jpeg_source_mgr* src = (struct jpeg_source_mgr*) cinfo->src;
+
+	if (num_bytes > 0) {
+		const size_t skip = std::min(static_cast<size_t>(num_bytes), src->bytes_in_buffer);
+		src->next_input_byte += skip;
+		src->bytes_in_buffer -= skip;
+	}
+}
+
+void term_source(j_decompress_ptr) {}
+
+void jpeg_mem_src_own(j_decompress_ptr cinfo, const unsigned char * buffer, size_t nbytes) {
+	struct jpeg_source_mgr* src;
+
+	if (cinfo->src == NULL) {   /* first time for this JPEG object? */
+		cinfo->src = (struct jpeg_source_mgr *)
+			(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+			sizeof(struct jpeg_source_mgr));
+	}
+
+	src = (struct jpeg_source_mgr*) cinfo->src;
+	src->init_source = init_source;
+	src->fill_input_buffer = fill_input_buffer;
+	src->skip_input_data = skip_input_data;
+	src->resync_to_restart = jpeg_resync_to_restart; /* use default method */
+	src->term_source = term_source;
+	src->bytes_in_buffer = nbytes;
+	src->next_input_byte = (JOCTET*)buffer;
+}
+
+/// Byte to float conversion table, same values as dividing by 255
+const float * byteToFloat() {
+	static const struct Table {
+		Table() {
+			for (int c = 0; c < 256; ++c) {
+				values[c] = c / 255.f;
+			}
+		}
+		float values[256];
+	} table;
+	return table.values;
+}
+
+inline int readShort(const unsigned char *data) {
+	return (data[0] << 8) | data[1];
+}
+
+/// Decode rows [@skipRows, @skipRows + @rowCount) of JPEG @data in @dest, which is the first of the rows
+/// Rows before @skipRows are decoded and discarded, rows after the last one are not decoded at all
+bool decodeRows(const unsigned char *data, size_t size, int width, int skipRows, int rowCount, float *dest) {
+	jpeg_decompress_struct jpegInfo;
+	JpegErrorManager jpegError;
+
+	jpegInfo.err = jpeg_std_error(&jpegError.pub);
+
+	jpegError.pub.error_exit = jpegErrorExit;
+
+	if (setjmp(jpegError.setjmp_buffer)) {
+		PRINT_WARN("Longjmp after jpeg error!");
+		jpeg_destroy_decompress(&jpegInfo);
+		return false;
+	}
+
+	jpeg_create_decompress(&jpegInfo);
+	jpeg_mem_src_own(&jpegInfo, data, size);
+
+	if (jpeg_read_header(&jpegInfo, TRUE) != JPEG_HEADER_OK) {
+		jpeg_destroy_decompress(&jpegInfo);
+		return false;
+	}
+
+	jpegInfo.out_color_space = JCS_EXT_RGBX;
+
+	if (!jpeg_start_decompress(&jpegInfo)) {
+		jpeg_destroy_decompress(&jpegInfo);
+		return false;
+	}
+
+	if (jpegInfo.output_width != static_cast<JDIMENSION>(width) || jpegInfo.output_components != 4 ||
+	    jpegInfo.output_height < static_cast<JDIMENSION>(skipRows + rowCount)) {
+		PRINT_WARN("Unexpected jpeg size %dx%d, expected width %d", jpegInfo.output_width, jpegInfo.output_height, width);
+		jpeg_destroy_decompress(&jpegInfo);
+		return false;
+	}
+
+	const int rowStride = width * 4;
+	JSAMPARRAY buffer = (*jpegInfo.mem->alloc_sarray)((j_common_ptr)&jpegInfo, JPOOL_IMAGE, rowStride, 1);
+	const float *toFloat = byteToFloat();
+
+	while (jpegInfo.output_scanline < static_cast<JDIMENSION>(skipRows + rowCount)) {
+		const int row = jpegInfo.output_scanline;
+		jpeg_read_scanlines(&jpegInfo, buffer, 1);
+		if (row < skipRows) {
+			continue;
+		}
+
+		float * line = dest + (row - skipRows) * rowStride;
+		const unsigned char * source = buffer[0];
+		for (int p = 0; p < rowStride; p += 4) {
+			line[p]     = toFloat[source[p]];
+			line[p + 1] = toFloat[source[p + 1]];
+			line[p + 2] = toFloat[source[p + 2]];
+			line[p + 3] = 1.f;
+		}
+	}
+
+	// remaining rows are not needed, destroy also aborts the decompression
+	jpeg_destroy_decompress(&jpegInfo);
+	return true;
+}
+
+/// Offset of the first byte of entropy coded data of restart interval @index
+size_t intervalStart(const JpegLayout &layout, int index) {
+	return index == 0 ? layout.scanOffset : layout.restarts[index - 1] + 2;
+}
+
+/// Offset after the last byte of entropy coded data of restart interval @index
+size_t intervalEnd(const JpegLayout &layout, int index) {
+	return index < static_cast<int>(layout.restarts.size()) ? layout.restarts[index] : layout.scanEnd;
+}
+
+/// Build stand alone JPEG of restart intervals [@first, @last) covering @height pixel rows
+/// Headers are reused with patched height and the restart markers are renumbered to start from 0
+void buildStrip(const unsigned char *data, const JpegLayout &layout, int first, int last, int height, std::vector<unsigned char> &strip) {
+	strip.clear();
+	strip.reserve(layout.scanOffset + intervalEnd(layout, last - 1) - intervalStart(layout, first) + 2 * (last - first));
+	strip.insert(strip.end(), data, data + layout.scanOffset);
+	strip[layout.heightOffset] = (height >> 8) & 0xFF;
+	strip[layout.heightOffset + 1] = height & 0xFF;
+
+	for (int c = first; c < last; ++c) {
+		strip.insert(strip.end(), data + intervalStart(layout, c), data + intervalEnd(layout, c));
+		if (c + 1 < last) {
+			strip.push_back(0xFF);
+			strip.push_back(JPEG_RST0 + (c - first) % 8);
+		}
+	}
+
+	strip.push_back(0xFF);
+	strip.push_back(JPEG_EOI);
+}
+
+} // namespace
+
+
+int JpegLayout::intervalsPerStrip(int &rows) const {
+	const int perRow = mcusPerRow();
+	if (restartInterval <= 0) {
+		return 0;
+	}
+	if (restartInterval % perRow == 0) {
+		rows = restartInterval / perRow;
+		return 1;
+	}
+	if (perRow % restartInterval == 0) {
+		rows = 1;
+		return perRow / restartInterval;
+	}
+	return 0;
+}
+
+bool JpegLayout::isSplittable() const {
+	int rows = 0;
+	if (!baseline || !singleScan || intervalsPerStrip(rows) == 0) {
+		return false;
+	}
+	// missing or extra markers mean the stream is damaged, the serial decoder copes with that better
+	const int mcuCount = mcusPerRow() * mcuRows();
+	const int intervals = (mcuCount + restartInterval - 1) / restartInterval;
+	return static_cast<int>(restarts.size()) + 1 == intervals;
+}
+
+
+bool VRayForBlender::parseJpegLayout(const unsigned char *data, size_t size, JpegLayout &layout) {
+	layout = JpegLayout();
+	if (size < 4 || data[0] != 0xFF || data[1] != JPEG_SOI) {
+		return false;
+	}
+
+	int components = 0;
+	size_t pos = 2;
+	while (pos + 4 <= size) {
+		if (data[pos] != 0xFF) {
+			return false;
+		}
+		const int marker = data[pos + 1];
+		if (marker == 0xFF) {
+			// fill byte
+			++pos;
+			continue;
+		}
+		if (marker == JPEG_SOI || (marker >= JPEG_RST0 && marker <= JPEG_RST0 + 7) || marker == 0x01) {
+			// stand alone markers
+			pos += 2;
+			continue;
+		}
+		if (marker == JPEG_EOI) {
+			return false;
+		}
+
+		const size_t segment = pos + 4;
+		const size_t segmentEnd = pos + 2 + readShort(data + pos + 2);
+		if (segmentEnd > size || segmentEnd < segment) {
+			return false;
+		}
+
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			// SOFn, only SOF0 and SOF1 are sequential huffman
+			if (segmentEnd - segment < 6) {
+				return false;
+			}
+			layout.baseline = marker == 0xC0 || marker == 0xC1;
+			layout.heightOffset = segment + 1;
+			layout.height = readShort(data + segment + 1);
+			layout.width = readShort(data + segment + 3);
+			components = data[segment + 5];
+			if (segmentEnd - segment < 6 + 3 * static_cast<size_t>(components)) {
+				return false;
+			}
+
+			int maxH = 1, maxV = 1;
+			for (int c = 0; c < components; ++c) {
+				const int sampling = data[segment + 6 + c * 3 + 1];
+				maxH = std::max(maxH, sampling >> 4);
+				maxV = std::max(maxV, sampling & 0xF);
+			}
+			// single component scans are not interleaved and their MCU is one block
+			layout.mcuWidth = components == 1 ? 8 : maxH * 8;
+			layout.mcuHeight = components == 1 ? 8 : maxV * 8;
+		} else if (marker == 0xDD) {
+			// DRI
+			if (segmentEnd - segment < 2) {
+				return false;
+			}
+			layout.restartInterval = readShort(data + segment);
+		} else if (marker == 0xDA) {
+			// SOS, find restart markers and end of the entropy coded data
+			if (layout.width <= 0 || layout.height <= 0) {
+				return false;
+			}
+			const int scanComponents = data[segment];
+			layout.scanOffset = segmentEnd;
+
+			size_t scan = segmentEnd;
+			while (scan + 1 < size) {
+				if (data[scan] != 0xFF) {
+					++scan;
+					continue;
+				}
+				const int next = data[scan + 1];
+				if (next == 0x00 || next == 0xFF) {
+					// stuffed byte or fill
+					++scan;
+				} else if (next >= JPEG_RST0 && next <= JPEG_RST0 + 7) {
+					layout.restarts.push_back(scan);
+					scan += 2;
+				} else {
+					layout.scanEnd = scan;
+					break;
+				}
+			}
+			if (!layout.scanEnd) {
+				return false;
+			}
+
+			layout.singleScan = scanComponents == components && data[layout.scanEnd + 1] == JPEG_EOI;
+			return true;
+		}
+
+		pos = segmentEnd;
+	}
+
+	return false;
+}
+
+bool VRayForBlender::decodeJpeg(const unsigned char *data, size_t size, const JpegLayout &layout, float *dest, ThreadManager::Ptr threadManager) {
+	int unitRows = 0;
+	const int unitIntervals = layout.intervalsPerStrip(unitRows);
+	const int units = unitRows ? (layout.mcuRows() + unitRows - 1) / unitRows : 0;
+	// few strips per worker so faster workers can pick up the remaining ones
+	const int workers = threadManager ? threadManager->workerCount() : 0;
+	const int strips = workers > 1 && layout.isSplittable() ? std::min(units, workers * 2) : 0;
+
+	if (strips < 2) {
+		return decodeRows(data, size, layout.width, 0, layout.height, dest);
+	}
+
+	const int intervals = static_cast<int>(layout.restarts.size()) + 1;
+	const int unitsPerStrip = (units + strips - 1) / strips;
+	const int unitHeight = unitRows * layout.mcuHeight;
+	// Vertically subsampled chroma is upsampled using the neighbour rows, decode one extra unit on each side
+	// of the strip, so rows at the edges are the same as when decoding the whole image
+	const int overlap = layout.mcuHeight > 8 ? 1 : 0;
+	std::atomic<bool> failed(false);
+
+	TaskGroup group(threadManager);
+	for (int firstUnit = 0; firstUnit < units; firstUnit += unitsPerStrip) {
+		const int lastUnit = std::min(units, firstUnit + unitsPerStrip);
+		group.run([&, firstUnit, lastUnit](int, const volatile bool &stop) {
+			if (stop || failed) {
+				return;
+			}
+			const int decodeFirst = std::max(0, firstUnit - overlap);
+			const int decodeLast = std::min(units, lastUnit + overlap);
+			const int decodeY = decodeFirst * unitHeight;
+			const int decodeHeight = std::min(layout.height, decodeLast * unitHeight) - decodeY;
+
+			const int y = firstUnit * unitHeight;
+			const int height = std::min(layout.height, lastUnit * unitHeight) - y;
+
+			std::vector<unsigned char> strip;
+			buildStrip(data, layout, decodeFirst * unitIntervals, std::min(intervals, decodeLast * unitIntervals), decodeHeight, strip);
+			if (!decodeRows(strip.data(), strip.size(), layout.width, y - decodeY, height, dest + static_cast<size_t>(y) * layout.width * 4)) {
+				failed = true;
+			}
+		});
+	}
+	group.wait();
+
+	return !failed && !threadManager->isStopped();
+}
+
+float * VRayForBlender::jpegToPixelData(unsigned char * data, int size, int &channels) {
+	JpegLayout layout;
+	if (!parseJpegLayout(data, size, layout)) {
+		PRINT_WARN("Invalid jpeg data!");
+		return nullptr;
+	}
+
+	float * imageData = new float[static_cast<size_t>(layout.width) * layout.height * 4];
+	if (!decodeJpeg(data, size, layout, imageData, nullptr)) {
+		delete[] imageData;
+		return nullptr;
+	}
+
+	channels = 4;
+	return imageData;
+}
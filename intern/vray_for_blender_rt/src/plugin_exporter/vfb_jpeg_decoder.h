@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_JPEG_DECODER_H
+#define VRAY_FOR_BLENDER_JPEG_DECODER_H
+
+#include "vfb_thread_manager.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace VRayForBlender {
+
+/// Layout of a JPEG stream, enough to split the decoding in horizontal strips at the restart markers
+struct JpegLayout {
+	JpegLayout()
+		: width(0)
+		, height(0)
+		, mcuWidth(8)
+		, mcuHeight(8)
+		, restartInterval(0)
+		, baseline(false)
+		, singleScan(false)
+		, heightOffset(0)
+		, scanOffset(0)
+		, scanEnd(0) {}
+
+	int    width;           ///< image width in pixels
+	int    height;          ///< image height in pixels
+	int    mcuWidth;        ///< pixels covered by one MCU horizontally
+	int    mcuHeight;       ///< pixels covered by one MCU vertically
+	int    restartInterval; ///< MCUs between restart markers, 0 if there are none
+	bool   baseline;        ///< sequential huffman coded image
+	bool   singleScan;      ///< all components are in one scan followed by EOI
+	size_t heightOffset;    ///< offset of the image height in the SOF segment
+	size_t scanOffset;      ///< offset of the entropy coded data of the first scan
+	size_t scanEnd;         ///< offset of the marker ending the first scan
+	std::vector<size_t> restarts; ///< offset of each restart marker in the scan
+
+	int mcusPerRow() const { return (width + mcuWidth - 1) / mcuWidth; }
+	int mcuRows() const { return (height + mcuHeight - 1) / mcuHeight; }
+
+	/// Number of restart intervals making up @rows MCU rows, 0 if the intervals do not end on MCU row boundaries
+	/// @rows - receives the MCU rows covered
+	int intervalsPerStrip(int &rows) const;
+
+	/// Check if the image can be decoded in independent strips
+	bool isSplittable() const;
+};
+
+/// Parse the markers of @data up to the end of the first scan
+/// @return false if @data is not a valid JPEG stream
+bool parseJpegLayout(const unsigned char *data, size_t size, JpegLayout &layout);
+
+/// Decode @data into @dest as RGBA float, with alpha 1.0
+/// @dest must have layout.width * layout.height * 4 floats
+/// If the image has restart markers on MCU row boundaries, strips are decoded in parallel on @threadManager
+/// otherwise or if @threadManager is null the image is decoded on the calling thread
+/// @return false if decoding failed, @dest could be partially written
+bool decodeJpeg(const unsigned char *data, size_t size, const JpegLayout &layout, float *dest, ThreadManager::Ptr threadManager);
+
+/// Decode JPEG to newly allocated RGBA float image, @channels receives 4, nullptr on failure
+float * jpegToPixelData(unsigned char * data, int size, int &channels);
+
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_JPEG_DECODER_H
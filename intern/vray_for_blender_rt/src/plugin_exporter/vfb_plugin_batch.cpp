@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_plugin_batch.h"
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+
+PluginBatch::PluginBatch()
+    : m_collapsed(0)
+{}
+
+
+void PluginBatch::create(const std::string &plugin, const std::string &pluginID)
+{
+	if (!m_created.insert(plugin).second) {
+		++m_collapsed;
+		return;
+	}
+	m_ops.push_back({OpType::Create, plugin, pluginID, AttrValue(), false});
+}
+
+
+void PluginBatch::set(const std::string &plugin, const std::string &property, const AttrValue &value)
+{
+	PropertyIndex &properties = m_setIndex[plugin];
+	auto iter = properties.find(property);
+	if (iter != properties.end()) {
+		// only the last value is sent, at the place of the last one, since it can reference plugins created meanwhile
+		Op &op = m_ops[iter->second];
+		op.dropped = true;
+		op.value = AttrValue();
+		++m_collapsed;
+		iter->second = m_ops.size();
+	} else {
+		properties[property] = m_ops.size();
+	}
+
+	m_ops.push_back({OpType::Set, plugin, property, value, false});
+}
+
+
+void PluginBatch::remove(const std::string &plugin)
+{
+	auto iter = m_setIndex.find(plugin);
+	if (iter != m_setIndex.end()) {
+		for (const auto &property : iter->second) {
+			Op &op = m_ops[property.second];
+			op.dropped = true;
+			op.value = AttrValue();
+			++m_collapsed;
+		}
+		m_setIndex.erase(iter);
+	}
+	m_created.erase(plugin);
+
+	m_ops.push_back({OpType::Remove, plugin, std::string(), AttrValue(), false});
+}
+
+
+void PluginBatch::replace(const std::string &oldPlugin, const std::string &newPlugin)
+{
+	m_ops.push_back({OpType::Replace, oldPlugin, newPlugin, AttrValue(), false});
+}
+
+
+void PluginBatch::take(std::vector<Op> &ops)
+{
+	ops.clear();
+	ops.reserve(m_ops.size());
+	for (Op &op : m_ops) {
+		if (!op.dropped) {
+			ops.push_back(std::move(op));
+		}
+	}
+
+	m_ops.clear();
+	m_setIndex.clear();
+	m_created.clear();
+}
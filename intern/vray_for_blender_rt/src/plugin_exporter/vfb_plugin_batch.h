@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_PLUGIN_BATCH_H
+#define VRAY_FOR_BLENDER_PLUGIN_BATCH_H
+
+#include "base_types.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace VRayForBlender {
+
+/// Plugin changes queued between two commits, to be sent together instead of one by one while exporting
+/// A property set again before the batch is taken drops the queued value and is queued at the end, creating
+/// a plugin again is ignored, and removing a plugin drops the queued property values for it; the order of all
+/// the other changes is kept.
+/// Not thread safe, the owner must lock it.
+class PluginBatch {
+public:
+	enum class OpType {
+		Create,
+		Set,
+		Remove,
+		Replace,
+	};
+
+	struct Op {
+		OpType                    type;
+		std::string               plugin;
+		std::string               name;  ///< Plugin ID for Create, property for Set, new plugin for Replace
+		VRayBaseTypes::AttrValue  value; ///< Only for Set
+		bool                      dropped;
+	};
+
+	PluginBatch();
+
+	void create(const std::string &plugin, const std::string &pluginID);
+	void set(const std::string &plugin, const std::string &property, const VRayBaseTypes::AttrValue &value);
+	void remove(const std::string &plugin);
+	void replace(const std::string &oldPlugin, const std::string &newPlugin);
+
+	/// Number of queued changes, including the dropped ones
+	size_t size() const { return m_ops.size(); }
+	bool   empty() const { return m_ops.empty(); }
+
+	/// Number of changes that were collapsed or dropped since the batch was created
+	uint64_t getCollapsedCount() const { return m_collapsed; }
+
+	/// Move the queued changes, without the dropped ones, in @ops in the order they were made and clear the batch
+	void take(std::vector<Op> &ops);
+
+private:
+	typedef std::unordered_map<std::string, size_t> PropertyIndex;
+
+	std::vector<Op>                                m_ops;
+	std::unordered_map<std::string, PropertyIndex> m_setIndex; ///< plugin -> property -> index of the queued Set in @m_ops
+	std::unordered_set<std::string>                m_created;  ///< plugins with a queued Create
+	uint64_t                                       m_collapsed;
+};
+
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_PLUGIN_BATCH_H
@@ -43,12 +43,22 @@ public:
 PluginExporter::~PluginExporter() {}
 
 
+namespace {
+/// Plugins holding big arrays which are worth to be looked up by their content
+bool isContentAddressed(const PluginDesc &pluginDesc)
+{
+	return pluginDesc.pluginID == "GeomStaticMesh" || pluginDesc.pluginID == "GeomMayaHair";
+}
+}
+
+
 int PluginExporter::remove_plugin(const std::string &name) {
 	std::lock_guard<std::recursive_mutex> lock(m_exportMtx);
 	int result = 1;
 	if (m_pluginManager.inCache(name)) {
 		PRINT_INFO_EX("Removing plugin: [%s]", name.c_str());
 		m_pluginManager.remove(name);
+		m_animationKeys.erase(name);
 		result = this->remove_plugin_impl(name);
 	}
 	return result;
@@ -60,21 +70,53 @@ AttrPlugin PluginExporter::export_plugin(const PluginDesc &pluginDesc, bool repl
 		return AttrPlugin(pluginDesc.pluginName);
 	}
 
-	std::lock_guard<std::recursive_mutex> lock(m_exportMtx);
+	ExportProfiler::Scope profile(m_profiler, "plugin", pluginDesc.pluginID.c_str());
+
 	const bool hasFrames = exporter_settings.settings_animation.use || exporter_settings.use_motion_blur;
 
+	// hashing the values is most of the time spent here, the plugin manager is thread safe so it's done
+	// before taking the lock, and only once for all the checks and the update of the cache
+
+	// geometry identical to one already exported in this frame is referenced instead of written again
+	// not used for viewport, since the referenced plugin could change without the referencing one being synced
+	const bool useContentKey = !is_viewport && isContentAddressed(pluginDesc);
+
+	PluginManager::DescHash descHash;
+	{
+		ExportProfiler::Scope profileDiff(m_profiler, "diff", pluginDesc.pluginID.c_str());
+		descHash = m_pluginManager.hashDesc(pluginDesc, useContentKey);
+	}
+
+	if (useContentKey) {
+		std::string owner;
+		if (m_pluginManager.findContentOwner(descHash.getContentKey(), pluginDesc.pluginName, current_scene_frame, owner)) {
+			return AttrPlugin(owner);
+		}
+	}
+
+	// the cache must match what was sent to the exporter, and exporters are not thread safe
+	std::lock_guard<std::recursive_mutex> lock(m_exportMtx);
+
 	// force replace off for animation, because repalce will wipe all animation data up until current frame
 	replace = hasFrames ? false : replace;
 
 	bool inCache = m_pluginManager.inCache(pluginDesc);
-	bool isDifferent = inCache ? m_pluginManager.differs(pluginDesc) : true;
-	bool isDifferentId = inCache ? m_pluginManager.differsId(pluginDesc) : false;
+	bool isDifferent = true;
+	bool isDifferentId = false;
+	if (inCache) {
+		isDifferent = m_pluginManager.differs(pluginDesc, descHash);
+		isDifferentId = m_pluginManager.differsId(pluginDesc);
+	}
 	AttrPlugin plg(pluginDesc.pluginName);
+	const bool keepKeys = keep_plugin_cache && !is_viewport && hasFrames;
 
 	if (is_viewport || hasFrames) {
 		if (!inCache) {
 			plg = this->export_plugin_impl(pluginDesc);
-			m_pluginManager.updateCache(pluginDesc);
+			m_pluginManager.updateCache(pluginDesc, descHash);
+			if (keepKeys) {
+				update_animation_keys(pluginDesc.pluginName, &pluginDesc);
+			}
 		} else if (replace || (inCache && isDifferent)) {
 
 			if (isDifferentId) {
@@ -82,9 +124,19 @@ AttrPlugin PluginExporter::export_plugin(const PluginDesc &pluginDesc, bool repl
 				// and when we remove it, it will reference invalid memory!
 				this->remove_plugin(pluginDesc.pluginName);
 				plg = this->export_plugin_impl(pluginDesc);
+				if (keepKeys) {
+					update_animation_keys(pluginDesc.pluginName, &pluginDesc);
+				}
 			} else {
 				if (!replace) {
-					plg = this->export_plugin_impl(m_pluginManager.differences(pluginDesc));
+					const PluginDesc changes = m_pluginManager.differences(pluginDesc, descHash);
+					if (keepKeys) {
+						export_hold_keys(changes);
+					}
+					plg = this->export_plugin_impl(changes);
+					if (keepKeys) {
+						update_animation_keys(pluginDesc.pluginName, &changes);
+					}
 				} else {
 					auto state = this->get_commit_state();
 					if (state != CommitState::CommitAutoOff) {
@@ -108,23 +160,107 @@ AttrPlugin PluginExporter::export_plugin(const PluginDesc &pluginDesc, bool repl
 				}
 			}
 
-			m_pluginManager.updateCache(pluginDesc);
+			m_pluginManager.updateCache(pluginDesc, descHash);
+		} else if (keepKeys) {
+			update_animation_keys(pluginDesc.pluginName, nullptr);
 		}
 	} else {
 		if (inCache && isDifferent) {
 			// TODO: do we really need to export previous state first?
 			// this->export_plugin_impl(m_pluginManager.fromCache(pluginDesc));
-			plg = this->export_plugin_impl(m_pluginManager.differences(pluginDesc));
-			m_pluginManager.updateCache(pluginDesc);
+			plg = this->export_plugin_impl(m_pluginManager.differences(pluginDesc, descHash));
+			m_pluginManager.updateCache(pluginDesc, descHash);
 		} else if (!inCache) {
 			plg = this->export_plugin_impl(pluginDesc);
-			m_pluginManager.updateCache(pluginDesc);
+			m_pluginManager.updateCache(pluginDesc, descHash);
 		}
 	}
 
+	if (useContentKey) {
+		m_pluginManager.updateContentOwner(descHash.getContentKey(), pluginDesc.pluginName, current_scene_frame);
+	}
+
 	return plg;
 }
 
+void PluginExporter::export_plugin_unchanged(const std::string &pluginName)
+{
+	const bool hasFrames = exporter_settings.settings_animation.use || exporter_settings.use_motion_blur;
+	if (keep_plugin_cache && !is_viewport && hasFrames) {
+		std::lock_guard<std::recursive_mutex> lock(m_exportMtx);
+		update_animation_keys(pluginName, nullptr);
+	}
+}
+
+void PluginExporter::export_hold_keys(const PluginDesc &changes)
+{
+	const auto keysIt = m_animationKeys.find(changes.pluginName);
+	if (keysIt == m_animationKeys.end() || keysIt->second.frame >= current_scene_frame) {
+		return;
+	}
+	const AnimationKeys &keys = keysIt->second;
+
+	PluginDesc hold(changes.pluginName, changes.pluginID);
+	std::vector<std::string> listHold;
+	for (const auto &attrPair : changes.pluginAttrs) {
+		const auto keyIt = keys.attrs.find(attrPair.first);
+		if (keyIt != keys.attrs.end() && keyIt->second.frame < keys.frame) {
+			if (is_list_value(attrPair.second.attrValue)) {
+				listHold.push_back(attrPair.first);
+			} else {
+				hold.add(keyIt->second.attr);
+			}
+		}
+	}
+
+	if (!hold.pluginAttrs.empty() || !listHold.empty()) {
+		const float frame = current_scene_frame;
+		current_scene_frame = keys.frame;
+		if (!hold.pluginAttrs.empty()) {
+			this->export_plugin_impl(hold);
+		}
+		if (!listHold.empty()) {
+			this->export_list_hold_keys(changes.pluginName, changes.pluginID, listHold);
+		}
+		current_scene_frame = frame;
+	}
+}
+
+void PluginExporter::update_animation_keys(const std::string &pluginName, const PluginDesc *written)
+{
+	AnimationKeys &keys = m_animationKeys[pluginName];
+	keys.frame = current_scene_frame;
+	if (written) {
+		for (const auto &attrPair : written->pluginAttrs) {
+			AnimationKey &key = keys.attrs[attrPair.first];
+			if (is_list_value(attrPair.second.attrValue)) {
+				key.attr = PluginAttr();
+			} else {
+				key.attr = attrPair.second;
+			}
+			key.frame = current_scene_frame;
+		}
+	}
+}
+
+bool PluginExporter::is_list_value(const AttrValue &value)
+{
+	switch (value.type) {
+		case ValueTypeListInt:
+		case ValueTypeListFloat:
+		case ValueTypeListVector:
+		case ValueTypeListColor:
+		case ValueTypeListPlugin:
+		case ValueTypeListString:
+		case ValueTypeMapChannels:
+		case ValueTypeInstancer:
+		case ValueTypeListValue:
+			return true;
+		default:
+			return false;
+	}
+}
+
 void PluginExporter::set_commit_state(VRayBaseTypes::CommitAction ca)
 {
 	if (ca == VRayBaseTypes::CommitAutoOff || ca == VRayBaseTypes::CommitAutoOn) {
@@ -145,6 +281,27 @@ RenderImage PluginExporter::get_pass(const std::string & name)
 	return image;
 }
 
+bool PluginExporter::update_image(RenderImage &image, std::vector<ImageRegion> &dirty, ImageRegion::Options options)
+{
+	dirty.clear();
+
+	RenderImage newImage = get_image();
+	if (!newImage) {
+		return false;
+	}
+
+	image = std::move(newImage);
+	if (options & ImageRegion::Options::RESET_ALPHA) {
+		image.resetAlpha();
+	}
+	if (options & ImageRegion::Options::CLAMP) {
+		image.clamp();
+	}
+	dirty.push_back(ImageRegion(0, 0, image.w, image.h));
+
+	return true;
+}
+
 
 VRayForBlender::PluginExporter::Ptr VRayForBlender::ExporterCreate(VRayForBlender::ExporterType type, const ExporterSettings & settings)
 {
@@ -29,6 +29,8 @@
 #include "vfb_plugin_exporter_types.h"
 #include "vfb_plugin_manager.h"
 #include "vfb_render_image.h"
+#include "vfb_thread_manager.h"
+#include "vfb_export_profiler.h"
 
 #include "RNA_blender_cpp.h"
 
@@ -72,6 +74,7 @@ public:
 	    , render_progress(0.f)
 	    , is_viewport(false)
 	    , is_prepass(false)
+	    , keep_plugin_cache(false)
 	    , commit_state(CommitState::CommitNone)
 	{}
 
@@ -90,7 +93,14 @@ public:
 	virtual void         export_vrscene(const std::string&) {}
 
 	virtual AttrPlugin   export_plugin_impl(const PluginDesc &pluginDesc)=0;
+	/// Write a hold key at the current frame for the list attributes @attrNames of the plugin, with the value last written
+	/// PluginExporter does not keep list values alive, so only exporters that can reference the written data can do this
+	/// The default does nothing and V-Ray interpolates the lists across the frames they were constant
+	virtual void         export_list_hold_keys(const std::string &, const std::string &, const std::vector<std::string> &) {}
 	AttrPlugin           export_plugin(const PluginDesc &pluginDesc, bool replace = false, bool dontExport = false);
+	/// Record that @pluginName was exported unchanged at the current frame, for callers which detect that themselves
+	/// and skip export_plugin, so the hold keys of the plugin are still written when it changes later
+	void                 export_plugin_unchanged(const std::string &pluginName);
 	virtual void         replace_plugin(const std::string &, const std::string &) {};
 
 	virtual int          remove_plugin_impl(const std::string&) { return 0; }
@@ -106,6 +116,12 @@ public:
 
 	RenderImage          get_pass(const std::string & name);
 
+	/// Copy the regions of the image changed since the previous call in @image, kept by the caller between calls
+	/// @dirty receives the changed regions, @options is applied only to them
+	/// Default implementation replaces the whole image with get_image()
+	/// @return true if @image changed
+	virtual bool         update_image(RenderImage &image, std::vector<ImageRegion> &dirty, ImageRegion::Options options);
+
 	virtual void         show_frame_buffer() {}
 	virtual void         hide_frame_buffer() {}
 	virtual void         set_render_mode(RenderMode) {}
@@ -125,6 +141,7 @@ public:
 	CommitState          get_commit_state() const { return commit_state; }
 
 	virtual void         set_export_file(VRayForBlender::ParamDesc::PluginType, PyObject *) {}
+	virtual ThreadManager::Ptr get_thread_manager() { return nullptr; }
 
 	void                 set_is_viewport(bool flag)  { is_viewport = flag; }
 	bool                 get_is_viewport() const { return is_viewport; }
@@ -136,9 +153,18 @@ public:
 	void                 set_prepass(bool flag) { is_prepass = flag; }
 	bool                 get_is_prepass() const { return is_prepass; }
 
+	// if true the plugin cache is kept between animation frames, so only the changed attributes
+	// are exported and a hold key is written for values which were constant for several frames
+	void                 set_keep_plugin_cache(bool flag) { keep_plugin_cache = flag; m_animationKeys.clear(); }
+	bool                 get_keep_plugin_cache() const { return keep_plugin_cache; }
+
 	PluginManager       &getPluginManager() { return m_pluginManager; }
+	ExportProfiler      &getProfiler() { return m_profiler; }
 
 protected:
+	/// Check if @value is a list type, the data of which is shared by all copies of the value
+	static bool          is_list_value(const AttrValue &value);
+
 	const ExporterSettings &exporter_settings;
 
 	ExpoterCallback      callback_on_image_ready;
@@ -151,11 +177,36 @@ protected:
 	std::string          progress_message;
 	bool                 is_viewport;
 	bool                 is_prepass;
+	bool                 keep_plugin_cache;
 	CommitState          commit_state;
 
 	PluginManager        m_pluginManager;
+	ExportProfiler       m_profiler;
 	std::recursive_mutex m_exportMtx;
 
+private:
+	/// Last value written for an attribute
+	struct AnimationKey {
+		PluginAttr  attr; ///< the written value, only for non list attributes so the cache doesn't keep lists alive
+		float       frame; ///< frame at which @attr was written
+	};
+
+	/// Keys written for a plugin while the plugin cache is kept between frames
+	struct AnimationKeys {
+		HashMap<std::string, AnimationKey> attrs; ///< last key of each attribute
+		float                              frame; ///< last frame the plugin was exported at, even if unchanged
+	};
+
+	/// Write the previous value of the attributes in @changes that were not keyed since before the last
+	/// frame @changes.pluginName was exported at, so V-Ray doesn't interpolate across the frames they were constant
+	/// List attributes are left to export_list_hold_keys
+	void                 export_hold_keys(const PluginDesc &changes);
+
+	/// Remember @written as keyed at the current frame, nullptr if the plugin was exported unchanged
+	void                 update_animation_keys(const std::string &pluginName, const PluginDesc *written);
+
+	HashMap<std::string, AnimationKeys> m_animationKeys; ///< written keys, used only with @keep_plugin_cache
+
 };
 
 PluginExporter::Ptr ExporterCreate(ExporterType type, const ExporterSettings & settings);
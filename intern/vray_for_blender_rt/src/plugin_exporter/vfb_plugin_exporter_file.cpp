@@ -25,6 +25,9 @@
 #include "BLI_path_util.h"
 #include "BLI_utildefines.h"
 
+#include <thread>
+#include <algorithm>
+
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 
@@ -34,6 +37,7 @@ using namespace VRayForBlender;
 VrsceneExporter::VrsceneExporter(const ExporterSettings & settings)
 	: PluginExporter(settings)
     , m_Synced(false)
+    , m_stopSerialize(false)
 {
 
 }
@@ -63,6 +67,7 @@ void VrsceneExporter::set_export_file(VRayForBlender::ParamDesc::PluginType type
 				BLI_assert("Failed to create PluginWriter for python file!");
 				return;
 			}
+			writer->setProfiler(&m_profiler);
 			m_fileWritersMap[fileName] = writer;
 		} else {
 			writer = iter->second;
@@ -96,13 +101,15 @@ void VrsceneExporter::set_export_file(VRayForBlender::ParamDesc::PluginType type
 
 VrsceneExporter::~VrsceneExporter()
 {
+	stopSerialization();
 }
 
 
 void VrsceneExporter::init()
 {
 	PRINT_INFO_EX("Initting VrsceneExporter");
-	m_threadManager = ThreadManager::make(2);
+	// compression of big arrays is split in chunks so it can use all cores
+	m_threadManager = ThreadManager::make(std::max(2u, std::thread::hardware_concurrency()));
 	for (auto & w : m_fileWritersMap) {
 		w.second->setFormat(exporter_settings.export_file_format);
 	}
@@ -111,7 +118,9 @@ void VrsceneExporter::init()
 
 void VrsceneExporter::free()
 {
+	stopSerialization();
 	m_Writers.clear();
+	m_listValues.clear();
 }
 
 
@@ -119,6 +128,7 @@ void VrsceneExporter::sync()
 {
 	PRINT_INFO_EX("Flushing all data to files");
 	m_Synced = true;
+	stopSerialization();
 	for (auto & writer : m_fileWritersMap) {
 		writer.second->blockFlushAll();
 	}
@@ -139,14 +149,8 @@ void VrsceneExporter::stop()
 }
 
 
-AttrPlugin VrsceneExporter::export_plugin_impl(const PluginDesc &pluginDesc)
+std::shared_ptr<PluginWriter> VrsceneExporter::getWriter(const PluginDesc &pluginDesc)
 {
-	const std::string & name = pluginDesc.pluginName;
-
-	AttrPlugin plugin;
-	plugin.plugin = name;
-	m_Synced = false;
-
 	const ParamDesc::PluginDesc & pluginParamDesc = GetPluginDescription(pluginDesc.pluginID);
 
 	auto writerType = pluginParamDesc.pluginType;
@@ -173,38 +177,189 @@ AttrPlugin VrsceneExporter::export_plugin_impl(const PluginDesc &pluginDesc)
 			writerPtr = m_Writers[ParamDesc::PluginSettings];
 			if (!writerPtr) {
 				PRINT_ERROR("Failed to get plugin writer for type %d exporting %s with id [%s]",
-					writerType, name.c_str(), pluginDesc.pluginID.c_str());
-				return plugin;
+					writerType, pluginDesc.pluginName.c_str(), pluginDesc.pluginID.c_str());
 			}
 		}
 	}
 
-	PluginWriter & writer = *writerPtr;
-	// dont set frame for settings file when DR is off and seperate files is on and current file is Settings
-	bool setFrame = !(
-	    !exporter_settings.settings_dr.use              &&
-	    exporter_settings.settings_files.use_separate   &&
-	    writer == *m_Writers[ParamDesc::PluginSettings]
-	);
+	return writerPtr;
+}
+
+
+void VrsceneExporter::writePlugin(PluginWriter &writer, const PluginDesc &pluginDesc)
+{
+	const bool keepLists = keep_plugin_cache && writer.format() == ExporterSettings::ExportFormatBIN;
 
 	writer << pluginDesc.pluginID << " " << StripString(pluginDesc.pluginName) << " {\n";
-	if (exporter_settings.settings_animation.use || exporter_settings.use_motion_blur) {
-		if (setFrame) {
-			writer.setAnimationFrame(this->current_scene_frame);
-		} else {
-			writer.setAnimationFrame(-1);
-		}
-	}
 
 	for (auto & attributePairs : pluginDesc.pluginAttrs) {
 		const PluginAttr & attr = attributePairs.second;
 
-		if (attr.attrValue.type != ValueTypeUnknown) {
+		if (attr.attrValue.type == ValueTypeUnknown) {
+			continue;
+		}
+
+		if (keepLists && is_list_value(attr.attrValue)) {
+			// the lists go to the sidecar, so their text is short and can be written again as a hold key
+			RawValue value;
+			writer.setCapture(&value.text);
+			writer << attr.attrValue;
+			writer.setCapture(nullptr);
+
+			if (value.text.size() <= MaxListValueText) {
+				m_listValues[pluginDesc.pluginName][attr.attrName] = value.text;
+			} else {
+				m_listValues[pluginDesc.pluginName].erase(attr.attrName);
+			}
+			writer << KVPair<RawValue>(attr.attrName, value);
+		} else {
 			writer << KVPair<AttrValue>(attr.attrName, attr.attrValue);
 		}
 	}
 
 	writer << "}\n\n";
+}
+
+
+void VrsceneExporter::writeListHold(PluginWriter &writer, const PluginDesc &pluginDesc)
+{
+	const auto plugin = m_listValues.find(pluginDesc.pluginName);
+	if (plugin == m_listValues.end()) {
+		return;
+	}
+
+	bool written = false;
+	for (auto & attributePairs : pluginDesc.pluginAttrs) {
+		const auto value = plugin->second.find(attributePairs.first);
+		if (value == plugin->second.end()) {
+			continue;
+		}
+		if (!written) {
+			writer << pluginDesc.pluginID << " " << StripString(pluginDesc.pluginName) << " {\n";
+			written = true;
+		}
+		writer << KVPair<RawValue>(attributePairs.first, RawValue{value->second});
+	}
+
+	if (written) {
+		writer << "}\n\n";
+	}
+}
+
+
+void VrsceneExporter::serializeLoop()
+{
+	std::unique_lock<std::mutex> lock(m_pendingMtx);
+	while (true) {
+		m_pendingCondVar.wait(lock, [this]() {
+			return !m_pending.empty() || m_stopSerialize;
+		});
+		if (m_pending.empty()) {
+			break;
+		}
+
+		PendingPlugin item = std::move(m_pending.front());
+		m_pending.pop_front();
+		lock.unlock();
+		m_pendingCondVar.notify_all();
+
+		if (item.hasFrames) {
+			item.writer->setAnimationFrame(item.frame);
+		}
+		{
+			ExportProfiler::Scope profile(m_profiler, "write", item.desc.pluginID.c_str());
+			if (item.listHold) {
+				writeListHold(*item.writer, item.desc);
+			} else {
+				writePlugin(*item.writer, item.desc);
+			}
+		}
+
+		lock.lock();
+	}
+}
+
+
+void VrsceneExporter::stopSerialization()
+{
+	if (!m_serializeThread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_pendingMtx);
+		m_stopSerialize = true;
+	}
+	m_pendingCondVar.notify_all();
+	m_serializeThread.join();
+	m_stopSerialize = false;
+}
+
+
+AttrPlugin VrsceneExporter::export_plugin_impl(const PluginDesc &pluginDesc)
+{
+	AttrPlugin plugin;
+	plugin.plugin = pluginDesc.pluginName;
+	m_Synced = false;
+
+	writeOrQueue(pluginDesc, false);
 
 	return plugin;
 }
+
+
+void VrsceneExporter::export_list_hold_keys(const std::string &pluginName, const std::string &pluginID, const std::vector<std::string> &attrNames)
+{
+	if (exporter_settings.export_file_format != ExporterSettings::ExportFormatBIN) {
+		return;
+	}
+
+	// only the names are needed, the values are the ones writePlugin kept in m_listValues
+	PluginDesc hold(pluginName, pluginID);
+	for (const auto & name : attrNames) {
+		hold.add(name, AttrValue());
+	}
+	writeOrQueue(hold, true);
+}
+
+
+void VrsceneExporter::writeOrQueue(const PluginDesc &pluginDesc, bool listHold)
+{
+	auto writerPtr = getWriter(pluginDesc);
+	if (!writerPtr) {
+		return;
+	}
+
+	// dont set frame for settings file when DR is off and seperate files is on and current file is Settings
+	bool setFrame = !(
+	    !exporter_settings.settings_dr.use              &&
+	    exporter_settings.settings_files.use_separate   &&
+	    *writerPtr == *m_Writers[ParamDesc::PluginSettings]
+	);
+
+	const bool hasFrames = exporter_settings.settings_animation.use || exporter_settings.use_motion_blur;
+	const float frame = setFrame ? this->current_scene_frame : -1;
+
+	if (exporter_settings.settings_animation.use) {
+		std::unique_lock<std::mutex> lock(m_pendingMtx);
+		if (!m_serializeThread.joinable()) {
+			m_serializeThread = std::thread(&VrsceneExporter::serializeLoop, this);
+		}
+		m_pendingCondVar.wait(lock, [this]() {
+			return m_pending.size() < MaxPendingPlugins;
+		});
+		m_pending.push_back(PendingPlugin{pluginDesc, writerPtr, frame, hasFrames, listHold});
+		lock.unlock();
+		m_pendingCondVar.notify_all();
+		return;
+	}
+
+	if (hasFrames) {
+		writerPtr->setAnimationFrame(frame);
+	}
+	ExportProfiler::Scope profile(m_profiler, "write", pluginDesc.pluginID.c_str());
+	if (listHold) {
+		writeListHold(*writerPtr, pluginDesc);
+	} else {
+		writePlugin(*writerPtr, pluginDesc);
+	}
+}
@@ -25,6 +25,11 @@
 #include "vfb_export_settings.h"
 #include "vfb_thread_manager.h"
 
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 
 namespace VRayForBlender {
 
@@ -44,8 +49,43 @@ public:
 	virtual void        stop();
 
 	virtual AttrPlugin  export_plugin_impl(const PluginDesc &pluginDesc);
+	/// Hold keys reference the lists written to the binary sidecar, so they are written only for the BIN format
+	virtual void        export_list_hold_keys(const std::string &pluginName, const std::string &pluginID, const std::vector<std::string> &attrNames);
 	virtual void        set_export_file(VRayForBlender::ParamDesc::PluginType type, PyObject *file);
+	virtual ThreadManager::Ptr get_thread_manager() { return m_threadManager; }
+
+	/// Max number of plugins waiting for the serialization thread before export_plugin_impl blocks
+	static const int MaxPendingPlugins = 1 << 14;
+
+	/// Max length of the text of a list value kept for hold keys, bigger values are written inline and not kept
+	static const size_t MaxListValueText = 4096;
 private:
+	/// Plugin waiting to be written by the serialization thread
+	struct PendingPlugin {
+		PluginDesc                     desc;
+		std::shared_ptr<PluginWriter>  writer;
+		float                          frame; ///< Animation frame for the writer, -1 to write without frame
+		bool                           hasFrames; ///< False if the writer's frame should be left unchanged
+		bool                           listHold; ///< Write hold keys for the list attributes named in @desc
+	};
+
+	/// Write @pluginDesc now, or queue it for the serialization thread for animations
+	void writeOrQueue(const PluginDesc &pluginDesc, bool listHold);
+
+	/// Find the writer for @pluginDesc, nullptr if there is none
+	std::shared_ptr<PluginWriter> getWriter(const PluginDesc &pluginDesc);
+
+	/// Write @pluginDesc to @writer, called from the serialization thread for animations
+	void writePlugin(PluginWriter &writer, const PluginDesc &pluginDesc);
+
+	/// Write hold keys for the list attributes named in @pluginDesc with their last written text
+	void writeListHold(PluginWriter &writer, const PluginDesc &pluginDesc);
+
+	/// Serialization thread's loop, writes plugins in the order they were exported
+	void serializeLoop();
+
+	/// Stop the serialization thread after all pending plugins are written
+	void stopSerialization();
 
 private:
 	typedef HashMap<ParamDesc::PluginType, std::shared_ptr<PluginWriter>, std::hash<int>> TypeToWriterMap;
@@ -57,6 +97,18 @@ private:
 	ThreadManager::Ptr            m_threadManager;
 	bool                          m_Synced;
 	std::string                   m_FileDir;
+
+	/// Text of the last list values written for each plugin and attribute, kept while the plugin cache is kept
+	/// between frames and the lists are written to the binary sidecar, so the text only references the data
+	HashMap<std::string, HashMap<std::string, std::string>> m_listValues;
+
+	// For animation, plugins are written on separate thread, so the scene for next frame
+	// can be evaluated while the current one is serialized and compressed
+	std::thread                   m_serializeThread;
+	std::deque<PendingPlugin>     m_pending; ///< Plugins not yet written, in export order
+	std::mutex                    m_pendingMtx; ///< Protects @m_pending and @m_stopSerialize
+	std::condition_variable       m_pendingCondVar; ///< Signaled when item is added or removed from @m_pending
+	bool                          m_stopSerialize; ///< Signal the thread to exit when @m_pending is empty
 };
 
 } // namespace VRayForBlender
@@ -20,10 +20,13 @@
 #include "vfb_plugin_exporter_zmq.h"
 #include "vfb_export_settings.h"
 #include "vfb_params_json.h"
+#include "vfb_image_kernels.h"
+#include "vfb_jpeg_decoder.h"
 
 #include "BLI_utildefines.h"
 
 #include <limits>
+#include <thread>
 
 using namespace VRayForBlender;
 
@@ -120,46 +123,25 @@ void ZmqExporter::ZmqRenderImage::update(const VRayBaseTypes::AttrImage &img, Zm
 		       img.imageType == VRayBaseTypes::AttrImage::ImageType::BW_REAL) {
 
 		const float * imgData = reinterpret_cast<const float *>(img.data.get());
-		float * myImage = nullptr;
 		int channels = 0;
 
 		switch (img.imageType) {
-		case VRayBaseTypes::AttrImage::ImageType::RGBA_REAL:
-			channels = 4;
-			myImage = new float[img.width * img.height * channels];
-			memcpy(myImage, imgData, img.width * img.height * channels * sizeof(float));
-
-			break;
-		case VRayBaseTypes::AttrImage::ImageType::RGB_REAL:
-			channels = 3;
-			myImage = new float[img.width * img.height * channels];
-
-			for (int c = 0; c < img.width * img.height; ++c) {
-				const float * source = imgData + (c * 4);
-				float * dest = myImage + (c * channels);
-
-				dest[0] = source[0];
-				dest[1] = source[1];
-				dest[2] = source[2];
-			}
-
-			break;
-		case VRayBaseTypes::AttrImage::ImageType::BW_REAL:
-			channels = 1;
-			myImage = new float[img.width * img.height * channels];
-
-			for (int c = 0; c < img.width * img.height; ++c) {
-				const float * source = imgData + (c * 4);
-				float * dest = myImage + (c * channels);
-
-				dest[0] = source[0];
-			}
-
-			break;
+		case VRayBaseTypes::AttrImage::ImageType::RGBA_REAL: channels = 4; break;
+		case VRayBaseTypes::AttrImage::ImageType::RGB_REAL:  channels = 3; break;
+		case VRayBaseTypes::AttrImage::ImageType::BW_REAL:   channels = 1; break;
 		default:
 			PRINT_WARN("MISSING IMAGE FORMAT CONVERTION FOR %d", img.imageType);
 		}
 
+		float * myImage = nullptr;
+		if (channels) {
+			// source is always RGBA, take the needed channels and fix the image in the same pass
+			const int flags = fixImage ? ImageKernels::Flip | ImageKernels::Clamp | ImageKernels::ResetAlpha : ImageKernels::None;
+			myImage = new float[img.width * img.height * channels];
+			ImageKernels::convert(myImage, img.width * channels, channels, imgData, img.width * 4, 4, img.width, img.height, flags);
+			fixImage = false;
+		}
+
 		{
 			std::lock_guard<std::mutex> lock(exp->m_imgMutex);
 			this->channels = channels;
@@ -184,6 +166,9 @@ ZmqExporter::ZmqExporter(const ExporterSettings & settings)
     , m_isDirty(true)
     , m_isAborted(false)
     , m_started(false)
+    , m_hasPendingJpeg(false)
+    , m_isDecodingJpeg(false)
+    , m_stopSharedImages(false)
 {
 	checkZmqClient();
 }
@@ -191,6 +176,7 @@ ZmqExporter::ZmqExporter(const ExporterSettings & settings)
 
 ZmqExporter::~ZmqExporter()
 {
+	stopSharedImages();
 	free();
 
 	{
@@ -199,6 +185,16 @@ ZmqExporter::~ZmqExporter()
 		m_client.reset();
 	}
 
+	if (m_decodeThreadManager) {
+		{
+			// nothing new can be queued, wait for the image being decoded since it writes in m_viewportImage
+			std::unique_lock<std::mutex> lock(m_jpegMutex);
+			m_hasPendingJpeg = false;
+			m_jpegDecoded.wait(lock, [this] { return !m_isDecodingJpeg; });
+		}
+		m_decodeThreadManager->stop();
+	}
+
 	// we could be destroyed while someone is inside get_render_channel and is accessing m_LayerImges
 	// but we can't protect it from inside this class
 }
@@ -225,6 +221,193 @@ RenderImage ZmqExporter::get_image() {
 	return get_render_channel(RenderChannelType::RenderChannelTypeNone);
 }
 
+bool ZmqExporter::update_image(RenderImage &image, std::vector<ImageRegion> &dirty, ImageRegion::Options options) {
+	if (!is_viewport) {
+		return PluginExporter::update_image(image, dirty, options);
+	}
+	return m_viewportImage.consume(image, dirty, options);
+}
+
+bool ZmqExporter::updateViewportImage(const ImageView &img) {
+	if (img.type == ImageType::RGBA_REAL && img.isBucket) {
+		ImageSize size;
+		{
+			std::lock_guard<std::mutex> lock(m_imgMutex);
+			size = {m_cachedValues.renderWidth, m_cachedValues.renderHeight, 4};
+		}
+		std::lock_guard<std::mutex> lock(m_viewportWriteMutex);
+		m_viewportImage.resize(size);
+		m_viewportImage.updateRegion(reinterpret_cast<const float *>(img.data), {img.x, img.y, img.width, img.height});
+	} else if (img.type == ImageType::RGBA_REAL) {
+		std::lock_guard<std::mutex> lock(m_viewportWriteMutex);
+		m_viewportImage.updateImage(reinterpret_cast<const float *>(img.data), {img.width, img.height, 4});
+	} else if (img.type == ImageType::JPG) {
+		queueViewportJpeg(reinterpret_cast<const unsigned char *>(img.data), img.size);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void ZmqExporter::queueViewportJpeg(const unsigned char *data, size_t size) {
+	std::lock_guard<std::mutex> lock(m_jpegMutex);
+	if (!m_decodeThreadManager) {
+		m_decodeThreadManager = ThreadManager::make(std::max(2u, std::thread::hardware_concurrency()));
+	}
+
+	// an older image still waiting is dropped, the draw only needs the latest one
+	m_pendingJpeg.assign(data, data + size);
+	m_hasPendingJpeg = true;
+
+	if (!m_isDecodingJpeg) {
+		m_isDecodingJpeg = true;
+		m_decodeThreadManager->addTask([this](int, const volatile bool &) {
+			decodeViewportJpeg();
+		}, ThreadManager::Priority::HIGH);
+	}
+}
+
+void ZmqExporter::decodeViewportJpeg() {
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(m_jpegMutex);
+			if (!m_hasPendingJpeg || m_decodeThreadManager->isStopped()) {
+				m_isDecodingJpeg = false;
+				m_jpegDecoded.notify_all();
+				return;
+			}
+			std::swap(m_pendingJpeg, m_decodingJpeg);
+			m_hasPendingJpeg = false;
+		}
+
+		JpegLayout layout;
+		if (!parseJpegLayout(m_decodingJpeg.data(), m_decodingJpeg.size(), layout)) {
+			PRINT_WARN("Invalid jpeg data for viewport image!");
+			continue;
+		}
+
+		{
+			// decode straight in the back buffer, strips of the image are decoded in parallel if it has restart markers
+			// and there is more than one core to do it
+			ThreadManager::Ptr stripThreads = std::thread::hardware_concurrency() > 1 ? m_decodeThreadManager : nullptr;
+			std::lock_guard<std::mutex> lock(m_viewportWriteMutex);
+			float *pixels = m_viewportImage.writeImage({layout.width, layout.height, 4});
+			if (!decodeJpeg(m_decodingJpeg.data(), m_decodingJpeg.size(), layout, pixels, stripThreads)) {
+				// the back buffer is partly decoded, it must not be published with the next update
+				m_viewportImage.discard();
+				continue;
+			}
+			m_viewportImage.publish();
+		}
+
+		if (this->callback_on_rt_image_updated) {
+			callback_on_rt_image_updated.cb();
+		}
+	}
+}
+
+void ZmqExporter::startSharedImages() {
+	const std::string &addr = exporter_settings.zmq_server_address;
+	const bool isLocal = addr.empty() || addr == "127.0.0.1" || addr == "localhost";
+	if (!is_viewport || !exporter_settings.use_zmq_shared_images || !isLocal || m_sharedImageThread.joinable()) {
+		return;
+	}
+
+	// the server creates the channel for it's port if it supports it, otherwise images keep coming over zmq
+	const std::string name = SharedImageChannel::GetChannelName(exporter_settings.zmq_server_port);
+	if (!m_sharedImages.open(name)) {
+		PRINT_INFO_EX("No shared image channel \"%s\", viewport images are read over zmq", name.c_str());
+		return;
+	}
+
+	PRINT_INFO_EX("Reading viewport images from shared image channel \"%s\"", name.c_str());
+	m_stopSharedImages = false;
+	m_sharedImageThread = std::thread(&ZmqExporter::readSharedImages, this);
+}
+
+void ZmqExporter::stopSharedImages() {
+	if (m_sharedImageThread.joinable()) {
+		m_stopSharedImages = true;
+		m_sharedImageThread.join();
+		PRINT_INFO_EX("Shared image channel: %llu images read, %llu overwritten before they were read",
+		              static_cast<unsigned long long>(m_sharedImages.getReadCount()),
+		              static_cast<unsigned long long>(m_sharedImages.getTornCount()));
+	}
+	m_sharedImages.close();
+}
+
+void ZmqExporter::readSharedImages() {
+	// images of a set are read until it's last one, one read call can end in the middle of a set or have several sets
+	bool setUpdated = false;
+	bool setTorn = false;
+	std::vector<unsigned char> jpeg;
+
+	while (!m_stopSharedImages) {
+		bool published = false;
+		bool ready = false;
+
+		const int count = m_sharedImages.read([&](const SharedImageChannel::ImageInfo &info, const void *data) {
+			const ImageType type = static_cast<ImageType>(info.imageType);
+			const uint64_t pixelsSize = static_cast<uint64_t>(std::max(0, info.width)) * std::max(0, info.height) * 4 * sizeof(float);
+			// images for other channels are not drawn in the viewport, and the rest of a torn set is not shown
+			if (setTorn || info.channel != static_cast<int>(RenderChannelType::RenderChannelTypeNone)) {
+				return;
+			}
+			if (type == ImageType::JPG) {
+				// decoded on another thread, so it's copied and queued only if it was not overwritten meanwhile
+				jpeg.assign(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<const unsigned char *>(data) + info.size);
+			} else if (info.size >= pixelsSize) {
+				// the data is copied once, straight from the shared memory in the back buffer of the viewport image
+				const ImageView view = {type, (info.flags & SharedImageChannel::ImageBucket) != 0, info.x, info.y,
+				                        info.width, info.height, data, static_cast<size_t>(info.size)};
+				setUpdated = updateViewportImage(view) || setUpdated;
+			}
+		}, [&](const SharedImageChannel::ImageInfo &info, bool torn) {
+			if (torn) {
+				// pixels already in the back buffer may be bad, drop the set when it ends
+				setTorn = true;
+				jpeg.clear();
+				return;
+			}
+			if (!jpeg.empty()) {
+				queueViewportJpeg(jpeg.data(), jpeg.size());
+				jpeg.clear();
+			}
+
+			ready = ready || (info.flags & SharedImageChannel::ImageReady);
+			if (!(info.flags & (SharedImageChannel::ImageLast | SharedImageChannel::ImageReady))) {
+				return;
+			}
+
+			// as with zmq, all images of a set are visible to the draw together
+			if (setUpdated || setTorn) {
+				std::lock_guard<std::mutex> lock(m_viewportWriteMutex);
+				if (setTorn) {
+					m_viewportImage.discard();
+				} else {
+					m_viewportImage.publish();
+					published = true;
+				}
+			}
+			setUpdated = false;
+			setTorn = false;
+		});
+
+		if (!count) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		if (published && this->callback_on_rt_image_updated) {
+			callback_on_rt_image_updated.cb();
+		}
+
+		if (ready && this->callback_on_image_ready) {
+			this->callback_on_image_ready.cb();
+		}
+	}
+}
+
 
 enum MessageLevel {
 	MessageError = 9999,
@@ -269,8 +452,15 @@ void ZmqExporter::zmqCallback(const VRayMessage & message, ZmqClient *) {
 		auto * set = message.getValue<VRayBaseTypes::AttrImageSet>();
 		bool ready = set->sourceType == VRayBaseTypes::ImageSourceType::ImageReady;
 		bool rtImageUpdate = false;
+		bool viewportUpdate = false;
 		for (const auto &img : set->images) {
-			m_layerImages[img.first].update(img.second, this, !is_viewport);
+			const ImageView view = {img.second.imageType, img.second.isBucket(), img.second.x, img.second.y,
+			                        img.second.width, img.second.height, img.second.data.get(), static_cast<size_t>(img.second.size)};
+			if (is_viewport && img.first == RenderChannelType::RenderChannelTypeNone && updateViewportImage(view)) {
+				viewportUpdate = true;
+			} else {
+				m_layerImages[img.first].update(img.second, this, !is_viewport);
+			}
 			// for result buckets use on bucket ready, otherwise rt image updated callback
 			if (img.first == RenderChannelType::RenderChannelTypeNone && img.second.isBucket() && this->callback_on_bucket_ready) {
 				this->callback_on_bucket_ready(img.second);
@@ -279,6 +469,12 @@ void ZmqExporter::zmqCallback(const VRayMessage & message, ZmqClient *) {
 			}
 		}
 
+		// all images of the set are visible to the draw together
+		if (viewportUpdate) {
+			std::lock_guard<std::mutex> lock(m_viewportWriteMutex);
+			m_viewportImage.publish();
+		}
+
 		if (rtImageUpdate && this->callback_on_rt_image_updated) {
 			callback_on_rt_image_updated.cb();
 		}
@@ -359,6 +555,8 @@ void ZmqExporter::init()
 			m_cachedValues.renderHeight = 0;
 			m_cachedValues.renderWidth = 0;
 			m_cachedValues.render_mode = exporter_settings.render_mode;
+
+			startSharedImages();
 		}
 	} catch (zmq::error_t &e) {
 		PRINT_ERROR("Failed to initialize ZMQ client\n%s", e.what());
@@ -388,18 +586,21 @@ void ZmqExporter::checkZmqClient()
 void ZmqExporter::free()
 {
 	checkZmqClient();
+	flushPluginBatch();
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::Free));
 }
 
 void ZmqExporter::clear_frame_data(float upTo)
 {
 	checkZmqClient();
+	flushPluginBatch();
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::ClearFrameValues, upTo));
 }
 
 void ZmqExporter::wait_for_server()
 {
 	checkZmqClient();
+	flushPluginBatch();
 	m_client->waitForMessages();
 }
 
@@ -412,6 +613,7 @@ void ZmqExporter::sync()
 	}
 
 	checkZmqClient();
+	flushPluginBatch();
 	CHECK_UPDATE(show_vfb, m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetVfbShow, exporter_settings.show_vfb)));
 	CHECK_UPDATE(viewport_image_quality, m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetQuality, exporter_settings.viewport_image_quality)));
 	CHECK_UPDATE(viewport_image_type, m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetViewportImageFormat, static_cast<int>(exporter_settings.viewport_image_type))));
@@ -426,6 +628,8 @@ void ZmqExporter::set_current_frame(float frame)
 	if (frame != current_scene_frame) {
 		current_scene_frame = frame;
 		checkZmqClient();
+		// values already queued are for the previous frame
+		flushPluginBatch();
 		m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCurrentFrame, frame));
 	}
 }
@@ -433,6 +637,7 @@ void ZmqExporter::set_current_frame(float frame)
 void ZmqExporter::set_render_region(int x, int y, int w, int h, bool crop)
 {
 	checkZmqClient();
+	flushPluginBatch();
 	const AttrListInt region({x, y, w, h});
 	if (crop) {
 		m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCropRegion, region));
@@ -448,6 +653,7 @@ void ZmqExporter::set_render_size(const int &w, const int &h)
 		m_cachedValues.renderWidth = w;
 		m_cachedValues.renderHeight = h;
 		checkZmqClient();
+		flushPluginBatch();
 		m_client->send(VRayMessage::msgRendererResize(w, h));
 	}
 }
@@ -457,6 +663,7 @@ void ZmqExporter::set_camera_plugin(const std::string &pluginName)
 	if (m_cachedValues.activeCamera != pluginName) {
 		m_isDirty = true;
 		checkZmqClient();
+		flushPluginBatch();
 		m_cachedValues.activeCamera = pluginName;
 		m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCurrentCamera, pluginName));
 	}
@@ -466,13 +673,16 @@ void ZmqExporter::set_commit_state(VRayBaseTypes::CommitAction ca)
 {
 	if (ca == CommitAction::CommitAutoOn || ca == CommitAction::CommitAutoOff) {
 		if (ca != commit_state) {
-			commit_state = ca;
 			checkZmqClient();
+			// changes queued while auto commit was off are sent before it is turned on
+			flushPluginBatch();
+			commit_state = ca;
 			m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCommitAction, static_cast<int>(ca)));
 		}
 	} else {
 		if (m_isDirty) {
 			checkZmqClient();
+			flushPluginBatch();
 			m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetCommitAction, static_cast<int>(ca)));
 			m_isDirty = false;
 		}
@@ -482,6 +692,7 @@ void ZmqExporter::set_commit_state(VRayBaseTypes::CommitAction ca)
 void ZmqExporter::start()
 {
 	checkZmqClient();
+	flushPluginBatch();
 	m_started = true;
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::Start));
 }
@@ -489,6 +700,7 @@ void ZmqExporter::start()
 void ZmqExporter::reset()
 {
 	// TODO: try with clear values up to time
+	flushPluginBatch();
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::Reset));
 
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::SetVfbShow, exporter_settings.show_vfb));
@@ -501,12 +713,14 @@ void ZmqExporter::reset()
 
 void ZmqExporter::stop()
 {
+	flushPluginBatch();
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::Stop));
 }
 
 void ZmqExporter::export_vrscene(const std::string &filepath)
 {
 	checkZmqClient();
+	flushPluginBatch();
 	m_client->send(VRayMessage::msgRendererAction(VRayMessage::RendererAction::ExportScene, filepath));
 }
 
@@ -514,7 +728,12 @@ int ZmqExporter::remove_plugin_impl(const std::string &name)
 {
 	m_isDirty = true;
 	checkZmqClient();
-	m_client->send(VRayMessage::msgPluginAction(name, VRayMessage::PluginAction::Remove));
+	if (isBatching()) {
+		std::lock_guard<std::mutex> lock(m_batchMutex);
+		m_batch.remove(name);
+	} else {
+		m_client->send(VRayMessage::msgPluginAction(name, VRayMessage::PluginAction::Remove));
+	}
 	return PluginExporter::remove_plugin_impl(name);
 }
 
@@ -522,7 +741,12 @@ void ZmqExporter::replace_plugin(const std::string & oldPlugin, const std::strin
 {
 	m_isDirty = true;
 	checkZmqClient();
-	m_client->send(VRayMessage::msgPluginReplace(oldPlugin, newPlugin));
+	if (isBatching()) {
+		std::lock_guard<std::mutex> lock(m_batchMutex);
+		m_batch.replace(oldPlugin, newPlugin);
+	} else {
+		m_client->send(VRayMessage::msgPluginReplace(oldPlugin, newPlugin));
+	}
 }
 
 
@@ -561,6 +785,26 @@ AttrPlugin ZmqExporter::export_plugin_impl(const PluginDesc & pluginDesc)
 		}
 	}
 
+	ExportProfiler::Scope profile(m_profiler, "write", pluginDesc.pluginID.c_str());
+	if (isBatching()) {
+		bool flush = false;
+		{
+			std::lock_guard<std::mutex> lock(m_batchMutex);
+			m_batch.create(name, pluginDesc.pluginID);
+			for (auto & attributePairs : pluginDesc.pluginAttrs) {
+				const PluginAttr & attr = attributePairs.second;
+				if (attr.attrValue.getType() != ValueTypeUnknown) {
+					m_batch.set(name, attr.attrName, attr.attrValue);
+				}
+			}
+			flush = m_batch.size() >= MaxBatchSize;
+		}
+		if (flush) {
+			flushPluginBatch();
+		}
+		return plugin;
+	}
+
 	m_client->send(VRayMessage::msgPluginCreate(name, pluginDesc.pluginID));
 
 	for (auto & attributePairs : pluginDesc.pluginAttrs) {
@@ -572,3 +816,41 @@ AttrPlugin ZmqExporter::export_plugin_impl(const PluginDesc & pluginDesc)
 
 	return plugin;
 }
+
+
+bool ZmqExporter::isBatching() const
+{
+	return exporter_settings.use_zmq_batch && commit_state != CommitAction::CommitAutoOn;
+}
+
+
+void ZmqExporter::flushPluginBatch()
+{
+	std::lock_guard<std::mutex> sendLock(m_batchSendMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_batchMutex);
+		if (m_batch.empty()) {
+			return;
+		}
+		m_batch.take(m_batchOps);
+	}
+
+	ExportProfiler::Scope profile(m_profiler, "write", "batch");
+	for (const PluginBatch::Op & op : m_batchOps) {
+		switch (op.type) {
+			case PluginBatch::OpType::Create:
+				m_client->send(VRayMessage::msgPluginCreate(op.plugin, op.name));
+				break;
+			case PluginBatch::OpType::Set:
+				m_client->send(VRayMessage::msgPluginSetProperty(op.plugin, op.name, op.value));
+				break;
+			case PluginBatch::OpType::Remove:
+				m_client->send(VRayMessage::msgPluginAction(op.plugin, VRayMessage::PluginAction::Remove));
+				break;
+			case PluginBatch::OpType::Replace:
+				m_client->send(VRayMessage::msgPluginReplace(op.plugin, op.name));
+				break;
+		}
+	}
+	m_batchOps.clear();
+}
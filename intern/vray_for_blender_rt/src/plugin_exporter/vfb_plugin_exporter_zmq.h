@@ -21,12 +21,18 @@
 #define VRAY_FOR_BLENDER_PLUGIN_EXPORTER_ZMQ_H
 
 #include "vfb_plugin_exporter.h"
+#include "vfb_plugin_batch.h"
+#include "vfb_render_image_ring.h"
+#include "vfb_shared_image_channel.h"
 #include "vfb_utils_object.h"
 
 #include "zmq_wrapper.hpp"
 #include "zmq_message.hpp"
 
+#include <atomic>
+#include <condition_variable>
 #include <stack>
+#include <thread>
 #include <vector>
 
 namespace VRayForBlender {
@@ -76,6 +82,7 @@ public:
 
 	virtual RenderImage get_image();
 	virtual RenderImage get_render_channel(RenderChannelType channelType);
+	virtual bool        update_image(RenderImage &image, std::vector<ImageRegion> &dirty, ImageRegion::Options options);
 	virtual void        set_render_size(const int &w, const int &h);
 	virtual void        set_render_region(int x, int y, int w, int h, bool crop);
 	virtual void        set_camera_plugin(const std::string &pluginName);
@@ -90,10 +97,41 @@ public:
 private:
 	void                checkZmqClient();
 	void                zmqCallback(const VRayMessage & message, ZmqClient * client);
+	/// Image pixels with their layout, pointing either in an AttrImage or in @m_sharedImages
+	struct ImageView {
+		VRayBaseTypes::AttrImage::ImageType type;
+		bool        isBucket;
+		int         x;
+		int         y;
+		int         width;
+		int         height;
+		const void *data;
+		size_t      size;
+	};
+
+	/// Write viewport image update in @m_viewportImage, returns false for image types not handled there
+	bool                updateViewportImage(const ImageView &img);
+	/// Queue JPEG @data for decoding on @m_decodeThreadManager, replacing the queued one if it was not decoded yet
+	void                queueViewportJpeg(const unsigned char *data, size_t size);
+	/// Decode queued JPEG images in @m_viewportImage until there are none left, runs on @m_decodeThreadManager
+	void                decodeViewportJpeg();
+	/// True if plugin changes are queued in @m_batch instead of sent right away
+	bool                isBatching() const;
+	/// Send all queued plugin changes, must be called before any other message so the order is kept
+	void                flushPluginBatch();
+	/// Open the shared image channel of a server on this host and start reading it, if enabled in the settings
+	void                startSharedImages();
+	/// Stop @m_sharedImageThread and close the channel
+	void                stopSharedImages();
+	/// Read viewport images from @m_sharedImages until stopped, runs on @m_sharedImageThread
+	void                readSharedImages();
 
 private:
 	using ImageType = VRayBaseTypes::AttrImage::ImageType;
 
+	/// Queued plugin changes are sent before commit once there are this many
+	static const size_t MaxBatchSize = 1 << 16;
+
 	struct ValueCache {
 		int renderWidth;
 		int renderHeight;
@@ -117,8 +155,30 @@ private:
 	std::mutex          m_zmqClientMutex;
 	ZmqRenderImage      m_currentImage;
 	ImageMap            m_layerImages;
+	RenderImageRing     m_viewportImage; ///< RT image in viewport mode, written from the zmq thread and read by the draw
+	std::mutex          m_viewportWriteMutex; ///< producer lock for @m_viewportImage, written by both the zmq thread and the decoder
+
+	// viewport JPEG images are decoded off the zmq thread, only the latest one is kept if decoding falls behind
+	ThreadManager::Ptr  m_decodeThreadManager; ///< created on the first JPEG image
+	std::mutex          m_jpegMutex; ///< lock for the members below
+	std::condition_variable m_jpegDecoded; ///< signaled when the decoding task exits
+	std::vector<unsigned char> m_pendingJpeg; ///< latest JPEG data not yet decoded
+	std::vector<unsigned char> m_decodingJpeg; ///< JPEG data being decoded, swapped with @m_pendingJpeg so both buffers are reused
+	bool                m_hasPendingJpeg;
+	bool                m_isDecodingJpeg;
 
 	ValueCache          m_cachedValues;
+
+	// with batching on, plugin changes are sent together on commit instead of one message at a time while exporting
+	PluginBatch         m_batch;
+	std::mutex          m_batchMutex; ///< lock for @m_batch
+	std::mutex          m_batchSendMutex; ///< held while a taken batch is sent, so two batches are not mixed
+	std::vector<PluginBatch::Op> m_batchOps; ///< reused buffer for the taken batch, used under @m_batchSendMutex
+
+	// a server on the same host can write viewport images in shared memory instead of sending them over zmq
+	SharedImageChannel  m_sharedImages; ///< only used from @m_sharedImageThread once it's started
+	std::thread         m_sharedImageThread;
+	std::atomic<bool>   m_stopSharedImages;
 };
 } // namespace VRayForBlender
 
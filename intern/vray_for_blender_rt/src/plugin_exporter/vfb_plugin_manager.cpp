@@ -3,6 +3,10 @@
 #include "vfb_plugin_exporter.h"
 #include "utils/cgr_hash.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 using namespace VRayForBlender;
 using namespace std;
 
@@ -100,10 +104,104 @@ MHash getAttrHash(const AttrValue & value, const MHash seed = 42) {
 	}
 	return false;
 }
+
+/// Hash of value used to compare content of plugins, lists use the 128 bit hash so different
+/// arrays wont be mistaken for equal ones
+void combineContentHash(const void *data, int bytes, u_int64_t out[2]) {
+	u_int64_t hash[2];
+	MurmurHash3_x64_128(data, bytes, 42, hash);
+	// combine each half separately so none of the 128 bits of state are lost
+	out[0] ^= hash[0] + 0x9e3779b97f4a7c15ULL + (out[0] << 6) + (out[0] >> 2);
+	out[1] ^= hash[1] + 0x9e3779b97f4a7c15ULL + (out[1] << 6) + (out[1] >> 2);
+}
+
+/// Content hash of a single property value, combined in the content key with the property name
+void getContentHash(const AttrValue & value, u_int64_t out[2]) {
+	auto hashBytes = [out](const void *data, int bytes) {
+		combineContentHash(data, bytes, out);
+	};
+
+	switch (value.type) {
+		case ValueTypeListInt:
+			hashBytes(*value.as<AttrListInt>(), value.as<AttrListInt>().getBytesCount());
+			break;
+		case ValueTypeListFloat:
+			hashBytes(*value.as<AttrListFloat>(), value.as<AttrListFloat>().getBytesCount());
+			break;
+		case ValueTypeListVector:
+			hashBytes(*value.as<AttrListVector>(), value.as<AttrListVector>().getBytesCount());
+			break;
+		case ValueTypeListColor:
+			hashBytes(*value.as<AttrListColor>(), value.as<AttrListColor>().getBytesCount());
+			break;
+		case ValueTypeString:
+			hashBytes(value.as<AttrSimpleType<std::string>>().value.c_str(), value.as<AttrSimpleType<std::string>>().value.size());
+			break;
+		case ValueTypeMapChannels:
+			for (const auto & iter : value.as<AttrMapChannels>().data) {
+				auto & map = iter.second;
+				hashBytes(map.name.c_str(), map.name.size());
+				hashBytes(*map.faces, map.faces.getBytesCount());
+				hashBytes(*map.vertices, map.vertices.getBytesCount());
+			}
+			break;
+		default: {
+			const MHash valHash = getAttrHash(value);
+			hashBytes(&valHash, sizeof(valHash));
+			break;
+		}
+	}
+}
+
+/// Get the data of the lists in a list property, the data is shared by all copies of the list
+/// @names - receives the hash of the channel names for map channels
+/// @return false if the property is not one of the list types
+bool getListData(const AttrValue & value, std::vector<std::weak_ptr<const void>> &data, MHash &names) {
+	names = 42;
+	switch (value.type) {
+		case ValueTypeListInt:
+			data.push_back(value.as<AttrListInt>().getData());
+			return true;
+		case ValueTypeListFloat:
+			data.push_back(value.as<AttrListFloat>().getData());
+			return true;
+		case ValueTypeListVector:
+			data.push_back(value.as<AttrListVector>().getData());
+			return true;
+		case ValueTypeListColor:
+			data.push_back(value.as<AttrListColor>().getData());
+			return true;
+		case ValueTypeMapChannels:
+			for (const auto & iter : value.as<AttrMapChannels>().data) {
+				names = getValueHash(iter.second.name, names);
+				data.push_back(iter.second.faces.getData());
+				data.push_back(iter.second.vertices.getData());
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// Check if the lists of two properties are the same objects
+bool sameListData(const std::vector<std::weak_ptr<const void>> &a, const std::vector<std::weak_ptr<const void>> &b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (size_t c = 0; c < a.size(); ++c) {
+		// expired data can't be shared by a live list
+		const auto data = a[c].lock();
+		if (!data || data != b[c].lock()) {
+			return false;
+		}
+	}
+	return true;
+}
 }
 
 
 PluginManager::PluginManager()
+	: m_contentHits(0)
 {}
 
 std::string PluginManager::getKey(const PluginDesc &pluginDesc) const
@@ -111,39 +209,157 @@ std::string PluginManager::getKey(const PluginDesc &pluginDesc) const
 	return pluginDesc.pluginName;
 }
 
+PluginManager::CacheStripe & PluginManager::getStripe(const std::string &key) const
+{
+	MHash keyHash;
+	MurmurHash3_x86_32(key.c_str(), key.size(), 42, &keyHash);
+	return m_cache[keyHash % CacheStripeCount];
+}
+
+size_t PluginManager::entryBytes(const std::string &key, const PluginDescHash &hash)
+{
+	// hash map node with key, value and cached hash + the bucket pointer
+	const size_t nodeBytes = sizeof(std::string) + sizeof(PluginDescHash) + 2 * sizeof(void*) + sizeof(size_t);
+	size_t bytes = nodeBytes + key.capacity() + hash.m_values.capacity() * sizeof(PropertyHash);
+	bytes += hash.m_lists.capacity() * sizeof(ListHash);
+	for (const auto & list : hash.m_lists) {
+		bytes += list.m_data.capacity() * sizeof(std::weak_ptr<const void>);
+	}
+	return bytes;
+}
+
+int PluginManager::findName(const std::string &name) const
+{
+	boost::shared_lock<boost::shared_mutex> l(m_namesLock);
+	auto iter = m_nameIds.find(name);
+	return iter == m_nameIds.end() ? -1 : iter->second;
+}
+
+int PluginManager::internName(const std::string &name) const
+{
+	const int id = findName(name);
+	if (id != -1) {
+		return id;
+	}
+
+	boost::unique_lock<boost::shared_mutex> l(m_namesLock);
+	// could have been added by another thread after the read lock was released
+	return m_nameIds.insert(std::make_pair(name, static_cast<int>(m_nameIds.size()))).first->second;
+}
+
+PluginManager::CacheStats PluginManager::getCacheStats() const
+{
+	CacheStats stats;
+	stats.entries = 0;
+	stats.bytes = sizeof(*this);
+
+	for (int c = 0; c < CacheStripeCount; ++c) {
+		lock_guard<mutex> l(m_cache[c].m_lock);
+		stats.entries += m_cache[c].m_entries.size();
+		stats.bytes += m_cache[c].m_bytes + m_cache[c].m_entries.bucket_count() * sizeof(void*);
+	}
+
+	boost::shared_lock<boost::shared_mutex> l(m_namesLock);
+	stats.names = m_nameIds.size();
+	stats.bytes += m_nameIds.bucket_count() * sizeof(void*);
+	for (const auto & name : m_nameIds) {
+		stats.bytes += sizeof(name) + 2 * sizeof(void*) + name.first.capacity();
+	}
+
+	return stats;
+}
+
 bool PluginManager::inCache(const std::string &name) const
 {
-	lock_guard<mutex> l(m_cacheLock);
-	return m_cache.find(name) != m_cache.end();
+	const CacheStripe & stripe = getStripe(name);
+	lock_guard<mutex> l(stripe.m_lock);
+	return stripe.m_entries.find(name) != stripe.m_entries.end();
 }
 
 bool PluginManager::inCache(const PluginDesc &pluginDesc) const
 {
-	lock_guard<mutex> l(m_cacheLock);
-	return m_cache.find(getKey(pluginDesc)) != m_cache.end();
+	return inCache(getKey(pluginDesc));
 }
 
 void PluginManager::remove(const std::string &pluginName)
 {
-	lock_guard<mutex> l(m_cacheLock);
-	m_cache.erase(pluginName);
+	{
+		CacheStripe & stripe = getStripe(pluginName);
+		lock_guard<mutex> l(stripe.m_lock);
+		auto iter = stripe.m_entries.find(pluginName);
+		if (iter != stripe.m_entries.end()) {
+			stripe.m_bytes -= entryBytes(iter->first, iter->second);
+			stripe.m_entries.erase(iter);
+		}
+	}
+
+	lock_guard<mutex> l(m_contentLock);
+	auto owned = m_ownedContent.find(pluginName);
+	if (owned != m_ownedContent.end()) {
+		auto owner = m_contentOwners.find(owned->second);
+		if (owner != m_contentOwners.end() && owner->second.m_name == pluginName) {
+			m_contentOwners.erase(owner);
+		}
+		m_ownedContent.erase(owned);
+	}
 }
 
 void PluginManager::remove(const PluginDesc &pluginDesc)
 {
-	lock_guard<mutex> l(m_cacheLock);
-	m_cache.erase(getKey(pluginDesc));
+	remove(getKey(pluginDesc));
 }
 
-std::pair<bool, PluginDesc> PluginManager::diffWithCache(const PluginDesc &pluginDesc, bool buildDiff) const 
+PluginManager::ContentKey PluginManager::makeContentKey(const PluginDesc &pluginDesc) const
 {
-	lock_guard<mutex> l(m_cacheLock);
-	const auto key = getKey(pluginDesc);
-	auto cacheEntry = m_cache.find(key);
+	return hashDesc(pluginDesc, true).getContentKey();
+}
 
+bool PluginManager::findContentOwner(const ContentKey &key, const std::string &name, float frame, std::string &owner) const
+{
+	lock_guard<mutex> l(m_contentLock);
+	auto iter = m_contentOwners.find(key);
+	// owner must be exported with this content in the same frame, otherwise it could have changed since
+	if (iter == m_contentOwners.end() || iter->second.m_name == name || iter->second.m_frame != frame) {
+		return false;
+	}
+
+	owner = iter->second.m_name;
+	++m_contentHits;
+	return true;
+}
+
+void PluginManager::updateContentOwner(const ContentKey &key, const std::string &name, float frame)
+{
+	lock_guard<mutex> l(m_contentLock);
+
+	auto owned = m_ownedContent.find(name);
+	if (owned != m_ownedContent.end() && !(owned->second == key)) {
+		// plugin's content changed - it can no longer be referenced for the old one
+		auto oldOwner = m_contentOwners.find(owned->second);
+		if (oldOwner != m_contentOwners.end() && oldOwner->second.m_name == name) {
+			m_contentOwners.erase(oldOwner);
+		}
+	}
+
+	auto & contentOwner = m_contentOwners[key];
+	contentOwner.m_name = name;
+	contentOwner.m_frame = frame;
+	m_ownedContent[name] = key;
+}
+
+std::pair<bool, PluginDesc> PluginManager::diffWithCache(const PluginDesc &pluginDesc, const DescHash &hash, bool buildDiff) const
+{
 	PluginDesc res(pluginDesc.pluginName, pluginDesc.pluginID);
 
-	if (cacheEntry == m_cache.end()) {
+	const PluginDescHash &descHash = hash.m_hash;
+	const std::vector<const PluginAttr*> &descAttrs = hash.m_attrs;
+
+	const auto key = getKey(pluginDesc);
+	const CacheStripe & stripe = getStripe(key);
+	lock_guard<mutex> l(stripe.m_lock);
+	auto cacheEntry = stripe.m_entries.find(key);
+
+	if (cacheEntry == stripe.m_entries.end()) {
 		return std::make_pair(true, res);
 	}
 
@@ -151,8 +367,6 @@ std::pair<bool, PluginDesc> PluginManager::diffWithCache(const PluginDesc &plugi
 		return std::make_pair(true, res);
 	}
 
-	const auto descHash = makeHash(pluginDesc);
-
 	if (descHash.m_allHash != cacheEntry->second.m_allHash) {
 		if (!buildDiff) {
 			return std::make_pair(true, res);
@@ -161,34 +375,21 @@ std::pair<bool, PluginDesc> PluginManager::diffWithCache(const PluginDesc &plugi
 		return std::make_pair(false, res);
 	}
 
-	BLI_assert(descHash.m_name == pluginDesc.pluginName && "PluginManager::diffWithCache called with desc to different plugin!");
-
-	const auto & cacheAttrMap = cacheEntry->second.m_values;
-	const auto & descAttrMap = descHash.m_values;
-
-	for (const auto &attrHash : descAttrMap) {
-		auto cacheHash = cacheAttrMap.find(attrHash.first);
+	const auto & cacheValues = cacheEntry->second.m_values;
+	const auto & descValues = descHash.m_values;
 
-		// attribute is not in cache at all
-		if (cacheHash == cacheAttrMap.end()) {
-			if (buildDiff) {
-				// we are sure it is here, since descAttrMap was build from pluginDesc
-				const auto & attr = pluginDesc.pluginAttrs.find(attrHash.first)->second;
-				res.add(attr.attrName, attr.attrValue);
-				continue;
-			} else {
-				return std::make_pair(true, res);
-			}
+	// both are sorted by property name id
+	auto cacheHash = cacheValues.begin();
+	for (int c = 0; c < descValues.size(); ++c) {
+		const PropertyHash & attrHash = descValues[c];
+		while (cacheHash != cacheValues.end() && cacheHash->m_name < attrHash.m_name) {
+			++cacheHash;
 		}
 
-		if (attrHash.second != cacheHash->second) {
-			if (buildDiff) {
-				// we are sure it is here, since descAttrMap was build from pluginDesc
-				const auto & attr = pluginDesc.pluginAttrs.find(attrHash.first)->second;
-				res.add(attr.attrName, attr.attrValue);
-			} else {
-				return std::make_pair(true, res);
-			}
+		// attribute is not in cache at all or has different value
+		if (cacheHash == cacheValues.end() || cacheHash->m_name != attrHash.m_name || cacheHash->m_hash != attrHash.m_hash) {
+			const PluginAttr & attr = *descAttrs[c];
+			res.add(attr.attrName, attr.attrValue);
 		}
 	}
 
@@ -197,36 +398,143 @@ std::pair<bool, PluginDesc> PluginManager::diffWithCache(const PluginDesc &plugi
 
 bool PluginManager::differsId(const PluginDesc &pluginDesc) const
 {
-	auto iter = m_cache.find(getKey(pluginDesc));
-	if (iter == m_cache.end()) {
+	const auto key = getKey(pluginDesc);
+	const CacheStripe & stripe = getStripe(key);
+	lock_guard<mutex> l(stripe.m_lock);
+	auto iter = stripe.m_entries.find(key);
+	if (iter == stripe.m_entries.end()) {
 		return false;
 	}
 
-	return iter->second.m_id != pluginDesc.pluginID;
+	return iter->second.m_id != findName(pluginDesc.pluginID);
 }
 
 bool PluginManager::differs(const PluginDesc &pluginDesc) const
 {
-	return diffWithCache(pluginDesc, false).first;
+	return differs(pluginDesc, hashDesc(pluginDesc));
 }
 
 PluginDesc PluginManager::differences(const PluginDesc &pluginDesc) const
 {
-	return diffWithCache(pluginDesc, true).second;
+	return differences(pluginDesc, hashDesc(pluginDesc));
+}
+
+bool PluginManager::differs(const PluginDesc &pluginDesc, const DescHash &hash) const
+{
+	return diffWithCache(pluginDesc, hash, false).first;
 }
 
+PluginDesc PluginManager::differences(const PluginDesc &pluginDesc, const DescHash &hash) const
+{
+	return diffWithCache(pluginDesc, hash, true).second;
+}
 
-PluginManager::PluginDescHash PluginManager::makeHash(const PluginDesc &pluginDesc) const
+PluginManager::DescHash PluginManager::hashDesc(const PluginDesc &pluginDesc, bool withContentKey) const
+{
+	DescHash hash;
+	hash.m_hash = makeHash(pluginDesc, &hash.m_attrs, withContentKey ? &hash.m_contentKey : nullptr);
+	return hash;
+}
+
+
+PluginManager::PluginDescHash PluginManager::makeHash(const PluginDesc &pluginDesc, std::vector<const PluginAttr*> *attrs, ContentKey *contentKey) const
 {
 	PluginDescHash hash;
-	hash.m_id = pluginDesc.pluginID;
-	hash.m_name = pluginDesc.pluginName;
+	hash.m_id = internName(pluginDesc.pluginID);
 	hash.m_allHash = 42;
 
+	// copy the cached lists so the stripe is not locked while hashing
+	std::vector<ListHash> cachedLists;
+	{
+		const auto key = getKey(pluginDesc);
+		const CacheStripe & stripe = getStripe(key);
+		lock_guard<mutex> l(stripe.m_lock);
+		auto cacheEntry = stripe.m_entries.find(key);
+		if (cacheEntry != stripe.m_entries.end()) {
+			cachedLists = cacheEntry->second.m_lists;
+		}
+	}
+
+	struct Value {
+		PropertyHash      m_hash;
+		const PluginAttr *m_attr;
+		u_int64_t         m_content[2];
+	};
+
+	std::vector<Value> values;
+	values.reserve(pluginDesc.pluginAttrs.size());
 	for (const auto & attr : pluginDesc.pluginAttrs) {
-		const auto aHash = getAttrHash(attr.second.attrValue);
-		hash.m_allHash = getValueHash(aHash, hash.m_allHash);
-		hash.m_values[attr.second.attrName] = aHash;
+		Value value = {};
+		value.m_hash.m_name = internName(attr.second.attrName);
+		value.m_attr = &attr.second;
+
+		ListHash list;
+		if (getListData(attr.second.attrValue, list.m_data, list.m_namesHash)) {
+			list.m_name = value.m_hash.m_name;
+			list.m_hasContent = false;
+
+			// lists are hashed only if their data is not the same as the last exported one for this property
+			auto cached = std::lower_bound(cachedLists.begin(), cachedLists.end(), list.m_name, [](const ListHash &a, int name) {
+				return a.m_name < name;
+			});
+			if (cached != cachedLists.end() && cached->m_name == list.m_name && cached->m_namesHash == list.m_namesHash &&
+			    sameListData(cached->m_data, list.m_data)) {
+				list.m_hash = cached->m_hash;
+				list.m_hasContent = cached->m_hasContent;
+				list.m_content[0] = cached->m_content[0];
+				list.m_content[1] = cached->m_content[1];
+			} else {
+				list.m_hash = getAttrHash(attr.second.attrValue);
+			}
+
+			if (contentKey && !list.m_hasContent) {
+				list.m_content[0] = list.m_content[1] = 42;
+				getContentHash(attr.second.attrValue, list.m_content);
+				list.m_hasContent = true;
+			}
+
+			value.m_hash.m_hash = list.m_hash;
+			value.m_content[0] = list.m_content[0];
+			value.m_content[1] = list.m_content[1];
+			hash.m_lists.push_back(std::move(list));
+		} else {
+			value.m_hash.m_hash = getAttrHash(attr.second.attrValue);
+			if (contentKey) {
+				value.m_content[0] = value.m_content[1] = 42;
+				getContentHash(attr.second.attrValue, value.m_content);
+			}
+		}
+
+		values.push_back(value);
+	}
+
+	// sort so diffWithCache can merge with cached values and m_allHash does not depend on hash map order
+	std::sort(values.begin(), values.end(), [](const Value &a, const Value &b) {
+		return a.m_hash.m_name < b.m_hash.m_name;
+	});
+	std::sort(hash.m_lists.begin(), hash.m_lists.end(), [](const ListHash &a, const ListHash &b) {
+		return a.m_name < b.m_name;
+	});
+
+	if (contentKey) {
+		contentKey->hash[0] = contentKey->hash[1] = 42;
+		combineContentHash(pluginDesc.pluginID.c_str(), pluginDesc.pluginID.size(), contentKey->hash);
+	}
+
+	hash.m_values.reserve(values.size());
+	if (attrs) {
+		attrs->reserve(values.size());
+	}
+	for (const auto & value : values) {
+		hash.m_allHash = getValueHash(value.m_hash.m_hash, hash.m_allHash);
+		hash.m_values.push_back(value.m_hash);
+		if (attrs) {
+			attrs->push_back(value.m_attr);
+		}
+		if (contentKey) {
+			combineContentHash(value.m_attr->attrName.c_str(), value.m_attr->attrName.size(), contentKey->hash);
+			combineContentHash(value.m_content, sizeof(value.m_content), contentKey->hash);
+		}
 	}
 
 	return hash;
@@ -234,15 +542,34 @@ PluginManager::PluginDescHash PluginManager::makeHash(const PluginDesc &pluginDe
 
 void PluginManager::updateCache(const PluginDesc &update)
 {
-	lock_guard<mutex> l(m_cacheLock);
+	updateCache(update, hashDesc(update));
+}
+
+void PluginManager::updateCache(const PluginDesc &update, const DescHash &hash)
+{
 	const auto key = getKey(update);
-	auto hash = makeHash(update);
 
-	m_cache[key] = hash;
+	CacheStripe & stripe = getStripe(key);
+	lock_guard<mutex> l(stripe.m_lock);
+	auto iter = stripe.m_entries.find(key);
+	if (iter != stripe.m_entries.end()) {
+		stripe.m_bytes -= entryBytes(iter->first, iter->second);
+		iter->second = hash.m_hash;
+	} else {
+		iter = stripe.m_entries.insert(std::make_pair(key, hash.m_hash)).first;
+	}
+	stripe.m_bytes += entryBytes(iter->first, iter->second);
 }
 
 void PluginManager::clear()
 {
-	lock_guard<mutex> l(m_cacheLock);
-	m_cache.clear();
+	for (int c = 0; c < CacheStripeCount; ++c) {
+		lock_guard<mutex> l(m_cache[c].m_lock);
+		m_cache[c].m_entries.clear();
+		m_cache[c].m_bytes = 0;
+	}
+
+	lock_guard<mutex> l(m_contentLock);
+	m_contentOwners.clear();
+	m_ownedContent.clear();
 }
@@ -21,17 +21,33 @@
 
 #include <vfb_plugin_attrs.h>
 
+#include <memory>
 #include <mutex>
+#include <vector>
 #include "utils/cgr_hash.h"
 
+#include <boost/thread/shared_mutex.hpp>
+
 namespace VRayForBlender {
 /// Class that keeps track of what data is exported last, it keeps hashes for all plugin's properties
 /// All plugins that are exported first go trough this class to check if any/all properties need to be exported
 /// Check PluginExporter::export_plugin for details
+/// The cache is split in stripes, each guarded by it's own lock, so exporting threads only contend
+/// when working on plugins in the same stripe
 class PluginManager {
 public:
 	PluginManager();
 
+	PluginManager(const PluginManager &) = delete;
+	PluginManager & operator=(const PluginManager &) = delete;
+
+	/// Memory used by the cache
+	struct CacheStats {
+		size_t entries; ///< number of plugins in the cache
+		size_t names; ///< number of interned property names and plugin IDs
+		size_t bytes; ///< approximate number of bytes allocated for the cache and interned names
+	};
+
 	//// Check if a plugin with a given name is in the cache
 	bool inCache(const std::string &name) const;
 	/// Check if a plugin with a plugin description is in the cache
@@ -46,6 +62,20 @@ public:
 
 	/// Update the cache with the given PluginDesc
 	void updateCache(const PluginDesc &update);
+
+	class DescHash;
+
+	/// Hash the properties of @pluginDesc once for the overloads below, the result is valid while @pluginDesc is
+	/// Hashing is most of the time spent in the manager, so callers should do it before taking any lock of their own
+	/// Lists sharing their data with the ones last cached for the plugin are not hashed again
+	/// @withContentKey - also calculate the same key as makeContentKey, available with DescHash::getContentKey
+	DescHash hashDesc(const PluginDesc &pluginDesc, bool withContentKey = false) const;
+	/// Same as differs(pluginDesc) but with the hash from hashDesc(pluginDesc)
+	bool differs(const PluginDesc &pluginDesc, const DescHash &hash) const;
+	/// Same as differences(pluginDesc) but with the hash from hashDesc(pluginDesc)
+	PluginDesc differences(const PluginDesc &pluginDesc, const DescHash &hash) const;
+	/// Same as updateCache(update) but with the hash from hashDesc(update)
+	void updateCache(const PluginDesc &update, const DescHash &hash);
 	/// Remove data from the cache for a plugin
 	void remove(const PluginDesc &pluginDesc);
 	/// Remove data from the cache for a plugin
@@ -56,27 +86,127 @@ public:
 
 	// returns the key in the cache for this pluginDesc (it's name)
 	std::string getKey(const PluginDesc &pluginDesc) const;
+
+	/// Content address of a plugin - hash of it's ID and all property values, independent of the plugin name
+	struct ContentKey {
+		u_int64_t hash[2];
+
+		bool operator==(const ContentKey &other) const {
+			return hash[0] == other.hash[0] && hash[1] == other.hash[1];
+		}
+	};
+
+	struct ContentKeyHash {
+		size_t operator()(const ContentKey &key) const {
+			return static_cast<size_t>(key.hash[0]);
+		}
+	};
+
+	/// Calculate the content address of a given PluginDesc
+	ContentKey makeContentKey(const PluginDesc &pluginDesc) const;
+
+	/// Find plugin that was exported with the same content during @frame under different name
+	/// @return true and the name of the plugin in @owner if found
+	bool findContentOwner(const ContentKey &key, const std::string &name, float frame, std::string &owner) const;
+
+	/// Mark that the plugin @name has content @key at @frame, replacing any previous content it owned
+	void updateContentOwner(const ContentKey &key, const std::string &name, float frame);
+
+	/// Number of plugins which were replaced by reference to plugin with same content
+	int getContentHits() const { return m_contentHits; }
+
+	/// Get number of entries and memory used by the cache
+	CacheStats getCacheStats() const;
 private:
-	/// Hash data kept for a single PluginDesc
+	/// Hash of a single property value
+	struct PropertyHash {
+		int   m_name; ///< interned name of the property
+		MHash m_hash; ///< hash of the property value
+	};
+
+	/// Hashes of a list property and the data they were calculated from, data is not changed once it's exported,
+	/// so a list sharing the same data has the same hashes
+	struct ListHash {
+		int                                      m_name; ///< interned name of the property
+		MHash                                    m_hash; ///< hash of the property value
+		MHash                                    m_namesHash; ///< hash of the channel names for map channels
+		bool                                     m_hasContent; ///< true if @m_content is calculated
+		u_int64_t                                m_content[2]; ///< content hash of the property value
+		std::vector<std::weak_ptr<const void>>   m_data; ///< data of the lists in the value, doesn't keep it alive
+	};
+
+	/// Hash data kept for a single PluginDesc, the plugin name is the key in the cache
 	struct PluginDescHash {
-		std::string                              m_name; ///< the name of the plugin
-		std::string                              m_id; ///< the ID of the plugin
+		int                                      m_id; ///< interned ID of the plugin
 		MHash                                    m_allHash; ///< hash of all the properties
-		HashMap<std::string, MHash>              m_values; ///< map of property name to property value hash
+		std::vector<PropertyHash>                m_values; ///< property hashes sorted by m_name
+		std::vector<ListHash>                    m_lists; ///< hashes of list properties sorted by m_name
 	};
 
-	/// Calculate the hash of a given PluginDesc
-	PluginDescHash makeHash(const PluginDesc &pluginDesc) const;
+	/// One part of the cache with it's own lock
+	struct CacheStripe {
+		HashMap<std::string, PluginDescHash>     m_entries; ///< map a plugin name to it's hash
+		size_t                                   m_bytes; ///< approximate memory used by @m_entries
+		mutable std::mutex                       m_lock; ///< lock protecting @m_entries and @m_bytes
+
+		CacheStripe(): m_bytes(0) {}
+	};
+
+	/// Number of stripes the cache is split into
+	static const int CacheStripeCount = 64;
+
+	/// Get the stripe in which the plugin @key is stored
+	CacheStripe & getStripe(const std::string &key) const;
+
+	/// Approximate memory used by the cache entry
+	static size_t entryBytes(const std::string &key, const PluginDescHash &hash);
+
+	/// Get the id for @name, adding it to the interned names if missing
+	int internName(const std::string &name) const;
+
+	/// Get the id for @name, or -1 if it was never interned
+	int findName(const std::string &name) const;
+
+	/// Calculate the hash of a given PluginDesc, reusing the hashes of lists with the same data in the cache
+	/// @attrs - if not null will be filled with the attributes of @pluginDesc in the order of the resulting m_values
+	/// @contentKey - if not null receives the content key of @pluginDesc
+	PluginDescHash makeHash(const PluginDesc &pluginDesc, std::vector<const PluginAttr*> *attrs = nullptr, ContentKey *contentKey = nullptr) const;
 
 	/// Check the difference of a PluginDesc with the cached data
 	/// @pluginDesc - the plugin description we want to filter/check
+	/// @hash - hash of @pluginDesc from hashDesc
 	/// @uildDiff - if true the second member of the returned pair will contain only the different parameters
 	///             else it will be empty PluginDesc with only name and ID set
-	std::pair<bool, PluginDesc> diffWithCache(const PluginDesc &pluginDesc, bool buildDiff) const;
+	std::pair<bool, PluginDesc> diffWithCache(const PluginDesc &pluginDesc, const DescHash &hash, bool buildDiff) const;
+
+	/// Owner of exported content and the frame it was last confirmed
+	struct ContentOwner {
+		std::string m_name; ///< name of the plugin that has this content
+		float       m_frame; ///< last frame at which the plugin was exported with this content
+	};
 
 	// name -> PluginDesc
-	HashMap<std::string, PluginDescHash> m_cache; ///< map a plugin name to it's hash
-	mutable std::mutex                   m_cacheLock; ///< lock protecting @m_cache
+	mutable CacheStripe                  m_cache[CacheStripeCount]; ///< map a plugin name to it's hash, split by name hash
+	mutable HashMap<std::string, int>    m_nameIds; ///< interned property names and plugin IDs
+	mutable boost::shared_mutex          m_namesLock; ///< lock protecting @m_nameIds
+	HashMap<ContentKey, ContentOwner, ContentKeyHash> m_contentOwners; ///< map content to plugin having it
+	HashMap<std::string, ContentKey>     m_ownedContent; ///< map plugin name to content it owns in @m_contentOwners
+	mutable int                          m_contentHits; ///< number of successfull findContentOwner calls
+	mutable std::mutex                   m_contentLock; ///< lock protecting content maps
+
+public:
+	/// Hash of a PluginDesc returned by hashDesc
+	class DescHash {
+		friend class PluginManager;
+	public:
+		/// Content key of the PluginDesc, only if hashDesc was called withContentKey
+		const ContentKey & getContentKey() const { return m_contentKey; }
+
+	private:
+		PluginDescHash                 m_hash;
+		std::vector<const PluginAttr*> m_attrs; ///< attributes of the PluginDesc in the order of m_hash.m_values
+		ContentKey                     m_contentKey;
+	};
 };
 
 } // namespace VRayForBlender
@@ -33,6 +33,133 @@ struct TraceTransformHex {
 	double v[3];
 };
 
+const size_t PluginWriter::ZipChunkSize;
+const size_t PluginWriter::DefaultMaxInFlightBytes;
+
+PluginWriter::ZipJob::ZipJob(std::shared_ptr<const void> owner, const u_int8_t *data, size_t size)
+	: m_owner(owner)
+	, m_data(data)
+	, m_size(size)
+	, m_chunks(std::max<size_t>(1, (size + ZipChunkSize - 1) / ZipChunkSize))
+	, m_remaining(m_chunks.size())
+	, m_failed(false)
+{}
+
+bool PluginWriter::ZipJob::compressChunk(int index) {
+	// size of the window for deflate, previous chunk's tail is used as dictionary
+	const size_t windowSize = 32768;
+
+	const size_t offset = index * ZipChunkSize;
+	const size_t size = std::min(ZipChunkSize, m_size - std::min(offset, m_size));
+	const bool isLast = index == m_chunks.size() - 1;
+	Chunk & chunk = m_chunks[index];
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// same compression level as GetStringZip, negative window bits for raw deflate without header
+	if (deflateInit2(&stream, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		PRINT_ERROR("Failed to init deflate for chunk %d", index);
+		m_failed = true;
+	} else {
+		if (offset > 0) {
+			const size_t dictSize = std::min(windowSize, offset);
+			deflateSetDictionary(&stream, m_data + offset - dictSize, dictSize);
+		}
+
+		// sync flush adds empty stored block, so reserve few bytes more than the bound
+		chunk.data.resize(deflateBound(&stream, size) + 16);
+		stream.next_in = const_cast<Bytef*>(m_data + offset);
+		stream.avail_in = size;
+		stream.next_out = reinterpret_cast<Bytef*>(&chunk.data[0]);
+		stream.avail_out = chunk.data.size();
+
+		// all chunks but the last must end on byte boundary and not set the final block bit
+		const int err = deflate(&stream, isLast ? Z_FINISH : Z_SYNC_FLUSH);
+		if (err != Z_STREAM_END && !(err == Z_OK && !isLast && stream.avail_out > 0)) {
+			PRINT_ERROR("Failed to deflate chunk %d, error %d", index, err);
+			m_failed = true;
+		}
+		chunk.data.resize(stream.total_out);
+		deflateEnd(&stream);
+	}
+
+	chunk.adler = adler32(adler32(0L, Z_NULL, 0), m_data + offset, size);
+
+	return --m_remaining == 0;
+}
+
+bool PluginWriter::ZipJob::skipChunk(int index) {
+	m_failed = true;
+	return --m_remaining == 0;
+}
+
+char * PluginWriter::ZipJob::finish() {
+	BLI_assert(m_remaining == 0 && "ZipJob::finish called before all chunks are done");
+
+	if (m_failed) {
+		m_chunks.clear();
+		// same as the single threaded path, hex is valid in place of ZIPB if that fails too
+		char * data = GetStringZip(m_data, m_size);
+		if (!data) {
+			PRINT_ERROR("Failed to compress %d bytes, writing them as hex", static_cast<int>(m_size));
+			data = GetHex(m_data, m_size);
+		}
+		m_owner.reset();
+		return data;
+	}
+
+	size_t zipLen = 2 + 4;
+	for (const Chunk & chunk : m_chunks) {
+		zipLen += chunk.data.size();
+	}
+
+	std::vector<u_int8_t> zip;
+	zip.reserve(zipLen);
+	// zlib header for deflate with 32K window and fastest compression level
+	zip.push_back(0x78);
+	zip.push_back(0x01);
+
+	uLong adler = m_chunks[0].adler;
+	for (int c = 0; c < m_chunks.size(); ++c) {
+		const Chunk & chunk = m_chunks[c];
+		zip.insert(zip.end(), chunk.data.begin(), chunk.data.end());
+		if (c > 0) {
+			const size_t size = std::min(ZipChunkSize, m_size - c * ZipChunkSize);
+			adler = adler32_combine(adler, chunk.adler, size);
+		}
+	}
+
+	zip.push_back((adler >> 24) & 0xFF);
+	zip.push_back((adler >> 16) & 0xFF);
+	zip.push_back((adler >> 8) & 0xFF);
+	zip.push_back(adler & 0xFF);
+
+	// chunks are no longer needed, free them before encoding
+	m_chunks.clear();
+	m_owner.reset();
+
+	return GetStringZipEncoded(zip.data(), zip.size(), m_size);
+}
+
+PluginWriter::ZipChunkTask::~ZipChunkTask() {
+	if (!m_done) {
+		// discarded by the thread manager
+		m_writer.chunkDone(m_item, *m_job, m_job->skipChunk(m_index));
+	}
+}
+
+void PluginWriter::ZipChunkTask::run() {
+	bool isLast = false;
+	if (m_writer.m_profiler) {
+		ExportProfiler::Scope profile(*m_writer.m_profiler, "write", "compress");
+		isLast = m_job->compressChunk(m_index);
+	} else {
+		isLast = m_job->compressChunk(m_index);
+	}
+	m_done = true;
+	m_writer.chunkDone(m_item, *m_job, isLast);
+}
+
 bool PluginWriter::WriteItem::isDone() const {
 	return m_ready.load(std::memory_order_acquire);
 }
@@ -61,6 +188,11 @@ void PluginWriter::WriteItem::asyncDone(const char * data) {
 	m_ready.store(true, std::memory_order_release);
 }
 
+void PluginWriter::WriteItem::append(const char * val) {
+	BLI_assert(!m_isAsync && "Called append on async WriteItem");
+	m_data.append(val);
+}
+
 PluginWriter::WriteItem::~WriteItem() {
 	if (m_freeData) {
 		delete[] m_asyncData;
@@ -70,6 +202,7 @@ PluginWriter::WriteItem::~WriteItem() {
 PluginWriter::WriteItem::WriteItem(WriteItem && other): WriteItem() {
 	std::swap(m_data, other.m_data);
 	std::swap(m_asyncData, other.m_asyncData);
+	std::swap(m_cost, other.m_cost);
 	m_ready = other.m_ready.load();
 	other.m_ready = false;
 	std::swap(m_freeData, other.m_freeData);
@@ -78,14 +211,22 @@ PluginWriter::WriteItem::WriteItem(WriteItem && other): WriteItem() {
 
 PluginWriter::PluginWriter(ThreadManager::Ptr tm, const char *fileName, ExporterSettings::ExportFormat format)
 	: PluginWriter(tm, fopen(fileName, "ab"), format)
-{}
+{
+	m_fileName = fileName;
+	m_sidecarName = fs::path(m_fileName + ".vrbin").filename().string();
+}
 
 PluginWriter::PluginWriter(ThreadManager::Ptr tm, file_t *file, ExporterSettings::ExportFormat format)
-	: m_threadManager(tm)
+	: m_runningTasks(0)
+    , m_threadManager(tm)
+    , m_inFlightBytes(0)
+    , m_maxInFlightBytes(DefaultMaxInFlightBytes)
     , m_depth(1)
     , m_animationFrame(-FLT_MAX)
     , m_file(file)
     , m_format(format)
+    , m_profiler(nullptr)
+    , m_capture(nullptr)
 {
 	if (!file) {
 		PRINT_ERROR("Plugin Writer create with invalid file pointer!");
@@ -108,6 +249,11 @@ void closeFile(PyObject * file)
 
 PluginWriter::~PluginWriter()
 {
+	{
+		// chunk tasks still reference the writer until they call chunkDone
+		std::unique_lock<std::mutex> lock(m_itemMutex);
+		m_itemDoneVar.wait(lock, [this] { return m_runningTasks == 0; });
+	}
 	closeFile(m_file);
 }
 
@@ -116,6 +262,29 @@ bool PluginWriter::good() const
 	return m_file != nullptr;
 }
 
+bool PluginWriter::writeBinary(const void *data, uint64_t length, BinarySidecar::ElementType type, BinarySidecar::Entry &entry)
+{
+	if (m_fileName.empty()) {
+		// no path to put the sidecar next to
+		return false;
+	}
+
+	if (!m_sidecar) {
+		m_sidecar.reset(new BinarySidecarWriter(m_fileName + ".vrbin"));
+		if (!m_sidecar->good()) {
+			PRINT_ERROR("Failed to create binary sidecar \"%s\", falling back to HEX", m_sidecar->getFileName().c_str());
+		}
+	}
+
+	if (!m_sidecar->good() || !m_sidecar->write(data, length, type, entry)) {
+		return false;
+	}
+	if (m_profiler) {
+		m_profiler->addBytes("BIN sidecar", length);
+	}
+	return true;
+}
+
 #define FormatAndAdd(pp, ...)                                     \
 	char buf[2048];                                               \
 	sprintf(buf, __VA_ARGS__);                                    \
@@ -125,7 +294,9 @@ bool PluginWriter::good() const
 
 PluginWriter &PluginWriter::writeStr(const char *str)
 {
-	if (good()) {
+	if (m_capture) {
+		m_capture->append(str);
+	} else if (good()) {
 		addTask(str);
 	}
 	return *this;
@@ -151,6 +322,37 @@ void write_file_impl(FILE * file, const char * data, int len = -1)
 		PRINT_ERROR("Failed to write to file!");
 	}
 }
+
+const char * formatName(ExporterSettings::ExportFormat format)
+{
+	switch (format) {
+	case ExporterSettings::ExportFormatZIP: return "ZIP";
+	case ExporterSettings::ExportFormatHEX: return "HEX";
+	case ExporterSettings::ExportFormatASCII: return "ASCII";
+	case ExporterSettings::ExportFormatBIN: return "BIN";
+	default: return "Unknown";
+	}
+}
+}
+
+void PluginWriter::writeData(const char *data, int len)
+{
+	if (len == -1) {
+		len = strlen(data);
+	}
+	write_file_impl(m_file, data, len);
+	if (m_profiler) {
+		m_profiler->addBytes(formatName(m_format), len);
+	}
+}
+
+void PluginWriter::writeFront()
+{
+	int len = 0;
+	const char * data = m_items.front().getData(len);
+	writeData(data, len);
+	m_inFlightBytes -= m_items.front().getCost();
+	m_items.pop_front();
 }
 
 void PluginWriter::processItems(const char * val)
@@ -158,40 +360,65 @@ void PluginWriter::processItems(const char * val)
 	// this function will not be called concurrently
 	// so it is safe to traverse m_items and expect not to change during execution
 
-	const int maxRep = m_items.size();
-	for (int c = 0; c < maxRep && m_items.front().isDone(); ++c) {
-		int len = 0;
-		const char * data = m_items.front().getData(len);
-		write_file_impl(m_file, data, len);
-		m_items.pop_front();
+	while (!m_items.empty() && m_items.front().isDone()) {
+		writeFront();
 	}
 
 	if (val && *val) {
 		if (m_items.empty()) {
 			// no items left in que, just write current value
-			write_file_impl(m_file, val);
+			writeData(val);
+		} else if (!m_items.back().isAsync()) {
+			// merge consecutive strings so they dont need an item each
+			m_items.back().append(val);
 		} else {
 			m_items.push_back(WriteItem(val));
 		}
 	}
 }
 
+void PluginWriter::chunkDone(WriteItem &item, ZipJob &job, bool isLast)
+{
+	// join the chunks before locking, only the last chunk gets here with isLast
+	const char * data = isLast ? job.finish() : nullptr;
+
+	// the item is marked done under the lock, so a waiting thread can't free the writer in between
+	std::lock_guard<std::mutex> lock(m_itemMutex);
+	if (isLast) {
+		item.asyncDone(data);
+	}
+	--m_runningTasks;
+	m_itemDoneVar.notify_all();
+}
+
+void PluginWriter::waitInFlight(size_t bytes)
+{
+	// always allow one item, even if it is bigger than the limit
+	while (!m_items.empty() && m_inFlightBytes + bytes > m_maxInFlightBytes) {
+		{
+			std::unique_lock<std::mutex> lock(m_itemMutex);
+			m_itemDoneVar.wait(lock, [this] { return m_items.front().isDone(); });
+		}
+		processItems();
+	}
+}
 
 void PluginWriter::blockFlushAll()
 {
 	SCOPED_TRACE("PluginWriter::blockFlushAll()");
-	for (int c = 0; c < m_items.size(); ++c) {
-		auto & item = m_items[c];
-		// lazy wait for item
-		while (!item.isDone()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	while (!m_items.empty()) {
+		{
+			std::unique_lock<std::mutex> lock(m_itemMutex);
+			m_itemDoneVar.wait(lock, [this] { return m_items.front().isDone(); });
 		}
-		int len = 0;
-		const char * data = item.getData(len);
-		write_file_impl(m_file, data, len);
+		writeFront();
 	}
+	BLI_assert(m_inFlightBytes == 0 && "PluginWriter in-flight bytes mismatch after flush");
 
-	m_items.clear();
+	// the .vrscene references the sidecar's payloads, so it must be readable as soon as the .vrscene is
+	if (m_sidecar && m_sidecar->good() && !m_sidecar->flush()) {
+		PRINT_ERROR("Failed to write the table of contents of binary sidecar \"%s\"", m_sidecar->getFileName().c_str());
+	}
 }
 
 const char * PluginWriter::indentation()
@@ -226,6 +453,11 @@ PluginWriter &operator<<(PluginWriter &pp, const std::string &val)
 	return !val.empty() ? pp.writeStr(val.c_str()) : pp;
 }
 
+PluginWriter &operator<<(PluginWriter &pp, const RawValue &val)
+{
+	return pp << val.text;
+}
+
 PluginWriter &operator<<(PluginWriter &pp, const AttrColor &val)
 {
 	FormatAndAdd(pp, "Color(%g,%g,%g)", val.r, val.g, val.b);
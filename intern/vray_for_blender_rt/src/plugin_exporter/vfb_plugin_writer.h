@@ -7,10 +7,15 @@
 #include <atomic>
 #include <set>
 #include <deque>
+#include <vector>
+
+#include <zlib.h>
 
 #include "vfb_plugin_attrs.h"
 #include "vfb_export_settings.h"
 #include "vfb_thread_manager.h"
+#include "vfb_binary_sidecar.h"
+#include "vfb_export_profiler.h"
 
 #include "utils/cgr_vrscene.h"
 #include "utils/cgr_string.h"
@@ -62,25 +67,133 @@ public:
 	}
 
 	/// Add task to the queue
+	/// Arrays bigger than ZipChunkSize are split and each chunk is compressed as separate task
+	/// Blocks while the bytes held by pending items exceed the in-flight limit
 	template <typename T>
 	void addTask(const T &task) {
-		// when adding and removing elements from deque no references are invalidated
+		const size_t bytes = task.getBytesCount();
+		waitInFlight(bytes);
 
+		// when adding and removing elements from deque no references are invalidated
 		m_items.emplace_back();
 		auto & item = m_items.back();
+		item.setCost(bytes);
+		m_inFlightBytes += bytes;
 
 		// Array's data is actually shared_ptr so copy it inside to preserve the data
-		m_threadManager->addTask([&item, task, this](int, const volatile bool &) {
-			char * zipData = GetStringZip(reinterpret_cast<const u_int8_t *>(*task), task.getBytesCount());
-			item.asyncDone(zipData);
-		}, ThreadManager::Priority::LOW);
+		std::shared_ptr<const T> owner(new T(task));
+		std::shared_ptr<ZipJob> job(new ZipJob(owner, reinterpret_cast<const u_int8_t *>(**owner), bytes));
+
+		// the last chunk frees the chunks of the job, so don't ask for the count while adding tasks
+		const int chunkCount = job->chunkCount();
+		{
+			std::lock_guard<std::mutex> lock(m_itemMutex);
+			m_runningTasks += chunkCount;
+		}
+
+		for (int c = 0; c < chunkCount; ++c) {
+			std::shared_ptr<ZipChunkTask> chunkTask(new ZipChunkTask(*this, item, job, c));
+			m_threadManager->addTask([chunkTask](int, const volatile bool &) {
+				chunkTask->run();
+			}, ThreadManager::Priority::LOW);
+		}
 
 		processItems();
 	}
 
-	/// Block until all items are done and wirtten to file
+	/// Block until all items are done and wirtten to file, and the binary sidecar's table of contents is written
 	void blockFlushAll();
+
+	/// Write @length bytes as payload in the binary sidecar of this file, creating it if needed
+	/// @return false if there is no sidecar for this writer or the write failed
+	bool writeBinary(const void *data, uint64_t length, BinarySidecar::ElementType type, BinarySidecar::Entry &entry);
+
+	/// Name of the sidecar file relative to the .vrscene, as written in references
+	const std::string & getSidecarName() const { return m_sidecarName; }
+
+	/// Set the maximum number of uncompressed bytes that can be pending compression or writing
+	/// addTask will block the exporting thread until enough items are flushed
+	void setMaxInFlightBytes(size_t bytes) { m_maxInFlightBytes = bytes; }
+	size_t getMaxInFlightBytes() const { return m_maxInFlightBytes; }
+
+	/// Set profiler counting the bytes written to the file and sidecar, may be nullptr
+	void setProfiler(ExportProfiler *profiler) { m_profiler = profiler; }
+
+	/// While set, written strings are appended to @capture instead of the file, binary payloads are still written
+	/// Arrays compressed asynchronously are not captured, so use it only for formats other than ZIP
+	void setCapture(std::string *capture) { m_capture = capture; }
+
+	/// Arrays are split in chunks of this size to be compressed in parallel
+	static const size_t ZipChunkSize = 1 << 20;
+
+	/// Default value for the in-flight limit
+	static const size_t DefaultMaxInFlightBytes = size_t(256) << 20;
 private:
+	/// Deflate of one array split in chunks which can be compressed concurrently
+	/// Chunks are raw deflate streams ending on byte boundary, so when concatenated
+	/// with zlib header and combined adler32 they form one valid zlib stream
+	class ZipJob {
+	public:
+		ZipJob(std::shared_ptr<const void> owner, const u_int8_t *data, size_t size);
+
+		ZipJob(const ZipJob &) = delete;
+		ZipJob & operator=(const ZipJob &) = delete;
+
+		int chunkCount() const { return m_chunks.size(); }
+
+		/// Compress chunk @index, returns true if this was the last chunk remaining
+		bool compressChunk(int index);
+
+		/// Mark chunk @index as not compressed, returns true if this was the last chunk remaining
+		bool skipChunk(int index);
+
+		/// Join all compressed chunks into ZIPB string, call only after all chunks are done
+		/// If any chunk failed the whole array is compressed with GetStringZip, or written as hex
+		char * finish();
+	private:
+		struct Chunk {
+			Chunk(): adler(0) {}
+			std::string data; ///< Raw deflate data for this chunk
+			uLong       adler; ///< Adler32 of the uncompressed chunk
+		};
+
+		std::shared_ptr<const void>  m_owner; ///< Keeps the source array alive
+		const u_int8_t              *m_data; ///< Uncompressed data
+		size_t                       m_size; ///< Size of @m_data in bytes
+		std::vector<Chunk>           m_chunks; ///< Compressed chunks
+		std::atomic<int>             m_remaining; ///< Number of chunks not yet compressed
+		std::atomic<bool>            m_failed; ///< True if any chunk could not be compressed
+	};
+
+	class WriteItem;
+
+	/// Task compressing one chunk of a ZipJob
+	/// If the thread manager discards the task without running it, the destructor skips the chunk
+	/// so the item is still completed and the writer is not left waiting for it
+	class ZipChunkTask {
+	public:
+		ZipChunkTask(PluginWriter &writer, WriteItem &item, std::shared_ptr<ZipJob> job, int index)
+			: m_writer(writer)
+			, m_item(item)
+			, m_job(job)
+			, m_index(index)
+			, m_done(false) {}
+
+		ZipChunkTask(const ZipChunkTask &) = delete;
+		ZipChunkTask & operator=(const ZipChunkTask &) = delete;
+
+		~ZipChunkTask();
+
+		/// Compress the chunk, complete the item if this was the last one
+		void run();
+	private:
+		PluginWriter            &m_writer; ///< Writer owning the item
+		WriteItem               &m_item; ///< Item completed by the last chunk
+		std::shared_ptr<ZipJob>  m_job; ///< Job this chunk is part of
+		int                      m_index; ///< Index of the chunk in the job
+		bool                     m_done; ///< True once the chunk was compressed or skipped
+	};
+
 	class WriteItem {
 	public:
 		/// Check if this write item is done (may be zipping currently)
@@ -92,6 +205,15 @@ private:
 		/// Mark this item as done and store the pointer provided
 		void asyncDone(const char * data);
 
+		/// Append data to a non async item
+		void append(const char * val);
+
+		bool isAsync() const { return m_isAsync; }
+
+		/// Set/get the number of bytes this item accounts for in the in-flight limit
+		void setCost(size_t bytes) { m_cost = bytes; }
+		size_t getCost() const { return m_cost; }
+
 		/// Release any data set in asycnDone
 		~WriteItem();
 
@@ -103,6 +225,7 @@ private:
 		WriteItem()
 			: m_data("")
 			, m_asyncData(nullptr)
+			, m_cost(0)
 			, m_ready(false)
 			, m_freeData(false)
 			, m_isAsync(true) {}
@@ -111,6 +234,7 @@ private:
 		explicit WriteItem(const std::string & val)
 			: m_data(val)
 			, m_asyncData(nullptr)
+			, m_cost(0)
 			, m_ready(true)
 			, m_freeData(false)
 			, m_isAsync(false) {}
@@ -119,6 +243,7 @@ private:
 		explicit WriteItem(const char * val)
 			: m_data(val ? val : "")
 			, m_asyncData(nullptr)
+			, m_cost(0)
 			, m_ready(true)
 			, m_freeData(false)
 			, m_isAsync(false) {}
@@ -126,6 +251,7 @@ private:
 	private:
 		std::string        m_data; ///< Data if this item is created 'done'
 		const char        *m_asyncData; ///< Data if this item is asyncly zipped
+		size_t             m_cost; ///< Bytes held by this item until written
 		std::atomic<bool>  m_ready; ///< Flag to check if this item is ready
 		bool               m_freeData; ///< True if data needs to be freed
 		bool               m_isAsync; ///< True if this item is async
@@ -136,14 +262,35 @@ private:
 	/// 2. write val if queue is empty or add it to the queue
 	void processItems(const char * val = nullptr);
 
-	std::mutex                      m_itemMutex; ///< only used to syncronize waiting for items
-	std::condition_variable         m_itemDoneVar; ///< used to block on blockFlushAll
+	/// Write and pop the front item
+	void writeFront();
+
+	/// Write @data to the file and count the bytes in the profiler, @len -1 means null terminated
+	void writeData(const char *data, int len = -1);
+
+	/// Block until @bytes more can be added without exceeding @m_maxInFlightBytes
+	void waitInFlight(size_t bytes);
+
+	/// Called when a chunk task of @job finished, stores the result in @item if @isLast
+	/// and wakes up any thread waiting for items or for running tasks
+	void chunkDone(WriteItem &item, ZipJob &job, bool isLast);
+
+	std::mutex                      m_itemMutex; ///< guards completing items and @m_runningTasks
+	std::condition_variable         m_itemDoneVar; ///< used to block on blockFlushAll and the destructor
+	int                             m_runningTasks; ///< Chunk tasks not yet finished, they reference this writer
 	std::deque<WriteItem>           m_items; ///< Item queue for all items to be writen to files
 	ThreadManager::Ptr              m_threadManager; ///< Thread manager for async items
+	size_t                          m_inFlightBytes; ///< Bytes held by items in @m_items
+	size_t                          m_maxInFlightBytes; ///< Limit for @m_inFlightBytes
 	int                             m_depth; ///< Current indentation depth
 	float                           m_animationFrame; ///< The current animation frame
 	file_t                         *m_file; ///< The file object coming from python api
-	ExporterSettings::ExportFormat  m_format; ///< The file format (ASCII, HEX, ZIP)
+	ExporterSettings::ExportFormat  m_format; ///< The file format (ASCII, HEX, ZIP, BIN)
+	std::string                     m_fileName; ///< Path of the file, empty if created from file pointer
+	std::string                     m_sidecarName; ///< Base name of the binary sidecar
+	std::unique_ptr<BinarySidecarWriter> m_sidecar; ///< Binary sidecar for BIN format, created on first payload
+	ExportProfiler                 *m_profiler; ///< Optional profiler for written bytes
+	std::string                    *m_capture; ///< If set receives the written strings, see setCapture
 
 private:
 	PluginWriter(const PluginWriter&) = delete;
@@ -168,6 +315,13 @@ PluginWriter &operator<<(PluginWriter &pp, const VRayBaseTypes::AttrInstancer &v
 PluginWriter &operator<<(PluginWriter &pp, const VRayBaseTypes::AttrListValue &val);
 PluginWriter &operator<<(PluginWriter &pp, const VRayBaseTypes::AttrValue &val);
 
+/// Value already in vrscene syntax, written as is
+struct RawValue {
+	std::string text;
+};
+
+PluginWriter &operator<<(PluginWriter &pp, const RawValue &val);
+
 template <typename T>
 using KVPair = std::pair<std::string, T>;
 
@@ -194,6 +348,32 @@ PluginWriter &operator<<(PluginWriter &pp, const VRayBaseTypes::AttrSimpleType<T
 template <>
 PluginWriter &operator<<(PluginWriter &pp, const VRayBaseTypes::AttrSimpleType<std::string> &val);
 
+/// Element type of AttrList<T> payloads written in the binary sidecar
+template <typename T>
+struct SidecarElementType {
+	static const BinarySidecar::ElementType value = BinarySidecar::ElementTypeRaw;
+};
+
+template <>
+struct SidecarElementType<int> {
+	static const BinarySidecar::ElementType value = BinarySidecar::ElementTypeInt;
+};
+
+template <>
+struct SidecarElementType<float> {
+	static const BinarySidecar::ElementType value = BinarySidecar::ElementTypeFloat;
+};
+
+template <>
+struct SidecarElementType<VRayBaseTypes::AttrVector> {
+	static const BinarySidecar::ElementType value = BinarySidecar::ElementTypeVector;
+};
+
+template <>
+struct SidecarElementType<VRayBaseTypes::AttrColor> {
+	static const BinarySidecar::ElementType value = BinarySidecar::ElementTypeColor;
+};
+
 template <typename T>
 PluginWriter &printList(PluginWriter &pp, const VRayBaseTypes::AttrList<T> &val, const char *listName, int itemsPerLine = 0)
 {
@@ -203,6 +383,7 @@ PluginWriter &printList(PluginWriter &pp, const VRayBaseTypes::AttrList<T> &val,
 		return pp << "()";
 	}
 	itemsPerLine = std::max(0, itemsPerLine);
+	BinarySidecar::Entry entry;
 	if (listName[0] == '\0' || pp.format() == ExporterSettings::ExportFormatASCII) {
 		pp << "(";
 		if (itemsPerLine) {
@@ -227,6 +408,10 @@ PluginWriter &printList(PluginWriter &pp, const VRayBaseTypes::AttrList<T> &val,
 		pp << "Hex(\"";
 		pp.addTask(val);
 		pp << "\")";
+	} else if (pp.format() == ExporterSettings::ExportFormatBIN && pp.writeBinary(*val, val.getBytesCount(), SidecarElementType<T>::value, entry)) {
+		char buf[64];
+		sprintf(buf, "\", %llu, %llu)", static_cast<unsigned long long>(entry.offset), static_cast<unsigned long long>(entry.length));
+		pp << "Bin(\"" << pp.getSidecarName() << buf;
 	} else {
 		char * zipData = GetHex(reinterpret_cast<const u_int8_t *>(*val), val.getBytesCount());
 		pp << "Hex(\"" << zipData << "\")";
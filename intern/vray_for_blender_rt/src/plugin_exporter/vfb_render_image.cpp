@@ -17,35 +17,23 @@
  */
 
 #include "vfb_render_image.h"
+#include "vfb_image_kernels.h"
 
 #include <cstring>
 #include <algorithm>
 
-#include "jpeglib.h"
-#include <setjmp.h>
-
 using namespace VRayForBlender;
 
 namespace {
-	void resetAlpha(float * data, int w, int h, int channels) {
-		if (channels == 4) {
-			for (int c = 3; c < w * h * channels; c+=4) {
-				data[c] = 1.0f;
-			}
+	int kernelFlags(ImageRegion::Options options) {
+		int flags = ImageKernels::None;
+		if (options & ImageRegion::Options::CLAMP) {
+			flags |= ImageKernels::Clamp;
 		}
-	}
-
-	void clamp(float * data, int w, int h, int channels, float max, float val) {
-		const int pixelCount = w * h;
-		for (int p = 0; p < pixelCount; ++p) {
-			float *pixel = data + (p * channels);
-			switch (channels) {
-			case 4:
-			case 3: pixel[2] = pixel[2] > max ? val : pixel[2];
-			case 2: pixel[1] = pixel[1] > max ? val : pixel[1];
-			case 1: pixel[0] = pixel[0] > max ? val : pixel[0];
-			}
+		if (options & ImageRegion::Options::RESET_ALPHA) {
+			flags |= ImageKernels::ResetAlpha;
 		}
+		return flags;
 	}
 }
 
@@ -67,21 +55,34 @@ void VRayForBlender::updateImageRegion(
 	const int sourceLineSize = sourceSize.w * pixelSize;
 	const int sourceLeftPad = sourceRegion.x * pixelSize;
 
-	const int destEnd = destSize.h - destRegion.y - 1;
+	// the region is flipped vertically, so the first source line goes to the last destination line
+	const int destStart = destSize.h - destRegion.y - destRegion.h;
 
-	const int copyLineSize = destRegion.w * pixelSize;
-	for (int c = 0; c < destRegion.h; c++) {
-		float * destLine = reinterpret_cast<float*>(dest) + destLineSize * (destEnd - c) + destLeftPad;
-		const float * sourceLine = reinterpret_cast<const float*>(source) + sourceLineSize * (c + sourceRegion.y) + sourceLeftPad;
+	float * destFirst = reinterpret_cast<float*>(dest) + destLineSize * destStart + destLeftPad;
+	const float * sourceFirst = reinterpret_cast<const float*>(source) + sourceLineSize * sourceRegion.y + sourceLeftPad;
 
-		memcpy(destLine, sourceLine, copyLineSize * sizeof(float));
-		if (options & ImageRegion::Options::CLAMP) {
-			::clamp(destLine, destRegion.w, 1, pixelSize, 1.0f, 1.0f);
-		}
-		if (options & ImageRegion::Options::RESET_ALPHA) {
-			::resetAlpha(destLine, destRegion.w, 1, pixelSize);
-		}
+	ImageKernels::convert(destFirst, destLineSize, pixelSize, sourceFirst, sourceLineSize, pixelSize,
+	                      destRegion.w, destRegion.h, kernelFlags(options) | ImageKernels::Flip);
+}
+
+size_t VRayForBlender::copyImageRegions(
+	float * __restrict dest, const float * __restrict source, ImageSize size,
+	const std::vector<ImageRegion> &regions, ImageRegion::Options options)
+{
+	const int pixelSize = size.channels;
+	const int lineSize = size.w * pixelSize;
+
+	size_t copied = 0;
+	for (const ImageRegion &region : regions) {
+		assert(region.x >= 0 && region.y >= 0 && region.x + region.w <= size.w && region.y + region.h <= size.h && "Region must fit inside image size!");
+
+		const int offset = lineSize * region.y + region.x * pixelSize;
+		ImageKernels::convert(dest + offset, lineSize, pixelSize, source + offset, lineSize, pixelSize,
+		                      region.w, region.h, kernelFlags(options));
+		copied += static_cast<size_t>(region.w) * region.h * pixelSize * sizeof(float);
 	}
+
+	return copied;
 }
 
 
@@ -123,8 +124,7 @@ RenderImage RenderImage::deepCopy(const RenderImage &source)
 
 RenderImage::~RenderImage()
 {
-	delete pixels;
-	pixels = nullptr;
+	FreePtrArr(pixels);
 }
 
 void RenderImage::updateRegion(const float *source, ImageRegion destRegion)
@@ -132,38 +132,21 @@ void RenderImage::updateRegion(const float *source, ImageRegion destRegion)
 	updated += (float)(destRegion.w * destRegion.h) / std::max((float)(this->w * this->h), 1.f);
 
 	ImageSize updateSize = {destRegion.w, destRegion.h, channels};
-	using O = ImageRegion::Options;
 	updateImageRegion(pixels, ImageSize{w, h, channels}, destRegion, source, updateSize, updateSize);
 }
 
 void RenderImage::flip()
 {
 	if (pixels && w && h) {
-		const int half_h = h / 2;
-
-		const int row_items = w * channels;
-		const int row_bytes = row_items * sizeof(float);
-
-		float *buf = new float[row_items];
-
-		for (int i = 0; i < half_h; ++i) {
-			float *to_row   = pixels + (i       * row_items);
-			float *from_row = pixels + ((h-i-1) * row_items);
-
-			memcpy(buf,      to_row,   row_bytes);
-			memcpy(to_row,   from_row, row_bytes);
-			memcpy(from_row, buf,      row_bytes);
-		}
-
-		FreePtr(buf);
+		ImageKernels::flipRows(pixels, w * channels, h);
 	}
 }
 
 
 void RenderImage::resetAlpha()
 {
-	if (pixels && w && h) {
-		::resetAlpha(pixels, w, h, channels);
+	if (pixels && w && h && channels == 4) {
+		ImageKernels::convert(pixels, w * channels, channels, pixels, w * channels, channels, w, h, ImageKernels::ResetAlpha);
 	}
 }
 
@@ -171,7 +154,7 @@ void RenderImage::resetAlpha()
 void RenderImage::clamp(float max, float val)
 {
 	if (pixels && w && h) {
-		::clamp(pixels, w, h, channels, max, val);
+		ImageKernels::convert(pixels, w * channels, channels, pixels, w * channels, channels, w, h, ImageKernels::Clamp, max, val);
 	}
 }
 
@@ -200,122 +183,3 @@ void RenderImage::cropTo(int width, int height)
 	delete[] pixels;
 	pixels = newImg;
 }
-
-namespace {
-
-struct JpegErrorManager {
-	jpeg_error_mgr pub;
-	jmp_buf setjmp_buffer;
-};
-
-void jpegErrorExit(j_common_ptr cinfo) {
-	JpegErrorManager * myerr = (JpegErrorManager*)cinfo->err;
-	char jpegErrMsg[JMSG_LENGTH_MAX + 1];
-	(*cinfo->err->format_message) (cinfo, jpegErrMsg);
-	PRINT_WARN("Error in jpeg decompress [%s]!", jpegErrMsg);
-	longjmp(myerr->setjmp_buffer, 1);
-}
-
-
-void init_source(j_decompress_ptr) {}
-
-boolean fill_input_buffer(j_decompress_ptr cinfo) {
-	unsigned char *buf = (unsigned char *)cinfo->src->next_input_byte - 2;
-
-	buf[0] = (JOCTET)0xFF;
-	buf[1] = (JOCTET)JPEG_EOI;
-
-	cinfo->src->next_input_byte = buf;
-	cinfo->src->bytes_in_buffer = 2;
-
-	return TRUE;
-}
-
-void skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
-	struct jpeg_source_mgr* src = (struct jpeg_source_mgr*) cinfo->src;
-
-	if (num_bytes > 0) {
-		src->next_input_byte += (size_t)num_bytes;
-		src->bytes_in_buffer -= (size_t)num_bytes;
-	}
-}
-
-void term_source(j_decompress_ptr) {}
-
-void jpeg_mem_src_own(j_decompress_ptr cinfo, const unsigned char * buffer, int nbytes) {
-	struct jpeg_source_mgr* src;
-
-	if (cinfo->src == NULL) {   /* first time for this JPEG object? */
-		cinfo->src = (struct jpeg_source_mgr *)
-			(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
-			sizeof(struct jpeg_source_mgr));
-	}
-
-	src = (struct jpeg_source_mgr*) cinfo->src;
-	src->init_source = init_source;
-	src->fill_input_buffer = fill_input_buffer;
-	src->skip_input_data = skip_input_data;
-	src->resync_to_restart = jpeg_resync_to_restart; /* use default method */
-	src->term_source = term_source;
-	src->bytes_in_buffer = nbytes;
-	src->next_input_byte = (JOCTET*)buffer;
-}
-}
-
-float * VRayForBlender::jpegToPixelData(unsigned char * data, int size, int &channels) {
-	jpeg_decompress_struct jpegInfo;
-	JpegErrorManager jpegError;
-
-	jpegInfo.err = jpeg_std_error(&jpegError.pub);
-
-	jpegError.pub.error_exit = jpegErrorExit;
-
-	if (setjmp(jpegError.setjmp_buffer)) {
-		PRINT_WARN("Longjmp after jpeg error!");
-		jpeg_destroy_decompress(&jpegInfo);
-		return nullptr;
-	}
-
-	jpeg_create_decompress(&jpegInfo);
-	jpeg_mem_src_own(&jpegInfo, data, size);
-
-	if (jpeg_read_header(&jpegInfo, TRUE) != JPEG_HEADER_OK) {
-		return nullptr;
-	}
-
-	jpegInfo.out_color_space = JCS_EXT_RGBX;
-
-	if (!jpeg_start_decompress(&jpegInfo)) {
-		return nullptr;
-	}
-
-	channels = jpegInfo.output_components;
-	int rowStride = jpegInfo.output_width * jpegInfo.output_components;
-	float * imageData = new float[jpegInfo.output_height * rowStride];
-	JSAMPARRAY buffer = (*jpegInfo.mem->alloc_sarray)((j_common_ptr)&jpegInfo, JPOOL_IMAGE, rowStride, 1);
-
-	int c = 0;
-	while (jpegInfo.output_scanline < jpegInfo.output_height) {
-		jpeg_read_scanlines(&jpegInfo, buffer, 1);
-
-		float * dest = imageData + c * rowStride;
-		unsigned char * source = buffer[0];
-
-		for (int r = 0; r < jpegInfo.image_width * jpegInfo.output_components; ++r) {
-			if ((r + 1) % 4 == 0) {
-				dest[r] = 1.f;
-			} else {
-				dest[r] = source[r] / 255.f;
-			}
-		}
-
-		++c;
-	}
-
-	jpeg_finish_decompress(&jpegInfo);
-	jpeg_destroy_decompress(&jpegInfo);
-
-	return imageData;
-}
-
-
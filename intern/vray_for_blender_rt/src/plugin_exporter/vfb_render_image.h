@@ -71,6 +71,19 @@ void updateImageRegion(
 );
 
 
+/// Copy @regions from one image to another image with the same size, without flipping
+/// @param dest - memory for the destination
+/// @param source - pointer to source memory
+/// @param size - size of both images
+/// @param regions - regions to copy, they must fit inside @size
+/// @param options - specifies additional actions to be performed on the copied regions in the destination
+/// @return number of bytes copied
+size_t copyImageRegions(
+	float * __restrict dest, const float * __restrict source, ImageSize size,
+	const std::vector<ImageRegion> &regions, ImageRegion::Options options = ImageRegion::Options::NONE
+);
+
+
 struct RenderImage {
 	RenderImage()
 	    : pixels(nullptr)
@@ -112,8 +125,6 @@ public:
 	float  updated;///< will hold % of updated area
 };
 
-float * jpegToPixelData(unsigned char * data, int size, int &channels);
-
 } // namespace VRayForBlender
 
 #endif // VRAY_FOR_BLENDER_RENDER_IMAGE_H
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_render_image_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace VRayForBlender;
+
+namespace {
+bool sameSize(const ImageSize &a, const ImageSize &b)
+{
+	return a.w == b.w && a.h == b.h && a.channels == b.channels;
+}
+
+bool coversImage(const ImageRegion &region, const ImageSize &size)
+{
+	return region.x <= 0 && region.y <= 0 && region.x + region.w >= size.w && region.y + region.h >= size.h;
+}
+}
+
+
+RenderImageRing::RenderImageRing()
+	: m_writeIndex(0)
+	, m_lastPublished(-1)
+	, m_size{0, 0, 0}
+	, m_readIndex(2)
+	, m_readyIndex(1)
+	, m_hasNew(false)
+	, m_publishedFrames(0)
+	, m_consumedFrames(0)
+	, m_producerBytes(0)
+	, m_consumerBytes(0)
+{
+}
+
+void RenderImageRing::addRegions(std::vector<ImageRegion> &list, const std::vector<ImageRegion> &regions, ImageSize size)
+{
+	if (list.size() == 1 && coversImage(list[0], size)) {
+		return;
+	}
+
+	list.insert(list.end(), regions.begin(), regions.end());
+
+	uint64_t area = 0;
+	for (const ImageRegion &region : list) {
+		area += static_cast<uint64_t>(region.w) * region.h;
+	}
+
+	// overlapping regions are counted more than once, so this can merge a bit early
+	if (list.size() > MaxRegions || area >= static_cast<uint64_t>(size.w) * size.h) {
+		list.assign(1, ImageRegion(size));
+	}
+}
+
+void RenderImageRing::allocate(Buffer &buffer, ImageSize size)
+{
+	buffer.size = size;
+	buffer.pixels.assign(static_cast<size_t>(size.w) * size.h * size.channels, 0.f);
+	buffer.stale.clear();
+}
+
+void RenderImageRing::resize(ImageSize size)
+{
+	if (sameSize(size, m_size)) {
+		return;
+	}
+
+	m_size = size;
+	allocate(m_buffers[m_writeIndex], size);
+	m_written.assign(1, ImageRegion(size));
+}
+
+void RenderImageRing::syncBackBuffer()
+{
+	Buffer &back = m_buffers[m_writeIndex];
+	if (!sameSize(back.size, m_size)) {
+		allocate(back, m_size);
+		back.stale.assign(1, ImageRegion(m_size));
+	}
+
+	if (back.stale.empty()) {
+		return;
+	}
+
+	if (m_lastPublished >= 0) {
+		const Buffer &published = m_buffers[m_lastPublished];
+		// the published buffer is only read by both sides until the next publish
+		if (sameSize(published.size, back.size)) {
+			m_producerBytes += copyImageRegions(back.pixels.data(), published.pixels.data(), back.size, back.stale);
+		}
+	}
+	back.stale.clear();
+}
+
+void RenderImageRing::updateRegion(const float *source, ImageRegion region, ImageRegion::Options options)
+{
+	if (region.x < 0 || region.y < 0 || region.x + region.w > m_size.w || region.y + region.h > m_size.h) {
+		return;
+	}
+
+	syncBackBuffer();
+	Buffer &back = m_buffers[m_writeIndex];
+
+	const ImageSize sourceSize = {region.w, region.h, back.size.channels};
+	updateImageRegion(back.pixels.data(), back.size, region, source, sourceSize, sourceSize, options);
+	m_producerBytes += static_cast<uint64_t>(region.w) * region.h * back.size.channels * sizeof(float);
+
+	// updateImageRegion flips the rows, so track the region in buffer coordinates
+	const ImageRegion written(region.x, back.size.h - region.y - region.h, region.w, region.h);
+	addRegions(m_written, {written}, m_size);
+}
+
+float * RenderImageRing::writeImage(ImageSize size)
+{
+	m_size = size;
+
+	Buffer &back = m_buffers[m_writeIndex];
+	if (!sameSize(back.size, size)) {
+		allocate(back, size);
+	}
+	// everything is overwritten, no need to sync
+	back.stale.clear();
+
+	m_producerBytes += back.byteCount();
+	m_written.assign(1, ImageRegion(size));
+	return back.pixels.data();
+}
+
+void RenderImageRing::updateImage(const float *source, ImageSize size)
+{
+	float *pixels = writeImage(size);
+	memcpy(pixels, source, m_buffers[m_writeIndex].byteCount());
+}
+
+void RenderImageRing::publish()
+{
+	if (m_written.empty()) {
+		return;
+	}
+
+	for (int c = 0; c < BufferCount; ++c) {
+		if (c != m_writeIndex) {
+			addRegions(m_buffers[c].stale, m_written, m_size);
+		}
+	}
+
+	const int published = m_writeIndex;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		addRegions(m_pending, m_written, m_size);
+		std::swap(m_writeIndex, m_readyIndex);
+		m_hasNew = true;
+	}
+
+	m_lastPublished = published;
+	m_written.clear();
+	m_publishedFrames++;
+}
+
+void RenderImageRing::discard()
+{
+	if (m_written.empty()) {
+		return;
+	}
+
+	Buffer &back = m_buffers[m_writeIndex];
+	if (m_lastPublished < 0) {
+		// nothing to restore from, start over from a cleared image
+		allocate(back, m_size);
+	} else {
+		// size could have been changed by the dropped updates, syncBackBuffer reallocates if so
+		m_size = m_buffers[m_lastPublished].size;
+		addRegions(back.stale, m_written, m_size);
+	}
+	m_written.clear();
+}
+
+bool RenderImageRing::consume(RenderImage &dest, std::vector<ImageRegion> &dirty, ImageRegion::Options options)
+{
+	std::vector<ImageRegion> regions;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (m_hasNew) {
+			std::swap(m_readIndex, m_readyIndex);
+			m_hasNew = false;
+			regions.swap(m_pending);
+		}
+	}
+
+	dirty.clear();
+	const Buffer &front = m_buffers[m_readIndex];
+	if (front.pixels.empty()) {
+		return false;
+	}
+
+	if (!dest.pixels || !sameSize(ImageSize{dest.w, dest.h, dest.channels}, front.size)) {
+		FreePtrArr(dest.pixels);
+		dest.pixels = new float[front.pixels.size()];
+		dest.w = front.size.w;
+		dest.h = front.size.h;
+		dest.channels = front.size.channels;
+		regions.assign(1, ImageRegion(front.size));
+	}
+
+	// regions published before a resize could be outside of the image
+	for (const ImageRegion &region : regions) {
+		const int x = std::max(region.x, 0);
+		const int y = std::max(region.y, 0);
+		const int w = std::min(region.x + region.w, front.size.w) - x;
+		const int h = std::min(region.y + region.h, front.size.h) - y;
+		if (w > 0 && h > 0) {
+			dirty.emplace_back(x, y, w, h);
+		}
+	}
+
+	if (dirty.empty()) {
+		return false;
+	}
+
+	m_consumerBytes += copyImageRegions(dest.pixels, front.pixels.data(), front.size, dirty, options);
+	m_consumedFrames++;
+	return true;
+}
+
+RenderImageRing::Stats RenderImageRing::getStats() const
+{
+	Stats stats;
+	stats.publishedFrames = m_publishedFrames;
+	stats.consumedFrames = m_consumedFrames;
+	stats.producerBytes = m_producerBytes;
+	stats.consumerBytes = m_consumerBytes;
+	return stats;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_RENDER_IMAGE_RING_H
+#define VRAY_FOR_BLENDER_RENDER_IMAGE_RING_H
+
+#include "vfb_render_image.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace VRayForBlender {
+
+/// Reusable image buffers passed from one producer (the thread receiving image updates) to one consumer (the draw)
+/// The producer writes in its own back buffer and publishes it by swapping buffer indices, so neither side waits for
+/// the other to copy pixels. The regions changed by each update are tracked, so the consumer copies only what changed
+/// since its previous frame and the producer only brings its reused back buffer up to date where it is stale.
+class RenderImageRing {
+public:
+	/// Producer, consumer and latest published buffer
+	static const int BufferCount = 3;
+
+	/// More regions than this are merged into one region covering the whole image
+	static const int MaxRegions = 64;
+
+	struct Stats {
+		uint64_t publishedFrames; ///< number of publish() calls that had any changes
+		uint64_t consumedFrames;  ///< number of consume() calls that copied anything
+		uint64_t producerBytes;   ///< bytes written by the producer: updates and syncing stale back buffers
+		uint64_t consumerBytes;   ///< bytes copied into the consumer's image
+	};
+
+	RenderImageRing();
+
+	RenderImageRing(const RenderImageRing &) = delete;
+	RenderImageRing & operator=(const RenderImageRing &) = delete;
+
+	/// Producer: set the size of the image, if it changed the back buffer is reallocated and cleared
+	void resize(ImageSize size);
+
+	/// Producer: copy bucket @source of @region's size in the back buffer, flipping it vertically
+	/// same as RenderImage::updateRegion, the image must already have the needed size
+	void updateRegion(const float *source, ImageRegion region, ImageRegion::Options options = ImageRegion::Options::FROM_RENDERER);
+
+	/// Producer: replace the whole image with @source, resizing the back buffer if needed
+	void updateImage(const float *source, ImageSize size);
+
+	/// Producer: get the back buffer to write the whole image of @size directly, e.g. from a decoder
+	/// the pixels are undefined and must all be written before publish()
+	float * writeImage(ImageSize size);
+
+	/// Producer: make all updates since the previous publish visible to the consumer, no-op if nothing changed
+	void publish();
+
+	/// Producer: drop all updates since the previous publish, e.g. when they came from a bad image
+	/// the back buffer is brought back to the last published image before it's written again
+	void discard();
+
+	/// Consumer: copy the regions changed since the previous call from the latest published image into @dest
+	/// @dest must be kept by the caller between calls and is reallocated only when the size changes
+	/// @param dirty - receives the regions of @dest that changed
+	/// @param options - conversions applied to the copied regions
+	/// @return true if anything was copied in @dest
+	bool consume(RenderImage &dest, std::vector<ImageRegion> &dirty, ImageRegion::Options options);
+
+	/// Current size of the producer's image
+	ImageSize getSize() const { return m_size; }
+
+	Stats getStats() const;
+
+private:
+	struct Buffer {
+		Buffer() : size{0, 0, 0} {}
+
+		size_t byteCount() const { return pixels.size() * sizeof(float); }
+
+		std::vector<float>       pixels;
+		ImageSize                size;
+		std::vector<ImageRegion> stale; ///< regions published from other buffers, after this one was last written
+	};
+
+	/// Add @regions to @list, merging them to one region covering the whole @size when there are too many
+	static void addRegions(std::vector<ImageRegion> &list, const std::vector<ImageRegion> &regions, ImageSize size);
+
+	/// Reallocate @buffer to @size with cleared pixels and no stale regions
+	static void allocate(Buffer &buffer, ImageSize size);
+
+	/// Producer: copy the stale regions of the back buffer from the last published buffer
+	void syncBackBuffer();
+
+	Buffer                   m_buffers[BufferCount];
+
+	// Producer only
+	int                      m_writeIndex; ///< index of the back buffer
+	int                      m_lastPublished; ///< index of the buffer published last, -1 before the first publish
+	ImageSize                m_size; ///< size of the image, buffers with other size are reallocated when written
+	std::vector<ImageRegion> m_written; ///< regions changed in the back buffer since the last publish
+
+	// Consumer only
+	int                      m_readIndex; ///< index of the buffer the consumer is reading from
+
+	// Exchanged between producer and consumer, never held while copying pixels
+	std::mutex               m_lock;
+	int                      m_readyIndex; ///< index of the latest published buffer
+	bool                     m_hasNew; ///< true if @m_readyIndex was published after the consumer's last swap
+	std::vector<ImageRegion> m_pending; ///< regions published but not yet consumed
+
+	std::atomic<uint64_t>    m_publishedFrames;
+	std::atomic<uint64_t>    m_consumedFrames;
+	std::atomic<uint64_t>    m_producerBytes;
+	std::atomic<uint64_t>    m_consumerBytes;
+};
+
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_RENDER_IMAGE_RING_H
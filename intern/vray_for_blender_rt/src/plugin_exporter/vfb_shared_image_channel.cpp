@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_shared_image_channel.h"
+
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+using namespace VRayForBlender;
+
+namespace {
+const char     Magic[8] = {'V', 'F', 'B', 'S', 'H', 'I', 'M', 'G'};
+const uint64_t PageSize = 4096;
+/// Slot header is followed by the pixels, at this offset from the start of the slot
+const uint64_t SlotDataOffset = 64;
+}
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "atomics in shared memory must not need a lock");
+
+struct SharedImageChannel::Header {
+	char                  magic[8];
+	uint32_t              version;
+	uint32_t              slotCount;
+	uint64_t              slotSize;   ///< Max bytes of pixels in a slot
+	uint64_t              slotStride; ///< Bytes from one slot to the next, multiple of the page size
+	std::atomic<uint64_t> written;    ///< Number of images written so far, image i is in slot i % slotCount
+};
+
+struct SharedImageChannel::Slot {
+	std::atomic<uint64_t> sequence; ///< 2 * i + 1 while image i is written, 2 * i + 2 once it's complete
+	ImageInfo             info;
+};
+
+static_assert(sizeof(SharedImageChannel::ImageInfo) + sizeof(uint64_t) <= SlotDataOffset, "slot header does not fit");
+
+
+SharedImageChannel::SharedImageChannel()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_isProducer(false)
+    , m_next(0)
+    , m_torn(0)
+    , m_read(0)
+#ifdef _WIN32
+    , m_mapHandle(nullptr)
+#endif
+{}
+
+
+SharedImageChannel::~SharedImageChannel()
+{
+	close();
+}
+
+
+std::string SharedImageChannel::GetChannelName(int port)
+{
+	char name[64];
+#ifdef _WIN32
+	snprintf(name, sizeof(name), "Local\\vfb_images_%d", port);
+#else
+	snprintf(name, sizeof(name), "/vfb_images_%d", port);
+#endif
+	return name;
+}
+
+
+bool SharedImageChannel::map(const std::string &name, bool create, uint64_t size)
+{
+#ifdef _WIN32
+	HANDLE mapHandle = nullptr;
+	if (create) {
+		mapHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		                               static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffff), name.c_str());
+	} else {
+		mapHandle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	}
+	if (!mapHandle) {
+		return false;
+	}
+	void *mem = MapViewOfFile(mapHandle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0);
+	if (!mem) {
+		CloseHandle(mapHandle);
+		return false;
+	}
+	if (!create) {
+		MEMORY_BASIC_INFORMATION info;
+		size = VirtualQuery(mem, &info, sizeof(info)) ? info.RegionSize : 0;
+	}
+	m_mapHandle = mapHandle;
+#else
+	if (create) {
+		// an old channel left by a crashed producer is replaced, a consumer still mapping it keeps the old memory
+		shm_unlink(name.c_str());
+	}
+	const int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY, 0600);
+	if (fd == -1) {
+		return false;
+	}
+	struct stat st;
+	const bool sized = create ? ftruncate(fd, size) == 0 : fstat(fd, &st) == 0;
+	if (!create && sized) {
+		size = st.st_size;
+	}
+	void *mem = sized && size ? mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	// the mapping keeps its own reference to the shared memory
+	::close(fd);
+	if (mem == MAP_FAILED) {
+		if (create) {
+			shm_unlink(name.c_str());
+		}
+		return false;
+	}
+#endif
+	m_data = reinterpret_cast<uint8_t *>(mem);
+	m_size = size;
+	m_name = name;
+	m_isProducer = create;
+	return true;
+}
+
+
+bool SharedImageChannel::create(const std::string &name, uint32_t slotCount, uint64_t slotSize)
+{
+	close();
+	if (slotCount < 2) {
+		return false;
+	}
+
+	const uint64_t slotStride = (SlotDataOffset + slotSize + PageSize - 1) / PageSize * PageSize;
+	if (!map(name, true, PageSize + slotCount * slotStride)) {
+		return false;
+	}
+
+	// new shared memory is zeroed, so all slots have sequence 0 which is never a valid one
+	Header *header = reinterpret_cast<Header *>(m_data);
+	header->version = Version;
+	header->slotCount = slotCount;
+	header->slotSize = slotSize;
+	header->slotStride = slotStride;
+	header->written.store(0, std::memory_order_relaxed);
+	// consumers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, Magic, sizeof(Magic));
+	return true;
+}
+
+
+bool SharedImageChannel::open(const std::string &name)
+{
+	close();
+	if (!map(name, false, 0)) {
+		return false;
+	}
+
+	const Header *header = reinterpret_cast<const Header *>(m_data);
+	bool valid = m_size >= PageSize && memcmp(header->magic, Magic, sizeof(Magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	valid = valid &&
+	        header->version == Version &&
+	        header->slotCount >= 2 &&
+	        header->slotStride % PageSize == 0 &&
+	        header->slotSize <= header->slotStride - SlotDataOffset &&
+	        header->slotStride <= header->slotStride * header->slotCount && // overflow
+	        header->slotCount <= (m_size - PageSize) / header->slotStride;
+
+	if (!valid) {
+		close();
+		return false;
+	}
+
+	m_next = header->written.load(std::memory_order_acquire);
+	return true;
+}
+
+
+void SharedImageChannel::close()
+{
+	if (m_data) {
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapHandle);
+		m_mapHandle = nullptr;
+#else
+		munmap(m_data, m_size);
+		if (m_isProducer) {
+			shm_unlink(m_name.c_str());
+		}
+#endif
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_name.clear();
+	m_isProducer = false;
+	m_next = 0;
+}
+
+
+SharedImageChannel::Slot * SharedImageChannel::getSlot(uint64_t index) const
+{
+	const Header *header = reinterpret_cast<const Header *>(m_data);
+	return reinterpret_cast<Slot *>(m_data + PageSize + (index % header->slotCount) * header->slotStride);
+}
+
+
+bool SharedImageChannel::write(const ImageInfo &info, const void *data)
+{
+	Header *header = reinterpret_cast<Header *>(m_data);
+	if (!m_data || !m_isProducer || info.size > header->slotSize) {
+		return false;
+	}
+
+	const uint64_t index = header->written.load(std::memory_order_relaxed);
+	Slot *slot = getSlot(index);
+
+	slot->sequence.store(2 * index + 1, std::memory_order_relaxed);
+	// the pixels must not be visible before the slot is marked as being written
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->info = info;
+	if (info.size) {
+		memcpy(reinterpret_cast<uint8_t *>(slot) + SlotDataOffset, data, info.size);
+	}
+	slot->sequence.store(2 * index + 2, std::memory_order_release);
+
+	header->written.store(index + 1, std::memory_order_release);
+	return true;
+}
+
+
+bool SharedImageChannel::beginRead(ImageInfo &info, const void *&data, uint64_t &sequence)
+{
+	if (!m_data) {
+		return false;
+	}
+
+	const Header *header = reinterpret_cast<const Header *>(m_data);
+	while (true) {
+		const uint64_t written = header->written.load(std::memory_order_acquire);
+		if (m_next >= written) {
+			return false;
+		}
+
+		// the producer could be writing the slot of image (written - slotCount) right now
+		const uint64_t oldest = written >= header->slotCount ? written - header->slotCount + 1 : 0;
+		if (m_next < oldest) {
+			m_torn += oldest - m_next;
+			m_next = oldest;
+		}
+
+		const Slot *slot = getSlot(m_next);
+		sequence = slot->sequence.load(std::memory_order_acquire);
+		if (sequence == 2 * m_next + 2) {
+			info = slot->info;
+			data = reinterpret_cast<const uint8_t *>(slot) + SlotDataOffset;
+			if (info.size <= header->slotSize) {
+				return true;
+			}
+		}
+
+		++m_torn;
+		++m_next;
+	}
+}
+
+
+bool SharedImageChannel::endRead(uint64_t sequence)
+{
+	// everything read from the slot must be done before checking it was not overwritten meanwhile
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const bool intact = getSlot(m_next)->sequence.load(std::memory_order_relaxed) == sequence;
+	if (intact) {
+		++m_read;
+	}
+	else {
+		++m_torn;
+	}
+	++m_next;
+	return intact;
+}
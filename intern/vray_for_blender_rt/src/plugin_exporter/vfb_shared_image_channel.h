@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_SHARED_IMAGE_CHANNEL_H
+#define VRAY_FOR_BLENDER_SHARED_IMAGE_CHANNEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace VRayForBlender {
+
+/// Ring of image slots in shared memory, written by a render server on the same host and read by the exporter
+/// Images are read straight from the mapping, without going through ZMQ and without intermediate copies.
+/// There is one producer and one consumer. The producer never waits: each slot has a sequence number which is odd
+/// while the slot is written, so the consumer can tell if an image was overwritten while it was reading it.
+class SharedImageChannel {
+public:
+	/// Flags of ImageInfo
+	enum ImageFlags {
+		ImageBucket = 1 << 0, ///< Region of the image at x, y, otherwise the whole image
+		ImageLast   = 1 << 1, ///< Last image of a set, the set can be shown once it's read
+		ImageReady  = 1 << 2, ///< Final image of the set, rendering is done
+	};
+
+	/// Description of one image, the values of channel and imageType are the ones of RenderChannelType and AttrImage::ImageType
+	struct ImageInfo {
+		int32_t  channel;
+		int32_t  imageType;
+		int32_t  x;
+		int32_t  y;
+		int32_t  width;
+		int32_t  height;
+		uint32_t flags;
+		uint32_t reserved;
+		uint64_t size;     ///< Bytes of pixel data
+	};
+
+	static const uint32_t Version = 1;
+
+	SharedImageChannel();
+	~SharedImageChannel();
+
+	SharedImageChannel(const SharedImageChannel &) = delete;
+	SharedImageChannel & operator=(const SharedImageChannel &) = delete;
+
+	/// Name of the shared memory used by the render server listening on @port
+	static std::string GetChannelName(int port);
+
+	/// Producer: create the shared memory @name with @slotCount slots of @slotSize bytes each, replacing an old one
+	/// @return false if the shared memory can't be created
+	bool create(const std::string &name, uint32_t slotCount, uint64_t slotSize);
+
+	/// Consumer: map the shared memory @name created by the producer, images written before this are skipped
+	/// @return false if there is no such shared memory or it's not a valid channel
+	bool open(const std::string &name);
+
+	/// Unmap the shared memory, the producer also removes it's name
+	void close();
+
+	bool good() const { return m_data != nullptr; }
+
+	/// Producer: write an image described by @info with pixels @data in the next slot
+	/// @return false if the image is bigger than a slot
+	bool write(const ImageInfo &info, const void *data);
+
+	/// Consumer: call fn(const ImageInfo &info, const void *data) for each image written since the previous call,
+	/// in the order they were written, @data points in the shared memory and is only valid during the call
+	/// After fn, done(const ImageInfo &info, bool torn) is called, @torn is true if the image was overwritten
+	/// while fn read it, then whatever fn took from @data is not valid, not even @info.
+	/// Images overwritten before they could be read are skipped.
+	/// @return number of images passed to fn, an image overwritten while fn read it is counted in @getTornCount
+	template <typename Fn, typename DoneFn>
+	int read(Fn fn, DoneFn done) {
+		int count = 0;
+		ImageInfo info;
+		const void *data = nullptr;
+		uint64_t sequence = 0;
+		while (beginRead(info, data, sequence)) {
+			fn(info, data);
+			done(info, !endRead(sequence));
+			++count;
+		}
+		return count;
+	}
+
+	/// Consumer: same as read(fn, done) for a caller that doesn't need to know which images were torn
+	template <typename Fn>
+	int read(Fn fn) {
+		return read(fn, [](const ImageInfo &, bool) {});
+	}
+
+	/// Consumer: number of images that were overwritten before or while they were read
+	uint64_t getTornCount() const { return m_torn; }
+
+	/// Consumer: number of images read
+	uint64_t getReadCount() const { return m_read; }
+
+private:
+	struct Header;
+	struct Slot;
+
+	bool    map(const std::string &name, bool create, uint64_t size);
+	Slot  * getSlot(uint64_t index) const;
+	/// Find the next image to read, false if there is none
+	bool    beginRead(ImageInfo &info, const void *&data, uint64_t &sequence);
+	/// Check the image from beginRead was not overwritten and move to the next one
+	/// @return false if the image was overwritten
+	bool    endRead(uint64_t sequence);
+
+	uint8_t    *m_data;
+	uint64_t    m_size;
+	std::string m_name;
+	bool        m_isProducer;
+	uint64_t    m_next; ///< Consumer: index of the next image to read
+	uint64_t    m_torn;
+	uint64_t    m_read;
+#ifdef _WIN32
+	void       *m_mapHandle;
+#endif
+};
+
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_SHARED_IMAGE_CHANNEL_H
@@ -108,9 +108,20 @@ AttrValue DataExporter::exportVRayNodeTexVoxelData(BL::NodeTree &ntree, BL::Node
 						std::string pluginName    = GenPluginName(node, ntree, context);
 						int         interpolation = RNA_enum_get(&texVoxelData, "interpolation");
 
+						// Older add-on versions don't have the sparse export options
+						const bool useSparse = RNA_struct_find_property(&texVoxelData, "use_sparse")
+						                       ? RNA_boolean_get(&texVoxelData, "use_sparse")
+						                       : true;
+						const bool quantize  = RNA_struct_find_property(&texVoxelData, "quantize")
+						                       ? RNA_boolean_get(&texVoxelData, "quantize")
+						                       : false;
+
 						if (m_settings.export_fluids) {
 							TexVoxelData texVoxelData((Object*)domainOb.ptr.data);
 							texVoxelData.initName(pluginName);
+							texVoxelData.setSparse(useSparse);
+							texVoxelData.setQuantize(quantize);
+							texVoxelData.setThreadManager(m_thread_manager);
 							texVoxelData.init((SmokeModifierData*)smokeMod.ptr.data);
 							texVoxelData.setInterpolation(interpolation);
 
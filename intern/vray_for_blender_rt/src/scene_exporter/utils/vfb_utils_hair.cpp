@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_utils_hair.h"
+
+extern "C" {
+#include "BKE_particle.h"
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+namespace {
+
+/// Same as mul_m4_v3 with @co as input and @out as output
+inline void transformPoint(const float tm[4][4], const float co[3], float out[3])
+{
+	const float x = co[0];
+	const float y = co[1];
+	const float z = co[2];
+	out[0] = x * tm[0][0] + y * tm[1][0] + tm[2][0] * z + tm[3][0];
+	out[1] = x * tm[0][1] + y * tm[1][1] + tm[2][1] * z + tm[3][1];
+	out[2] = x * tm[0][2] + y * tm[1][2] + tm[2][2] * z + tm[3][2];
+}
+
+/// Destination of the filled data, the arrays are already allocated for all strands
+struct StrandArrays {
+	const int  *numVertices;
+	AttrVector *vertices;
+	float      *widths;
+	AttrVector *strandUVW; ///< null if UVs are not exported
+};
+
+/// Fill strands [@first, @last) starting from vertex @vertexOffset and hash what was written
+void fillChunk(ParticleCacheKey * const *cache, int first, int last, int vertexOffset, const float tm[4][4],
+               float width, bool widthFade, const Hair::StrandUVFn &uv, const StrandArrays &arrays, Hair::StrandsHash &hash)
+{
+	int vertex = vertexOffset;
+	for (int p = first; p < last; ++p) {
+		const ParticleCacheKey *key = cache[p];
+		const int steps = arrays.numVertices[p];
+
+		float fadeWidth = width;
+		const float fadeStep = width / (steps + 1);
+
+		for (int s = 0; s < steps; ++s, ++key, ++vertex) {
+			transformPoint(tm, key->co, &arrays.vertices[vertex].x);
+			arrays.widths[vertex] = widthFade ? std::max(1e-6f, fadeWidth) : width;
+			fadeWidth -= fadeStep;
+		}
+
+		if (arrays.strandUVW && steps > 0) {
+			uv(p, &arrays.strandUVW[p].x);
+		}
+	}
+
+	// the chunk was just written, so hashing it now reads from cache instead of going over the arrays again later
+	hash.combine(arrays.numVertices + first, (last - first) * sizeof(int));
+	hash.combine(arrays.vertices + vertexOffset, (vertex - vertexOffset) * sizeof(AttrVector));
+	hash.combine(arrays.widths + vertexOffset, (vertex - vertexOffset) * sizeof(float));
+	if (arrays.strandUVW) {
+		hash.combine(arrays.strandUVW + first, (last - first) * sizeof(AttrVector));
+	}
+}
+
+} // namespace
+
+
+void Hair::StrandsHash::combine(const void *data, int bytes)
+{
+	u_int64_t dataHash[2];
+	MurmurHash3_x64_128(data, bytes, 42, dataHash);
+	// same mixing as the plugin manager's content hash, each half separately so none of the 128 bits are lost
+	hash[0] ^= dataHash[0] + 0x9e3779b97f4a7c15ULL + (hash[0] << 6) + (hash[0] >> 2);
+	hash[1] ^= dataHash[1] + 0x9e3779b97f4a7c15ULL + (hash[1] << 6) + (hash[1] >> 2);
+}
+
+Hair::StrandsHash Hair::FillChildStrands(ParticleCacheKey * const *cache, int count, const float tm[4][4], float width, bool widthFade,
+                                         const StrandUVFn &uv, ThreadManager::Ptr threadManager,
+                                         AttrListInt &numVertices, AttrListVector &vertices,
+                                         AttrListFloat &widths, AttrListVector &strandUVW)
+{
+	const int chunks = (count + HairChunkStrands - 1) / HairChunkStrands;
+	const int tasks = count < HairParallelStrands ? 1 : chunks;
+
+	// vertex count of each strand and the first vertex of each chunk, so chunks can be filled independently
+	numVertices.resize(count);
+	int *strandVertices = *numVertices;
+	std::vector<int> chunkOffsets(chunks + 1, 0);
+	{
+		std::atomic<int> nextChunk(0);
+		runSharedWork(threadManager, tasks, [&]() {
+			for (int c = nextChunk++; c < chunks; c = nextChunk++) {
+				const int last = std::min(count, (c + 1) * HairChunkStrands);
+				int chunkVertices = 0;
+				for (int p = c * HairChunkStrands; p < last; ++p) {
+					// segments is -1 when current particle is virtual
+					strandVertices[p] = std::max(0, cache[p]->segments);
+					chunkVertices += strandVertices[p];
+				}
+				chunkOffsets[c + 1] = chunkVertices;
+			}
+		});
+	}
+	for (int c = 0; c < chunks; ++c) {
+		chunkOffsets[c + 1] += chunkOffsets[c];
+	}
+
+	vertices.resize(chunkOffsets[chunks]);
+	widths.resize(chunkOffsets[chunks]);
+	if (uv) {
+		strandUVW.resize(count);
+		memset(*strandUVW, 0, count * sizeof(AttrVector));
+	}
+
+	const StrandArrays arrays = {strandVertices, *vertices, *widths, uv ? *strandUVW : nullptr};
+	std::vector<StrandsHash> chunkHashes(chunks);
+	{
+		std::atomic<int> nextChunk(0);
+		runSharedWork(threadManager, tasks, [&]() {
+			for (int c = nextChunk++; c < chunks; c = nextChunk++) {
+				const int last = std::min(count, (c + 1) * HairChunkStrands);
+				fillChunk(cache, c * HairChunkStrands, last, chunkOffsets[c], tm, width, widthFade, uv, arrays, chunkHashes[c]);
+			}
+		});
+	}
+
+	StrandsHash hash;
+	hash.combine(&count, sizeof(count));
+	if (chunks) {
+		hash.combine(chunkHashes.data(), chunks * sizeof(StrandsHash));
+	}
+	return hash;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_UTILS_HAIR_H
+#define VRAY_FOR_BLENDER_UTILS_HAIR_H
+
+#include "base_types.h"
+#include "utils/cgr_hash.h"
+#include "vfb_thread_manager.h"
+
+#include <functional>
+
+struct ParticleCacheKey;
+
+namespace VRayForBlender {
+namespace Hair {
+
+/// 128 bit hash of filled strand data, it does not depend on the number of threads used to fill it
+struct StrandsHash {
+	StrandsHash() {
+		hash[0] = hash[1] = 0;
+	}
+
+	bool operator==(const StrandsHash &other) const {
+		return hash[0] == other.hash[0] && hash[1] == other.hash[1];
+	}
+
+	bool operator!=(const StrandsHash &other) const {
+		return !(*this == other);
+	}
+
+	/// Mix @bytes of @data into the hash
+	void combine(const void *data, int bytes);
+
+	u_int64_t hash[2];
+};
+
+/// Number of strands filled by a thread at once, also the granularity of the hash
+const int HairChunkStrands = 1 << 12;
+
+/// Strand caches with less strands than this are always filled on the calling thread
+const int HairParallelStrands = 1 << 14;
+
+/// Get the UV coordinates of child strand @strand in @uvw
+typedef std::function<void(int strand, float uvw[3])> StrandUVFn;
+
+/// Fill GeomMayaHair data for the @count child strands of a particle system's @cache
+/// Each strand gets the positions of it's first @segments cache keys transformed by @tm and the same number of widths,
+/// which are @width or fading from @width towards 0 along the strand with @widthFade
+/// @uv - if set, fills @strandUVW with one item for each strand, strands without vertices get zero UVs
+/// @threadManager - the calling thread and free workers of @threadManager fill and hash whole chunks of HairChunkStrands strands
+/// @return hash of all the filled data, combined from the chunk hashes in strand order
+StrandsHash FillChildStrands(ParticleCacheKey * const *cache, int count, const float tm[4][4], float width, bool widthFade,
+                             const StrandUVFn &uv, ThreadManager::Ptr threadManager,
+                             VRayBaseTypes::AttrListInt &numVertices, VRayBaseTypes::AttrListVector &vertices,
+                             VRayBaseTypes::AttrListFloat &widths, VRayBaseTypes::AttrListVector &strandUVW);
+
+} // namespace Hair
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_UTILS_HAIR_H
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_utils_map_channels.h"
+
+#include "DNA_meshdata_types.h"
+
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+namespace {
+
+uint32_t floatKey(float value)
+{
+	// -0.0 and 0.0 compare equal so they must hash the same
+	if (value == 0.f) {
+		value = 0.f;
+	}
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+uint32_t hashVertex(const AttrVector &v)
+{
+	uint32_t hash = floatKey(v.x) * 0x9E3779B1u;
+	hash = (hash ^ floatKey(v.y)) * 0x85EBCA77u;
+	hash = (hash ^ floatKey(v.z)) * 0xC2B2AE3Du;
+	// murmur3 finalizer so all bits affect the table slot
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+bool equalVertex(const AttrVector &left, const AttrVector &right)
+{
+	return left.x == right.x && left.y == right.y && left.z == right.z;
+}
+
+/// Value of @corner of @face from @layer
+AttrVector layerValue(const Mesh::MapChannelLayer &layer, int face, int corner)
+{
+	AttrVector value;
+	if (layer.uv) {
+		value.x = layer.uv[face].uv[corner][0];
+		value.y = layer.uv[face].uv[corner][1];
+		value.z = 0.f;
+	} else {
+		// same channel order as MeshColor.color1 in RNA
+		const MCol &col = layer.color[face * 4 + corner];
+		value.x = col.b / 255.f;
+		value.y = col.g / 255.f;
+		value.z = col.r / 255.f;
+	}
+	return value;
+}
+
+void fillLayer(const MFace *faces, int numFaces, int numCorners, const Mesh::MapChannelLayer &layer, bool merge, AttrMapChannels::AttrMapChannel &channel)
+{
+	channel.vertices.resize(numCorners);
+	channel.faces.resize(numCorners);
+
+	AttrVector *vertices = *channel.vertices;
+	int corner = 0;
+	for (int c = 0; c < numFaces; ++c) {
+		const AttrVector v0 = layerValue(layer, c, 0);
+		const AttrVector v2 = layerValue(layer, c, 2);
+
+		vertices[corner++] = v0;
+		vertices[corner++] = layerValue(layer, c, 1);
+		vertices[corner++] = v2;
+
+		if (faces[c].v4) {
+			vertices[corner++] = v0;
+			vertices[corner++] = v2;
+			vertices[corner++] = layerValue(layer, c, 3);
+		}
+	}
+
+	int *indices = *channel.faces;
+	if (merge) {
+		channel.vertices.resize(Mesh::MergeChannelVertices(vertices, numCorners, indices));
+	} else {
+		for (int c = 0; c < numCorners; ++c) {
+			indices[c] = c;
+		}
+	}
+}
+
+}
+
+int Mesh::MergeChannelVertices(AttrVector *vertices, int count, int *indices)
+{
+	// open addressing table with at most 50% load, holding indices of unique vertices
+	uint32_t tableSize = 16;
+	while (tableSize < 2 * static_cast<uint32_t>(count)) {
+		tableSize *= 2;
+	}
+	const uint32_t mask = tableSize - 1;
+	std::vector<int> table(tableSize, -1);
+
+	int unique = 0;
+	for (int c = 0; c < count; ++c) {
+		const AttrVector vertex = vertices[c];
+		uint32_t slot = hashVertex(vertex) & mask;
+		while (table[slot] != -1 && !equalVertex(vertices[table[slot]], vertex)) {
+			slot = (slot + 1) & mask;
+		}
+
+		if (table[slot] == -1) {
+			// unique vertices are compacted at the front, @unique is never past @c
+			table[slot] = unique;
+			vertices[unique++] = vertex;
+		}
+		indices[c] = table[slot];
+	}
+
+	return unique;
+}
+
+void Mesh::FillMapChannels(const MFace *faces, int numFaces, const std::vector<MapChannelLayer> &layers, bool merge,
+                           int threadCount, AttrListString &names, AttrMapChannels &channels)
+{
+	if (layers.empty() || !numFaces) {
+		return;
+	}
+
+	int numCorners = 0;
+	for (int c = 0; c < numFaces; ++c) {
+		numCorners += faces[c].v4 ? 6 : 3;
+	}
+
+	// create all channels first, so each thread only writes to the channels it took
+	std::vector<std::pair<const MapChannelLayer*, AttrMapChannels::AttrMapChannel*>> work;
+	for (const MapChannelLayer &layer : layers) {
+		if (channels.data.find(layer.name) != channels.data.end()) {
+			continue;
+		}
+		AttrMapChannels::AttrMapChannel &channel = channels.data[layer.name];
+		channel.name = layer.name;
+		work.push_back(std::make_pair(&layer, &channel));
+	}
+
+	std::atomic<int> nextLayer(0);
+	auto fillLayers = [&]() {
+		for (int c = nextLayer++; c < work.size(); c = nextLayer++) {
+			fillLayer(faces, numFaces, numCorners, *work[c].first, merge, *work[c].second);
+		}
+	};
+
+	const int extraThreads = numCorners < MapChannelsParallelCorners ? 0 : std::min<int>(threadCount, work.size()) - 1;
+	std::vector<std::thread> threads;
+	for (int c = 0; c < extraThreads; ++c) {
+		threads.emplace_back(fillLayers);
+	}
+	fillLayers();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	names.resize(channels.data.size());
+	int c = 0;
+	for (const auto &channel : channels.data) {
+		(*names)[c++] = channel.second.name;
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_UTILS_MAP_CHANNELS_H
+#define VRAY_FOR_BLENDER_UTILS_MAP_CHANNELS_H
+
+#include "base_types.h"
+
+#include <string>
+#include <vector>
+
+struct MFace;
+struct MTFace;
+struct MCol;
+
+namespace VRayForBlender {
+namespace Mesh {
+
+/// One UV or vertex color layer of tessellated faces, only one of @uv and @color is set
+struct MapChannelLayer {
+	MapChannelLayer(const std::string &name, const MTFace *uv, const MCol *color)
+	    : name(name)
+	    , uv(uv)
+	    , color(color)
+	{}
+
+	std::string   name;
+	const MTFace *uv;    ///< One item for each face
+	const MCol   *color; ///< Four items for each face
+};
+
+/// Fill map channels for all @layers of the @numFaces tessellated @faces
+/// Quads are split in (0 1 2) and (0 2 3) triangles, the same way FillMeshData splits the faces
+/// @merge - merge equal vertices in each channel, otherwise each face corner gets it's own vertex
+/// @threadCount - max number of threads filling layers in parallel, 1 to fill all of them on the calling thread
+/// NOTE: Separate threads are used instead of the exporter's ThreadManager, because this is called with the Blender
+///       lock held and waiting on a TaskGroup could pick up another object's task that needs the same lock
+void FillMapChannels(const MFace *faces, int numFaces, const std::vector<MapChannelLayer> &layers, bool merge,
+                     int threadCount, VRayBaseTypes::AttrListString &names, VRayBaseTypes::AttrMapChannels &channels);
+
+/// Layers with less face corners than this are always filled on the calling thread
+const int MapChannelsParallelCorners = 1 << 14;
+
+/// Merge equal vertices of the first @count @vertices in place, keeping the order of their first occurrence
+/// @indices - filled with the merged index of each of the original vertices, must have @count items
+/// @return the number of unique vertices, which are moved to the begining of @vertices
+int MergeChannelVertices(VRayBaseTypes::AttrVector *vertices, int count, int *indices);
+
+} // namespace Mesh
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_UTILS_MAP_CHANNELS_H
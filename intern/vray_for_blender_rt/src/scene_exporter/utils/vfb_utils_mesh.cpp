@@ -17,291 +17,21 @@
  */
 
 #include "vfb_utils_mesh.h"
+#include "vfb_utils_map_channels.h"
+#include "vfb_utils_mesh_topology.h"
 #include "vfb_utils_blender.h"
 #include "vfb_utils_math.h"
 #include "vfb_typedefs.h"
 
-#include "utils/cgr_hash.h"
+#include "DNA_mesh_types.h"
+#include "DNA_customdata_types.h"
 
-using namespace VRayForBlender;
-
-struct ChanVertex {
-	ChanVertex():
-	    v(),
-	    index(0)
-	{}
-
-	template <int size>
-	ChanVertex(const BL::Array<float, size> &data)
-		: v()
-	    , index(0)
-	{
-		float * dest = &v.x;
-		for (int c = 0; c < std::min(3, size); c++) {
-			dest[c] = data[c];
-		}
-	}
-
-	bool operator == (const ChanVertex &other) const {
-		return (v.x == other.v.x) && (v.y == other.v.y) && (v.z == other.v.z);
-	}
-
-	AttrVector   v;
-	mutable int  index;
-};
-
-struct MapVertexHash {
-	std::size_t operator () (const ChanVertex &mv) const {
-		MHash hash;
-		MurmurHash3_x86_32(&mv.v, sizeof(AttrVector), 42, &hash);
-		return (std::size_t)hash;
-	}
-};
-
-typedef HashSet<ChanVertex, MapVertexHash>  ChanSet;
-typedef HashMap<std::string, ChanSet>       ChanMap;
-
-
-struct MapChannelBase {
-	MapChannelBase(BL::Mesh mesh, int numFaces):
-	    mesh(mesh),
-	    num_faces(numFaces)
-	{
-		num_channels = mesh.tessface_uv_textures.length() +
-		               mesh.tessface_vertex_colors.length();
-	}
-
-	virtual void init()=0;
-	virtual void init_attributes(AttrListString &map_channels_names, AttrMapChannels &map_channels)=0;
-	virtual bool needProcessFaces() const { return false; }
-	virtual int  get_map_face_vertex_index(const std::string&, const ChanVertex&) { return -1; }
-
-	int numChannels() const {
-		return num_channels;
-	}
-
-protected:
-	BL::Mesh  mesh;
-	int       num_channels;
-	int       num_faces;
-
-};
-
-
-struct MapChannelRaw:
-        MapChannelBase
-{
-	MapChannelRaw(BL::Mesh mesh, int numFaces):
-	    MapChannelBase(mesh, numFaces)
-	{}
-
-	virtual void init() override {}
-	virtual void init_attributes(AttrListString &map_channels_names, AttrMapChannels &map_channels) override {
-
-		if (num_channels) {
-			// Init storage
-			//
-			BL::Mesh::tessface_uv_textures_iterator uvIt;
-			for(mesh.tessface_uv_textures.begin(uvIt); uvIt != mesh.tessface_uv_textures.end(); ++uvIt) {
-				BL::MeshTextureFaceLayer  uvLayer(*uvIt);
-				const std::string &uvLayerName = uvLayer.name();
-
-				// Setup channel data storage
-				AttrMapChannels::AttrMapChannel &map_channel = map_channels.data[uvLayerName];
-				map_channel.name = uvLayerName;
-				map_channel.vertices.resize(num_faces * 3);
-				map_channel.faces.resize(num_faces * 3);
-			}
-
-			BL::Mesh::tessface_vertex_colors_iterator colIt;
-			for(mesh.tessface_vertex_colors.begin(colIt); colIt != mesh.tessface_vertex_colors.end(); ++colIt) {
-				BL::MeshColorLayer  colLayer(*colIt);
-				const std::string &colLayerName = colLayer.name();
-
-				// Setup channel data storage
-				AttrMapChannels::AttrMapChannel &map_channel = map_channels.data[colLayerName];
-				map_channel.name = colLayerName;
-				map_channel.vertices.resize(num_faces * 3);
-				map_channel.faces.resize(num_faces * 3);
-			}
-
-			// Fill data
-			//
-			BL::Mesh::tessfaces_iterator faceIt;
-			int faceIdx = 0;
-			int chanVertIndex = 0;
-			for (mesh.tessfaces.begin(faceIt); faceIt != mesh.tessfaces.end(); ++faceIt, ++faceIdx) {
-				BlFace faceVerts = faceIt->vertices_raw();
-
-				BL::Mesh::tessface_uv_textures_iterator uvIt;
-				for(mesh.tessface_uv_textures.begin(uvIt); uvIt != mesh.tessface_uv_textures.end(); ++uvIt) {
-					BL::MeshTextureFaceLayer  uvLayer(*uvIt);
-					const std::string &uvLayerName = uvLayer.name();
-
-					AttrMapChannels::AttrMapChannel &uv_channel = map_channels.data[uvLayerName];
-
-					AttrVector v0(uvLayer.data[faceIdx].uv1());
-					AttrVector v1(uvLayer.data[faceIdx].uv2());
-					AttrVector v2(uvLayer.data[faceIdx].uv3());
-					v0.z = v1.z = v2.z = 0.f;
-
-					(*uv_channel.vertices)[chanVertIndex+0] = v0;
-					(*uv_channel.vertices)[chanVertIndex+1] = v1;
-					(*uv_channel.vertices)[chanVertIndex+2] = v2;
-
-					if (faceVerts[3]) {
-						AttrVector v3(uvLayer.data[faceIdx].uv4());
-						v3.z = 0.f;
-
-						(*uv_channel.vertices)[chanVertIndex+3] = v0;
-						(*uv_channel.vertices)[chanVertIndex+4] = v2;
-						(*uv_channel.vertices)[chanVertIndex+5] = v3;
-					}
-				}
-
-				BL::Mesh::tessface_vertex_colors_iterator colIt;
-				for(mesh.tessface_vertex_colors.begin(colIt); colIt != mesh.tessface_vertex_colors.end(); ++colIt) {
-					BL::MeshColorLayer  colLayer(*colIt);
-					const std::string &colLayerName = colLayer.name();
-
-					AttrMapChannels::AttrMapChannel &col_channel = map_channels.data[colLayerName];
-
-					const AttrVector v0(colLayer.data[faceIdx].color1());
-					const AttrVector v1(colLayer.data[faceIdx].color2());
-					const AttrVector v2(colLayer.data[faceIdx].color3());
-
-					(*col_channel.vertices)[chanVertIndex+0] = v0;
-					(*col_channel.vertices)[chanVertIndex+1] = v1;
-					(*col_channel.vertices)[chanVertIndex+2] = v2;
-
-					if (faceVerts[3]) {
-						const AttrVector v3(colLayer.data[faceIdx].color4());
-
-						(*col_channel.vertices)[chanVertIndex+3] = v0;
-						(*col_channel.vertices)[chanVertIndex+4] = v2;
-						(*col_channel.vertices)[chanVertIndex+5] = v3;
-					}
-				}
-
-				chanVertIndex += faceVerts[3] ? 6 : 3;
-			}
-
-			// Setup face data
-			for (auto &mcIt : map_channels.data) {
-				for (int i = 0; i < mcIt.second.faces.getData()->size(); ++i) {
-					(*mcIt.second.faces)[i] = i;
-				}
-			}
-
-			// Store channel names
-			map_channels_names.resize(num_channels);
-			int i = 0;
-			for (const auto &mcIt : map_channels.data) {
-				(*map_channels_names)[i++] = mcIt.second.name;
-			}
-		}
-	}
-};
-
-
-struct MapChannelMerge:
-        MapChannelBase
-{
-	MapChannelMerge(BL::Mesh mesh, int numFaces):
-	    MapChannelBase(mesh, numFaces)
-	{}
-
-	virtual void init() override {
-		if (num_channels) {
-
-			BL::Mesh::tessfaces_iterator faceIt;
-			int faceIdx = 0;
-			for (mesh.tessfaces.begin(faceIt); faceIt != mesh.tessfaces.end(); ++faceIt, ++faceIdx) {
-				BlFace faceVerts = faceIt->vertices_raw();
-
-				BL::Mesh::tessface_uv_textures_iterator uvIt;
-				for(mesh.tessface_uv_textures.begin(uvIt); uvIt != mesh.tessface_uv_textures.end(); ++uvIt) {
-					BL::MeshTextureFaceLayer uvLayer(*uvIt);
-
-					const std::string &layerName = uvLayer.name();
-
-					ChanSet &uvSet = chan_data[layerName];
-
-					uvSet.insert(ChanVertex(uvLayer.data[faceIdx].uv1()));
-					uvSet.insert(ChanVertex(uvLayer.data[faceIdx].uv2()));
-					uvSet.insert(ChanVertex(uvLayer.data[faceIdx].uv3()));
-
-					if (faceVerts[3]) {
-						uvSet.insert(ChanVertex(uvLayer.data[faceIdx].uv4()));
-					}
-				}
-
-				BL::Mesh::tessface_vertex_colors_iterator colIt;
-				for(mesh.tessface_vertex_colors.begin(colIt); colIt != mesh.tessface_vertex_colors.end(); ++colIt) {
-					BL::MeshColorLayer colLayer(*colIt);
-
-					const std::string &layerName = colLayer.name();
-
-					ChanSet &colSet = chan_data[layerName];
-
-					colSet.insert(ChanVertex(colLayer.data[faceIdx].color1()));
-					colSet.insert(ChanVertex(colLayer.data[faceIdx].color2()));
-					colSet.insert(ChanVertex(colLayer.data[faceIdx].color3()));
-
-					if (faceVerts[3]) {
-						colSet.insert(ChanVertex(colLayer.data[faceIdx].color4()));
-					}
-				}
-			}
-		}
-	}
-
-	virtual void init_attributes(AttrListString &map_channels_names, AttrMapChannels &map_channels) override {
-		if (num_channels) {
-			for (ChanMap::iterator setsIt = chan_data.begin(); setsIt != chan_data.end(); ++setsIt) {
-				const std::string &chan_name = setsIt->first;
-				ChanSet           &chan_data = setsIt->second;
-
-				// Setup channel data storage
-				AttrMapChannels::AttrMapChannel &map_channel = map_channels.data[chan_name];
-				map_channel.name = chan_name;
-				map_channel.vertices.resize(chan_data.size());
-				map_channel.faces.resize(num_faces * 3);
-
-				int f = 0;
-				for (ChanSet::iterator setIt = chan_data.begin(); setIt != chan_data.end(); ++setIt, ++f) {
-					const ChanVertex &map_vertex = *setIt;
-
-					// Set vertex index for lookup from faces
-					map_vertex.index = f;
-
-					// Store channel vertex
-					(*map_channel.vertices)[f] = map_vertex.v;
-				}
-			}
-
-			// Store channel names
-			map_channels_names.resize(num_channels);
-			int i = 0;
-			for (const auto &mcIt : map_channels.data) {
-				(*map_channels_names)[i++] = mcIt.second.name;
-			}
-		}
-	}
-
-	virtual bool needProcessFaces() const override { return true; }
-
-	virtual int get_map_face_vertex_index(const std::string &layerName, const ChanVertex &cv) override {
-		return chan_data[layerName].find(cv)->index;
-	}
-
-private:
-	ChanMap  chan_data;
-
-};
+#include <thread>
 
+using namespace VRayForBlender;
 
-int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::Object ob, VRayForBlender::Mesh::ExportOptions options, PluginDesc &pluginDesc)
+int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::Object ob, VRayForBlender::Mesh::ExportOptions options, PluginDesc &pluginDesc,
+                                       TopologyCache *topologyCache)
 {
 	int err = 0;
 
@@ -381,27 +111,48 @@ int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::
 	}
 
 	AttrListVector  vertices(mesh.vertices.length());
-	AttrListInt     faces(numFaces * 3);
 	AttrListVector  normals(numFaces * 3);
-	AttrListInt     faceNormals(numFaces * 3);
-	AttrListInt     face_mtlIDs(numFaces);
-	AttrListInt     edge_visibility(numFaces / 10 + ((numFaces % 10 > 0) ? 1 : 0));
-
-	AttrListString  map_channels_names;
-	AttrMapChannels map_channels;
-
-	MapChannelBase *channels_data = nullptr;
-	MapChannelMerge mergeMapChannel(mesh, numFaces);
-	MapChannelRaw rawMapChannel(mesh, numFaces);
-	if (options.merge_channel_vertices) {
-		channels_data = &mergeMapChannel;
-	} else {
-		channels_data = &rawMapChannel;
+
+	// map channels are read directly from the tessface custom data layers
+	std::vector<VRayForBlender::Mesh::MapChannelLayer> channelLayers;
+	BL::Mesh::tessface_uv_textures_iterator uvIt;
+	for (mesh.tessface_uv_textures.begin(uvIt); uvIt != mesh.tessface_uv_textures.end(); ++uvIt) {
+		const CustomDataLayer *layer = reinterpret_cast<const CustomDataLayer*>(uvIt->ptr.data);
+		channelLayers.emplace_back(uvIt->name(), reinterpret_cast<const MTFace*>(layer->data), nullptr);
+	}
+	BL::Mesh::tessface_vertex_colors_iterator colIt;
+	for (mesh.tessface_vertex_colors.begin(colIt); colIt != mesh.tessface_vertex_colors.end(); ++colIt) {
+		const CustomDataLayer *layer = reinterpret_cast<const CustomDataLayer*>(colIt->ptr.data);
+		channelLayers.emplace_back(colIt->name(), nullptr, reinterpret_cast<const MCol*>(layer->data));
 	}
-	channels_data->init();
-	channels_data->init_attributes(map_channels_names, map_channels);
 
-	memset((*edge_visibility), 0, edge_visibility.getBytesCount());
+	const ::Mesh *meshData = reinterpret_cast<const ::Mesh*>(mesh.ptr.data);
+
+	// when only the vertices moved, as with armature deformation, the topology arrays of the previous export are reused
+	// and only vertices and normals are filled
+	MeshTopology topology;
+	bool reuseTopology = false;
+	if (topologyCache) {
+		topology.key = GetTopologyKey(mesh.vertices.length(), meshData->mface, meshData->totface, channelLayers, options.merge_channel_vertices);
+		reuseTopology = topologyCache->find(pluginDesc.pluginName, topology.key, topology);
+	}
+
+	AttrListInt &faces           = topology.faces;
+	AttrListInt &faceNormals     = topology.faceNormals;
+	AttrListInt &face_mtlIDs     = topology.face_mtlIDs;
+	AttrListInt &edge_visibility = topology.edge_visibility;
+
+	if (!reuseTopology) {
+		faces = AttrListInt(numFaces * 3);
+		faceNormals = AttrListInt(numFaces * 3);
+		face_mtlIDs = AttrListInt(numFaces);
+		edge_visibility = AttrListInt(numFaces / 10 + ((numFaces % 10 > 0) ? 1 : 0));
+
+		VRayForBlender::Mesh::FillMapChannels(meshData->mface, meshData->totface, channelLayers, options.merge_channel_vertices,
+		                                      std::thread::hardware_concurrency(), topology.map_channels_names, topology.map_channels);
+
+		memset((*edge_visibility), 0, edge_visibility.getBytesCount());
+	}
 
 	BL::Mesh::vertices_iterator vertIt;
 	int vertexIndex = 0;
@@ -416,9 +167,7 @@ int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::
 	int faceVertIndex = 0;
 	int faceCount     = 0;
 	int edgeVisIndex  = 0;
-	int chanVertIndex = 0;
-	int faceIdx       = 0;
-	for (mesh.tessfaces.begin(faceIt); faceIt != mesh.tessfaces.end(); ++faceIt, ++faceIdx) {
+	for (mesh.tessfaces.begin(faceIt); faceIt != mesh.tessfaces.end(); ++faceIt) {
 		BlFace faceVerts = faceIt->vertices_raw();
 
 		// Normals
@@ -460,22 +209,26 @@ int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::
 			}
 		}
 
-		// Store normals / face normals
-		(*faceNormals)[faceNormIndex++] = normalIndex;
+		// Store normals
 		(*normals)[normalIndex++] = n0;
-		(*faceNormals)[faceNormIndex++] = normalIndex;
 		(*normals)[normalIndex++] = n1;
-		(*faceNormals)[faceNormIndex++] = normalIndex;
 		(*normals)[normalIndex++] = n2;
 		if (faceVerts[3]) {
-			(*faceNormals)[faceNormIndex++] = normalIndex;
 			(*normals)[normalIndex++] = n0;
-			(*faceNormals)[faceNormIndex++] = normalIndex;
 			(*normals)[normalIndex++] = n2;
-			(*faceNormals)[faceNormIndex++] = normalIndex;
 			(*normals)[normalIndex++] = n3;
 		}
 
+		if (reuseTopology) {
+			continue;
+		}
+
+		// Store face normals, each face corner has it's own normal
+		const int faceNormalCount = faceVerts[3] ? 6 : 3;
+		for (int c = 0; c < faceNormalCount; ++c, ++faceNormIndex) {
+			(*faceNormals)[faceNormIndex] = faceNormIndex;
+		}
+
 		// Material ID
 		const int matID = faceIt->material_index() + 1;
 
@@ -505,67 +258,14 @@ int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::
 			(*edge_visibility)[edgeVisIndex/10] |= (7 << ((edgeVisIndex%10)*3));
 			edgeVisIndex++;
 		}
-
-		// Store UV / vertex colors
-		if (channels_data->numChannels() && channels_data->needProcessFaces()) {
-			int channel_vert_index = chanVertIndex;
-
-			BL::Mesh::tessface_uv_textures_iterator uvIt;
-			for (mesh.tessface_uv_textures.begin(uvIt); uvIt != mesh.tessface_uv_textures.end(); ++uvIt) {
-				BL::MeshTextureFaceLayer uvLayer(*uvIt);
-
-				const std::string &layerName = uvLayer.name();
-
-				AttrListInt &uvData = map_channels.data[layerName].faces;
-
-				const int v0 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(uvLayer.data[faceIdx].uv1()));
-				const int v1 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(uvLayer.data[faceIdx].uv2()));
-				const int v2 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(uvLayer.data[faceIdx].uv3()));
-
-				(*uvData)[channel_vert_index+0] = v0;
-				(*uvData)[channel_vert_index+1] = v1;
-				(*uvData)[channel_vert_index+2] = v2;
-
-				if (faceVerts[3]) {
-					const int v3 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(uvLayer.data[faceIdx].uv4()));
-
-					(*uvData)[channel_vert_index+3] = v0;
-					(*uvData)[channel_vert_index+4] = v2;
-					(*uvData)[channel_vert_index+5] = v3;
-				}
-			}
-
-			BL::Mesh::tessface_vertex_colors_iterator colIt;
-			for (mesh.tessface_vertex_colors.begin(colIt); colIt != mesh.tessface_vertex_colors.end(); ++colIt) {
-				BL::MeshColorLayer colLayer(*colIt);
-
-				const std::string &layerName = colLayer.name();
-
-				AttrListInt &colData = map_channels.data[layerName].faces;
-
-				const int v0 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(colLayer.data[faceIdx].color1()));
-				const int v1 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(colLayer.data[faceIdx].color2()));
-				const int v2 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(colLayer.data[faceIdx].color3()));
-
-				(*colData)[channel_vert_index+0] = v0;
-				(*colData)[channel_vert_index+1] = v1;
-				(*colData)[channel_vert_index+2] = v2;
-
-				if (faceVerts[3]) {
-					const int v3 = channels_data->get_map_face_vertex_index(layerName, ChanVertex(colLayer.data[faceIdx].color4()));
-
-					(*colData)[channel_vert_index+3] = v0;
-					(*colData)[channel_vert_index+4] = v2;
-					(*colData)[channel_vert_index+5] = v3;
-				}
-			}
-
-			chanVertIndex += faceVerts[3] ? 6 : 3;
-		}
 	}
 
 	data.meshes.remove(mesh, false, false, false);
 
+	if (topologyCache && !reuseTopology) {
+		topologyCache->store(pluginDesc.pluginName, topology);
+	}
+
 	pluginDesc.add("vertices", vertices);
 	pluginDesc.add("faces", faces);
 	pluginDesc.add("normals", normals);
@@ -573,9 +273,9 @@ int VRayForBlender::Mesh::FillMeshData(BL::BlendData data, BL::Scene scene, BL::
 	pluginDesc.add("face_mtlIDs", face_mtlIDs);
 	pluginDesc.add("edge_visibility", edge_visibility);
 
-	if (channels_data->numChannels()) {
-		pluginDesc.add("map_channels_names", map_channels_names);
-		pluginDesc.add("map_channels",       map_channels);
+	if (!channelLayers.empty()) {
+		pluginDesc.add("map_channels_names", topology.map_channels_names);
+		pluginDesc.add("map_channels",       topology.map_channels);
 	}
 
 	if (options.force_dynamic_geometry) {
@@ -41,7 +41,13 @@ struct ExportOptions {
 	bool     use_subsurf_to_osd;
 };
 
-int FillMeshData(BL::BlendData data, BL::Scene scene, BL::Object ob, ExportOptions options, PluginDesc &pluginDesc);
+class TopologyCache;
+
+/// Fill GeomStaticMesh @pluginDesc with the mesh of @ob evaluated with @options
+/// @topologyCache - if set, the topology arrays of the previous export of the same plugin are reused when the
+///                  topology did not change, and new ones are stored in it
+int FillMeshData(BL::BlendData data, BL::Scene scene, BL::Object ob, ExportOptions options, PluginDesc &pluginDesc,
+                 TopologyCache *topologyCache = nullptr);
 
 } // namespace Mesh
 } // namespace VRayForBlender
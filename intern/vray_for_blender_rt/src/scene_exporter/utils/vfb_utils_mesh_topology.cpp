@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_utils_mesh_topology.h"
+
+#include "DNA_meshdata_types.h"
+
+using namespace VRayForBlender;
+
+
+Mesh::TopologyKey Mesh::GetTopologyKey(int vertexCount, const MFace *faces, int faceCount, const std::vector<MapChannelLayer> &layers, bool merge)
+{
+	// hash each array separately and then all of the hashes, so the arrays don't have to be copied together
+	std::vector<u_int64_t> parts;
+	parts.reserve(2 * (layers.size() + 2));
+
+	auto addPart = [&parts](const void *data, size_t bytes) {
+		u_int64_t hash[2] = {0, 0};
+		MurmurHash3_x64_128(data, static_cast<int>(bytes), 42, hash);
+		parts.push_back(hash[0]);
+		parts.push_back(hash[1]);
+	};
+
+	// MFace has the vertex indices and material index, it also has flags like selection which only cost a miss
+	// when they change
+	addPart(faces, faceCount * sizeof(MFace));
+	for (const MapChannelLayer &layer : layers) {
+		addPart(layer.name.c_str(), layer.name.size());
+		if (layer.uv) {
+			addPart(layer.uv, faceCount * sizeof(MTFace));
+		} else {
+			addPart(layer.color, faceCount * 4 * sizeof(MCol));
+		}
+	}
+	parts.push_back(merge);
+
+	TopologyKey key;
+	key.vertexCount = vertexCount;
+	key.faceCount = faceCount;
+	MurmurHash3_x64_128(parts.data(), static_cast<int>(parts.size() * sizeof(u_int64_t)), 42, key.hash);
+	return key;
+}
+
+
+bool Mesh::TopologyCache::find(const std::string &name, const TopologyKey &key, MeshTopology &topology) const
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		auto iter = m_topologies.find(name);
+		if (iter != m_topologies.end() && iter->second.key == key) {
+			topology = iter->second;
+			++m_hits;
+			return true;
+		}
+	}
+	++m_misses;
+	return false;
+}
+
+
+void Mesh::TopologyCache::store(const std::string &name, const MeshTopology &topology)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_topologies[name] = topology;
+}
+
+
+void Mesh::TopologyCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_topologies.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
+
+
+Mesh::TopologyCache::Stats Mesh::TopologyCache::getStats() const
+{
+	return {m_hits, m_misses};
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_UTILS_MESH_TOPOLOGY_H
+#define VRAY_FOR_BLENDER_UTILS_MESH_TOPOLOGY_H
+
+#include "vfb_utils_map_channels.h"
+#include "utils/cgr_hash.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace VRayForBlender {
+namespace Mesh {
+
+/// Fingerprint of everything in a tessellated mesh except the vertex positions and normals
+struct TopologyKey {
+	TopologyKey()
+	    : vertexCount(0)
+	    , faceCount(0)
+	{
+		hash[0] = hash[1] = 0;
+	}
+
+	bool operator==(const TopologyKey &other) const {
+		return vertexCount == other.vertexCount && faceCount == other.faceCount &&
+		       hash[0] == other.hash[0] && hash[1] == other.hash[1];
+	}
+
+	bool operator!=(const TopologyKey &other) const {
+		return !(*this == other);
+	}
+
+	int       vertexCount;
+	int       faceCount;
+	u_int64_t hash[2]; ///< Hash of the faces, material indices and map channel layers
+};
+
+/// Get the fingerprint of @vertexCount vertices with @faceCount tessellated @faces and map channel @layers
+/// @merge - the merge option FillMapChannels is called with
+TopologyKey GetTopologyKey(int vertexCount, const MFace *faces, int faceCount, const std::vector<MapChannelLayer> &layers, bool merge);
+
+/// GeomStaticMesh arrays that depend only on the topology
+struct MeshTopology {
+	TopologyKey                    key;
+	VRayBaseTypes::AttrListInt     faces;
+	VRayBaseTypes::AttrListInt     faceNormals;
+	VRayBaseTypes::AttrListInt     face_mtlIDs;
+	VRayBaseTypes::AttrListInt     edge_visibility;
+	VRayBaseTypes::AttrListString  map_channels_names;
+	VRayBaseTypes::AttrMapChannels map_channels;
+};
+
+/// Topology of exported meshes by plugin name, so meshes which are only deformed don't have to rebuild it
+/// The cached lists share their data with the exported ones, so nothing is copied on a hit.
+class TopologyCache {
+public:
+	struct Stats {
+		int hits;
+		int misses;
+	};
+
+	TopologyCache()
+	    : m_hits(0)
+	    , m_misses(0)
+	{}
+
+	/// Get the topology stored for mesh @name in @topology
+	/// @return false if there is none or it was stored with a different @key
+	bool find(const std::string &name, const TopologyKey &key, MeshTopology &topology) const;
+
+	/// Store @topology of mesh @name, replacing the previous one
+	void store(const std::string &name, const MeshTopology &topology);
+
+	/// Remove everything and reset the counters
+	void clear();
+
+	/// Get the number of successful and failed finds since the last clear
+	Stats getStats() const;
+
+private:
+	std::unordered_map<std::string, MeshTopology> m_topologies;
+	mutable std::mutex       m_lock; ///< lock protecting @m_topologies
+	mutable std::atomic<int> m_hits;
+	mutable std::atomic<int> m_misses;
+};
+
+} // namespace Mesh
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_UTILS_MESH_TOPOLOGY_H
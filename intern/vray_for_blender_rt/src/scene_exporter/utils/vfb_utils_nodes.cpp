@@ -23,6 +23,10 @@ extern "C" {
 #include "BKE_node.h" // For bNodeSocket->link access
 }
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 
 BL::NodeTree VRayForBlender::Nodes::GetNodeTree(BL::ID & id, const std::string &attr)
 {
@@ -173,3 +177,212 @@ VRayForBlender::VRayNodeSocketType VRayForBlender::getVRayNodeSocketType(BL::Nod
 
 	return vrayNodeSocketUnknown;
 }
+
+
+namespace {
+
+/// Properties of nodes and sockets that only change how they look in the editor
+const char * const ignoredHashProperties[] = {
+	"rna_type", "location", "width", "width_hidden", "height", "dimensions", "select", "hide",
+	"show_options", "show_preview", "show_texture", "show_expanded", "label", "color", "use_custom_color",
+	"parent", "inputs", "outputs", "internal_links", "node", "link_limit",
+};
+
+/// Max depth of nested property groups that are hashed
+const int maxHashDepth = 3;
+
+bool isIgnoredHashProperty(const char *name)
+{
+	for (const char *ignored : ignoredHashProperties) {
+		if (strcmp(name, ignored) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void hashBytes(const void *data, int size, MHash &hash)
+{
+	MurmurHash3_x86_32(data, size, hash, &hash);
+}
+
+void hashString(const std::string &value, MHash &hash)
+{
+	hashBytes(value.c_str(), value.size(), hash);
+}
+
+void hashProperties(PointerRNA *ptr, int depth, MHash &hash)
+{
+	RNA_STRUCT_BEGIN(ptr, prop) {
+		const char *name = RNA_property_identifier(prop);
+		if (isIgnoredHashProperty(name)) {
+			continue;
+		}
+		hashBytes(name, strlen(name), hash);
+
+		const PropertyType propType = RNA_property_type(prop);
+		const int arrayLength = RNA_property_array_length(ptr, prop);
+		switch (propType) {
+			case PROP_BOOLEAN:
+			case PROP_INT: {
+				std::vector<int> values(std::max(arrayLength, 1));
+				if (!arrayLength) {
+					values[0] = propType == PROP_INT ? RNA_property_int_get(ptr, prop) : RNA_property_boolean_get(ptr, prop);
+				}
+				else if (propType == PROP_INT) {
+					RNA_property_int_get_array(ptr, prop, values.data());
+				}
+				else {
+					RNA_property_boolean_get_array(ptr, prop, values.data());
+				}
+				hashBytes(values.data(), values.size() * sizeof(int), hash);
+				break;
+			}
+			case PROP_FLOAT: {
+				std::vector<float> values(std::max(arrayLength, 1));
+				if (!arrayLength) {
+					values[0] = RNA_property_float_get(ptr, prop);
+				}
+				else {
+					RNA_property_float_get_array(ptr, prop, values.data());
+				}
+				hashBytes(values.data(), values.size() * sizeof(float), hash);
+				break;
+			}
+			case PROP_ENUM: {
+				const int value = RNA_property_enum_get(ptr, prop);
+				hashBytes(&value, sizeof(value), hash);
+				break;
+			}
+			case PROP_STRING: {
+				const int length = RNA_property_string_length(ptr, prop);
+				std::string value(length + 1, '\0');
+				RNA_property_string_get(ptr, prop, &value[0]);
+				value.resize(length);
+				hashString(value, hash);
+				break;
+			}
+			case PROP_POINTER: {
+				PointerRNA pointer = RNA_property_pointer_get(ptr, prop);
+				if (!pointer.data) {
+					break;
+				}
+				if (RNA_struct_is_ID(pointer.type)) {
+					// IDs are exported by their own code, so a change is noticed only from the update tags
+					BL::ID id(pointer);
+					hashString(id.name(), hash);
+					const int updated[2] = {id.is_updated(), id.is_updated_data()};
+					hashBytes(updated, sizeof(updated), hash);
+				}
+				else if (depth < maxHashDepth) {
+					hashProperties(&pointer, depth + 1, hash);
+				}
+				break;
+			}
+			case PROP_COLLECTION: {
+				const int count = RNA_property_collection_length(ptr, prop);
+				hashBytes(&count, sizeof(count), hash);
+				if (depth < maxHashDepth) {
+					RNA_PROP_BEGIN(ptr, itemPtr, prop) {
+						hashProperties(&itemPtr, depth + 1, hash);
+					}
+					RNA_PROP_END;
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	RNA_STRUCT_END;
+}
+
+} // namespace
+
+
+MHash VRayForBlender::Nodes::NodeHashCache::getHash(BL::Node node)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return getHashLocked(node);
+}
+
+
+void VRayForBlender::Nodes::NodeHashCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_hashes.clear();
+}
+
+
+MHash VRayForBlender::Nodes::NodeHashCache::getHashLocked(BL::Node node)
+{
+	if (!node) {
+		return 0;
+	}
+
+	auto iter = m_hashes.find(node.ptr.data);
+	if (iter != m_hashes.end()) {
+		return iter->second;
+	}
+	// node trees have no cycles, but don't recurse forever on a broken one
+	m_hashes[node.ptr.data] = 0;
+
+	MHash hash = 42;
+	hashString(node.bl_idname(), hash);
+	hashString(node.name(), hash);
+	hashProperties(&node.ptr, 0, hash);
+
+	BL::Node::inputs_iterator inSockIt;
+	for (node.inputs.begin(inSockIt); inSockIt != node.inputs.end(); ++inSockIt) {
+		BL::NodeSocket sock(*inSockIt);
+		hashString(sock.identifier(), hash);
+
+		bNodeLink *link = reinterpret_cast<bNodeSocket*>(sock.ptr.data)->link;
+		if (link) {
+			PointerRNA linkPtr;
+			RNA_pointer_create(reinterpret_cast<ID*>(sock.ptr.id.data), &RNA_NodeLink, link, &linkPtr);
+			BL::NodeLink nodeLink(linkPtr);
+
+			const MHash linked = getHashLocked(nodeLink.from_node());
+			hashBytes(&linked, sizeof(linked), hash);
+			hashString(nodeLink.from_socket().identifier(), hash);
+		}
+		else {
+			hashProperties(&sock.ptr, 0, hash);
+		}
+	}
+
+	if (node.is_a(&RNA_ShaderNodeGroup) || node.is_a(&RNA_NodeCustomGroup)) {
+		const MHash group = getTreeHashLocked(GetGroupNodeTree(node));
+		hashBytes(&group, sizeof(group), hash);
+	}
+
+	m_hashes[node.ptr.data] = hash;
+	return hash;
+}
+
+
+MHash VRayForBlender::Nodes::NodeHashCache::getTreeHashLocked(BL::NodeTree ntree)
+{
+	if (!ntree) {
+		return 0;
+	}
+
+	auto iter = m_hashes.find(ntree.ptr.data);
+	if (iter != m_hashes.end()) {
+		return iter->second;
+	}
+	m_hashes[ntree.ptr.data] = 0;
+
+	MHash hash = 42;
+	hashString(ntree.name(), hash);
+
+	BL::NodeTree::nodes_iterator nodeIt;
+	for (ntree.nodes.begin(nodeIt); nodeIt != ntree.nodes.end(); ++nodeIt) {
+		const MHash nodeHash = getHashLocked(*nodeIt);
+		hashBytes(&nodeHash, sizeof(nodeHash), hash);
+	}
+
+	m_hashes[ntree.ptr.data] = hash;
+	return hash;
+}
@@ -21,6 +21,10 @@
 #define VRAY_FOR_BLENDER_UTILS_NODES_H
 
 #include "vfb_rna.h"
+#include "vfb_typedefs.h"
+#include "utils/cgr_hash.h"
+
+#include <mutex>
 
 
 namespace VRayForBlender {
@@ -63,6 +67,27 @@ BL::NodeSocket  GetConnectedSocket(BL::NodeSocket socket);
 
 BL::Node  GetNodeByType(BL::NodeTree nodeTree, const std::string &nodeType);
 
+/// Structural hashes of nodes, the hash of a node covers it's type, name, properties, the values
+/// of unlinked input sockets and the hashes of all the nodes linked to it's inputs, so two nodes
+/// have the same hash only if the whole subtrees feeding them are the same.
+/// Referenced IDs are hashed by name and update tags, group nodes also hash their group tree.
+/// Hashes are kept until clear() so each node is hashed once per sync, safe to use from many threads.
+class NodeHashCache {
+public:
+	/// Get the hash of @node and everything linked to it's inputs
+	MHash getHash(BL::Node node);
+
+	/// Forget all hashes, must be called when nodes could have changed
+	void clear();
+
+private:
+	MHash getHashLocked(BL::Node node);
+	MHash getTreeHashLocked(BL::NodeTree ntree);
+
+	HashMap<const void*, MHash> m_hashes; ///< bNode / bNodeTree to hash
+	std::mutex                  m_mtx;
+};
+
 } // namespace Nodes
 } // namespace VRayForBlender
 
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_utils_voxel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+namespace {
+
+/// Mark the occupied bricks of brick slab @bz in @bricks
+void scanSlab(const std::vector<const float*> &grids, const int res[3], float threshold, int bz, Voxel::OccupiedBricks &bricks)
+{
+	const int brickSize = Voxel::VoxelBrickSize;
+	char *slab = bricks.occupied.data() + static_cast<size_t>(bz) * bricks.bricks[0] * bricks.bricks[1];
+
+	const int zEnd = std::min(res[2], (bz + 1) * brickSize);
+	for (int z = bz * brickSize; z < zEnd; ++z) {
+		for (int y = 0; y < res[1]; ++y) {
+			char *brickRow = slab + (y / brickSize) * bricks.bricks[0];
+			const size_t rowOffset = (static_cast<size_t>(z) * res[1] + y) * res[0];
+
+			for (int bx = 0; bx < bricks.bricks[0]; ++bx) {
+				if (brickRow[bx]) {
+					continue;
+				}
+				const int xEnd = std::min(res[0], (bx + 1) * brickSize);
+				for (const float *grid : grids) {
+					const float *row = grid + rowOffset;
+					for (int x = bx * brickSize; x < xEnd; ++x) {
+						if (std::fabs(row[x]) > threshold) {
+							brickRow[bx] = true;
+							break;
+						}
+					}
+					if (brickRow[bx]) {
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+} // namespace
+
+
+Voxel::OccupiedBricks Voxel::FindOccupiedBricks(const std::vector<const float*> &grids, const int res[3], float threshold, ThreadManager::Ptr threadManager)
+{
+	OccupiedBricks result;
+	for (int c = 0; c < 3; ++c) {
+		result.bricks[c] = (std::max(0, res[c]) + VoxelBrickSize - 1) / VoxelBrickSize;
+	}
+	result.occupied.resize(static_cast<size_t>(result.bricks[0]) * result.bricks[1] * result.bricks[2], false);
+
+	std::vector<const float*> validGrids;
+	for (const float *grid : grids) {
+		if (grid) {
+			validGrids.push_back(grid);
+		}
+	}
+	if (validGrids.empty() || result.occupied.empty()) {
+		return result;
+	}
+
+	const size_t voxels = static_cast<size_t>(res[0]) * res[1] * res[2];
+	const int tasks = voxels < VoxelParallelVoxels ? 1 : result.bricks[2];
+
+	std::atomic<int> nextSlab(0);
+	runSharedWork(threadManager, tasks, [&]() {
+		for (int bz = nextSlab++; bz < result.bricks[2]; bz = nextSlab++) {
+			scanSlab(validGrids, res, threshold, bz, result);
+		}
+	});
+
+	int minBrick[3] = {result.bricks[0], result.bricks[1], result.bricks[2]};
+	int maxBrick[3] = {-1, -1, -1};
+	size_t brick = 0;
+	for (int bz = 0; bz < result.bricks[2]; ++bz) {
+		for (int by = 0; by < result.bricks[1]; ++by) {
+			for (int bx = 0; bx < result.bricks[0]; ++bx, ++brick) {
+				if (result.occupied[brick]) {
+					const int coords[3] = {bx, by, bz};
+					for (int c = 0; c < 3; ++c) {
+						minBrick[c] = std::min(minBrick[c], coords[c]);
+						maxBrick[c] = std::max(maxBrick[c], coords[c]);
+					}
+					result.occupiedCount++;
+				}
+			}
+		}
+	}
+
+	if (result.occupiedCount) {
+		for (int c = 0; c < 3; ++c) {
+			result.bounds.min[c] = minBrick[c] * VoxelBrickSize;
+			result.bounds.max[c] = std::min(res[c], (maxBrick[c] + 1) * VoxelBrickSize);
+		}
+	}
+
+	return result;
+}
+
+
+Voxel::VoxelBox Voxel::GetExportBox(const OccupiedBricks &bricks, const int res[3])
+{
+	VoxelBox box;
+	if (!bricks.occupiedCount) {
+		box.max[0] = box.max[1] = box.max[2] = 1;
+		return box;
+	}
+
+	for (int c = 0; c < 3; ++c) {
+		box.min[c] = std::max(0, bricks.bounds.min[c] - 1);
+		box.max[c] = std::min(res[c], bricks.bounds.max[c] + 1);
+	}
+	return box;
+}
+
+
+float Voxel::QuantizeHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	if ((bits & 0x7F800000) == 0x7F800000) {
+		return value;
+	}
+
+	// round to nearest even on the 13 mantissa bits that are dropped, a carry correctly bumps the exponent
+	bits += 0x00000FFF + ((bits >> 13) & 1);
+	bits &= ~0x00001FFFu;
+
+	memcpy(&value, &bits, sizeof(bits));
+	return value;
+}
+
+
+void Voxel::CropGrid(const float *grid, const int res[3], const VoxelBox &box, bool quantize, AttrListFloat &crop)
+{
+	crop.resize(box.count());
+	float *dest = *crop;
+
+	const int rowSize = box.size(0);
+	for (int z = box.min[2]; z < box.max[2]; ++z) {
+		for (int y = box.min[1]; y < box.max[1]; ++y, dest += rowSize) {
+			const float *row = grid + (static_cast<size_t>(z) * res[1] + y) * res[0] + box.min[0];
+			if (quantize) {
+				std::transform(row, row + rowSize, dest, QuantizeHalf);
+			}
+			else {
+				memcpy(dest, row, rowSize * sizeof(float));
+			}
+		}
+	}
+}
+
+
+void Voxel::GetBoxUVWTransform(const int res[3], const VoxelBox &box, float tm[4][4])
+{
+	memset(tm, 0, sizeof(float[4][4]));
+	for (int c = 0; c < 3; ++c) {
+		tm[c][c] = static_cast<float>(res[c]) / box.size(c);
+		tm[3][c] = -static_cast<float>(box.min[c]) / box.size(c);
+	}
+	tm[3][3] = 1.0f;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_UTILS_VOXEL_H
+#define VRAY_FOR_BLENDER_UTILS_VOXEL_H
+
+#include "base_types.h"
+#include "vfb_thread_manager.h"
+
+#include <vector>
+
+namespace VRayForBlender {
+namespace Voxel {
+
+/// Size of the bricks in each dimension, occupancy is detected per brick
+const int VoxelBrickSize = 8;
+
+/// Grids with less voxels than this are always scanned on the calling thread
+const int VoxelParallelVoxels = 1 << 18;
+
+/// Voxel box [min, max) of a grid
+struct VoxelBox {
+	VoxelBox() {
+		min[0] = min[1] = min[2] = 0;
+		max[0] = max[1] = max[2] = 0;
+	}
+
+	int size(int axis) const {
+		return max[axis] - min[axis];
+	}
+
+	size_t count() const {
+		return static_cast<size_t>(size(0)) * size(1) * size(2);
+	}
+
+	int min[3];
+	int max[3];
+};
+
+/// Bricks of a grid that have at least one voxel above the threshold
+struct OccupiedBricks {
+	OccupiedBricks()
+	    : occupiedCount(0)
+	{}
+
+	int               bricks[3];     ///< Number of bricks in each dimension, the last ones could be partial
+	std::vector<char> occupied;      ///< One item for each brick, x is the fastest changing coordinate
+	int               occupiedCount;
+	VoxelBox          bounds;        ///< Voxel bounds of the occupied bricks, empty if none are occupied
+};
+
+/// Find the bricks of @grids that have a voxel with absolute value above @threshold
+/// All grids are in Blender smoke order (x + y * res[0] + z * res[0] * res[1]), null grids are skipped
+/// @threadManager - the calling thread and free workers of @threadManager scan whole brick slabs along z
+OccupiedBricks FindOccupiedBricks(const std::vector<const float*> &grids, const int res[3], float threshold, ThreadManager::Ptr threadManager);
+
+/// Get the box to export for @bricks of a grid with resolution @res
+/// The bounds are grown by one voxel on each side that is not on the grid's border, so the voxels on the sides of
+/// the box are empty and interpolating or clamping outside of it gives the same result as with the whole grid
+/// If nothing is occupied the box is a single voxel at the grid's origin
+VoxelBox GetExportBox(const OccupiedBricks &bricks, const int res[3]);
+
+/// Copy the @box part of @grid with resolution @res to @crop, keeping the voxel order
+/// @quantize - round the values to 16 bit (half float) precision, so the compressed lists are smaller
+void CropGrid(const float *grid, const int res[3], const VoxelBox &box, bool quantize, VRayBaseTypes::AttrListFloat &crop);
+
+/// Round @value to the nearest value with 10 bit mantissa, NaN and infinity are kept as is
+float QuantizeHalf(float value);
+
+/// Transform mapping UVWs of the whole grid with resolution @res to UVWs of it's @box part
+void GetBoxUVWTransform(const int res[3], const VoxelBox &box, float tm[4][4]);
+
+} // namespace Voxel
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_UTILS_VOXEL_H
@@ -19,6 +19,7 @@
 #include "vfb_node_exporter.h"
 #include "vfb_utils_blender.h"
 #include "vfb_utils_math.h"
+#include "vfb_utils_hair.h"
 
 extern "C" {
 #include "DNA_modifier_types.h"
@@ -51,6 +52,8 @@ BLI_INLINE void GetParticleUV(short from, DerivedMesh *dm, float *fuv, int layer
 
 AttrValue DataExporter::exportGeomMayaHair(BL::Object ob, BL::ParticleSystem psys, BL::ParticleSystemModifier psm)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "data", "exportGeomMayaHair");
+
 	AttrValue hair;
 
 	const int is_preview = (m_evalMode == EvalModePreview);
@@ -115,54 +118,12 @@ AttrValue DataExporter::exportGeomMayaHair(BL::Object ob, BL::ParticleSystem psy
 			ParticleSettings           *pst  = (ParticleSettings*)pset.ptr.data;
 			ParticleSystemModifierData *psmd = (ParticleSystemModifierData*)psm.ptr.data;
 
-			ParticleCacheKey **child_cache = ps->childcache;
-			int                child_total = ps->totchildcache;
-			int                tot_verts = 0;
-
-			num_hair_vertices.resize(child_total);
-
-			for (int p = 0; p < child_total; ++p) {
-				// segments is -1 when current particle is virtual
-				const int seg_verts = std::max(0, child_cache[p]->segments);
-				tot_verts += std::max(0, seg_verts);
-
-				(*num_hair_vertices)[p] = seg_verts;
-			}
-
-			widths.resize(tot_verts);
-			hair_vertices.resize(tot_verts);
-
 			const bool has_uv = psmd->dm_final && CustomData_number_of_layers(&psmd->dm_final->faceData, CD_MTFACE);
-			if (has_uv) {
-				strand_uvw.resize(tot_verts);
-			}
-
-			int hair_vert_index = 0;
-			for(int p = 0; p < child_total; ++p) {
-				ParticleCacheKey *child_key = child_cache[p];
-
-				const int child_steps = child_key->segments;
-
-				float hair_fade_width = hair_width;
-				float hair_fade_step  = hair_width / (child_steps+1);
-
-				for(int s = 0; s < child_steps; ++s, ++child_key) {
-					float *co = (float*)&(*hair_vertices)[hair_vert_index];
-					copy_v3_v3(co, child_key->co);
-					mul_m4_v3(hair_itm, co);
-
-					(*widths)[hair_vert_index] = use_width_fade
-					                             ? std::max(1e-6f, hair_fade_width)
-					                             : hair_width;
-
-					hair_fade_width -= hair_fade_step;
-
-					hair_vert_index++;
-				}
-
-				if (has_uv && child_steps > 0) {
-					float *uv = (float*)&(*strand_uvw)[p];
 
+			Hair::StrandUVFn strand_uv;
+			if (has_uv) {
+				// only reads the derived mesh, so it's safe to call from the fill tasks
+				strand_uv = [ps, pst, psmd, layer_idx](int p, float uv[3]) {
 					ChildParticle *cpa = ps->child + p;
 					if(pst->childtype == PART_CHILD_FACES) {
 						GetParticleUV(PART_FROM_FACE, psmd->dm_final, cpa->fuv, layer_idx, cpa->num, uv);
@@ -179,8 +140,28 @@ AttrValue DataExporter::exportGeomMayaHair(BL::Object ob, BL::ParticleSystem psy
 
 						GetParticleUV(pst->from, psmd->dm_final, parent->fuv, layer_idx, num, uv);
 					}
-				}
+				};
+			}
+
+			// strands are filled and hashed in chunks by this and the idle export threads, the hash lets unchanged hair skip the export
+			// so the plugin manager does not hash and the exporter does not send the same arrays again
+			Hair::StrandsHash strands_hash = Hair::FillChildStrands(ps->childcache, ps->totchildcache, hair_itm,
+			                                                        hair_width, use_width_fade, strand_uv,
+			                                                        m_thread_manager,
+			                                                        num_hair_vertices, hair_vertices, widths, strand_uvw);
+			strands_hash.combine(&widths_in_pixels, sizeof(widths_in_pixels));
+			const int geom_splines = pset.use_hair_bspline();
+			strands_hash.combine(&geom_splines, sizeof(geom_splines));
+
+			const std::string hair_name = getHairName(ob, psys, pset);
+			std::lock_guard<std::mutex> lock(m_hairMtx);
+			auto iter = m_hairHashes.find(hair_name);
+			if (iter != m_hairHashes.end() && iter->second == strands_hash && m_exporter->getPluginManager().inCache(hair_name)) {
+				// the exporter still needs to know the hair was constant at this frame to write it's hold keys
+				m_exporter->export_plugin_unchanged(hair_name);
+				return AttrPlugin(hair_name);
 			}
+			m_hairHashes[hair_name] = strands_hash;
 		}
 		else {
 			// Export particles using C++ RNA API
@@ -27,6 +27,8 @@
 
 AttrValue DataExporter::exportLight(BL::Object ob, bool check_updated, const ObjectOverridesAttrs & override)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "data", "exportLight");
+
 	AttrValue plugin;
 
 	bool is_updated      = check_updated ? ob.is_updated()      : true;
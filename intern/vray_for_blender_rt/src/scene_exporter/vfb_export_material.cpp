@@ -25,8 +25,32 @@
 
 void DataExporter::clearMaterialCache()
 {
-	std::lock_guard<std::mutex> mtlLock(m_materials_mtx);
-	m_exported_materials.clear();
+	{
+		std::lock_guard<std::mutex> mtlLock(m_materials_mtx);
+		m_exported_materials.clear();
+	}
+	{
+		std::lock_guard<std::mutex> nodesLock(m_nodes_mtx);
+		m_exported_nodes.clear();
+	}
+	// nodes could change before next sync
+	m_node_hashes.clear();
+
+	m_material_hits = 0;
+	m_material_misses = 0;
+	m_node_hits = 0;
+	m_node_misses = 0;
+}
+
+
+DataExporter::NodeCacheStats DataExporter::getNodeCacheStats() const
+{
+	NodeCacheStats stats;
+	stats.materialHits = m_material_hits;
+	stats.materialMisses = m_material_misses;
+	stats.nodeHits = m_node_hits;
+	stats.nodeMisses = m_node_misses;
+	return stats;
 }
 
 
@@ -40,6 +64,17 @@ AttrValue DataExporter::getDefaultMaterial()
 
 void DataExporter::exportMaterialSettings()
 {
+	{
+		// node exporters also read the current frame (image sequences) and scene settings (color mapping),
+		// which are not part of the tree hash, so exports from another frame or scene state can't be reused
+		const float frame = m_settings.settings_animation.frame_current;
+		std::lock_guard<std::mutex> mtlLock(m_materials_mtx);
+		if (frame != m_material_states_frame || m_scene.is_updated() || m_scene.is_updated_data()) {
+			m_material_states.clear();
+			m_material_states_frame = frame;
+		}
+	}
+
 	// Default material - always the same, export only once
 	if (!m_defaults.default_material) {
 		PluginDesc defaultBrdfDesc("DefaultBRDF", "BRDFDiffuse");
@@ -61,6 +96,8 @@ void DataExporter::exportMaterialSettings()
 
 AttrValue DataExporter::exportMaterial(BL::Material ma, BL::Object ob, bool exportAsOverride)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "data", "exportMaterial");
+
 	AttrValue material = getDefaultMaterial();
 
 	if (!ma) {
@@ -105,8 +142,32 @@ AttrValue DataExporter::exportMaterial(BL::Material ma, BL::Object ob, bool expo
 	using PT = ParamDesc::PluginType;
 	auto pluginType = PT::PluginUnknown;
 
+	// tree that is not tagged for update and has the same hash as in the last sync is not walked again,
+	// as long as the plugins exported for it are still there
+	const bool selectPreview = m_settings.use_select_preview && m_is_preview;
+	const std::string materialName = getIdUniqueName(ma);
+	MHash treeHash = 0;
+	if (!selectPreview) {
+		treeHash = m_node_hashes.getHash(output);
+		MurmurHash3_x86_32(materialName.c_str(), materialName.size(), treeHash, &treeHash);
+
+		if (!ntree.is_updated() && !ma.is_updated() && !ma.is_updated_data()) {
+			std::lock_guard<std::mutex> mtlLock(m_materials_mtx);
+			auto iter = m_material_states.find(materialName);
+			if (iter != m_material_states.end() && iter->second.hash == treeHash &&
+			    iter->second.material.type == ValueTypePlugin &&
+			    m_exporter->getPluginManager().inCache(iter->second.material.as<AttrPlugin>().plugin))
+			{
+				++m_material_hits;
+				m_exported_materials.insert(std::make_pair(ma, iter->second.material));
+				return iter->second.material;
+			}
+		}
+		++m_material_misses;
+	}
+
 	bool needExport = true;
-	if (m_settings.use_select_preview && m_is_preview) {
+	if (selectPreview) {
 		BL::Node selected = getNtreeSelectedNode(ntree);
 		if (selected && ob.name().find("preview_") != std::string::npos) {
 			BL::Node  conNode(PointerRNA_NULL);
@@ -165,6 +226,9 @@ AttrValue DataExporter::exportMaterial(BL::Material ma, BL::Object ob, bool expo
 	{
 		std::lock_guard<std::mutex> mtlLock(m_materials_mtx);
 		m_exported_materials.insert(std::make_pair(ma, material));
+		if (!selectPreview) {
+			m_material_states[materialName] = {treeHash, material};
+		}
 	}
 
 	return material;
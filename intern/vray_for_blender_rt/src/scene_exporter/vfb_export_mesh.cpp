@@ -22,6 +22,8 @@
 
 AttrValue DataExporter::exportGeomStaticMesh(BL::Object ob, const ObjectOverridesAttrs & oattrs)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "data", "exportGeomStaticMesh");
+
 	AttrValue geom;
 
 	PluginDesc geomDesc(getMeshName(ob), "GeomStaticMesh");
@@ -38,7 +40,11 @@ AttrValue DataExporter::exportGeomStaticMesh(BL::Object ob, const ObjectOverride
 	                                 (renderMode == RenderModeRtGpu) ||
 	                                 (oattrs && oattrs.useInstancer);
 
-	int err = VRayForBlender::Mesh::FillMeshData(m_data, m_scene, ob, options, geomDesc);
+	// a mesh exported once is not exported again, so it's topology is worth keeping only if there will be more exports
+	// frame by frame animation resets the exporter for each frame, which clears the topologies too
+	const bool keepTopology = m_settings.is_viewport || m_exporter->get_keep_plugin_cache();
+
+	int err = VRayForBlender::Mesh::FillMeshData(m_data, m_scene, ob, options, geomDesc, keepTopology ? &m_mesh_topologies : nullptr);
 	if (!err) {
 		geom = m_exporter->export_plugin(geomDesc);
 	}
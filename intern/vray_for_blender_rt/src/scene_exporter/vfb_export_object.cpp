@@ -22,6 +22,10 @@
 #include "vfb_utils_nodes.h"
 #include "vfb_utils_string.h"
 #include "DNA_object_types.h"
+#include "DNA_anim_types.h"
+#include "BKE_animsys.h"
+#include "BKE_key.h"
+#include "BLI_listbase.h"
 #include "vfb_utils_math.h"
 
 uint32_t to_int_layer(const BlLayers & layers) {
@@ -162,8 +166,49 @@ bool DataExporter::objectIsMeshLight(BL::Object ob)
 	return geomNode.bl_idname() == "VRayNodeLightMesh";
 }
 
+void DataExporter::setReuseStaticGeometry(bool value)
+{
+	m_reuse_static_geometry = value;
+}
+
+void DataExporter::setThreadManager(ThreadManager::Ptr threadManager)
+{
+	m_thread_manager = threadManager;
+}
+
+bool DataExporter::isGeometryStatic(BL::Object ob)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_static_geometry_mtx);
+		auto iter = m_static_geometry.find(ob.ptr.data);
+		if (iter != m_static_geometry.end()) {
+			return iter->second;
+		}
+	}
+
+	::Object *object = reinterpret_cast<::Object*>(ob.ptr.data);
+	// any modifier could depend on time or other objects, only plain meshes are considered static
+	bool isStatic = ob.type() == BL::Object::type_MESH &&
+	                object->data &&
+	                BLI_listbase_is_empty(&object->modifiers) &&
+	                object->partype != PARSKEL &&
+	                !BKE_key_from_object(object) &&
+	                !Nodes::GetNodeTree(ob);
+
+	if (isStatic) {
+		const AnimData *adt = BKE_animdata_from_id(reinterpret_cast<ID*>(object->data));
+		isStatic = !adt || (!adt->action && BLI_listbase_is_empty(&adt->drivers) && BLI_listbase_is_empty(&adt->nla_tracks));
+	}
+
+	std::lock_guard<std::mutex> lock(m_static_geometry_mtx);
+	m_static_geometry[ob.ptr.data] = isStatic;
+	return isStatic;
+}
+
 AttrValue DataExporter::exportObject(BL::Object ob, bool check_updated, const ObjectOverridesAttrs & override)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "data", "exportObject");
+
 	AttrPlugin node;
 
 	BL::ID data(ob.data());
@@ -209,6 +254,9 @@ AttrValue DataExporter::exportObject(BL::Object ob, bool check_updated, const Ob
 		if ((!is_data_updated && !m_layer_changed) || !m_settings.export_meshes) {
 			// nothing changed just get the name
 			geom = AttrPlugin(getMeshName(ob));
+		} else if (m_reuse_static_geometry && m_exporter->getPluginManager().inCache(getMeshName(ob)) && isGeometryStatic(ob)) {
+			// animation frame - mesh is the same as in the previous one
+			geom = AttrPlugin(getMeshName(ob));
 		} else if (is_data_updated) {
 			// data was updated - must export mesh
 			geom = exportGeomStaticMesh(ob, override);
@@ -604,7 +652,8 @@ bool instancerItemCompare(const AttrInstancer::Item & left, const AttrInstancer:
 };
 
 void sortInstancerParticles(AttrInstancer & instancer) {
-	if (instancer.data.getCount()) {
+	// dupli export sorts the items in parallel already
+	if (instancer.data.getCount() && !std::is_sorted(instancer.data.getData()->begin(), instancer.data.getData()->end(), instancerItemCompare)) {
 		std::sort(instancer.data.getData()->begin(), instancer.data.getData()->end(), instancerItemCompare);
 	}
 }
@@ -624,8 +673,10 @@ AttrInstancer::Item * getParticle(AttrInstancer & instancer, int index) {
 
 }
 
-AttrValue DataExporter::exportVrayInstancer2(BL::Object ob, AttrInstancer & instancer, IdTrack::PluginType dupliType, bool exportObTm, bool checkMBlur)
+AttrValue DataExporter::exportVrayInstancer2(BL::Object ob, AttrInstancer & instancer, IdTrack::PluginType dupliType, bool exportObTm, bool checkMBlur, MHash itemsHash)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "data", "exportVrayInstancer2");
+
 	const auto exportName = "Instancer2@" + getNodeName(ob);
 	const auto & wrapperName = "NodeWrapper@" + exportName;
 	PluginDesc nodeWrapper(wrapperName, "Node");
@@ -684,9 +735,12 @@ AttrValue DataExporter::exportVrayInstancer2(BL::Object ob, AttrInstancer & inst
 		}
 	} else {
 		exportData = &instancer;
-		for (int c = 0; c < exportData->data.getCount(); c++) {
-			auto & particle = (*exportData->data.getData())[c];
-			memset(&particle.vel, 0, sizeof(particle.vel));
+		// caller hashed the items with zero velocity
+		if (!itemsHash) {
+			for (int c = 0; c < exportData->data.getCount(); c++) {
+				auto & particle = (*exportData->data.getData())[c];
+				memset(&particle.vel, 0, sizeof(particle.vel));
+			}
 		}
 		m_exporter->set_current_frame(exportData->frameNumber);
 	}
@@ -695,6 +749,22 @@ AttrValue DataExporter::exportVrayInstancer2(BL::Object ob, AttrInstancer & inst
 
 	const AttrListString sceneNames = cryptomatteAllNames(ob);
 
+	// with known items hash, unchanged instancer is not exported again so items are not hashed by the plugin manager
+	bool skipInstancer = false;
+	if (itemsHash && !freeExportData) {
+		MHash key = itemsHash;
+		MurmurHash3_x86_32(&visible, sizeof(visible), key, &key);
+		MurmurHash3_x86_32(&exportData->frameNumber, sizeof(exportData->frameNumber), key, &key);
+		for (const auto & name : *sceneNames.getData()) {
+			MurmurHash3_x86_32(name.c_str(), name.size(), key, &key);
+		}
+
+		std::lock_guard<std::mutex> lock(m_instMtx);
+		auto iter = m_instancerHashes.find(exportName);
+		skipInstancer = iter != m_instancerHashes.end() && iter->second == key && m_exporter->getPluginManager().inCache(exportName);
+		m_instancerHashes[exportName] = key;
+	}
+
 	PluginDesc instancerDesc(exportName, "Instancer2");
 	instancerDesc.add("instances", *exportData);
 	instancerDesc.add("visible", visible);
@@ -714,7 +784,7 @@ AttrValue DataExporter::exportVrayInstancer2(BL::Object ob, AttrInstancer & inst
 		setNSamples(nodeWrapper, ob);
 	}
 
-	auto inst = m_exporter->export_plugin(instancerDesc);
+	const AttrPlugin inst = skipInstancer ? AttrPlugin(exportName) : m_exporter->export_plugin(instancerDesc);
 	nodeWrapper.add("geometry", inst);
 	nodeWrapper.add("visible", true);
 	nodeWrapper.add("objectID", ob.pass_index());
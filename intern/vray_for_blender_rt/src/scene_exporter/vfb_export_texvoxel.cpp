@@ -21,6 +21,7 @@
  */
 
 #include "vfb_export_texvoxel.h"
+#include "vfb_utils_voxel.h"
 #include "BLI_math.h"
 #include "smoke_API.h"
 
@@ -203,24 +204,56 @@ void TexVoxelData::initSmoke() {
 	}
 	PRINT_INFO_EX("Density range: [%.3f-%.3f]", min_dens, max_dens);
 #endif
+	if (NOT(m_use_sparse)) {
+		if (dens) {
+			m_dens.resize(tot_res_high);
+			std::copy(dens, dens + tot_res_high, m_dens.getData()->begin());
+		}
+		if (flame) {
+			m_flame.resize(tot_res_high);
+			std::copy(flame, flame + tot_res_high, m_flame.getData()->begin());
+		}
+		if (fuel) {
+			m_fuel.resize(tot_res_high);
+			std::copy(fuel, fuel + tot_res_high, m_fuel.getData()->begin());
+		}
+#if CGR_USE_HEAT
+		if (heat) {
+			m_heat.resize(tot_res_low);
+			std::copy(heat, heat + tot_res_low, m_heat.getData()->begin());
+		}
+#endif
+		return;
+	}
+
+	// Most of a high resolution domain is usually empty, so only the box around the occupied bricks is exported
+	// and the UVW transform is changed to map the domain to that box
+	const Voxel::OccupiedBricks bricks = Voxel::FindOccupiedBricks({dens, flame, fuel}, m_res_high, 0.0f, m_thread_manager);
+	const Voxel::VoxelBox box = Voxel::GetExportBox(bricks, m_res_high);
+
 	if (dens) {
-		m_dens.resize(tot_res_high);
-		std::copy(dens, dens + tot_res_high, m_dens.getData()->begin());
+		Voxel::CropGrid(dens, m_res_high, box, m_quantize, m_dens);
 	}
 	if (flame) {
-		m_flame.resize(tot_res_high);
-		std::copy(flame, flame + tot_res_high, m_flame.getData()->begin());
+		Voxel::CropGrid(flame, m_res_high, box, m_quantize, m_flame);
 	}
 	if (fuel) {
-		m_fuel.resize(tot_res_high);
-		std::copy(fuel, fuel + tot_res_high, m_fuel.getData()->begin());
+		Voxel::CropGrid(fuel, m_res_high, box, m_quantize, m_fuel);
 	}
 #if CGR_USE_HEAT
-	if (heat) {
-		m_heat.resize(tot_res_low);
-		std::copy(heat, heat + tot_res_low, m_heat.getData()->begin());
+	// Heat is only exported without high resolution, when it has the same resolution as the other grids
+	if (heat && NOT(sds->flags & MOD_SMOKE_HIGHRES)) {
+		Voxel::CropGrid(heat, m_res_low, box, m_quantize, m_heat);
 	}
 #endif
+
+	float boxTm[4][4];
+	Voxel::GetBoxUVWTransform(m_res_high, box, boxTm);
+	mul_m4_m4m4(m_uvw_transform, boxTm, m_uvw_transform);
+
+	for (int c = 0; c < 3; ++c) {
+		m_res_high[c] = box.size(c);
+	}
 }
 
 
@@ -51,6 +51,8 @@ class TexVoxelData {
 public:
 	TexVoxelData(Object *ob)
 	    : m_smd(nullptr)
+	    , m_use_sparse(true)
+	    , m_quantize(false)
 	    , p_interpolation(0)
 	    , m_ob(ob)
 	{}
@@ -61,11 +63,21 @@ public:
 	void               init(SmokeModifierData *smd);
 	void               setInterpolation(int value);
 
+	/// Export only the part of the grids around the occupied bricks, must be set before init()
+	void               setSparse(bool value) { m_use_sparse = value; }
+	/// Round the exported grids to 16 bit precision, must be set before init()
+	void               setQuantize(bool value) { m_quantize = value; }
+	/// Scan the grids for occupied bricks with the help of @threadManager's workers, must be set before init()
+	void               setThreadManager(ThreadManager::Ptr threadManager) { m_thread_manager = threadManager; }
+
 private:
 	void               initUvTransform();
 	void               initSmoke();
 
 	SmokeModifierData *m_smd;
+	bool               m_use_sparse;
+	bool               m_quantize;
+	ThreadManager::Ptr m_thread_manager;
 
 	int                m_res_high[3];
 
@@ -117,6 +117,16 @@ void IdTrack::reset_usage() {
 	}
 }
 
+void IdTrack::reset_usage(BL::Object ob) {
+	auto iter = data.find(DataExporter::getIdUniqueName(ob));
+	if (iter != data.end()) {
+		for (auto &pl : iter->second.plugins) {
+			pl.second.used = false;
+		}
+		iter->second.used = false;
+	}
+}
+
 HashSet<std::string> IdTrack::getAllObjectPlugins(BL::Object ob) const {
 	auto iter = data.find(DataExporter::getIdUniqueName(ob));
 	if (iter == data.end()) {
@@ -206,10 +216,28 @@ void DataExporter::init(PluginExporter::Ptr exporter)
 }
 
 
-void DataExporter::sync()
+void DataExporter::sync(const std::vector<BL::Object> *objects)
 {
 	auto lock = raiiLock();
-	for (auto dIt = m_id_track.data.begin(); dIt != m_id_track.data.end(); ++dIt) {
+
+	// for incremental sync only the objects synced now can have unused plugins
+	std::vector<IdTrack::TrackMap::iterator> checkDeps;
+	if (objects) {
+		checkDeps.reserve(objects->size());
+		for (const auto & ob : *objects) {
+			auto iter = m_id_track.data.find(getIdUniqueName(ob));
+			if (iter != m_id_track.data.end()) {
+				checkDeps.push_back(iter);
+			}
+		}
+	} else {
+		checkDeps.reserve(m_id_track.data.size());
+		for (auto dIt = m_id_track.data.begin(); dIt != m_id_track.data.end(); ++dIt) {
+			checkDeps.push_back(dIt);
+		}
+	}
+
+	for (auto dIt : checkDeps) {
 		auto ob = dIt->second.object;
 		auto &dep = dIt->second;
 
@@ -305,11 +333,13 @@ void DataExporter::setComputedLayers(uint32_t layers, bool is_local_view)
 }
 
 
-void DataExporter::resetSyncState()
+void DataExporter::resetSyncState(bool keepObjectUsage)
 {
 	auto lock = raiiLock();
 	m_id_cache.clear();
-	m_id_track.reset_usage();
+	if (!keepObjectUsage) {
+		m_id_track.reset_usage();
+	}
 	clearMaterialCache();
 	// all hidden objects will be checked agains current settings
 	refreshHideLists();
@@ -318,12 +348,41 @@ void DataExporter::resetSyncState()
 	m_scene_layers = to_int_layer(m_scene.layers());
 }
 
+void DataExporter::resetObjectUsage()
+{
+	auto lock = raiiLock();
+	m_id_track.reset_usage();
+}
+
+void DataExporter::resetObjectUsage(BL::Object ob)
+{
+	auto lock = raiiLock();
+	m_id_track.reset_usage(ob);
+}
+
 void DataExporter::reset()
 {
 	auto lock = raiiLock();
 	m_defaults.default_material = AttrPlugin();
 	m_id_cache.clear();
 	m_id_track.clear();
+	{
+		std::lock_guard<std::mutex> instLock(m_instMtx);
+		m_instancerHashes.clear();
+	}
+	{
+		std::lock_guard<std::mutex> hairLock(m_hairMtx);
+		m_hairHashes.clear();
+	}
+	{
+		std::lock_guard<std::mutex> mtlLock(m_materials_mtx);
+		m_material_states.clear();
+	}
+	{
+		std::lock_guard<std::mutex> staticLock(m_static_geometry_mtx);
+		m_static_geometry.clear();
+	}
+	m_mesh_topologies.clear();
 	clearMaterialCache();
 	// all hidden objects will be checked agains current settings
 	refreshHideLists();
@@ -428,6 +487,7 @@ AttrValue DataExporter::exportVRayNode(BL::NodeTree &ntree, BL::Node &node, BL::
 
 	AttrValue attrValue;
 	const std::string &nodeClass = node.bl_idname();
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "node", nodeClass.c_str());
 
 #if 0
 	PRINT_INFO_EX("Exporting \"%s\" from \"%s\"",
@@ -627,7 +687,36 @@ AttrValue DataExporter::exportVRayNode(BL::NodeTree &ntree, BL::Node &node, BL::
 	else {
 		PluginDesc pluginDesc(DataExporter::GenPluginName(node, ntree, context),
 		                      DataExporter::GetNodePluginID(node));
-		attrValue = exportVRayNodeAuto(ntree, node, fromSocket, context, pluginDesc);
+
+		// the same subtree reached again in this sync is exported once, the node the
+		// plugin is connected to changes the default uvwgen so it's part of the key
+		MHash nodeHash = m_node_hashes.getHash(node);
+		BL::Node consumer(fromSocket ? fromSocket.node() : BL::Node(PointerRNA_NULL));
+		if (consumer) {
+			const std::string &consumerClass = consumer.bl_idname();
+			MurmurHash3_x86_32(consumerClass.c_str(), consumerClass.size(), nodeHash, &nodeHash);
+		}
+
+		bool exported = false;
+		{
+			std::lock_guard<std::mutex> nodesLock(m_nodes_mtx);
+			auto iter = m_exported_nodes.find(pluginDesc.pluginName);
+			if (iter != m_exported_nodes.end() && iter->second.hash == nodeHash) {
+				attrValue = iter->second.plugin;
+				exported = true;
+			}
+		}
+
+		if (exported) {
+			++m_node_hits;
+		}
+		else {
+			++m_node_misses;
+			attrValue = exportVRayNodeAuto(ntree, node, fromSocket, context, pluginDesc);
+
+			std::lock_guard<std::mutex> nodesLock(m_nodes_mtx);
+			m_exported_nodes[pluginDesc.pluginName] = {nodeHash, attrValue};
+		}
 	}
 
 	return attrValue;
@@ -24,8 +24,12 @@
 #include "vfb_typedefs.h"
 #include "vfb_params_desc.h"
 #include "vfb_render_view.h"
+#include "vfb_utils_hair.h"
+#include "vfb_utils_mesh_topology.h"
+#include "vfb_utils_nodes.h"
 
 #include "DNA_ID.h"
+#include <atomic>
 #include <stack>
 #include <vector>
 #include <deque>
@@ -193,6 +197,8 @@ struct IdTrack {
 	void              clear();
 	void              insert(BL::Object ob, const std::string &plugin, PluginType type = PluginType::NONE);
 	void              reset_usage();
+	/// Reset usage only for the plugins of @ob
+	void              reset_usage(BL::Object ob);
 
 	HashSet<std::string> getAllObjectPlugins(BL::Object ob) const;
 
@@ -307,6 +313,14 @@ public:
 	};
 
 	typedef HashMap<BL::Material, AttrValue> MaterialCache;
+
+	/// Counters of node tree exports that were reused instead of walking the tree again
+	struct NodeCacheStats {
+		int materialHits;   ///< Unchanged materials reused from a previous sync
+		int materialMisses;
+		int nodeHits;       ///< Automatically exported nodes reused in the current sync
+		int nodeMisses;
+	};
 	typedef HashMap<std::string, HashSet<BL::Object>> ObjectHideMap;
 
 	DataExporter(ExporterSettings & expSettings)
@@ -316,9 +330,15 @@ public:
 	    , m_context(PointerRNA_NULL)
 	    , m_view3d(PointerRNA_NULL)
 	    , m_is_local_view(false)
+	    , m_reuse_static_geometry(false)
 	    , m_active_camera(PointerRNA_NULL)
 	    , m_exporter(nullptr)
 	    , m_settings(expSettings)
+	    , m_material_states_frame(-FLT_MAX)
+	    , m_material_hits(0)
+	    , m_material_misses(0)
+	    , m_node_hits(0)
+	    , m_node_misses(0)
 	{}
 
 	// Generate unique plugin name from node
@@ -364,13 +384,19 @@ public:
 	void              init(PluginExporter::Ptr exporter);
 	/// Go trough IdTrack and find all unused plugins and remove them
 	/// Export SettingsLightLinker
-	void              sync();
+	/// @objects - if not null only plugins of these objects are checked, used for incremental sync
+	void              sync(const std::vector<BL::Object> *objects = nullptr);
 
 	/// Clear all cached data, used for FrameByFrame export, to clear everything because reset() is called on vray
 	void              reset();
 
 	/// Reset all state that is kept for one sync, must be called after each sync
-	void              resetSyncState();
+	/// @keepObjectUsage - true for incremental sync, objects not synced will keep their plugins
+	void              resetSyncState(bool keepObjectUsage = false);
+	/// Mark all plugins in IdTrack as not used
+	void              resetObjectUsage();
+	/// Mark plugins of @ob in IdTrack as not used, so ones not exported again are removed on sync
+	void              resetObjectUsage(BL::Object ob);
 
 	bool              isObjectInThisSync(BL::Object ob);
 	/// Check if we are currently in undo sync and if yes, checks if the object passed was changed in the sync we are undoing currently
@@ -386,6 +412,15 @@ public:
 	void              exportMaterialSettings();
 	void              setComputedLayers(uint32_t layers, bool is_local_view);
 
+	/// Reuse already exported geometry of objects for which isGeometryStatic is true, used for animation
+	/// after the first frame so meshes that can't change are not rebuilt for every frame
+	void              setReuseStaticGeometry(bool value);
+	/// Thread manager whose free workers help with filling large data of a single export, e.g. hair strands
+	void              setThreadManager(ThreadManager::Ptr threadManager);
+	/// Check if @ob's geometry can't change over time: mesh without modifiers, shape keys, node tree
+	/// or animation on it's data, result is cached until reset()
+	bool              isGeometryStatic(BL::Object ob);
+
 	void              setAttrsFromNode(BL::NodeTree &ntree, BL::Node &node, BL::NodeSocket &fromSocket, NodeContext &context, PluginDesc &pluginDesc, const std::string &pluginID, const ParamDesc::PluginType &pluginType);
 	void              setAttrsFromNodeAuto(BL::NodeTree &ntree, BL::Node &node, BL::NodeSocket &fromSocket, NodeContext &context, PluginDesc &pluginDesc);
 	void              setAttrFromPropGroup(PointerRNA *propGroup, ID *holder, const ParamDesc::AttrDesc &attrName, PluginDesc &pluginDesc);
@@ -412,7 +447,10 @@ public:
 	AttrValue         exportAsset(BL::Object ob, bool check_updated = false, const ObjectOverridesAttrs & = ObjectOverridesAttrs());
 	AttrValue         exportLight(BL::Object ob, bool check_updated = false, const ObjectOverridesAttrs & = ObjectOverridesAttrs());
 	void              exportHair(BL::Object ob, BL::ParticleSystemModifier psm, BL::ParticleSystem psys, bool check_updated = false);
-	AttrValue         exportVrayInstancer2(BL::Object ob, AttrInstancer & instancer, IdTrack::PluginType dupliType, bool exportObTm = false, bool checkMBlur = true);
+	/// Export Instancer2 and the node wrapping it for @ob
+	/// @itemsHash - hash of the instancer items computed by the caller, 0 means unknown
+	///              if it matches the previous export of the same instancer the Instancer2 plugin is not exported again
+	AttrValue         exportVrayInstancer2(BL::Object ob, AttrInstancer & instancer, IdTrack::PluginType dupliType, bool exportObTm = false, bool checkMBlur = true, MHash itemsHash = 0);
 	void              flushInstancerData();
 	void              exportEnvironment(NodeContext &context);
 	void              exportLightLinker();
@@ -463,6 +501,10 @@ public:
 	static bool       isObGroupInstance(BL::Object ob);
 
 	void              clearMaterialCache();
+	/// Get the node cache counters since the start of the current sync
+	NodeCacheStats    getNodeCacheStats() const;
+	/// Get the counters of mesh exports that reused their topology since the last reset()
+	Mesh::TopologyCache::Stats getMeshTopologyStats() const { return m_mesh_topologies.getStats(); }
 
 	void              setActiveCamera(BL::Object camera);
 	void              refreshHideLists();
@@ -561,6 +603,10 @@ private:
 	bool              m_is_local_view;
 	bool              m_layer_changed;
 	bool              m_is_preview;
+	bool              m_reuse_static_geometry;
+	HashMap<void*, bool> m_static_geometry; ///< Cached result of isGeometryStatic
+	std::mutex        m_static_geometry_mtx;
+	ThreadManager::Ptr m_thread_manager;
 
 	BL::Object        m_active_camera;
 	// should be set on each sync with setComputedLayers
@@ -576,6 +622,32 @@ private:
 	MaterialCache     m_exported_materials;
 	std::mutex        m_materials_mtx;
 
+	/// Result of the last export of a material and the hash of it's tree
+	struct MaterialState {
+		MHash     hash;
+		AttrValue material;
+	};
+	/// Material name to it's last export, kept between syncs to skip unchanged trees (uses m_materials_mtx)
+	HashMap<std::string, MaterialState> m_material_states;
+	/// Frame the states in m_material_states were exported for
+	float             m_material_states_frame;
+
+	/// Result of an automatically exported node and the hash of it's subtree and consumer
+	struct NodeState {
+		MHash     hash;
+		AttrValue plugin;
+	};
+	/// Node plugin name to it's export in the current sync, so shared subtrees are exported once
+	HashMap<std::string, NodeState> m_exported_nodes;
+	std::mutex        m_nodes_mtx;
+	/// Structural hashes of nodes for the current sync
+	Nodes::NodeHashCache m_node_hashes;
+
+	std::atomic<int>  m_material_hits;
+	std::atomic<int>  m_material_misses;
+	std::atomic<int>  m_node_hits;
+	std::atomic<int>  m_node_misses;
+
 
 	struct InstancerData {
 		AttrInstancer instancer;
@@ -585,7 +657,14 @@ private:
 	};
 	typedef std::unordered_map<std::string, InstancerData> InstCache;
 	InstCache         m_prevFrameInstancer;
+	/// Instancer name to hash of last exported data, used to skip unchanged instancers
+	HashMap<std::string, MHash> m_instancerHashes;
 	std::mutex        m_instMtx;
+	/// Hair name to hash of last exported child strands, used to skip unchanged hair
+	HashMap<std::string, Hair::StrandsHash> m_hairHashes;
+	std::mutex        m_hairMtx;
+	/// Topology of exported meshes, used only when meshes can be exported again (RT and animation)
+	Mesh::TopologyCache m_mesh_topologies;
 };
 
 // implemented in vfb_export_object.cpp
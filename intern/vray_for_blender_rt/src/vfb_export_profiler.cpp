@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vfb_export_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+using namespace VRayForBlender;
+
+namespace {
+std::atomic<bool> defaultEnabled(false);
+
+// Number of profiler scopes currently open on this thread, used to find the outermost ones
+thread_local int tlsScopeDepth = 0;
+
+/// Cpu time used by the calling thread in nanoseconds
+uint64_t threadCpuNs()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	const uint64_t kernelTime = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+	const uint64_t userTime = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+	// FILETIME is in 100ns units
+	return (kernelTime + userTime) * 100;
+#else
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+		return 0;
+	}
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/// Append @value as quoted JSON string to @out
+void appendJSONString(std::string &out, const std::string &value)
+{
+	out += '"';
+	for (const char c : value) {
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				out += buf;
+			} else {
+				out += c;
+			}
+		}
+	}
+	out += '"';
+}
+
+/// Append formatted value to @out
+template <typename... Args>
+void appendFormat(std::string &out, const char *format, Args... args)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), format, args...);
+	out += buf;
+}
+
+double toSeconds(uint64_t ns)
+{
+	return ns / 1e9;
+}
+
+double toMicroseconds(uint64_t ns)
+{
+	return ns / 1e3;
+}
+}
+
+
+ExportProfiler::Scope::Scope(ExportProfiler &profiler, const char *category, const char *name)
+	: m_profiler(profiler.isEnabled() ? &profiler : nullptr)
+	, m_category(category)
+	, m_startNs(0)
+	, m_startCpuNs(0)
+{
+	if (m_profiler) {
+		++tlsScopeDepth;
+		m_name = name;
+		m_startNs = m_profiler->elapsedNs();
+		m_startCpuNs = threadCpuNs();
+	}
+}
+
+ExportProfiler::Scope::~Scope()
+{
+	if (m_profiler) {
+		const uint64_t wallNs = m_profiler->elapsedNs() - m_startNs;
+		const uint64_t cpuNs = threadCpuNs() - m_startCpuNs;
+		const bool isOuter = --tlsScopeDepth == 0;
+		m_profiler->addTime(m_category, m_name, m_startNs, wallNs, cpuNs, isOuter);
+	}
+}
+
+
+ExportProfiler::ExportProfiler()
+	: m_enabled(getDefaultEnabled())
+	, m_start(std::chrono::steady_clock::now())
+	, m_droppedEvents(0)
+{
+}
+
+void ExportProfiler::reset()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_start = std::chrono::steady_clock::now();
+	m_sections.clear();
+	m_bytes.clear();
+	m_threads.clear();
+	m_threadBusyNs.clear();
+	m_events.clear();
+	m_droppedEvents = 0;
+}
+
+uint64_t ExportProfiler::elapsedNs() const
+{
+	std::chrono::steady_clock::time_point start;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		start = m_start;
+	}
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int ExportProfiler::threadIndex()
+{
+	const std::thread::id id = std::this_thread::get_id();
+	auto iter = std::find(m_threads.begin(), m_threads.end(), id);
+	if (iter != m_threads.end()) {
+		return iter - m_threads.begin();
+	}
+	m_threads.push_back(id);
+	m_threadBusyNs.push_back(0);
+	return m_threads.size() - 1;
+}
+
+void ExportProfiler::addTime(const char *category, const std::string &name, uint64_t startNs, uint64_t wallNs, uint64_t cpuNs, bool isOuter)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	Section &section = m_sections[SectionKey(category, name)];
+	section.calls++;
+	section.wallNs += wallNs;
+	section.cpuNs += cpuNs;
+
+	const int thread = threadIndex();
+	if (isOuter) {
+		m_threadBusyNs[thread] += wallNs;
+	}
+
+	if (m_events.size() < MaxEvents) {
+		m_events.push_back(Event{category, name, startNs, wallNs, thread});
+	} else {
+		m_droppedEvents++;
+	}
+}
+
+void ExportProfiler::addBytes(const char *format, uint64_t bytes)
+{
+	if (!m_enabled) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_bytes[format] += bytes;
+}
+
+std::string ExportProfiler::toJSON() const
+{
+	const uint64_t totalNs = elapsedNs();
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	std::string out;
+	appendFormat(out, "{\n\t\"elapsed\": %.6f,\n\t\"sections\": [", toSeconds(totalNs));
+
+	bool first = true;
+	for (const auto &item : m_sections) {
+		out += first ? "\n\t\t{\"category\": " : ",\n\t\t{\"category\": ";
+		appendJSONString(out, item.first.first);
+		out += ", \"name\": ";
+		appendJSONString(out, item.first.second);
+		appendFormat(out, ", \"calls\": %llu, \"wall\": %.6f, \"cpu\": %.6f}",
+		             static_cast<unsigned long long>(item.second.calls), toSeconds(item.second.wallNs), toSeconds(item.second.cpuNs));
+		first = false;
+	}
+
+	out += "\n\t],\n\t\"bytes\": {";
+	first = true;
+	for (const auto &item : m_bytes) {
+		out += first ? "\n\t\t" : ",\n\t\t";
+		appendJSONString(out, item.first);
+		appendFormat(out, ": %llu", static_cast<unsigned long long>(item.second));
+		first = false;
+	}
+
+	out += "\n\t},\n\t\"threads\": [";
+	for (size_t c = 0; c < m_threadBusyNs.size(); ++c) {
+		const double utilization = totalNs ? double(m_threadBusyNs[c]) / totalNs : 0.0;
+		appendFormat(out, "%s\n\t\t{\"id\": %d, \"busy\": %.6f, \"utilization\": %.4f}",
+		             c ? "," : "", static_cast<int>(c), toSeconds(m_threadBusyNs[c]), utilization);
+	}
+
+	appendFormat(out, "\n\t],\n\t\"dropped_events\": %llu\n}\n", static_cast<unsigned long long>(m_droppedEvents));
+	return out;
+}
+
+std::string ExportProfiler::toChromeTrace() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	std::string out;
+	out.reserve(m_events.size() * 96);
+	out += "{\"traceEvents\": [";
+
+	for (size_t c = 0; c < m_threads.size(); ++c) {
+		appendFormat(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"Export thread %d\"}}",
+		             c ? "," : "", static_cast<int>(c), static_cast<int>(c));
+	}
+
+	for (const Event &event : m_events) {
+		out += ",\n{\"name\": ";
+		appendJSONString(out, event.name);
+		out += ", \"cat\": ";
+		appendJSONString(out, event.category);
+		appendFormat(out, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+		             event.thread, toMicroseconds(event.startNs), toMicroseconds(event.wallNs));
+	}
+
+	appendFormat(out, "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": %llu}}\n",
+	             static_cast<unsigned long long>(m_droppedEvents));
+	return out;
+}
+
+void ExportProfiler::setDefaultEnabled(bool enabled)
+{
+	defaultEnabled = enabled;
+}
+
+bool ExportProfiler::getDefaultEnabled()
+{
+	return defaultEnabled;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2015, Chaos Software Ltd
+ *
+ * V-Ray For Blender
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VRAY_FOR_BLENDER_EXPORT_PROFILER_H
+#define VRAY_FOR_BLENDER_EXPORT_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VRayForBlender {
+
+/// Collects call counts, wall and cpu time for sections of the export and the number of bytes written per format
+/// Sections are identified by category ("scene", "data", "plugin", ...) and name (function or plugin type)
+/// All methods are safe to call concurrently, when disabled Scope does not touch the profiler at all
+class ExportProfiler {
+public:
+	/// Accumulated counters for one section
+	struct Section {
+		uint64_t calls;  ///< number of times the section was entered
+		uint64_t wallNs; ///< total wall time, nested sections are included in their parent
+		uint64_t cpuNs;  ///< total cpu time of the calling threads
+
+		Section()
+			: calls(0)
+			, wallNs(0)
+			, cpuNs(0) {}
+	};
+
+	/// Time the lifetime of the object as one call of a section
+	class Scope {
+	public:
+		/// @category - must be string literal, since it is kept without copying
+		/// @name - copied only when the profiler is enabled
+		Scope(ExportProfiler &profiler, const char *category, const char *name);
+		~Scope();
+
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+	private:
+		ExportProfiler *m_profiler; ///< nullptr if the profiler was disabled when the scope started
+		const char     *m_category;
+		std::string     m_name;
+		uint64_t        m_startNs;
+		uint64_t        m_startCpuNs;
+	};
+
+	ExportProfiler();
+
+	ExportProfiler(const ExportProfiler &) = delete;
+	ExportProfiler & operator=(const ExportProfiler &) = delete;
+
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+	bool isEnabled() const { return m_enabled; }
+
+	/// Clear all counters and start measuring time from now, called at the start of each export
+	void reset();
+
+	/// Add one call of the section with the provided times, @startNs is relative to last reset
+	void addTime(const char *category, const std::string &name, uint64_t startNs, uint64_t wallNs, uint64_t cpuNs, bool isOuter);
+
+	/// Add @bytes to the total written for @format
+	void addBytes(const char *format, uint64_t bytes);
+
+	/// Nanoseconds since last reset
+	uint64_t elapsedNs() const;
+
+	/// Summary of all sections, bytes and per thread utilization as JSON object
+	std::string toJSON() const;
+
+	/// All recorded scopes as complete events in Chrome trace event format (chrome://tracing)
+	std::string toChromeTrace() const;
+
+	/// Initial value of the enabled flag for newly created exporters
+	static void setDefaultEnabled(bool enabled);
+	static bool getDefaultEnabled();
+
+	/// Maximum number of scopes kept for the Chrome trace, counters are updated after that but events are dropped
+	static const size_t MaxEvents = 1 << 20;
+private:
+	/// One recorded scope for the trace
+	struct Event {
+		const char  *category;
+		std::string  name;
+		uint64_t     startNs;
+		uint64_t     wallNs;
+		int          thread;
+	};
+
+	/// Index of the calling thread in @m_threads, adding it if needed, call with @m_lock taken
+	int threadIndex();
+
+	typedef std::pair<std::string, std::string> SectionKey;
+
+	std::atomic<bool>                     m_enabled;
+	mutable std::mutex                    m_lock; ///< protects all members below
+	std::chrono::steady_clock::time_point m_start; ///< time of last reset
+	std::map<SectionKey, Section>         m_sections; ///< counters for (category, name)
+	std::map<std::string, uint64_t>       m_bytes; ///< bytes written for each format
+	std::vector<std::thread::id>          m_threads; ///< threads that recorded anything, index is used as trace tid
+	std::vector<uint64_t>                 m_threadBusyNs; ///< time covered by outermost scopes for each thread
+	std::vector<Event>                    m_events; ///< at most MaxEvents recorded scopes
+	uint64_t                              m_droppedEvents; ///< scopes not added to @m_events
+};
+
+} // namespace VRayForBlender
+
+#endif // VRAY_FOR_BLENDER_EXPORT_PROFILER_H
@@ -28,6 +28,8 @@ using namespace VRayForBlender;
 
 ExporterSettings::ExporterSettings()
     : export_meshes(true)
+    , use_zmq_batch(true)
+    , use_zmq_shared_images(false)
     , override_material(PointerRNA_NULL)
     , current_bake_object(PointerRNA_NULL)
     , camera_stereo_left(PointerRNA_NULL)
@@ -232,6 +234,8 @@ void ExporterSettings::update(BL::Context context, BL::RenderEngine engine, BL::
 	if (zmq_server_address.empty()) {
 		zmq_server_address = "127.0.0.1";
 	}
+	use_zmq_batch = RNA_struct_find_property(&m_vrayExporter, "zmq_batch") ? RNA_boolean_get(&m_vrayExporter, "zmq_batch") : true;
+	use_zmq_shared_images = RNA_struct_find_property(&m_vrayExporter, "zmq_shared_images") ? RNA_boolean_get(&m_vrayExporter, "zmq_shared_images") : false;
 
 	if (is_viewport) {
 		render_mode = static_cast<RenderMode>(RNA_enum_ext_get(&m_vrayExporter, "viewport_rendering_mode"));
@@ -118,7 +118,8 @@ struct ExporterSettings {
 	enum ExportFormat {
 		ExportFormatZIP = 0,
 		ExportFormatHEX,
-		ExportFormatASCII
+		ExportFormatASCII,
+		ExportFormatBIN, ///< Arrays are written to binary sidecar file and referenced by offset
 	};
 
 	enum WorkMode {
@@ -194,6 +195,8 @@ struct ExporterSettings {
 	int               viewport_image_quality;
 	int               zmq_server_port;
 	std::string       zmq_server_address;
+	bool              use_zmq_batch; ///< Send plugin changes to the ZMQ server together on commit
+	bool              use_zmq_shared_images; ///< Read viewport images from shared memory if the ZMQ server is on this host
 
 	std::string       override_material_name;
 	BL::Material      override_material;
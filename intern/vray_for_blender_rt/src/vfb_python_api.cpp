@@ -398,6 +398,113 @@ static PyObject* vfb_view_draw(PyObject*, PyObject *value)
 }
 
 
+/// Build list of dicts with the counters of each worker thread of @threadManager
+static PyObject* vfb_make_thread_stats(VRayForBlender::ThreadManager::Ptr threadManager)
+{
+	if (!threadManager) {
+		return PyList_New(0);
+	}
+
+	const std::vector<VRayForBlender::WorkerStats> stats = threadManager->getStats();
+	PyObject *statsList = PyList_New(stats.size());
+
+	for (int c = 0; c < stats.size(); ++c) {
+		PyObject *list_item = Py_BuildValue("{s:K,s:K,s:d}",
+		                                    "tasks_run", static_cast<unsigned long long>(stats[c].tasksRun),
+		                                    "tasks_stolen", static_cast<unsigned long long>(stats[c].tasksStolen),
+		                                    "idle_time", stats[c].idleSeconds);
+		PyList_SET_ITEM(statsList, c, list_item);
+	}
+
+	return statsList;
+}
+
+/// Get per worker counters for the object export threads and the file writer threads
+static PyObject* vfb_get_thread_stats(PyObject*, PyObject *value)
+{
+	VRayForBlender::SceneExporter *exporter = vfb_cast_exporter(value);
+	if (!exporter) {
+		Py_RETURN_NONE;
+	}
+
+	VRayForBlender::PluginExporter::Ptr pluginExporter = exporter->get_plugin_exporter();
+
+	PyObject *exportStats = vfb_make_thread_stats(exporter->get_thread_manager());
+	PyObject *writeStats = vfb_make_thread_stats(pluginExporter ? pluginExporter->get_thread_manager() : nullptr);
+
+	PyObject *result = Py_BuildValue("{s:N,s:N}", "export", exportStats, "write", writeStats);
+	return result;
+}
+
+
+/// Get number of plugins and memory used by the exporter's plugin cache
+static PyObject* vfb_get_cache_stats(PyObject*, PyObject *value)
+{
+	VRayForBlender::SceneExporter *exporter = vfb_cast_exporter(value);
+	if (!exporter || !exporter->get_plugin_exporter()) {
+		Py_RETURN_NONE;
+	}
+
+	const VRayForBlender::PluginManager::CacheStats stats = exporter->get_plugin_exporter()->getPluginManager().getCacheStats();
+
+	return Py_BuildValue("{s:n,s:n,s:n}",
+	                     "entries", static_cast<Py_ssize_t>(stats.entries),
+	                     "names", static_cast<Py_ssize_t>(stats.names),
+	                     "bytes", static_cast<Py_ssize_t>(stats.bytes));
+}
+
+
+/// Enable or disable export profiling for @exporter, or for all exporters created after this call if it is None
+static PyObject* vfb_set_export_profiling(PyObject*, PyObject *args)
+{
+	PyObject *pyExporter = nullptr;
+	int enabled = 0;
+
+	if (!PyArg_ParseTuple(args, "Op", &pyExporter, &enabled)) {
+		return nullptr;
+	}
+
+	VRayForBlender::SceneExporter *exporter = vfb_cast_exporter(pyExporter);
+	if (!exporter) {
+		VRayForBlender::ExportProfiler::setDefaultEnabled(enabled);
+	} else if (exporter->get_plugin_exporter()) {
+		exporter->get_plugin_exporter()->getProfiler().setEnabled(enabled);
+	}
+
+	Py_RETURN_NONE;
+}
+
+
+/// Get the profile of the last export as string, format is "JSON" or "CHROME" for chrome://tracing
+static PyObject* vfb_get_export_profile(PyObject*, PyObject *args)
+{
+	PyObject *pyExporter = nullptr;
+	const char *format = "JSON";
+
+	if (!PyArg_ParseTuple(args, "O|s", &pyExporter, &format)) {
+		return nullptr;
+	}
+
+	VRayForBlender::SceneExporter *exporter = vfb_cast_exporter(pyExporter);
+	if (!exporter || !exporter->get_plugin_exporter()) {
+		Py_RETURN_NONE;
+	}
+
+	const VRayForBlender::ExportProfiler &profiler = exporter->get_plugin_exporter()->getProfiler();
+	std::string profile;
+	if (strcmp(format, "JSON") == 0) {
+		profile = profiler.toJSON();
+	} else if (strcmp(format, "CHROME") == 0) {
+		profile = profiler.toChromeTrace();
+	} else {
+		PyErr_Format(PyExc_ValueError, "Unknown profile format \"%s\"", format);
+		return nullptr;
+	}
+
+	return PyUnicode_FromStringAndSize(profile.c_str(), profile.size());
+}
+
+
 static PyObject* vfb_get_exporter_types(PyObject*, PyObject*)
 {
 	PRINT_INFO_EX("vfb_get_exporter_types()");
@@ -637,6 +744,12 @@ static PyMethodDef methods[] = {
     { "view_update", vfb_view_update, METH_O, "" },
     { "view_draw",   vfb_view_draw,   METH_O, "" },
 
+    { "get_thread_stats", vfb_get_thread_stats, METH_O, "" },
+    { "get_cache_stats",  vfb_get_cache_stats,  METH_O, "" },
+
+    { "set_export_profiling", vfb_set_export_profiling, METH_VARARGS, "" },
+    { "get_export_profile",   vfb_get_export_profile,   METH_VARARGS, "" },
+
 	{ "zmq_heartbeat_start",              vfb_zmq_heartbeat_start, METH_VARARGS, ""},
 	{ "zmq_heartbeat_stop",  (PyCFunction)vfb_zmq_heartbeat_stop,  METH_NOARGS,  ""},
 	{ "zmq_heartbeat_check", (PyCFunction)vfb_zmq_heartbeat_check, METH_NOARGS,  ""},
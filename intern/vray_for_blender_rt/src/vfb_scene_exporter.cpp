@@ -30,6 +30,7 @@
 #include "DNA_ID.h"
 #include "DNA_object_types.h"
 #include "DNA_modifier_types.h"
+#include "DNA_scene_types.h"
 
 #include "RE_engine.h"
 
@@ -282,20 +283,118 @@ static HashSet<std::string> RenderGIPlugins = {
 };
 
 namespace {
-MHash getParticleID(BL::Object dupliGenerator, BL::DupliObject dupliObject, int dupliIndex)
+MHash getParticleID(BL::Object dupliGenerator, const DupliObject *dupliObject, int dupliIndex)
 {
+	// same as DupliObject.index in RNA
 	MHash particleID = dupliIndex ^
-	                   dupliObject.index() ^
-	                   reinterpret_cast<intptr_t>(dupliObject.object().ptr.data) ^
+	                   dupliObject->persistent_id[0] ^
+	                   reinterpret_cast<intptr_t>(dupliObject->ob) ^
 	                   reinterpret_cast<intptr_t>(dupliGenerator.ptr.data);
 
 	for (int i = 0; i < 16; ++i) {
-		particleID ^= dupliObject.persistent_id()[i];
+		particleID ^= dupliObject->persistent_id[i];
 	}
 
 	return particleID;
 }
 
+/// Number of dupli objects processed by one task in sync_dupli
+const int DupliChunkSize = 1 << 16;
+
+/// Data for object duplicated by a dupli generator, it's the same for all of it's instances
+struct DupliParentInfo {
+	BL::Object   object;
+	bool         geometry;
+	bool         light;
+	bool         meshLight;
+	bool         clipper;
+	bool         hidden; ///< hidden for all instances
+	bool         visible; ///< visible on the current layers
+	float        inverted[4][4]; ///< inverted world matrix
+	std::string  nodeName;
+
+	DupliParentInfo(): object(PointerRNA_NULL) {}
+};
+
+typedef HashMap<const Object*, DupliParentInfo> DupliParentMap;
+
+/// How a single dupli object is exported
+enum class DupliKind {
+	SKIP, ///< hidden geometry - not exported and not counted
+	HIDDEN, ///< hidden, not exported but counted for the particle ID
+	NODE, ///< exported as separate node (lights, mesh lights, visible clippers)
+	INSTANCER, ///< exported as item of the Instancer2
+};
+
+DupliKind getDupliKind(const DupliParentInfo &parent, const DupliObject *dupli) {
+	const bool hidden = dupli->no_draw || parent.hidden;
+	// hidden geometries are not exported at all, but hidden mesh lights are
+	if (!parent.meshLight && parent.geometry && hidden) {
+		return DupliKind::SKIP;
+	}
+	// node based duplication is for: (light, mesh light, visible clipper)
+	if (parent.light || parent.meshLight || (parent.clipper && !hidden)) {
+		return DupliKind::NODE;
+	}
+	return hidden ? DupliKind::HIDDEN : DupliKind::INSTANCER;
+}
+
+/// Part of the dupli list processed by one task
+struct DupliChunk {
+	int                               begin; ///< first index in the dupli list
+	int                               end; ///< one past the last index in the dupli list
+	int                               dupliCount; ///< number of not skipped duplis
+	int                               instancerCount; ///< number of instancer items
+	int                               dupliOffset; ///< dupli index of the first not skipped dupli
+	int                               instancerOffset; ///< index of the first instancer item
+	MHash                             hash; ///< hash of this chunk's instancer items
+	HashSet<const Object*>            parents; ///< all objects duplicated in this chunk
+	HashSet<const Object*>            instancedParents; ///< objects with at least one instancer item
+	std::vector<std::pair<int, int>>  nodes; ///< list index and dupli index of duplis exported as nodes
+};
+
+/// Sort instancer items by particle index, each chunk's range is sorted in parallel and then merged in pairs
+void sortInstancerChunks(AttrInstancer &instances, const std::vector<DupliChunk> &chunks, ThreadManager::Ptr threadManager) {
+	auto & items = *instances.data.getData();
+	auto compare = [](const AttrInstancer::Item &left, const AttrInstancer::Item &right) {
+		return left.index < right.index;
+	};
+
+	std::vector<int> bounds;
+	for (const auto & chunk : chunks) {
+		bounds.push_back(chunk.instancerOffset);
+	}
+	bounds.push_back(items.size());
+
+	{
+		TaskGroup group(threadManager);
+		for (int c = 0; c + 1 < bounds.size(); ++c) {
+			const int begin = bounds[c], end = bounds[c + 1];
+			group.run([&items, &compare, begin, end](int, const volatile bool &) {
+				std::sort(items.begin() + begin, items.begin() + end, compare);
+			});
+		}
+		group.wait();
+	}
+
+	while (bounds.size() > 2) {
+		std::vector<int> merged;
+		TaskGroup group(threadManager);
+		for (int c = 0; c < bounds.size() - 1; c += 2) {
+			merged.push_back(bounds[c]);
+			if (c + 2 < bounds.size()) {
+				const int begin = bounds[c], middle = bounds[c + 1], end = bounds[c + 2];
+				group.run([&items, &compare, begin, middle, end](int, const volatile bool &) {
+					std::inplace_merge(items.begin() + begin, items.begin() + middle, items.begin() + end, compare);
+				});
+			}
+		}
+		merged.push_back(bounds.back());
+		group.wait();
+		bounds.swap(merged);
+	}
+}
+
 MHash getParticleID(BL::Object arrayGenerator, int arrayIndex)
 {
 	const MHash particleID = arrayIndex ^
@@ -386,12 +485,13 @@ void SceneExporter::init() {
 	if (!m_threadManager) {
 		// lets init ThreadManager based on object count
 		if (m_scene.objects.length() > 10) { // TODO: change to appropriate number
-			m_threadManager = ThreadManager::make(2);
+			m_threadManager = ThreadManager::make(std::max(2u, std::thread::hardware_concurrency()));
 		} else {
 			// thread manager with 0 means all objects will be exported from current thread
 			m_threadManager = ThreadManager::make(0);
 		}
 	}
+	m_data_exporter.setThreadManager(m_threadManager);
 }
 
 void SceneExporter::init_data()
@@ -430,6 +530,8 @@ void SceneExporter::render_start()
 
 bool SceneExporter::export_scene(const bool check_updated)
 {
+	// the profile returned to python covers only the last export
+	m_exporter->getProfiler().reset();
 	return true;
 }
 
@@ -473,15 +575,31 @@ void SceneExporter::calculate_scene_layers()
 void SceneExporter::sync(const bool check_updated)
 {
 	SCOPED_TRACE_EX("SceneExporter::sync(%d)", static_cast<int>(check_updated));
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "scene", "sync");
 
 	if (!m_frameExporter.isCurrentSubframe()) {
 		m_data_exporter.syncStart(m_isUndoSync);
 	}
 
+	// only viewport uses incremental sync, so don't walk the scene for production
+	m_isIncrementalSync = is_viewport() && can_sync_incremental() && check_updated;
+
+	if (!check_updated || m_isUndoSync) {
+		// objects could be reallocated with same address without being tagged
+		std::lock_guard<std::mutex> lock(m_objectSyncInfoLock);
+		m_objectSyncInfo.clear();
+	}
+
 	sync_prepass();
 
 	calculate_scene_layers();
 
+	if (m_isIncrementalSync && m_data_exporter.hasLayerChanged()) {
+		// visibility of any object could change, fall back to syncing all of them
+		m_isIncrementalSync = false;
+		m_data_exporter.resetObjectUsage();
+	}
+
 	// TODO: this is hack so we can export object dependent on effect before any other objects so we
 	// can hide/show them correctly
 	m_exporter->set_prepass(true);
@@ -511,7 +629,7 @@ void SceneExporter::sync(const bool check_updated)
 
 	if (!m_frameExporter.isCurrentSubframe()) {
 		// Sync data (will remove deleted objects)
-		m_data_exporter.sync();
+		m_data_exporter.sync(m_isIncrementalSync ? &m_updatedObjects : nullptr);
 		// must be after sync so we update plugins appropriately
 		m_data_exporter.exportLightLinker();
 	}
@@ -523,6 +641,82 @@ void SceneExporter::sync(const bool check_updated)
 		m_data_exporter.syncEnd();
 
 	m_isUndoSync = false;
+	m_isIncrementalSync = false;
+}
+
+uint64_t SceneExporter::collect_updated_objects()
+{
+	m_updatedObjects.clear();
+	// set by the depsgraph if any object was tagged since the last update
+	const bool objectsTagged = m_data.objects.is_updated();
+
+	// walk DNA directly, this is done on each viewport update so it must be cheap even for huge scenes
+	Scene *scene = reinterpret_cast<Scene*>(m_scene.ptr.data);
+	uint64_t hash = 0;
+	for (Base *base = reinterpret_cast<Base*>(scene->base.first); base; base = base->next) {
+		Object *ob = base->object;
+		hash = hash * 31 + reinterpret_cast<uintptr_t>(ob);
+
+		// exportObject also re-exports an object when it's parent is updated
+		const bool parentTagged = ob->parent && (ob->parent->id.recalc & ID_RECALC_ALL);
+		if (objectsTagged && ((ob->id.recalc & ID_RECALC_ALL) || parentTagged)) {
+			PointerRNA obPtr;
+			RNA_id_pointer_create(&ob->id, &obPtr);
+			m_updatedObjects.push_back(BL::Object(obPtr));
+		}
+	}
+
+	return hash;
+}
+
+bool SceneExporter::can_sync_incremental()
+{
+	const uint64_t objectsHash = collect_updated_objects();
+	// added or removed objects need full sync so IdTrack can find deleted ones
+	const bool sameObjects = objectsHash == m_syncedObjectsHash;
+	m_syncedObjectsHash = objectsHash;
+
+	// changed node trees, materials and textures are checked by exportObject for each object
+	// without the object being tagged, so they need full sync
+	const bool shadingUpdated = m_data.node_groups.is_updated() || m_data.materials.is_updated() ||
+	                            m_data.textures.is_updated();
+
+	// scene settings and undo can change objects without tagging them
+	return sameObjects && !shadingUpdated && !m_isUndoSync && !m_settings.use_motion_blur && !m_scene.is_updated();
+}
+
+SceneExporter::ObjectSyncInfo SceneExporter::get_object_sync_info(BL::Object ob, bool is_updated)
+{
+	if (!is_updated) {
+		std::lock_guard<std::mutex> lock(m_objectSyncInfoLock);
+		auto iter = m_objectSyncInfo.find(ob.ptr.data);
+		if (iter != m_objectSyncInfo.end()) {
+			return iter->second;
+		}
+	}
+
+	PointerRNA vrayObject = RNA_pointer_get(&ob.ptr, "vray");
+	PointerRNA vrayClipper = RNA_pointer_get(&vrayObject, "VRayClipper");
+
+	ObjectSyncInfo info;
+	info.hasClipper = RNA_boolean_get(&vrayClipper, "enabled");
+	info.hasArrayMod = false;
+
+	for (int c = ob.modifiers.length() - 1; c >= 0; --c) {
+		if (ob.modifiers[c].type() != BL::Modifier::type_ARRAY) {
+			// stop on last non array mod - we export only array mods on top of mod stack
+			break;
+		}
+		if (ob.modifiers[c].show_render()) {
+			// we found atleast one stuitable array mod
+			info.hasArrayMod = true;
+			break;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_objectSyncInfoLock);
+	m_objectSyncInfo[ob.ptr.data] = info;
+	return info;
 }
 
 
@@ -540,7 +734,7 @@ static void TagNtreeIfIdPropTextureUpdated(BL::NodeTree ntree, BL::Node node, co
 void SceneExporter::sync_prepass()
 {
 	m_data_exporter.setActiveCamera(m_active_camera);
-	m_data_exporter.resetSyncState();
+	m_data_exporter.resetSyncState(m_isIncrementalSync);
 
 	BL::BlendData::node_groups_iterator nIt;
 	for (m_data.node_groups.begin(nIt); nIt != m_data.node_groups.end(); ++nIt) {
@@ -753,6 +947,8 @@ void SceneExporter::sync_object(BL::Object ob, const int &check_updated, const O
 
 void SceneExporter::sync_dupli(BL::Object ob, const int &check_updated)
 {
+	ExportProfiler::Scope profile(m_exporter->getProfiler(), "scene", "sync_dupli");
+
 	PointerRNA vrayObject = RNA_pointer_get(&ob.ptr, "vray");
 	PointerRNA vrayClipper = RNA_pointer_get(&vrayObject, "VRayClipper");
 	bool noClipper = !RNA_boolean_get(&vrayClipper, "enabled");
@@ -770,168 +966,250 @@ void SceneExporter::sync_dupli(BL::Object ob, const int &check_updated)
 
 		return;
 	}
-	MHash maxParticleId = 0;
 
-	enum class InstanceFlags {
-		GEOMETRY, HIDDEN, LIGHT, MESH_LIGHT, CLIPPER, FLAGS_COUNT
-	};
-	using IF = InstanceFlags;
-	Blender::FlagsArray<IF, IF::FLAGS_COUNT> instanceFlags;
+	std::vector<const DupliObject*> duplis;
+	for (auto & instance : Blender::collection(ob.dupli_list)) {
+		duplis.push_back(static_cast<const DupliObject*>(instance.ptr.data));
+	}
 
-	AttrInstancer instances;
-	instances.frameNumber = m_frameExporter.getCurrentFrame();
+	std::vector<DupliChunk> chunks((duplis.size() + DupliChunkSize - 1) / DupliChunkSize);
+	for (int c = 0; c < chunks.size(); ++c) {
+		chunks[c].begin = c * DupliChunkSize;
+		chunks[c].end = std::min<int>(duplis.size(), (c + 1) * DupliChunkSize);
+	}
 
-	int num_instances = 0;
-	int idx_instances = 0;
-	if (noClipper) {
-		int c = 0;
-		for (auto & instance : Blender::collection(ob.dupli_list)) {
-			BL::Object      parentOb(instance.object());
-			instanceFlags.push_back(false);
-			auto flags = instanceFlags.get_flags(c++);
-
-			if (instance.hide() || (!m_exporter->get_is_viewport() && parentOb.hide_render())) {
-				flags.set(IF::HIDDEN);
-			}
+	// find all duplicated objects, there are usually much less of them than instances
+	{
+		TaskGroup group(m_threadManager);
+		for (auto & chunk : chunks) {
+			group.run([&duplis, &chunk](int, const volatile bool &) {
+				for (int c = chunk.begin; c < chunk.end; ++c) {
+					chunk.parents.insert(duplis[c]->ob);
+				}
+			});
+		}
+		group.wait();
+	}
 
-			if (Blender::IsGeometry(parentOb)) {
-				flags.set(IF::GEOMETRY);
-			}
+	if (is_interrupted()) {
+		return;
+	}
 
-			if (Blender::IsLight(parentOb)) {
-				flags.set(IF::LIGHT);
-			} else if (m_data_exporter.objectIsMeshLight(parentOb)) {
-				flags.set(IF::MESH_LIGHT);
-			}
+	// if parent is empty or it is hidden in some way, do not show base objects
+	const bool hide_from_parent = !m_data_exporter.isObjectVisible(ob) || ob.type() == BL::Object::type_EMPTY;
+
+	// objects create by linked group should all be hidden
+	// NOTE: this is different than a group of only linked objects
+	bool linkedGroup = false;
+	if (BL::Group group = ob.dupli_group()) {
+		linkedGroup = !!group.library();
+	}
 
-			// hidden geometries are not exported at all, but hidden mesh lights are
-			if (!flags.get(IF::MESH_LIGHT) && flags.get(IF::GEOMETRY) && flags.get(IF::HIDDEN)) {
+	// RNA and exporter data is accessed only from here, the tasks below only read from the map
+	DupliParentMap parents;
+	for (const auto & chunk : chunks) {
+		for (const Object *parent : chunk.parents) {
+			if (parents.find(parent) != parents.end()) {
 				continue;
 			}
+			PointerRNA parentPtr;
+			RNA_id_pointer_create(const_cast<ID*>(&parent->id), &parentPtr);
+			BL::Object parentOb(parentPtr);
+
+			DupliParentInfo & info = parents[parent];
+			info.object = parentOb;
+			info.hidden = !m_exporter->get_is_viewport() && parentOb.hide_render();
+			info.geometry = Blender::IsGeometry(parentOb);
+			info.light = Blender::IsLight(parentOb);
+			info.meshLight = !info.light && m_data_exporter.objectIsMeshLight(parentOb);
+			info.visible = m_data_exporter.isObjectVisible(parentOb, OVisibility::HIDE_LAYER);
 
 			PointerRNA vrayObject = RNA_pointer_get(&parentOb.ptr, "vray");
 			PointerRNA vrayClipper = RNA_pointer_get(&vrayObject, "VRayClipper");
+			info.clipper = RNA_boolean_get(&vrayClipper, "enabled");
 
-			if (RNA_boolean_get(&vrayClipper, "enabled")) {
-				flags.set(IF::CLIPPER);
-			}
-
-			// TODO: consider caching instancer suitable objects - there could be alot of instances of the same object
-			// if any of the duplicated objects is clipper or light we cant use instancer
-			if (!(flags.get(IF::LIGHT) || flags.get(IF::MESH_LIGHT) || flags.get(IF::CLIPPER))) {
-				maxParticleId = std::max(maxParticleId, getParticleID(ob, instance, idx_instances));
-				++num_instances;
-			}
-			++idx_instances;
+			copy_m4_m4(info.inverted, const_cast<float (*)[4]>(parent->obmat));
+			invert_m4(info.inverted);
+			info.nodeName = m_data_exporter.getNodeName(parentOb);
 		}
+	}
 
-		if (noClipper) { // this could be removed
-			instances.data.resize(num_instances);
+	// count duplis in each chunk so each can fill it's part of the instancer independently
+	{
+		TaskGroup group(m_threadManager);
+		for (auto & chunk : chunks) {
+			group.run([&duplis, &parents, &chunk, noClipper](int, const volatile bool &) {
+				chunk.dupliCount = 0;
+				chunk.instancerCount = 0;
+				for (int c = chunk.begin; c < chunk.end; ++c) {
+					const DupliKind kind = getDupliKind(parents.find(duplis[c]->ob)->second, duplis[c]);
+					if (kind != DupliKind::SKIP) {
+						++chunk.dupliCount;
+					}
+					if (kind == DupliKind::INSTANCER && noClipper) {
+						++chunk.instancerCount;
+					}
+				}
+			});
 		}
+		group.wait();
+	}
+
+	int dupliOffset = 0;
+	int instancerOffset = 0;
+	for (auto & chunk : chunks) {
+		chunk.dupliOffset = dupliOffset;
+		chunk.instancerOffset = instancerOffset;
+		dupliOffset += chunk.dupliCount;
+		instancerOffset += chunk.instancerCount;
+	}
+
+	AttrInstancer instances;
+	instances.frameNumber = m_frameExporter.getCurrentFrame();
+	if (noClipper) {
+		instances.data.resize(instancerOffset);
 	}
 
 	if (is_interrupted()) {
 		return;
 	}
 
-	int dupliIdx = 0;
-	int instancerIdx = 0; // for objects using instancer
-	// if parent is empty or it is hidden in some way, do not show base objects
-	const bool hide_from_parent = !m_data_exporter.isObjectVisible(ob) || ob.type() == BL::Object::type_EMPTY;
+	const bool useVelocity = m_settings.use_motion_blur && m_settings.calculate_instancer_velocity;
 
-	// objects create by linked group should all be hidden
-	// NOTE: this is different than a group of only linked objects
-	bool linkedGroup = false;
-	if (BL::Group group = ob.dupli_group()) {
-		linkedGroup = !!group.library();
-	}
+	{
+		TaskGroup group(m_threadManager);
+		for (auto & chunk : chunks) {
+			group.run([&duplis, &parents, &chunk, &instances, &ob, noClipper, useVelocity](int, const volatile bool &stop) {
+				int dupliIdx = chunk.dupliOffset;
+				int instancerIdx = chunk.instancerOffset;
+				chunk.hash = 42;
+				for (int c = chunk.begin; c < chunk.end && !stop; ++c) {
+					const DupliObject *dupli = duplis[c];
+					const DupliParentInfo & parent = parents.find(dupli->ob)->second;
+					const DupliKind kind = getDupliKind(parent, dupli);
+
+					if (kind == DupliKind::SKIP) {
+						continue;
+					}
 
-	int c = 0;
-	for (auto & instance : Blender::collection(ob.dupli_list)) {
-		if (is_interrupted()) {
-			return;
-		}
-		auto flags = instanceFlags.get_flags(c++);
-		BL::Object parentOb(instance.object());
+					if (kind == DupliKind::NODE) {
+						chunk.nodes.push_back(std::make_pair(c, dupliIdx));
+					} else if (kind == DupliKind::INSTANCER && noClipper) {
+						float tm[4][4];
+						mul_m4_m4m4(tm, const_cast<float (*)[4]>(dupli->mat), const_cast<float (*)[4]>(parent.inverted));
+
+						AttrInstancer::Item &instancer_item = (*instances.data)[instancerIdx++];
+						instancer_item.index = getParticleID(ob, dupli, dupliIdx);
+						instancer_item.node = parent.nodeName;
+						instancer_item.tm = AttrTransformFromBlTransform(tm);
+						if (useVelocity) {
+							instancer_item.vel = AttrTransformFromBlTransform(dupli->mat);
+						} else {
+							memset(&instancer_item.vel, 0, sizeof(instancer_item.vel));
+						}
 
-		if (!flags.get(IF::MESH_LIGHT) && flags.get(IF::GEOMETRY) && flags.get(IF::HIDDEN)) {
-			continue;
+						// hashed here, while the item is in cache, so unchanged instancer can skip the export
+						MurmurHash3_x86_32(&instancer_item.index, sizeof(instancer_item.index), chunk.hash, &chunk.hash);
+						MurmurHash3_x86_32(&instancer_item.tm, sizeof(instancer_item.tm), chunk.hash, &chunk.hash);
+						MurmurHash3_x86_32(parent.nodeName.c_str(), parent.nodeName.size(), chunk.hash, &chunk.hash);
+
+					}
+					if (kind == DupliKind::INSTANCER) {
+						chunk.instancedParents.insert(dupli->ob);
+					}
+					++dupliIdx;
+				}
+			});
 		}
+		group.wait();
+	}
+
+	if (is_interrupted()) {
+		return;
+	}
+
+	// objects used by the instancer are synced once, all other calls would be skipped by the id cache
+	HashSet<const Object*> syncedParents;
+	for (const auto & chunk : chunks) {
+		for (const Object *parent : chunk.instancedParents) {
+			if (!syncedParents.insert(parent).second) {
+				continue;
+			}
+			const DupliParentInfo & info = parents[parent];
+			BL::Object parentOb(info.object);
 
-		MHash persistendID;
-		persistendID = getParticleID(ob, instance, dupliIdx);
+			ObjectOverridesAttrs overrideAttrs;
+			overrideAttrs.override = true;
+			overrideAttrs.isDupli = true;
+			overrideAttrs.dupliEmitter = ob;
+			// if object instancing this child is from group, then we need to hide all of the sources since they are implicitly linked in this scene
+			overrideAttrs.visible = info.visible && !linkedGroup;
+			overrideAttrs.tm = AttrTransformFromBlTransform(parentOb.matrix_world());
+			overrideAttrs.id = reinterpret_cast<intptr_t>(parentOb.ptr.data);
 
-		ObjectOverridesAttrs overrideAttrs;
-		overrideAttrs.override = true;
-		overrideAttrs.isDupli = true;
-		overrideAttrs.dupliEmitter = ob;
+			sync_object(parentOb, check_updated, overrideAttrs);
+		}
+	}
 
+	for (const auto & chunk : chunks) {
+		for (const auto & node : chunk.nodes) {
+			if (is_interrupted()) {
+				return;
+			}
+			const DupliObject *dupli = duplis[node.first];
+			const DupliParentInfo & info = parents[dupli->ob];
+			const bool hidden = dupli->no_draw || info.hidden;
+			BL::Object parentOb(info.object);
 
-		// TODO: if we check here it might be faster to skip the redundent call to sync_object
-		// node based duplication is for: (light, mesh light, visible clipper)
-		if (flags.get(IF::LIGHT) || flags.get(IF::MESH_LIGHT) || (flags.get(IF::CLIPPER) && !flags.get(IF::HIDDEN))) {
+			const MHash persistendID = getParticleID(ob, dupli, node.second);
+
+			ObjectOverridesAttrs overrideAttrs;
+			overrideAttrs.override = true;
+			overrideAttrs.isDupli = true;
+			overrideAttrs.dupliEmitter = ob;
 			overrideAttrs.useInstancer = false;
 
 			// sync dupli base object
 			if (!hide_from_parent) {
-				overrideAttrs.visible = !flags.get(IF::HIDDEN);
+				overrideAttrs.visible = !hidden;
 				overrideAttrs.tm = AttrTransformFromBlTransform(parentOb.matrix_world());
 				sync_object(parentOb, check_updated, overrideAttrs);
 			}
 			overrideAttrs.visible = true;
 			overrideAttrs.override = true;
-			overrideAttrs.tm = AttrTransformFromBlTransform(instance.matrix());
+			overrideAttrs.tm = AttrTransformFromBlTransform(dupli->mat);
 			overrideAttrs.id = persistendID;
 
 			char namePrefix[255] = {0, };
 			snprintf(namePrefix, 250, "Dupli%u@", persistendID);
 			overrideAttrs.namePrefix = namePrefix;
 
-			if (flags.get(IF::CLIPPER)) {
+			if (info.clipper) {
 				// clipper expects the node to be visible, and will hide it on its own
 				overrideAttrs.visible = true;
 			}
 			// overrideAttrs.visible = true; do this?
 
-			if (flags.get(IF::LIGHT)) {
+			if (info.light) {
 				// mark the duplication so we can remove in rt
 				auto lock = m_data_exporter.raiiLock();
 				m_data_exporter.m_id_track.insert(ob, overrideAttrs.namePrefix + m_data_exporter.getLightName(parentOb), IdTrack::DUPLI_LIGHT);
 			}
 			sync_object(parentOb, check_updated, overrideAttrs);
-		} else if (!flags.get(IF::HIDDEN)) {
-
-			// if object instancing this child is from group, then we need to hide all of the sources since they are implicitly linked in this scene
-			overrideAttrs.visible = !flags.get(IF::HIDDEN) && m_data_exporter.isObjectVisible(parentOb, OVisibility::HIDE_LAYER) && !linkedGroup;
-			overrideAttrs.tm = AttrTransformFromBlTransform(parentOb.matrix_world());
-			overrideAttrs.id = reinterpret_cast<intptr_t>(parentOb.ptr.data);
-
-			float inverted[4][4];
-			copy_m4_m4(inverted, ((Object*)parentOb.ptr.data)->obmat);
-			invert_m4(inverted);
-
-			float tm[4][4];
-			mul_m4_m4m4(tm, ((DupliObject*)instance.ptr.data)->mat, inverted);
-
-			AttrInstancer::Item &instancer_item = (*instances.data)[instancerIdx];
-			instancer_item.index = persistendID;
-			instancer_item.node = m_data_exporter.getNodeName(parentOb);
-			instancer_item.tm = AttrTransformFromBlTransform(tm);
-			if (m_settings.use_motion_blur && m_settings.calculate_instancer_velocity) {
-				instancer_item.vel = AttrTransformFromBlTransform(static_cast<struct DupliObject*>(instance.ptr.data)->mat);
-			} else {
-				memset(&instancer_item.vel, 0, sizeof(instancer_item.vel));
-			}
-			sync_object(parentOb, check_updated, overrideAttrs);
-
-			++instancerIdx;
 		}
-
-		dupliIdx++;
 	}
 
 	if (noClipper) {
-		m_data_exporter.exportVrayInstancer2(ob, instances, IdTrack::DUPLI_INSTACER);
+		if (useVelocity) {
+			// velocity export looks up particles by index
+			sortInstancerChunks(instances, chunks, m_threadManager);
+		}
+
+		MHash itemsHash = 42;
+		for (const auto & chunk : chunks) {
+			MurmurHash3_x86_32(&chunk.hash, sizeof(chunk.hash), itemsHash, &itemsHash);
+		}
+		m_data_exporter.exportVrayInstancer2(ob, instances, IdTrack::DUPLI_INSTACER, false, true, itemsHash);
 	}
 }
 
@@ -1187,41 +1465,24 @@ void SceneExporter::sync_array_mod(BL::Object ob, const int &check_updated) {
 	m_data_exporter.exportVrayInstancer2(ob, instances, IdTrack::DUPLI_MODIFIER, true);
 }
 
-void SceneExporter::pre_sync_object(const bool check_updated, BL::Object &ob, CondWaitGroup &wg) {
+void SceneExporter::pre_sync_object(const bool check_updated, BL::Object &ob, TaskGroup &group) {
 	if (is_interrupted()) {
 		return;
 	}
 
-	m_threadManager->addTask([this, check_updated, ob, &wg](int, const volatile bool &) mutable {
-		// make wrapper to call wg.done() on function exit
-		RAIIWaitGroupTask<CondWaitGroup> doneTask(wg);
+	group.run([this, check_updated, ob](int, const volatile bool &) mutable {
 		if (is_interrupted()) {
 			return;
 		}
 
 		const auto obName = ob.name();
 		SCOPED_TRACE_EX("Export task for object (%s)", obName.c_str());
+		ExportProfiler::Scope profile(m_exporter->getProfiler(), "scene", "sync_object");
 		const bool is_updated = (check_updated ? ob.is_updated() : true) || m_data_exporter.hasLayerChanged();
 		const bool visible = m_data_exporter.isObjectVisible(ob);
 
-		PointerRNA vrayObject = RNA_pointer_get(&ob.ptr, "vray");
-		PointerRNA vrayClipper = RNA_pointer_get(&vrayObject, "VRayClipper");
-		const bool noClipper = !RNA_boolean_get(&vrayClipper, "enabled");
-
-		bool has_array_mod = false;
-		if (noClipper) {
-			for (int c = ob.modifiers.length() - 1; c >= 0; --c) {
-				if (ob.modifiers[c].type() != BL::Modifier::type_ARRAY) {
-					// stop on last non array mod - we export only array mods on top of mod stack
-					break;
-				}
-				if (ob.modifiers[c].show_render()) {
-					// we found atleast one stuitable array mod
-					has_array_mod = true;
-					break;
-				}
-			}
-		}
+		const ObjectSyncInfo info = get_object_sync_info(ob, !check_updated || ob.is_updated() || ob.is_updated_data());
+		const bool has_array_mod = !info.hasClipper && info.hasArrayMod;
 		if (ob.is_duplicator()) {
 			if (is_updated) {
 				sync_dupli(ob, check_updated);
@@ -1255,36 +1516,44 @@ void SceneExporter::pre_sync_object(const bool check_updated, BL::Object &ob, Co
 void SceneExporter::sync_objects(const bool check_updated) {
 	PRINT_INFO_EX("SceneExporter::sync_objects(%i)", check_updated);
 
-	if (!m_frameExporter.isCurrentSubframe()) {
-		CondWaitGroup wg(m_scene.objects.length() - m_frameExporter.countObjectsWithSubframes());
+	if (m_isIncrementalSync) {
+		// only objects tagged by the depsgraph, all others keep their plugins from previous sync
+		TaskGroup group(m_threadManager);
+		for (auto & ob : m_updatedObjects) {
+			m_data_exporter.resetObjectUsage(ob);
+			pre_sync_object(check_updated, ob, group);
+		}
+
+		// always wait, queued tasks reference the group - when interrupted they return without exporting
+		PRINT_INFO_EX("Started export for %d updated objects - waiting for all.", static_cast<int>(m_updatedObjects.size()));
+		group.wait();
+	}
+	else if (!m_frameExporter.isCurrentSubframe()) {
+		TaskGroup group(m_threadManager);
 		for (auto & ob : Blender::collection(m_scene.objects)) {
 			// If motion blur is enabled, export only object without subframes, theese with will be exported later
 			if (!m_settings.use_motion_blur) {
-				pre_sync_object(check_updated, ob, wg);
+				pre_sync_object(check_updated, ob, group);
 			} else {
 				if (!m_frameExporter.hasObjectSubframes(ob)) {
-					pre_sync_object(check_updated, ob, wg);
+					pre_sync_object(check_updated, ob, group);
 				}
 			}
 		}
 
-		if (!is_interrupted() && m_threadManager->workerCount()) {
-			PRINT_INFO_EX("Started export for all objects - waiting for all.");
-			wg.wait();
-		}
+		PRINT_INFO_EX("Started export for all objects - waiting for all.");
+		group.wait();
 	}
 	else{
 		auto range = m_frameExporter.getObjectsWithCurrentSubframes();
-		CondWaitGroup wg(m_frameExporter.countObjectsWithCurrentSubframes());
+		TaskGroup group(m_threadManager);
 		for (auto obIt = range.first; obIt != range.second; ++obIt) {
 			BL::Object ob((*obIt).second);
-			pre_sync_object(check_updated, ob, wg);
+			pre_sync_object(check_updated, ob, group);
 		}
 
-		if (!is_interrupted() && m_threadManager->workerCount()) {
-			PRINT_INFO_EX("Started export for all objects - waiting for all.");
-			wg.wait();
-		}
+		PRINT_INFO_EX("Started export for all objects - waiting for all.");
+		group.wait();
 	}
 }
 
@@ -317,6 +317,8 @@ public:
 		, m_sceneComputedLayers(0)
 		, m_isLocalView(false)
 		, m_isUndoSync(false)
+		, m_isIncrementalSync(false)
+		, m_syncedObjectsHash(0)
 	{}
 
 	virtual ~SceneExporter();
@@ -326,6 +328,7 @@ public:
 	        void         init_data();
 	void                 free();
 	PluginExporter::Ptr  get_plugin_exporter() { return m_exporter; };
+	ThreadManager::Ptr   get_thread_manager() { return m_threadManager; };
 
 public:
 
@@ -345,7 +348,7 @@ public:
 	/// Export all scene data for the current frame
 	void                 sync(const bool check_updated=false);
 	void                 sync_view(const bool check_updated=false);
-	void                 pre_sync_object(const bool check_updated, BL::Object &ob, CondWaitGroup &wg);
+	void                 pre_sync_object(const bool check_updated, BL::Object &ob, TaskGroup &group);
 
 	void                 sync_objects(const bool check_updated=false);
 	void                 sync_effects(const bool check_updated=false);
@@ -379,6 +382,10 @@ public:
 
 	void                 calculate_scene_layers();
 
+	/// Check if only objects tagged for update need to be synced, false if any node tree, material or texture is updated
+	/// Fills m_updatedObjects with the scene's objects tagged for update or having updated parent
+	bool                 can_sync_incremental();
+
 	static BL::Object    getActiveCamera(BL::SpaceView3D view3d, BL::Scene scene);
 
 	PythonGIL            m_pyGIL;
@@ -388,6 +395,18 @@ protected:
 	void                 get_view_from_camera(ViewParams &viewParams, BL::Object &cameraObject);
 	void                 get_view_from_viewport(ViewParams &viewParams);
 
+	/// Data needed to decide how to export object, cached between syncs
+	struct ObjectSyncInfo {
+		bool hasClipper; ///< VRayClipper is enabled
+		bool hasArrayMod; ///< top of the modifier stack has enabled array modifier
+	};
+
+	/// Get cached ObjectSyncInfo for @ob, recalculate it if @is_updated or not cached yet
+	ObjectSyncInfo       get_object_sync_info(BL::Object ob, bool is_updated);
+
+	/// Calculate hash of the scene's object list and fill m_updatedObjects with objects tagged for update
+	uint64_t             collect_updated_objects();
+
 protected:
 	BL::Context          m_context;
 	BL::RenderEngine     m_engine;
@@ -419,6 +438,13 @@ protected:
 
 	bool                 m_isLocalView; ///< True if "local view" is enabled
 	bool                 m_isUndoSync; ///< True if the current sync is caused because user did undo action
+	bool                 m_isIncrementalSync; ///< True if the current sync exports only objects tagged for update
+
+	std::vector<BL::Object> m_updatedObjects; ///< Objects tagged for update, collected at the begining of incremental sync
+	uint64_t             m_syncedObjectsHash; ///< Hash of the scene's object list at last sync, used to detect added/removed objects
+
+	HashMap<void*, ObjectSyncInfo> m_objectSyncInfo; ///< Cached ObjectSyncInfo for each object
+	std::mutex           m_objectSyncInfoLock; ///< Lock protecting m_objectSyncInfo
 private:
 	int                  is_physical_view(BL::Object &cameraObject);
 	int                  is_physical_updated(ViewParams &viewParams);
@@ -151,6 +151,9 @@ void ProductionExporter::for_each_exported_frame(FrameExportManager & frameExp,
 		 (aMode == AnimMode::AnimationModeCameraLoop && !m_settings.use_hide_from_view)
 	);
 
+	// after the first export only transforms and other small data are re-evaluated for meshes which can't change
+	m_data_exporter.setReuseStaticGeometry(!isFirstExport);
+
 	if (onlyView) {
 		sync_view(false);
 	} else {
@@ -182,6 +185,13 @@ bool ProductionExporter::export_scene(const bool)
 		renderThread = std::thread(&ProductionExporter::render_loop, this);
 	}
 
+	// for animation exported to file keep the plugin cache between frames, so only the changed
+	// attributes are written as keyframes (with a hold key at the last frame a value was constant)
+	// and the file writer serializes previous frame while the scene is evaluated for the next one
+	const bool keepPluginCache = isFileExport && m_settings.settings_animation.use &&
+	                             m_settings.settings_animation.mode != SettingsAnimation::AnimationModeFrameByFrame;
+	m_exporter->set_keep_plugin_cache(keepPluginCache);
+
 	double totalSyncTime = 0.;
 	const int renderFrames = m_frameExporter.getRenderFrameCount();
 	bool isFirstExport = true;
@@ -191,6 +201,8 @@ bool ProductionExporter::export_scene(const bool)
 
 		if (!firstFrame) {
 			m_viewParams = {};
+		}
+		if (!firstFrame && !keepPluginCache) {
 			// call reset on vray
 			m_exporter->reset();
 			// clear all cached plugins
@@ -228,6 +240,11 @@ bool ProductionExporter::export_scene(const bool)
 		// wait render for current frame only
 		if (!isFileExport) {
 			PRINT_INFO_EX("Frame sync time %.3f sec.", frameSyncSeconds);
+			const DataExporter::NodeCacheStats nodeStats = m_data_exporter.getNodeCacheStats();
+			PRINT_INFO_EX("Node cache: materials %d reused, %d exported; nodes %d reused, %d exported",
+			              nodeStats.materialHits, nodeStats.materialMisses, nodeStats.nodeHits, nodeStats.nodeMisses);
+			const Mesh::TopologyCache::Stats topologyStats = m_data_exporter.getMeshTopologyStats();
+			PRINT_INFO_EX("Mesh topology: %d reused, %d rebuilt", topologyStats.hits, topologyStats.misses);
 			if (!wait_for_frame_render()) {
 				break;
 			}
@@ -236,8 +253,12 @@ bool ProductionExporter::export_scene(const bool)
 	}
 
 	m_data_exporter.flushInstancerData();
+	m_data_exporter.setReuseStaticGeometry(false);
 
 	PRINT_INFO_EX("Total sync time %.3f sec.", totalSyncTime);
+	PRINT_INFO_EX("Geometry plugins reused by content: %d", m_exporter->getPluginManager().getContentHits());
+	const PluginManager::CacheStats cacheStats = m_exporter->getPluginManager().getCacheStats();
+	PRINT_INFO_EX("Plugin cache: %d plugins, %.2f MB", static_cast<int>(cacheStats.entries), cacheStats.bytes / (1024.0 * 1024.0));
 
 	if (!isFileExport) {
 		std::unique_lock<std::mutex> uLock(m_python_state_lock, std::defer_lock);
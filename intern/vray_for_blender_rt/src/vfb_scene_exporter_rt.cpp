@@ -27,6 +27,14 @@
 #endif
 
 
+InteractiveExporter::~InteractiveExporter()
+{
+	if (m_viewportTexture) {
+		glDeleteTextures(1, &m_viewportTexture);
+	}
+}
+
+
 void InteractiveExporter::create_exporter()
 {
 	if (m_settings.exporter_type == ExporterType::ExpoterTypeFile) {
@@ -153,6 +161,11 @@ bool InteractiveExporter::export_scene(const bool check_updated)
 	clock_t end = clock();
 	double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
 	PRINT_INFO_EX("Synced in %.3f sec.", elapsed_secs);
+	const DataExporter::NodeCacheStats nodeStats = m_data_exporter.getNodeCacheStats();
+	PRINT_INFO_EX("Node cache: materials %d reused, %d exported; nodes %d reused, %d exported",
+	              nodeStats.materialHits, nodeStats.materialMisses, nodeStats.nodeHits, nodeStats.nodeMisses);
+	const Mesh::TopologyCache::Stats topologyStats = m_data_exporter.getMeshTopologyStats();
+	PRINT_INFO_EX("Mesh topology: %d reused, %d rebuilt", topologyStats.hits, topologyStats.misses);
 
 	return true;
 }
@@ -174,13 +187,20 @@ void InteractiveExporter::draw()
 	sync_view(true);
 	// python_thread_state_restore();
 
-	RenderImage image = m_exporter->get_image();
+	const bool transparent = m_settings.getViewportShowAlpha();
+	const ImageRegion::Options options = transparent ? ImageRegion::Options::CLAMP : ImageRegion::Options::FROM_RENDERER;
+	if (options != m_viewportOptions) {
+		// regions already converted with the other options must be copied again
+		m_viewportImage = RenderImage();
+		m_viewportOptions = options;
+	}
+
+	const bool updated = m_exporter->update_image(m_viewportImage, m_viewportDirty, options);
+	const RenderImage &image = m_viewportImage;
 	if (!image) {
 		tag_redraw();
 	}
 	else {
-		const bool transparent = m_settings.getViewportShowAlpha();
-
 		glPushMatrix();
 		// When initializing view params we multiply all sizes by this scale, but now we need to calculate blender sizes
 		// so we must go back in blender sizes
@@ -197,24 +217,42 @@ void InteractiveExporter::draw()
 			glEnable(GL_BLEND);
 			glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 		}
-		else {
-			image.resetAlpha();
-		}
-		image.clamp();
 
 		glColor3f(1.0f, 1.0f, 1.0f);
 
-		GLuint texid;
-		glGenTextures(1, &texid);
-		glBindTexture(GL_TEXTURE_2D, texid);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, image.w, image.h, 0, GL_RGBA, GL_FLOAT, image.pixels);
+		// the texture is kept between draws and only the changed regions are uploaded
+		bool textureValid = true;
+		if (!m_viewportTexture || m_viewportTextureSize.w != image.w || m_viewportTextureSize.h != image.h) {
+			if (!m_viewportTexture) {
+				glGenTextures(1, &m_viewportTexture);
+			}
+			glBindTexture(GL_TEXTURE_2D, m_viewportTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, image.w, image.h, 0, GL_RGBA, GL_FLOAT, image.pixels);
+			textureValid = glGetError() == GL_NO_ERROR;
+			m_viewportTextureSize = {image.w, image.h, image.channels};
+		} else {
+			glBindTexture(GL_TEXTURE_2D, m_viewportTexture);
+			if (updated) {
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, image.w);
+				for (const ImageRegion &region : m_viewportDirty) {
+					glPixelStorei(GL_UNPACK_SKIP_PIXELS, region.x);
+					glPixelStorei(GL_UNPACK_SKIP_ROWS, region.y);
+					glTexSubImage2D(GL_TEXTURE_2D, 0, region.x, region.y, region.w, region.h, GL_RGBA, GL_FLOAT, image.pixels);
+				}
+				glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+				glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+				textureValid = glGetError() == GL_NO_ERROR;
+			}
+		}
 
-		if (glGetError() != GL_NO_ERROR) {
+		if (!textureValid) {
 			// for some reason we cant draw 2d textures
 
 			glBindTexture(GL_TEXTURE_2D, 0);
 			glDisable(GL_TEXTURE_2D);
-			glDeleteTextures(1, &texid);
+			glDeleteTextures(1, &m_viewportTexture);
+			m_viewportTexture = 0;
 
 			float xZoom = 1.f;
 			float yZoom = 1.f;
@@ -232,9 +270,10 @@ void InteractiveExporter::draw()
 
 			// TODO: we are directly drawing to screen, if viewportResolution is not 100% then this will not fill the drawing area
 			//       to fix this, we should streach the image manually
-			// we need to manually flip since we cant do it on the device
-			image.flip();
-			glDrawPixels(image.w, image.h, GL_RGBA, GL_FLOAT, image.pixels);
+			// we need to manually flip since we cant do it on the device, flip a copy since the image is kept for next draw
+			RenderImage flipped = RenderImage::deepCopy(image);
+			flipped.flip();
+			glDrawPixels(flipped.w, flipped.h, GL_RGBA, GL_FLOAT, flipped.pixels);
 
 			glPixelZoom(1.0f, 1.0f);
 		}
@@ -273,7 +312,6 @@ void InteractiveExporter::draw()
 			m_engine.unbind_display_space_shader();
 			glBindTexture(GL_TEXTURE_2D, 0);
 			glDisable(GL_TEXTURE_2D);
-			glDeleteTextures(1, &texid);
 		}
 
 		if (transparent) {
@@ -30,8 +30,13 @@ class InteractiveExporter
 public:
 	InteractiveExporter(BL::Context context, BL::RenderEngine engine, BL::BlendData data, BL::Scene scene)
 	    : SceneExporter(context, engine, data, scene, BL::SpaceView3D(context.space_data()), context.region_data(), context.region())
+	    , m_viewportOptions(ImageRegion::Options::NONE)
+	    , m_viewportTexture(0)
+	    , m_viewportTextureSize{0, 0, 0}
 	{}
 
+	virtual ~InteractiveExporter();
+
 	virtual void  draw() override;
 	virtual void  sync_dupli(BL::Object ob, const int &check_updated = false) override;
 	virtual void  create_exporter() override;
@@ -43,6 +48,13 @@ public:
 public:
 	void          cb_on_image_ready() { tag_redraw(); }
 
+private:
+	RenderImage              m_viewportImage; ///< converted image, only the changed regions are updated on each draw
+	std::vector<ImageRegion> m_viewportDirty; ///< regions of @m_viewportImage changed by the last update
+	ImageRegion::Options     m_viewportOptions; ///< conversions applied to @m_viewportImage
+	unsigned int             m_viewportTexture; ///< GL texture kept between draws, 0 if not created
+	ImageSize                m_viewportTextureSize; ///< size @m_viewportTexture was allocated with
+
 };
 
 } // namespace VRayForBlender
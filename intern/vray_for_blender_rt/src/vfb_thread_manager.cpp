@@ -6,10 +6,22 @@
 using namespace VRayForBlender;
 using namespace std;
 
+namespace {
+// Set for worker threads so nested addTask calls can find the worker's own queue
+thread_local const ThreadManager *tlsManager = nullptr;
+thread_local int                  tlsWorker  = -1;
+}
+
 ThreadManager::ThreadManager(int thCount)
-	: m_stop(false)
+	: m_pending(0)
+	, m_sleeping(0)
+	, m_nextQueue(0)
+	, m_stop(false)
 {
 	if (thCount > 0) {
+		for (int c = 0; c < thCount; ++c) {
+			m_queues.emplace_back(new Worker());
+		}
 		for (int c = 0; c < thCount; ++c) {
 			m_workers.emplace_back(thread(&ThreadManager::workerRun, this, c));
 		}
@@ -30,10 +42,14 @@ ThreadManager::~ThreadManager() {
 }
 
 void ThreadManager::stop() {
-	m_stop = true;
+	{
+		// set under the lock so no worker can miss the flag between checking it and going to sleep
+		lock_guard<mutex> lock(m_sleepMtx);
+		m_stop = true;
+	}
 
 	if (!m_workers.empty()) {
-		m_queueCondVar.notify_all();
+		m_sleepCondVar.notify_all();
 
 		for (int c = 0; c < m_workers.size(); ++c) {
 			if (m_workers[c].joinable()) {
@@ -44,46 +60,218 @@ void ThreadManager::stop() {
 		}
 
 		m_workers.clear();
+
+		for (auto & queue : m_queues) {
+			lock_guard<mutex> lock(queue->mtx);
+			m_pending -= queue->tasks.size();
+			queue->tasks.clear();
+		}
 	}
 }
 
+int ThreadManager::currentWorker() const {
+	return tlsManager == this ? tlsWorker : -1;
+}
+
 void ThreadManager::addTask(ThreadManager::Task task, ThreadManager::Priority priority) {
 	if (m_workers.empty()) {
 		// no workers - do the job ourselves
 		task(-1, m_stop);
+		return;
+	}
+
+	const int thIdx = currentWorker();
+	if (thIdx != -1) {
+		// nested task - keep it on this worker so it runs next while data is still in cache
+		Worker & queue = *m_queues[thIdx];
+		lock_guard<mutex> lock(queue.mtx);
+		queue.tasks.push_front(move(task));
 	} else {
+		Worker & queue = *m_queues[m_nextQueue++ % m_queues.size()];
+		lock_guard<mutex> lock(queue.mtx);
+		if (priority == Priority::HIGH) {
+			queue.tasks.push_front(move(task));
+		} else {
+			queue.tasks.push_back(move(task));
+		}
+	}
+
+	++m_pending;
+	if (m_sleeping > 0) {
 		{
-			lock_guard<mutex> lock(m_queueMtx);
-			if (priority == Priority::HIGH) {
-				m_tasks.push_front(task);
-			} else {
-				m_tasks.push_back(task);
-			}
+			// sleeping worker could be between checking m_pending and waiting on the cond var
+			lock_guard<mutex> lock(m_sleepMtx);
 		}
-		m_queueCondVar.notify_one();
+		m_sleepCondVar.notify_one();
+	}
+}
+
+bool ThreadManager::popTask(int thIdx, Task &task) {
+	Worker & queue = *m_queues[thIdx];
+	lock_guard<mutex> lock(queue.mtx);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+	task = move(queue.tasks.front());
+	queue.tasks.pop_front();
+	--m_pending;
+	return true;
+}
+
+bool ThreadManager::stealTask(int thIdx, Task &task) {
+	const int count = m_queues.size();
+	const int start = thIdx == -1 ? 0 : thIdx + 1;
+	for (int c = 0; c < count; ++c) {
+		const int victim = (start + c) % count;
+		if (victim == thIdx) {
+			continue;
+		}
+		Worker & queue = *m_queues[victim];
+		lock_guard<mutex> lock(queue.mtx);
+		if (!queue.tasks.empty()) {
+			// take the oldest task, it is most likely the biggest chunk of work
+			task = move(queue.tasks.back());
+			queue.tasks.pop_back();
+			--m_pending;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadManager::runPendingTask() {
+	// tasks are still run after stop, with the flag set, a worker waiting in a task group
+	// would otherwise wait for tasks that are only discarded after it is joined
+	// m_queues never changes after construction, unlike m_workers which stop clears
+	if (m_queues.empty() || m_pending <= 0) {
+		return false;
+	}
+
+	const int thIdx = currentWorker();
+	Task task;
+	if (thIdx != -1 && popTask(thIdx, task)) {
+		task(thIdx, m_stop);
+		++m_queues[thIdx]->tasksRun;
+		return true;
+	}
+
+	if (stealTask(thIdx, task)) {
+		task(thIdx, m_stop);
+		if (thIdx != -1) {
+			++m_queues[thIdx]->tasksRun;
+			++m_queues[thIdx]->tasksStolen;
+		}
+		return true;
+	}
+	return false;
+}
+
+std::vector<WorkerStats> ThreadManager::getStats() const {
+	std::vector<WorkerStats> stats(m_queues.size());
+	for (int c = 0; c < m_queues.size(); ++c) {
+		stats[c].tasksRun = m_queues[c]->tasksRun;
+		stats[c].tasksStolen = m_queues[c]->tasksStolen;
+		stats[c].idleSeconds = m_queues[c]->idleNs / 1e9;
+	}
+	return stats;
+}
+
+void ThreadManager::resetStats() {
+	for (auto & queue : m_queues) {
+		queue->tasksRun = 0;
+		queue->tasksStolen = 0;
+		queue->idleNs = 0;
 	}
 }
 
 void ThreadManager::workerRun(int thIdx) {
 	PRINT_INFO_EX("Thread [%d] starting ...", thIdx);
 
+	tlsManager = this;
+	tlsWorker = thIdx;
+
+	Worker & self = *m_queues[thIdx];
+
 	while (!m_stop) {
 		Task task;
-		{
-			unique_lock<mutex> lock(m_queueMtx);
-			// wait for task or stop
-			m_queueCondVar.wait(lock, [this] { return !m_tasks.empty() || m_stop; });
-
-			if (m_stop) {
-				break;
+		bool stolen = false;
+		if (!popTask(thIdx, task)) {
+			stolen = stealTask(thIdx, task);
+			if (!stolen) {
+				const auto idleStart = chrono::steady_clock::now();
+				{
+					unique_lock<mutex> lock(m_sleepMtx);
+					++m_sleeping;
+					// wait for task or stop
+					m_sleepCondVar.wait(lock, [this] { return m_pending > 0 || m_stop; });
+					--m_sleeping;
+				}
+				self.idleNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - idleStart).count();
+				continue;
 			}
-
-			task = m_tasks.front();
-			m_tasks.pop_front();
 		}
 
 		task(thIdx, m_stop);
+
+		++self.tasksRun;
+		if (stolen) {
+			++self.tasksStolen;
+		}
 	}
 
+	tlsManager = nullptr;
+	tlsWorker = -1;
+
 	PRINT_INFO_EX("Thread [%d] stopping.", thIdx);
-}
\ No newline at end of file
+}
+
+void TaskGroup::run(ThreadManager::Task task, ThreadManager::Priority priority) {
+	++m_remaining;
+	// done() is called when the last copy of the task is destroyed, after it ran or when the
+	// thread manager discarded it without running
+	std::shared_ptr<RAIIWaitGroupTask<TaskGroup>> doneTask(new RAIIWaitGroupTask<TaskGroup>(*this));
+	m_threadManager->addTask([doneTask, task](int thIdx, const volatile bool &stop) {
+		task(thIdx, stop);
+	}, priority);
+}
+
+void TaskGroup::done() {
+	// decrement and notify under the lock, wait() can return and destroy the group as soon as it sees 0
+	lock_guard<mutex> lock(m_mtx);
+	if (--m_remaining == 0) {
+		m_condVar.notify_all();
+	}
+}
+
+void TaskGroup::wait() {
+	while (true) {
+		if (m_threadManager->runPendingTask()) {
+			continue;
+		}
+		// all tasks of the group are running on other threads, they could still add nested ones so check periodically
+		unique_lock<mutex> lock(m_mtx);
+		if (m_remaining == 0) {
+			return;
+		}
+		m_condVar.wait_for(lock, chrono::milliseconds(1), [this] { return m_remaining == 0; });
+	}
+}
+
+void VRayForBlender::runSharedWork(ThreadManager::Ptr threadManager, int maxTasks, const function<void()> &work) {
+	const int tasks = threadManager ? min(maxTasks - 1, threadManager->workerCount()) : 0;
+	if (tasks <= 0) {
+		work();
+		return;
+	}
+
+	TaskGroup group(threadManager);
+	for (int c = 0; c < tasks; ++c) {
+		group.run([&work](int, const volatile bool &stop) {
+			if (!stop) {
+				work();
+			}
+		});
+	}
+	work();
+	group.wait();
+}
@@ -30,6 +30,7 @@
 #include <vector>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 
 namespace VRayForBlender {
 
@@ -134,7 +135,21 @@ private:
 	WGType & m_waitGroup;
 };
 
-/// Basic thread manager able to execute tasks on different threads
+/// Counters collected by each worker thread of ThreadManager
+struct WorkerStats {
+	uint64_t tasksRun;    ///< number of tasks executed by the worker, including stolen ones
+	uint64_t tasksStolen; ///< number of tasks taken from other worker's queue
+	double   idleSeconds; ///< time spent waiting for tasks
+
+	WorkerStats()
+		: tasksRun(0)
+		, tasksStolen(0)
+		, idleSeconds(0.0) {}
+};
+
+/// Work stealing thread manager able to execute tasks on different threads
+/// Each worker has its own queue, tasks added from a worker thread go to its own queue
+/// and are executed depth first, idle workers steal the oldest tasks from other queues
 class ThreadManager {
 public:
 	typedef std::shared_ptr<ThreadManager> Ptr;
@@ -165,14 +180,50 @@ public:
 	// Stop all threads and discards any tasks not yet started
 	// if thread count is 0, stop will still set the flag for stop to true
 	// and if addTask was called from another thread it will signal the task to stop
+	// discarded tasks are destroyed without being called
 	void stop();
 
+	// Check if stop was called
+	bool isStopped() const {
+		return m_stop;
+	}
+
 	// Add task to queue
+	// called from a worker thread (nested task) the @task is added to the worker's own queue
+	// and will be the next one it executes unless stolen
+	// called from any other thread @task is distributed round robin over the worker's queues
 	// @task with LOW  @priority will be added at the end      of queue
 	// @task with HIGH @priority will be added at the begining of queue
 	// okay to be called concurrently
 	void addTask(Task task, Priority priority);
+
+	// Execute one pending task on the calling thread if there is any
+	// worker threads take from their own queue first, other threads only steal
+	// after stop was called tasks still pending are executed with the stop flag set,
+	// so a worker waiting on a TaskGroup does not block stop from joining it
+	// @return true if a task was executed
+	bool runPendingTask();
+
+	// Get a snapshot of the counters for each worker
+	std::vector<WorkerStats> getStats() const;
+
+	// Set all worker counters to 0
+	void resetStats();
 private:
+	/// Queue and counters owned by one worker thread
+	struct Worker {
+		std::mutex             mtx;         ///< lock guarding @tasks
+		std::deque<Task>       tasks;       ///< front is executed next by the owner, thieves take from back
+		std::atomic<uint64_t>  tasksRun;    ///< see WorkerStats
+		std::atomic<uint64_t>  tasksStolen; ///< see WorkerStats
+		std::atomic<uint64_t>  idleNs;      ///< see WorkerStats, in nanoseconds
+
+		Worker()
+			: tasksRun(0)
+			, tasksStolen(0)
+			, idleNs(0) {}
+	};
+
 	/// Initialize ThreadManager
 	/// @thCount - number of threads to create, if 0 all tasks will be executed immediately on calling thread
 	ThreadManager(int thCount);
@@ -180,13 +231,68 @@ private:
 	/// Base function for each thread
 	void workerRun(int thIdx);
 
-	std::mutex               m_queueMtx;     ///< lock guarding @m_tasks
-	std::condition_variable  m_queueCondVar; ///< cond var for threads to wait for new tasks
-	std::deque<Task>         m_tasks;        ///< queue of the pending tasks
-	std::vector<std::thread> m_workers;      ///< all worker threads created for this instace
-	volatile bool            m_stop;         ///< if set to true, will stop all threads, also passed to each task as second argument
+	/// Get the worker index of the calling thread, -1 if it is not one of this manager's workers
+	int currentWorker() const;
+
+	/// Take task from @thIdx's own queue
+	bool popTask(int thIdx, Task &task);
+
+	/// Take task from the back of any queue other than @thIdx's, @thIdx could be -1
+	bool stealTask(int thIdx, Task &task);
+
+	std::vector<std::unique_ptr<Worker>> m_queues;         ///< one queue per worker
+	std::vector<std::thread>             m_workers;        ///< all worker threads created for this instace
+	std::atomic<int>                     m_pending;        ///< number of tasks in all queues
+	std::atomic<int>                     m_sleeping;       ///< number of workers waiting on @m_sleepCondVar
+	std::atomic<unsigned>                m_nextQueue;      ///< round robin counter for tasks added from non worker threads
+	std::mutex                           m_sleepMtx;       ///< lock for @m_sleepCondVar
+	std::condition_variable              m_sleepCondVar;   ///< cond var for idle threads to wait for new tasks
+	volatile bool                        m_stop;           ///< if set to true, will stop all threads, also passed to each task as second argument
 };
 
+/// Group of tasks added to a ThreadManager which can be waited on
+/// Tasks can add more tasks to the same group, wait will execute pending tasks while waiting
+/// so it is safe to call from inside a worker thread
+class TaskGroup {
+public:
+	TaskGroup(ThreadManager::Ptr threadManager)
+		: m_threadManager(threadManager)
+		, m_remaining(0) {}
+
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup & operator=(const TaskGroup &) = delete;
+
+	/// Add @task to the thread manager as part of this group
+	void run(ThreadManager::Task task, ThreadManager::Priority priority = ThreadManager::Priority::LOW);
+
+	/// Get number of tasks remaining at call time, could be less when function returns
+	int remaining() const {
+		return m_remaining;
+	}
+
+	/// Block until all tasks in the group are done, executing any pending tasks meanwhile
+	/// Tasks discarded by ThreadManager::stop count as done, so this returns only once
+	/// no task references the group anymore
+	void wait();
+
+private:
+	friend class RAIIWaitGroupTask<TaskGroup>;
+
+	/// Mark one task as done
+	void done();
+
+	ThreadManager::Ptr       m_threadManager; ///< manager executing the tasks
+	std::atomic<int>         m_remaining;     ///< number of tasks not yet completed, decremented under @m_mtx
+	std::mutex               m_mtx;           ///< lock for m_condVar and for the last decrement of @m_remaining
+	std::condition_variable  m_condVar;       ///< signaled when m_remaining drops to 0
+};
+
+/// Run @work on the calling thread and in up to @maxTasks - 1 tasks of @threadManager, return when all of them are done
+/// @work must take it's items from shared state until none are left, so the calling thread finishes everything
+/// even if the tasks are discarded by stop or the workers are busy with other tasks
+/// Safe to call from inside a task, with null @threadManager @work only runs on the calling thread
+void runSharedWork(ThreadManager::Ptr threadManager, int maxTasks, const std::function<void()> &work);
+
 } // namespace VRayForBlender
 
 #endif // VRAY_FOR_BLENDER_THREAD_MANAGER_H
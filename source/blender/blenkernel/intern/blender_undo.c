@@ -197,6 +197,20 @@ void BKE_undo_write(bContext *C, const char *name)
 		memused = MEM_get_memory_in_use();
 		/* success = */ /* UNUSED */ BLO_write_file_mem(CTX_data_main(C), prevfile, &curundo->memfile, G.fileflags);
 		curundo->undosize = MEM_get_memory_in_use() - memused;
+
+		if (G.debug & G_DEBUG_WM) {
+			const MemFile *memfile = &curundo->memfile;
+			size_t store_size;
+			unsigned int store_buffers;
+
+			BLO_memfile_store_stats(&store_size, &store_buffers);
+			printf("%s: '%s' %.2f MB in %u chunks, %u shared (%u moved), %.2f MB new, "
+			       "all steps %.2f MB in %u buffers\n",
+			       __func__, curundo->name, (double)memfile->size_total / (1024.0 * 1024.0),
+			       memfile->chunks_num, memfile->chunks_ident, memfile->chunks_moved,
+			       (double)memfile->size / (1024.0 * 1024.0),
+			       (double)store_size / (1024.0 * 1024.0), store_buffers);
+		}
 	}
 
 	if (U.undomemory != 0) {
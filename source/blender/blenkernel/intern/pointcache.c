@@ -47,6 +47,7 @@
 #include "DNA_smoke_types.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_task.h"
 #include "BLI_threads.h"
 #include "BLI_math.h"
 #include "BLI_utildefines.h"
@@ -96,6 +97,12 @@
 
 #define LZO_OUT_LEN(size)     ((size) + (size) / 16 + 64 + 3)
 
+/* Arrays larger than a block are compressed in independent blocks, with the sizes of all blocks
+ * written in front of them, so they are compressed and decompressed on all threads.
+ * The compressed flag of such arrays is PTCACHE_COMPRESS_BLOCKS + the compression mode. */
+#define PTCACHE_COMPRESS_BLOCKS      16
+#define PTCACHE_COMPRESS_BLOCK_SIZE  (1 << 20)
+
 #ifdef WITH_LZMA
 #include "LzmaLib.h"
 #endif
@@ -1912,6 +1919,239 @@ static void ptcache_file_close(PTCacheFile *pf)
 	}
 }
 
+typedef struct PTCacheCompressBlocks {
+	unsigned char *data;          /* uncompressed data of all blocks */
+	unsigned int data_len;
+	unsigned char **blocks;       /* compressed data of each block */
+	unsigned int *blocks_len;     /* a block as long as its data is stored uncompressed */
+	int *blocks_error;
+	int mode;
+} PTCacheCompressBlocks;
+
+static bool ptcache_compress_blocks_supported(int mode)
+{
+#ifdef WITH_LZO
+	if (mode == PTCACHE_COMPRESS_LZO)
+		return true;
+#endif
+#ifdef WITH_LZMA
+	if (mode == PTCACHE_COMPRESS_LZMA)
+		return true;
+#endif
+	(void)mode; /* unused when building w/o compression */
+
+	return false;
+}
+
+static unsigned int ptcache_compress_block_len(const PTCacheCompressBlocks *cb, int block)
+{
+	return MIN2(PTCACHE_COMPRESS_BLOCK_SIZE, cb->data_len - (unsigned int)block * PTCACHE_COMPRESS_BLOCK_SIZE);
+}
+
+static void ptcache_compress_block_cb(void *__restrict userdata,
+                                      const int block,
+                                      const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	PTCacheCompressBlocks *cb = userdata;
+	unsigned char *in = cb->data + (size_t)block * PTCACHE_COMPRESS_BLOCK_SIZE;
+	const unsigned int in_len = ptcache_compress_block_len(cb, block);
+	unsigned char *out = MEM_mallocN(LZO_OUT_LEN(in_len), "pointcache_block");
+	size_t out_len = 0;
+
+	(void)in; /* unused when building w/o compression */
+
+	if (out == NULL) {
+		/* store the block uncompressed */
+		cb->blocks[block] = NULL;
+		cb->blocks_len[block] = in_len;
+		return;
+	}
+
+#ifdef WITH_LZO
+	if (cb->mode == PTCACHE_COMPRESS_LZO) {
+		LZO_HEAP_ALLOC(wrkmem, LZO1X_MEM_COMPRESS);
+
+		out_len = LZO_OUT_LEN(in_len);
+		if (lzo1x_1_compress(in, (lzo_uint)in_len, out, (lzo_uint *)&out_len, wrkmem) != LZO_E_OK)
+			out_len = 0;
+	}
+#endif
+#ifdef WITH_LZMA
+	if (cb->mode == PTCACHE_COMPRESS_LZMA && in_len > LZMA_PROPS_SIZE + 1) {
+		/* properties go in front of the data, only keep the result when all of it is smaller */
+		size_t props_len = LZMA_PROPS_SIZE;
+
+		out_len = in_len - LZMA_PROPS_SIZE - 1;
+		/* the dictionary doesn't need to be larger than a block */
+		if (LzmaCompress(out + LZMA_PROPS_SIZE, &out_len, in, in_len, out, &props_len,
+		                 5, PTCACHE_COMPRESS_BLOCK_SIZE, 3, 0, 2, 32, 1) == SZ_OK)
+		{
+			out_len += LZMA_PROPS_SIZE;
+		}
+		else {
+			out_len = 0;
+		}
+	}
+#endif
+
+	if (out_len == 0 || out_len >= in_len) {
+		MEM_freeN(out);
+		cb->blocks[block] = NULL;
+		cb->blocks_len[block] = in_len;
+	}
+	else {
+		cb->blocks[block] = out;
+		cb->blocks_len[block] = (unsigned int)out_len;
+	}
+}
+
+static void ptcache_decompress_block_cb(void *__restrict userdata,
+                                        const int block,
+                                        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	PTCacheCompressBlocks *cb = userdata;
+	unsigned char *out = cb->data + (size_t)block * PTCACHE_COMPRESS_BLOCK_SIZE;
+	const unsigned int out_len = ptcache_compress_block_len(cb, block);
+	const unsigned char *in = cb->blocks[block];
+	const unsigned int in_len = cb->blocks_len[block];
+	bool ok = false;
+
+	if (in_len == out_len) {
+		memcpy(out, in, out_len);
+		return;
+	}
+
+#ifdef WITH_LZO
+	if (cb->mode == PTCACHE_COMPRESS_LZO) {
+		lzo_uint len = out_len;
+		ok = (lzo1x_decompress_safe(in, (lzo_uint)in_len, out, &len, NULL) == LZO_E_OK) && (len == out_len);
+	}
+#endif
+#ifdef WITH_LZMA
+	if (cb->mode == PTCACHE_COMPRESS_LZMA && in_len > LZMA_PROPS_SIZE) {
+		size_t len = out_len, src_len = in_len - LZMA_PROPS_SIZE;
+		ok = (LzmaUncompress(out, &len, in + LZMA_PROPS_SIZE, &src_len, in, LZMA_PROPS_SIZE) == SZ_OK) &&
+		     (len == out_len);
+	}
+#endif
+
+	cb->blocks_error[block] = !ok;
+}
+
+static int ptcache_file_compressed_read_blocks(PTCacheFile *pf, unsigned char *result, unsigned int len, int mode)
+{
+	PTCacheCompressBlocks cb = {NULL};
+	ParallelRangeSettings settings;
+	const int blocks_num = (int)((len + PTCACHE_COMPRESS_BLOCK_SIZE - 1) / PTCACHE_COMPRESS_BLOCK_SIZE);
+	unsigned int file_blocks_num = 0;
+	unsigned char *in = NULL;
+	size_t in_len = 0;
+	int i, r = 0;
+
+	if (!ptcache_file_read(pf, &file_blocks_num, 1, sizeof(unsigned int)) || file_blocks_num != (unsigned int)blocks_num)
+		return 1;
+
+	cb.data = result;
+	cb.data_len = len;
+	cb.mode = mode;
+	cb.blocks = MEM_callocN(sizeof(*cb.blocks) * blocks_num, "pointcache_blocks");
+	cb.blocks_len = MEM_callocN(sizeof(*cb.blocks_len) * blocks_num, "pointcache_blocks_len");
+	cb.blocks_error = MEM_callocN(sizeof(*cb.blocks_error) * blocks_num, "pointcache_blocks_error");
+
+	if (cb.blocks == NULL || cb.blocks_len == NULL || cb.blocks_error == NULL)
+		r = 1;
+	else if (!ptcache_file_read(pf, cb.blocks_len, blocks_num, sizeof(unsigned int)))
+		r = 1;
+
+	for (i = 0; i < blocks_num && r == 0; i++) {
+		if (cb.blocks_len[i] > ptcache_compress_block_len(&cb, i))
+			r = 1;
+		in_len += cb.blocks_len[i];
+	}
+
+	/* read all blocks at once, then decompress them on all threads */
+	if (r == 0) {
+		in = MEM_mallocN(in_len, "pointcache_compressed_buffer");
+		if (in == NULL || !ptcache_file_read(pf, in, in_len, sizeof(unsigned char)))
+			r = 1;
+	}
+
+	if (r == 0) {
+		unsigned char *block = in;
+		for (i = 0; i < blocks_num; i++) {
+			cb.blocks[i] = block;
+			block += cb.blocks_len[i];
+		}
+
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.use_threading = (blocks_num > 1);
+		settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+		BLI_task_parallel_range(0, blocks_num, &cb, ptcache_decompress_block_cb, &settings);
+
+		for (i = 0; i < blocks_num; i++) {
+			if (cb.blocks_error[i])
+				r = 1;
+		}
+	}
+
+	MEM_SAFE_FREE(in);
+	MEM_SAFE_FREE(cb.blocks);
+	MEM_SAFE_FREE(cb.blocks_len);
+	MEM_SAFE_FREE(cb.blocks_error);
+
+	return r;
+}
+
+static int ptcache_file_compressed_write_blocks(PTCacheFile *pf, unsigned char *in, unsigned int in_len, int mode)
+{
+	PTCacheCompressBlocks cb = {NULL};
+	ParallelRangeSettings settings;
+	const int blocks_num = (int)((in_len + PTCACHE_COMPRESS_BLOCK_SIZE - 1) / PTCACHE_COMPRESS_BLOCK_SIZE);
+	const unsigned char compressed = PTCACHE_COMPRESS_BLOCKS + mode;
+	const unsigned int file_blocks_num = blocks_num;
+	int i;
+
+	cb.data = in;
+	cb.data_len = in_len;
+	cb.mode = mode;
+	cb.blocks = MEM_callocN(sizeof(*cb.blocks) * blocks_num, "pointcache_blocks");
+	cb.blocks_len = MEM_callocN(sizeof(*cb.blocks_len) * blocks_num, "pointcache_blocks_len");
+
+	if (cb.blocks == NULL || cb.blocks_len == NULL) {
+		/* write the array uncompressed, same as when it doesn't get smaller */
+		const unsigned char uncompressed = 0;
+
+		MEM_SAFE_FREE(cb.blocks);
+		MEM_SAFE_FREE(cb.blocks_len);
+		ptcache_file_write(pf, &uncompressed, 1, sizeof(unsigned char));
+		ptcache_file_write(pf, in, in_len, sizeof(unsigned char));
+		return 0;
+	}
+
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+	BLI_task_parallel_range(0, blocks_num, &cb, ptcache_compress_block_cb, &settings);
+
+	ptcache_file_write(pf, &compressed, 1, sizeof(unsigned char));
+	ptcache_file_write(pf, &file_blocks_num, 1, sizeof(unsigned int));
+	ptcache_file_write(pf, cb.blocks_len, blocks_num, sizeof(unsigned int));
+
+	for (i = 0; i < blocks_num; i++) {
+		if (cb.blocks[i]) {
+			ptcache_file_write(pf, cb.blocks[i], cb.blocks_len[i], sizeof(unsigned char));
+			MEM_freeN(cb.blocks[i]);
+		}
+		else {
+			ptcache_file_write(pf, in + (size_t)i * PTCACHE_COMPRESS_BLOCK_SIZE, cb.blocks_len[i], sizeof(unsigned char));
+		}
+	}
+
+	MEM_freeN(cb.blocks);
+	MEM_freeN(cb.blocks_len);
+
+	return 0;
+}
+
 static int ptcache_file_compressed_read(PTCacheFile *pf, unsigned char *result, unsigned int len)
 {
 	int r = 0;
@@ -1921,9 +2161,14 @@ static int ptcache_file_compressed_read(PTCacheFile *pf, unsigned char *result,
 	size_t out_len = len;
 #endif
 	unsigned char *in;
-	unsigned char *props = MEM_callocN(16 * sizeof(char), "tmp");
+	unsigned char *props;
 
 	ptcache_file_read(pf, &compressed, 1, sizeof(unsigned char));
+	if (compressed > PTCACHE_COMPRESS_BLOCKS) {
+		return ptcache_file_compressed_read_blocks(pf, result, len, compressed - PTCACHE_COMPRESS_BLOCKS);
+	}
+
+	props = MEM_callocN(16 * sizeof(char), "tmp");
 	if (compressed) {
 		unsigned int size;
 		ptcache_file_read(pf, &size, 1, sizeof(unsigned int));
@@ -1969,6 +2214,11 @@ static int ptcache_file_compressed_write(PTCacheFile *pf, unsigned char *in, uns
 
 	(void)mode; /* unused when building w/o compression */
 
+	if (in_len > PTCACHE_COMPRESS_BLOCK_SIZE && ptcache_compress_blocks_supported(mode)) {
+		MEM_freeN(props);
+		return ptcache_file_compressed_write_blocks(pf, in, in_len, mode);
+	}
+
 #ifdef WITH_LZO
 	out_len= LZO_OUT_LEN(in_len);
 	if (mode == 1) {
@@ -41,8 +41,10 @@ struct BLI_mempool;
 
 /* Task Scheduler
  * 
- * Central scheduler that holds running threads ready to execute tasks. A single
- * queue holds the task from all pools.
+ * Central scheduler that holds running threads ready to execute tasks. Every
+ * thread has its own queue, which holds the tasks pushed from it. Threads run
+ * the newest tasks of their own queue first, and steal the oldest tasks from
+ * the queues of other threads when they run out of work.
  *
  * Init/exit must be called before/after any task pools are created/freed, and
  * must be called from the main threads. All other scheduler and pool functions
@@ -60,6 +62,19 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler);
 
 int BLI_task_scheduler_num_threads(TaskScheduler *scheduler);
 
+typedef struct TaskSchedulerStats {
+	/* Tasks pushed to the queues of the threads. */
+	size_t num_pushed;
+	/* Tasks taken by a thread from its own queue. */
+	size_t num_popped;
+	/* Tasks taken by a thread from the queue of another thread. */
+	size_t num_stolen;
+	/* Times a thread had to sleep because it found no task it could run. */
+	size_t num_sleeps;
+} TaskSchedulerStats;
+
+void BLI_task_scheduler_stats(TaskScheduler *scheduler, TaskSchedulerStats *r_stats);
+
 /* Task Pool
  *
  * Pool of tasks that will be executed by the central TaskScheduler. For each
@@ -112,7 +127,7 @@ ThreadMutex *BLI_task_pool_user_mutex(TaskPool *pool);
 
 /* Delayed push, use that to reduce thread overhead by accumulating
  * all new tasks into local queue first and pushing it to scheduler
- * from within a single mutex lock.
+ * from within a single lock.
  */
 void BLI_task_pool_delayed_push_begin(TaskPool *pool, int thread_id);
 void BLI_task_pool_delayed_push_end(TaskPool *pool, int thread_id);
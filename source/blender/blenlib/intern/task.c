@@ -49,12 +49,6 @@
  */
 #define MEMPOOL_SIZE 256
 
-/* Number of tasks which are pushed directly to local thread queue.
- *
- * This allows thread to fetch next task without locking the whole queue.
- */
-#define LOCAL_QUEUE_SIZE 1
-
 /* Number of tasks which are allowed to be scheduled in a delayed manner.
  *
  * This allows to use less locks per graph node children schedule. More details
@@ -62,6 +56,11 @@
  */
 #define DELAYED_QUEUE_SIZE 4096
 
+/* Index of the queue used by threads which are neither the main thread nor
+ * one of the scheduler's worker threads.
+ */
+#define TASK_QUEUE_OTHER(scheduler) ((scheduler)->num_threads + 1)
+
 #ifndef NDEBUG
 #  define ASSERT_THREAD_ID(scheduler, thread_id)                              \
 	do {                                                                      \
@@ -142,31 +141,47 @@ typedef struct TaskThreadLocalStorage {
 	 */
 	TaskMemPool task_mempool;
 
-	/* Local queue keeps thread alive by keeping small amount of tasks ready
-	 * to be picked up without causing global thread locks for synchronization.
-	 */
-	int num_local_queue;
-	Task *local_queue[LOCAL_QUEUE_SIZE];
-
 	/* Thread can be marked for delayed tasks push. This is helpful when it's
 	 * know that lots of subsequent task pushed will happen from the same thread
 	 * without "interrupting" for task execution.
 	 *
 	 * We try to accumulate as much tasks as possible in a local queue without
-	 * any locks first, and then we push all of them into a scheduler's queue
-	 * from within a single mutex lock.
+	 * any locks first, and then we push all of them into the thread's queue
+	 * from within a single lock.
 	 */
 	bool do_delayed_push;
 	int num_delayed_queue;
 	Task *delayed_queue[DELAYED_QUEUE_SIZE];
 } TaskThreadLocalStorage;
 
+/* Queue of tasks of a single thread.
+ *
+ * The thread takes its own tasks from the tail, so the tasks it pushed last are
+ * run first while their data is still in the cache. Other threads which ran
+ * out of work steal the oldest tasks from the head.
+ *
+ * Every queue has its own lock, which is almost never contended: only by a
+ * thread stealing from it at the same time. Threads only go through the
+ * scheduler's mutex when they have to sleep or wake others up.
+ */
+typedef struct TaskQueue {
+	SpinLock lock;
+	ListBase tasks;
+	/* Number of tasks in the list, can be read without the lock to skip
+	 * empty queues when looking for work.
+	 */
+	volatile int num;
+
+	/* Statistics, also used to detect pushes while going to sleep. */
+	volatile size_t num_pushed;
+	size_t num_popped;
+	size_t num_stolen;
+} TaskQueue;
+
 struct TaskPool {
 	TaskScheduler *scheduler;
 
 	volatile size_t num;
-	ThreadMutex num_mutex;
-	ThreadCondition num_cond;
 
 	void *userdata;
 	ThreadMutex user_mutex;
@@ -210,9 +225,13 @@ struct TaskScheduler {
 	int num_threads;
 	bool background_thread_only;
 
-	ListBase queue;
-	ThreadMutex queue_mutex;
-	ThreadCondition queue_cond;
+	/* Threads which found no work wait on this condition, it's notified when
+	 * tasks are pushed or a pool has no more tasks.
+	 */
+	ThreadMutex sleep_mutex;
+	ThreadCondition sleep_cond;
+	volatile unsigned int num_sleeping;
+	size_t num_sleeps;
 
 	volatile bool do_exit;
 
@@ -220,10 +239,16 @@ struct TaskScheduler {
 	pthread_key_t tls_id_key;
 };
 
+/* Thread of the scheduler: main thread, worker thread or the slot of the
+ * queue used by all other threads, see TASK_QUEUE_OTHER().
+ */
 typedef struct TaskThread {
 	TaskScheduler *scheduler;
 	int id;
 	TaskThreadLocalStorage tls;
+	TaskQueue queue;
+	/* Random state for picking the queue to steal from. */
+	unsigned int steal_seed;
 } TaskThread;
 
 /* Helper */
@@ -328,98 +353,211 @@ static void task_free(TaskPool *pool, Task *task, const int thread_id)
 
 /* Task Scheduler */
 
-static void task_pool_num_decrease(TaskPool *pool, size_t done)
+/* Number of tasks of the pool which are queued or running. Atomic, so that
+ * everything the tasks did is visible once it's zero.
+ */
+BLI_INLINE size_t task_pool_num_get(TaskPool *pool)
 {
-	BLI_mutex_lock(&pool->num_mutex);
+	return atomic_add_and_fetch_z((size_t *)&pool->num, 0);
+}
 
-	BLI_assert(pool->num >= done);
+/* Sum of the pushes to all queues, a change means there might be new work. */
+static size_t task_scheduler_num_pushed(TaskScheduler *scheduler)
+{
+	size_t num_pushed = 0;
+	for (int i = 0; i < scheduler->num_threads + 2; i++) {
+		num_pushed += scheduler->task_threads[i].queue.num_pushed;
+	}
+	return num_pushed;
+}
 
-	pool->num -= done;
+/* Wake up sleeping threads after tasks were pushed or a pool got done.
+ *
+ * The caller must have done an atomic operation after the change, so either
+ * the change is seen by a thread going to sleep or the thread is seen here.
+ */
+static void task_scheduler_wake(TaskScheduler *scheduler)
+{
+	if (scheduler->num_sleeping != 0) {
+		BLI_mutex_lock(&scheduler->sleep_mutex);
+		BLI_condition_notify_all(&scheduler->sleep_cond);
+		BLI_mutex_unlock(&scheduler->sleep_mutex);
+	}
+}
+
+/* Sleep until new tasks are pushed, or until 'pool' has no more tasks when
+ * it's given. 'num_pushed' is task_scheduler_num_pushed() from before the last
+ * look for work, so pushes since are not missed.
+ */
+static void task_scheduler_sleep(TaskScheduler *scheduler, TaskPool *pool, const size_t num_pushed)
+{
+	BLI_mutex_lock(&scheduler->sleep_mutex);
+
+	atomic_add_and_fetch_u((unsigned int *)&scheduler->num_sleeping, 1);
 
-	if (pool->num == 0)
-		BLI_condition_notify_all(&pool->num_cond);
+	if (!scheduler->do_exit &&
+	    (pool == NULL || task_pool_num_get(pool) != 0) &&
+	    task_scheduler_num_pushed(scheduler) == num_pushed)
+	{
+		scheduler->num_sleeps++;
+		BLI_condition_wait(&scheduler->sleep_cond, &scheduler->sleep_mutex);
+	}
+
+	atomic_sub_and_fetch_u((unsigned int *)&scheduler->num_sleeping, 1);
 
-	BLI_mutex_unlock(&pool->num_mutex);
+	BLI_mutex_unlock(&scheduler->sleep_mutex);
 }
 
-static void task_pool_num_increase(TaskPool *pool, size_t new)
+static void task_pool_num_decrease(TaskPool *pool, size_t done)
 {
-	BLI_mutex_lock(&pool->num_mutex);
+	/* The pool might be freed as soon as it has no tasks left. */
+	TaskScheduler *scheduler = pool->scheduler;
 
-	pool->num += new;
-	BLI_condition_notify_all(&pool->num_cond);
+	BLI_assert(pool->num >= done);
 
-	BLI_mutex_unlock(&pool->num_mutex);
+	if (atomic_sub_and_fetch_z((size_t *)&pool->num, done) == 0) {
+		task_scheduler_wake(scheduler);
+	}
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+static void task_pool_num_increase(TaskPool *pool, size_t new)
 {
-	bool found_task = false;
-	BLI_mutex_lock(&scheduler->queue_mutex);
-
-	while (!scheduler->queue.first && !scheduler->do_exit)
-		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-
-	do {
-		Task *current_task;
-
-		/* Assuming we can only have a void queue in 'exit' case here seems logical (we should only be here after
-		 * our worker thread has been woken up from a condition_wait(), which only happens after a new task was
-		 * added to the queue), but it is wrong.
-		 * Waiting on condition may wake up the thread even if condition is not signaled (spurious wake-ups), and some
-		 * race condition may also empty the queue **after** condition has been signaled, but **before** awoken thread
-		 * reaches this point...
-		 * See http://stackoverflow.com/questions/8594591
-		 *
-		 * So we only abort here if do_exit is set.
-		 */
-		if (scheduler->do_exit) {
-			BLI_mutex_unlock(&scheduler->queue_mutex);
-			return false;
+	atomic_add_and_fetch_z((size_t *)&pool->num, new);
+}
+
+/* Index of the queue of the calling thread, which has 'thread_id' or -1 when
+ * it's not known.
+ */
+static int task_queue_index(TaskPool *pool, const int thread_id)
+{
+	TaskScheduler *scheduler = pool->scheduler;
+
+	if (thread_id == -1) {
+		if (BLI_thread_is_main()) {
+			return 0;
 		}
+		TaskThread *thread = pthread_getspecific(scheduler->tls_id_key);
+		return (thread != NULL) ? thread->id : TASK_QUEUE_OTHER(scheduler);
+	}
+	if (thread_id == 0 && pool->use_local_tls) {
+		return TASK_QUEUE_OTHER(scheduler);
+	}
+	return thread_id;
+}
 
-		for (current_task = scheduler->queue.first;
-		     current_task != NULL;
-		     current_task = current_task->next)
-		{
-			TaskPool *pool = current_task->pool;
+BLI_INLINE bool task_scheduler_can_take(TaskScheduler *scheduler, Task *task, TaskPool *pool)
+{
+	if (pool != NULL) {
+		return task->pool == pool;
+	}
+	return !scheduler->background_thread_only || task->pool->run_in_background;
+}
 
-			if (scheduler->background_thread_only && !pool->run_in_background) {
-				continue;
+/* Take a task which can be run for 'pool' from 'queue', newest first from the
+ * thread's own queue and oldest first when stealing from another thread.
+ */
+static Task *task_queue_take(TaskScheduler *scheduler, TaskQueue *queue, TaskPool *pool,
+                             const bool is_own_queue, const bool skip_empty)
+{
+	Task *task;
+
+	if (skip_empty && queue->num == 0) {
+		return NULL;
+	}
+
+	BLI_spin_lock(&queue->lock);
+
+	if (is_own_queue) {
+		for (task = queue->tasks.last; task; task = task->prev) {
+			if (task_scheduler_can_take(scheduler, task, pool)) {
+				break;
 			}
+		}
+	}
+	else {
+		for (task = queue->tasks.first; task; task = task->next) {
+			if (task_scheduler_can_take(scheduler, task, pool)) {
+				break;
+			}
+		}
+	}
 
-			*task = current_task;
-			found_task = true;
-			BLI_remlink(&scheduler->queue, *task);
-			break;
+	if (task) {
+		BLI_remlink(&queue->tasks, task);
+		queue->num--;
+		if (is_own_queue) {
+			queue->num_popped++;
+		}
+		else {
+			queue->num_stolen++;
 		}
-		if (!found_task)
-			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-	} while (!found_task);
+	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	BLI_spin_unlock(&queue->lock);
 
-	return true;
+	return task;
 }
 
-BLI_INLINE void handle_local_queue(TaskThreadLocalStorage *tls,
-                                   const int thread_id)
+/* Get a task for the thread with queue 'queue_index', only from 'pool' when
+ * given. Empty queues are skipped without locking when 'skip_empty' is set,
+ * which may miss tasks which were pushed just now.
+ */
+static Task *task_scheduler_take(TaskScheduler *scheduler, const int queue_index, TaskPool *pool,
+                                 const bool skip_empty)
 {
-	BLI_assert(!tls->do_delayed_push);
-	while (tls->num_local_queue > 0) {
-		/* We pop task from queue before handling it so handler of the task can
-		 * push next job to the local queue.
+	TaskThread *threads = scheduler->task_threads;
+	const int num_queues = scheduler->num_threads + 2;
+	Task *task = task_queue_take(scheduler, &threads[queue_index].queue, pool, true, skip_empty);
+
+	if (task == NULL) {
+		/* Steal from another thread, starting at a random one so that threads
+		 * which ran out of work don't all go for the same queue.
 		 */
-		tls->num_local_queue--;
-		Task *local_task = tls->local_queue[tls->num_local_queue];
-		/* TODO(sergey): Double-check work_and_wait() doesn't handle other's
-		 * pool tasks.
+		int victim = queue_index + 1;
+		if (queue_index != TASK_QUEUE_OTHER(scheduler)) {
+			unsigned int *seed = &threads[queue_index].steal_seed;
+			*seed ^= *seed << 13;
+			*seed ^= *seed >> 17;
+			*seed ^= *seed << 5;
+			victim = (int)(*seed % (unsigned int)num_queues);
+		}
+
+		for (int i = 0; i < num_queues && task == NULL; i++, victim++) {
+			victim %= num_queues;
+			if (victim != queue_index) {
+				task = task_queue_take(scheduler, &threads[victim].queue, pool, false, skip_empty);
+			}
+		}
+	}
+
+	return task;
+}
+
+/* Get a task like task_scheduler_take(), sleeping until one can be taken.
+ * Waiting for tasks of 'pool' stops when it has no more tasks, returns NULL
+ * then, or when the scheduler exits.
+ */
+static Task *task_scheduler_wait_take(TaskScheduler *scheduler, const int queue_index, TaskPool *pool)
+{
+	while (!scheduler->do_exit && (pool == NULL || task_pool_num_get(pool) != 0)) {
+		Task *task = task_scheduler_take(scheduler, queue_index, pool, true);
+		if (task) {
+			return task;
+		}
+
+		/* Look once more at all queues before going to sleep, any push after
+		 * this is noticed by task_scheduler_sleep().
 		 */
-		TaskPool *local_pool = local_task->pool;
-		local_task->run(local_pool, local_task->taskdata, thread_id);
-		task_free(local_pool, local_task, thread_id);
+		const size_t num_pushed = task_scheduler_num_pushed(scheduler);
+		task = task_scheduler_take(scheduler, queue_index, pool, false);
+		if (task) {
+			return task;
+		}
+
+		task_scheduler_sleep(scheduler, pool, num_pushed);
 	}
-	BLI_assert(!tls->do_delayed_push);
+
+	return NULL;
 }
 
 static void *task_scheduler_thread_run(void *thread_p)
@@ -432,8 +570,10 @@ static void *task_scheduler_thread_run(void *thread_p)
 
 	pthread_setspecific(scheduler->tls_id_key, thread);
 
+	UNUSED_VARS_NDEBUG(tls);
+
 	/* keep popping off tasks */
-	while (task_scheduler_thread_wait_pop(scheduler, &task)) {
+	while ((task = task_scheduler_wait_take(scheduler, thread_id, NULL))) {
 		TaskPool *pool = task->pool;
 
 		/* run task */
@@ -444,9 +584,6 @@ static void *task_scheduler_thread_run(void *thread_p)
 		/* delete task */
 		task_free(pool, task, thread_id);
 
-		/* Handle all tasks from local queue. */
-		handle_local_queue(tls, thread_id);
-
 		/* notify pool task was done */
 		task_pool_num_decrease(pool, 1);
 	}
@@ -462,9 +599,8 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 	 * threads, so we keep track of the number of users. */
 	scheduler->do_exit = false;
 
-	BLI_listbase_clear(&scheduler->queue);
-	BLI_mutex_init(&scheduler->queue_mutex);
-	BLI_condition_init(&scheduler->queue_cond);
+	BLI_mutex_init(&scheduler->sleep_mutex);
+	BLI_condition_init(&scheduler->sleep_cond);
 
 	if (num_threads == 0) {
 		/* automatic number of threads will be main thread + num cores */
@@ -480,11 +616,20 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 		num_threads = 1;
 	}
 
-	scheduler->task_threads = MEM_mallocN(sizeof(TaskThread) * (num_threads + 1),
+	scheduler->num_threads = num_threads;
+
+	/* Main thread, worker threads and the queue of other threads. */
+	scheduler->task_threads = MEM_callocN(sizeof(TaskThread) * (num_threads + 2),
 	                                      "TaskScheduler task threads");
 
-	/* Initialize TLS for main thread. */
-	initialize_task_tls(&scheduler->task_threads[0].tls);
+	for (int i = 0; i < num_threads + 2; i++) {
+		TaskThread *thread = &scheduler->task_threads[i];
+		thread->scheduler = scheduler;
+		thread->id = i;
+		thread->steal_seed = 0x9e3779b9u * (unsigned int)(i + 1);
+		initialize_task_tls(&thread->tls);
+		BLI_spin_init(&thread->queue.lock);
+	}
 
 	pthread_key_create(&scheduler->tls_id_key, NULL);
 
@@ -492,14 +637,10 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 	if (num_threads > 0) {
 		int i;
 
-		scheduler->num_threads = num_threads;
 		scheduler->threads = MEM_callocN(sizeof(pthread_t) * num_threads, "TaskScheduler threads");
 
 		for (i = 0; i < num_threads; i++) {
 			TaskThread *thread = &scheduler->task_threads[i + 1];
-			thread->scheduler = scheduler;
-			thread->id = i + 1;
-			initialize_task_tls(&thread->tls);
 
 			if (pthread_create(&scheduler->threads[i], NULL, task_scheduler_thread_run, thread) != 0) {
 				fprintf(stderr, "TaskScheduler failed to launch thread %d/%d\n", i, num_threads);
@@ -512,13 +653,11 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 
 void BLI_task_scheduler_free(TaskScheduler *scheduler)
 {
-	Task *task;
-
 	/* stop all waiting threads */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	BLI_mutex_lock(&scheduler->sleep_mutex);
 	scheduler->do_exit = true;
-	BLI_condition_notify_all(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	BLI_condition_notify_all(&scheduler->sleep_cond);
+	BLI_mutex_unlock(&scheduler->sleep_mutex);
 
 	pthread_key_delete(scheduler->tls_id_key);
 
@@ -534,25 +673,25 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 		MEM_freeN(scheduler->threads);
 	}
 
-	/* Delete task thread data */
-	if (scheduler->task_threads) {
-		for (int i = 0; i < scheduler->num_threads + 1; ++i) {
-			TaskThreadLocalStorage *tls = &scheduler->task_threads[i].tls;
-			free_task_tls(tls);
-		}
+	/* Delete task thread data and leftover tasks */
+	for (int i = 0; i < scheduler->num_threads + 2; ++i) {
+		TaskThread *thread = &scheduler->task_threads[i];
+		Task *task;
 
-		MEM_freeN(scheduler->task_threads);
-	}
+		free_task_tls(&thread->tls);
 
-	/* delete leftover tasks */
-	for (task = scheduler->queue.first; task; task = task->next) {
-		task_data_free(task, 0);
+		for (task = thread->queue.tasks.first; task; task = task->next) {
+			task_data_free(task, 0);
+		}
+		BLI_freelistN(&thread->queue.tasks);
+		BLI_spin_end(&thread->queue.lock);
 	}
-	BLI_freelistN(&scheduler->queue);
+
+	MEM_freeN(scheduler->task_threads);
 
 	/* delete mutex/condition */
-	BLI_mutex_end(&scheduler->queue_mutex);
-	BLI_condition_end(&scheduler->queue_cond);
+	BLI_mutex_end(&scheduler->sleep_mutex);
+	BLI_condition_end(&scheduler->sleep_cond);
 
 	MEM_freeN(scheduler);
 }
@@ -562,41 +701,119 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
 	return scheduler->num_threads + 1;
 }
 
-static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
+/**
+ * Get the number of tasks which went through the scheduler's queues since
+ * it was created, for profiling.
+ */
+void BLI_task_scheduler_stats(TaskScheduler *scheduler, TaskSchedulerStats *r_stats)
 {
-	task_pool_num_increase(task->pool, 1);
+	memset(r_stats, 0, sizeof(*r_stats));
 
-	/* add task to queue */
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	for (int i = 0; i < scheduler->num_threads + 2; i++) {
+		TaskQueue *queue = &scheduler->task_threads[i].queue;
 
+		BLI_spin_lock(&queue->lock);
+		r_stats->num_pushed += queue->num_pushed;
+		r_stats->num_popped += queue->num_popped;
+		r_stats->num_stolen += queue->num_stolen;
+		BLI_spin_unlock(&queue->lock);
+	}
+
+	BLI_mutex_lock(&scheduler->sleep_mutex);
+	r_stats->num_sleeps = scheduler->num_sleeps;
+	BLI_mutex_unlock(&scheduler->sleep_mutex);
+}
+
+/* Add tasks to a queue, the caller must have increased the number of tasks of
+ * their pools already.
+ */
+static void task_queue_push(TaskQueue *queue, Task *task, TaskPriority priority)
+{
+	/* High priority tasks are taken next by the thread owning the queue, low
+	 * priority ones are taken first by other threads. */
 	if (priority == TASK_PRIORITY_HIGH)
-		BLI_addhead(&scheduler->queue, task);
+		BLI_addtail(&queue->tasks, task);
 	else
-		BLI_addtail(&scheduler->queue, task);
+		BLI_addhead(&queue->tasks, task);
 
-	BLI_condition_notify_one(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	queue->num++;
+}
+
+static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority,
+                                const int queue_index)
+{
+	TaskQueue *queue = &scheduler->task_threads[queue_index].queue;
+
+	task_pool_num_increase(task->pool, 1);
+
+	/* add task to queue */
+	BLI_spin_lock(&queue->lock);
+	task_queue_push(queue, task, priority);
+	atomic_add_and_fetch_z((size_t *)&queue->num_pushed, 1);
+	BLI_spin_unlock(&queue->lock);
+
+	task_scheduler_wake(scheduler);
 }
 
 static void task_scheduler_push_all(TaskScheduler *scheduler,
                                     TaskPool *pool,
                                     Task **tasks,
-                                    int num_tasks)
+                                    int num_tasks,
+                                    const int queue_index)
 {
+	TaskQueue *queue = &scheduler->task_threads[queue_index].queue;
+
 	if (num_tasks == 0) {
 		return;
 	}
 
 	task_pool_num_increase(pool, num_tasks);
 
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	BLI_spin_lock(&queue->lock);
 
 	for (int i = 0; i < num_tasks; i++) {
-		BLI_addhead(&scheduler->queue, tasks[i]);
+		task_queue_push(queue, tasks[i], TASK_PRIORITY_HIGH);
+	}
+
+	atomic_add_and_fetch_z((size_t *)&queue->num_pushed, (size_t)num_tasks);
+	BLI_spin_unlock(&queue->lock);
+
+	task_scheduler_wake(scheduler);
+}
+
+/* Push the tasks of a suspended pool. They are spread over the queues of the
+ * thread waiting for them and all worker threads, so the workers which are
+ * woken up find their first task in their own queue.
+ */
+static void task_scheduler_push_suspended(TaskScheduler *scheduler, TaskPool *pool, const int queue_index)
+{
+	const bool is_worker = (queue_index >= 1 && queue_index <= scheduler->num_threads);
+	const int num_queues = scheduler->background_thread_only ? 1 : 1 + scheduler->num_threads - is_worker;
+	const size_t num_tasks = pool->num_suspended;
+
+	task_pool_num_increase(pool, num_tasks);
+
+	for (int i = 0; i < num_queues; i++) {
+		/* The waiting thread first, then all workers except itself. */
+		const int index = (i == 0) ? queue_index : ((is_worker && i >= queue_index) ? i + 1 : i);
+		TaskQueue *queue = &scheduler->task_threads[index].queue;
+		size_t num_queue_tasks = num_tasks / (size_t)num_queues + ((size_t)i < num_tasks % (size_t)num_queues);
+
+		if (num_queue_tasks == 0) {
+			break;
+		}
+
+		BLI_spin_lock(&queue->lock);
+		atomic_add_and_fetch_z((size_t *)&queue->num_pushed, num_queue_tasks);
+		while (num_queue_tasks--) {
+			task_queue_push(queue, BLI_pophead(&pool->suspended_queue), TASK_PRIORITY_HIGH);
+		}
+		BLI_spin_unlock(&queue->lock);
 	}
 
-	BLI_condition_notify_all(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	pool->num_suspended = 0;
+
+	task_scheduler_wake(scheduler);
 }
 
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
@@ -604,24 +821,36 @@ static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 	Task *task, *nexttask;
 	size_t done = 0;
 
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	/* A pool without tasks can't have any of them queued. */
+	if (task_pool_num_get(pool) == 0) {
+		return;
+	}
+
+	for (int i = 0; i < scheduler->num_threads + 2; i++) {
+		TaskQueue *queue = &scheduler->task_threads[i].queue;
+
+		BLI_spin_lock(&queue->lock);
 
-	/* free all tasks from this pool from the queue */
-	for (task = scheduler->queue.first; task; task = nexttask) {
-		nexttask = task->next;
+		/* free all tasks from this pool from the queue */
+		for (task = queue->tasks.first; task; task = nexttask) {
+			nexttask = task->next;
 
-		if (task->pool == pool) {
-			task_data_free(task, pool->thread_id);
-			BLI_freelinkN(&scheduler->queue, task);
+			if (task->pool == pool) {
+				task_data_free(task, pool->thread_id);
+				BLI_freelinkN(&queue->tasks, task);
+				queue->num--;
 
-			done++;
+				done++;
+			}
 		}
-	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+		BLI_spin_unlock(&queue->lock);
+	}
 
 	/* notify done */
-	task_pool_num_decrease(pool, done);
+	if (done) {
+		task_pool_num_decrease(pool, done);
+	}
 }
 
 /* Task Pool */
@@ -655,9 +884,6 @@ static TaskPool *task_pool_create_ex(TaskScheduler *scheduler,
 	pool->run_in_background = is_background;
 	pool->use_local_tls = false;
 
-	BLI_mutex_init(&pool->num_mutex);
-	BLI_condition_init(&pool->num_cond);
-
 	pool->userdata = userdata;
 	BLI_mutex_init(&pool->user_mutex);
 
@@ -740,9 +966,6 @@ void BLI_task_pool_free(TaskPool *pool)
 {
 	BLI_task_pool_cancel(pool);
 
-	BLI_mutex_end(&pool->num_mutex);
-	BLI_condition_end(&pool->num_cond);
-
 	BLI_mutex_end(&pool->user_mutex);
 
 #ifdef DEBUG_STATS
@@ -794,21 +1017,12 @@ static void task_pool_push(
 		atomic_fetch_and_add_z(&pool->num_suspended, 1);
 		return;
 	}
-	/* Populate to any local queue first, this is cheapest push ever. */
 	if (task_can_use_local_queues(pool, thread_id)) {
 		ASSERT_THREAD_ID(pool->scheduler, thread_id);
 		TaskThreadLocalStorage *tls = get_task_tls(pool, thread_id);
-		/* Try to push to a local execution queue.
-		 * These tasks will be picked up next.
-		 */
-		if (tls->num_local_queue < LOCAL_QUEUE_SIZE) {
-			tls->local_queue[tls->num_local_queue] = task;
-			tls->num_local_queue++;
-			return;
-		}
 		/* If we are in the delayed tasks push mode, we push tasks to a
 		 * temporary local queue first without any locks, and then move them
-		 * to global execution queue with a single lock.
+		 * to thread's execution queue with a single lock.
 		 */
 		if (tls->do_delayed_push && tls->num_delayed_queue < DELAYED_QUEUE_SIZE) {
 			tls->delayed_queue[tls->num_delayed_queue] = task;
@@ -816,10 +1030,10 @@ static void task_pool_push(
 			return;
 		}
 	}
-	/* Do push to a global execution ppol, slowest possible method,
-	 * causes quite reasonable amount of threading overhead.
+	/* Push to the queue of the current thread, where it will be picked up
+	 * next by this thread or stolen by an idle one.
 	 */
-	task_scheduler_push(pool->scheduler, task, priority);
+	task_scheduler_push(pool->scheduler, task, priority, task_queue_index(pool, thread_id));
 }
 
 void BLI_task_pool_push_ex(
@@ -845,16 +1059,14 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
 {
 	TaskThreadLocalStorage *tls = get_task_tls(pool, pool->thread_id);
 	TaskScheduler *scheduler = pool->scheduler;
+	const int queue_index = task_queue_index(pool, pool->thread_id);
+	Task *task;
+
+	UNUSED_VARS_NDEBUG(tls);
 
 	if (atomic_fetch_and_and_uint8((uint8_t *)&pool->is_suspended, 0)) {
 		if (pool->num_suspended) {
-			task_pool_num_increase(pool, pool->num_suspended);
-			BLI_mutex_lock(&scheduler->queue_mutex);
-
-			BLI_movelisttolist(&scheduler->queue, &pool->suspended_queue);
-
-			BLI_condition_notify_all(&scheduler->queue_cond);
-			BLI_mutex_unlock(&scheduler->queue_mutex);
+			task_scheduler_push_suspended(scheduler, pool, queue_index);
 		}
 	}
 
@@ -862,58 +1074,20 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
 
 	ASSERT_THREAD_ID(pool->scheduler, pool->thread_id);
 
-	BLI_mutex_lock(&pool->num_mutex);
-
-	while (pool->num != 0) {
-		Task *task, *work_task = NULL;
-		bool found_task = false;
-
-		BLI_mutex_unlock(&pool->num_mutex);
-
-		BLI_mutex_lock(&scheduler->queue_mutex);
-
-		/* find task from this pool. if we get a task from another pool,
-		 * we can get into deadlock */
-
-		for (task = scheduler->queue.first; task; task = task->next) {
-			if (task->pool == pool) {
-				work_task = task;
-				found_task = true;
-				BLI_remlink(&scheduler->queue, task);
-				break;
-			}
-		}
-
-		BLI_mutex_unlock(&scheduler->queue_mutex);
-
-		/* if found task, do it, otherwise wait until other tasks are done */
-		if (found_task) {
-			/* run task */
-			BLI_assert(!tls->do_delayed_push);
-			work_task->run(pool, work_task->taskdata, pool->thread_id);
-			BLI_assert(!tls->do_delayed_push);
-
-			/* delete task */
-			task_free(pool, task, pool->thread_id);
-
-			/* Handle all tasks from local queue. */
-			handle_local_queue(tls, pool->thread_id);
-
-			/* notify pool task was done */
-			task_pool_num_decrease(pool, 1);
-		}
+	/* only take tasks from this pool. if we get a task from another pool,
+	 * we can get into deadlock */
+	while ((task = task_scheduler_wait_take(scheduler, queue_index, pool))) {
+		/* run task */
+		BLI_assert(!tls->do_delayed_push);
+		task->run(pool, task->taskdata, pool->thread_id);
+		BLI_assert(!tls->do_delayed_push);
 
-		BLI_mutex_lock(&pool->num_mutex);
-		if (pool->num == 0)
-			break;
+		/* delete task */
+		task_free(pool, task, pool->thread_id);
 
-		if (!found_task)
-			BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
+		/* notify pool task was done */
+		task_pool_num_decrease(pool, 1);
 	}
-
-	BLI_mutex_unlock(&pool->num_mutex);
-
-	handle_local_queue(tls, pool->thread_id);
 }
 
 void BLI_task_pool_cancel(TaskPool *pool)
@@ -923,10 +1097,10 @@ void BLI_task_pool_cancel(TaskPool *pool)
 	task_scheduler_clear(pool->scheduler, pool);
 
 	/* wait until all entries are cleared */
-	BLI_mutex_lock(&pool->num_mutex);
-	while (pool->num)
-		BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
-	BLI_mutex_unlock(&pool->num_mutex);
+	while (task_pool_num_get(pool)) {
+		const size_t num_pushed = task_scheduler_num_pushed(pool->scheduler);
+		task_scheduler_sleep(pool->scheduler, pool, num_pushed);
+	}
 
 	pool->do_cancel = false;
 }
@@ -964,7 +1138,8 @@ void BLI_task_pool_delayed_push_end(TaskPool *pool, int thread_id)
 		task_scheduler_push_all(pool->scheduler,
 		                        pool,
 		                        tls->delayed_queue,
-		                        tls->num_delayed_queue);
+		                        tls->num_delayed_queue,
+		                        task_queue_index(pool, thread_id));
 		tls->do_delayed_push = false;
 		tls->num_delayed_queue = 0;
 	}
@@ -37,13 +37,17 @@ typedef struct {
 	void *next, *prev;
 	
 	char *buf;
-	unsigned int ident, size;
-	
+	unsigned int ident, size;  /* ident: data was already stored when the chunk was added */
+	struct MemFileBuffer *buffer;  /* refcounted storage of buf, shared by all chunks with the same data */
 } MemFileChunk;
 
 typedef struct MemFile {
 	ListBase chunks;
-	unsigned int size;
+	unsigned int size;  /* size of the data that was not stored yet */
+
+	/* statistics of the undo step */
+	size_t size_total;
+	unsigned int chunks_num, chunks_ident, chunks_moved;
 } MemFile;
 
 /* actually only used writefile.c */
@@ -52,6 +56,7 @@ extern void memfile_chunk_add(MemFile *compare, MemFile *current, const char *bu
 /* exports */
 extern void BLO_memfile_free(MemFile *memfile);
 extern void BLO_memfile_merge(MemFile *first, MemFile *second);
+extern void BLO_memfile_store_stats(size_t *r_size, unsigned int *r_buffers_num);
 
 #endif
 
@@ -210,11 +210,11 @@ LinkNode *BLO_blendhandle_get_previews(BlendHandle *bh, int ofblocktype, int *to
 					if (prv) {
 						memcpy(new_prv, prv, sizeof(PreviewImage));
 						if (prv->rect[0] && prv->w[0] && prv->h[0]) {
-							unsigned int *rect = NULL;
+							const unsigned int *rect = NULL;
 							size_t len = new_prv->w[0] * new_prv->h[0] * sizeof(unsigned int);
 							new_prv->rect[0] = MEM_callocN(len, __func__);
 							bhead = blo_nextbhead(fd, bhead);
-							rect = (unsigned int *)(bhead + 1);
+							rect = blo_bhead_data(bhead);
 							BLI_assert(len == bhead->len);
 							memcpy(new_prv->rect[0], rect, len);
 						}
@@ -227,11 +227,11 @@ LinkNode *BLO_blendhandle_get_previews(BlendHandle *bh, int ofblocktype, int *to
 						}
 						
 						if (prv->rect[1] && prv->w[1] && prv->h[1]) {
-							unsigned int *rect = NULL;
+							const unsigned int *rect = NULL;
 							size_t len = new_prv->w[1] * new_prv->h[1] * sizeof(unsigned int);
 							new_prv->rect[1] = MEM_callocN(len, __func__);
 							bhead = blo_nextbhead(fd, bhead);
-							rect = (unsigned int *)(bhead + 1);
+							rect = blo_bhead_data(bhead);
 							BLI_assert(len == bhead->len);
 							memcpy(new_prv->rect[1], rect, len);
 						}
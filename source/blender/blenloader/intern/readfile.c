@@ -46,10 +46,12 @@
 #include "BLI_utildefines.h"
 #ifndef WIN32
 #  include <unistd.h> // for read close
+#  include <sys/mman.h> // for mmap munmap
 #else
 #  include <io.h> // for open close read
 #  include "winsock2.h"
 #  include "BLI_winstuff.h"
+#  include "mmap_win.h"
 #endif
 
 /* allow readfile to use deprecated functionality */
@@ -108,6 +110,7 @@
 #include "BLI_endian_switch.h"
 #include "BLI_blenlib.h"
 #include "BLI_math.h"
+#include "BLI_task.h"
 #include "BLI_threads.h"
 #include "BLI_mempool.h"
 
@@ -242,10 +245,14 @@ typedef struct OldNew {
 typedef struct OldNewMap {
 	OldNew *entries;
 	int nentries, entriessize;
-	bool sorted;
 	int lasthit;
+	/* open addressing hash of old addresses, slots hold entry index + 1 so zero is empty */
+	int *map;
+	int mapsize;
 } OldNewMap;
 
+#define OLDNEWMAP_MAPSIZE_DEFAULT 2048
+
 
 /* local prototypes */
 static void *read_struct(FileData *fd, BHead *bh, const char *blockname);
@@ -292,25 +299,49 @@ static OldNewMap *oldnewmap_new(void)
 	
 	onm->entriessize = 1024;
 	onm->entries = MEM_malloc_arrayN(onm->entriessize, sizeof(*onm->entries), "OldNewMap.entries");
+
+	onm->mapsize = OLDNEWMAP_MAPSIZE_DEFAULT;
+	onm->map = MEM_calloc_arrayN(onm->mapsize, sizeof(*onm->map), "OldNewMap.map");
 	
 	return onm;
 }
 
-static int verg_oldnewmap(const void *v1, const void *v2)
+/* old addresses are aligned, mix all bits so they spread over the whole map */
+BLI_INLINE unsigned int oldnewmap_hash(const void *addr)
 {
-	const struct OldNew *x1=v1, *x2=v2;
-	
-	if (x1->old > x2->old) return 1;
-	else if (x1->old < x2->old) return -1;
-	return 0;
+	uint64_t key = (uint64_t)(uintptr_t)addr;
+
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+
+	return (unsigned int)key;
 }
 
+/* slot of \a addr in the map, or the empty slot it would be stored at */
+static int oldnewmap_find_slot(const OldNewMap *onm, const void *addr)
+{
+	const unsigned int mask = (unsigned int)onm->mapsize - 1;
+	unsigned int slot = oldnewmap_hash(addr) & mask;
+
+	while (onm->map[slot] && onm->entries[onm->map[slot] - 1].old != addr) {
+		slot = (slot + 1) & mask;
+	}
 
-static void oldnewmap_sort(FileData *fd) 
+	return (int)slot;
+}
+
+static void oldnewmap_map_resize(OldNewMap *onm, int mapsize)
 {
-	BLI_assert(fd->libmap->sorted == false);
-	qsort(fd->libmap->entries, fd->libmap->nentries, sizeof(OldNew), verg_oldnewmap);
-	fd->libmap->sorted = 1;
+	int i;
+
+	MEM_freeN(onm->map);
+	onm->mapsize = mapsize;
+	onm->map = MEM_calloc_arrayN(onm->mapsize, sizeof(*onm->map), "OldNewMap.map");
+
+	for (i = 0; i < onm->nentries; i++) {
+		onm->map[oldnewmap_find_slot(onm, onm->entries[i].old)] = i + 1;
+	}
 }
 
 /* nr is zero for data, and ID code for libdata */
@@ -329,6 +360,14 @@ static void oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr,
 	entry->old = oldaddr;
 	entry->newp = newaddr;
 	entry->nr = nr;
+
+	/* keep the map at most half full, a later entry with the same address replaces the earlier one */
+	if (UNLIKELY(onm->nentries * 2 > onm->mapsize)) {
+		oldnewmap_map_resize(onm, onm->mapsize * 2);
+	}
+	else {
+		onm->map[oldnewmap_find_slot(onm, oldaddr)] = onm->nentries;
+	}
 }
 
 void blo_do_versions_oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
@@ -336,54 +375,10 @@ void blo_do_versions_oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void
 	oldnewmap_insert(onm, oldaddr, newaddr, nr);
 }
 
-/**
- * Do a full search (no state).
- *
- * \param lasthit: Use as a reference position to avoid a full search
- * from either end of the array, giving more efficient lookups.
- *
- * \note This would seem an ideal case for hash or btree lookups.
- * However the data is written in-order, using the \a lasthit will normally avoid calling this function.
- * Creating a btree/hash structure adds overhead for the common-case to optimize the corner-case
- * (since most entries will never be retrieved).
- * So just keep full lookups as a fall-back.
- */
-static int oldnewmap_lookup_entry_full(const OldNewMap *onm, const void *addr, int lasthit)
+/* index of the entry of \a addr, -1 if there is none */
+static int oldnewmap_lookup_entry(const OldNewMap *onm, const void *addr)
 {
-	const int nentries = onm->nentries;
-	const OldNew *entries = onm->entries;
-	int i;
-
-	/* search relative to lasthit where possible */
-	if (lasthit >= 0 && lasthit < nentries) {
-
-		/* search forwards */
-		i = lasthit;
-		while (++i != nentries) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-
-		/* search backwards */
-		i = lasthit + 1;
-		while (i--) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-	}
-	else {
-		/* search backwards (full) */
-		i = nentries;
-		while (i--) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-	}
-
-	return -1;
+	return onm->map[oldnewmap_find_slot(onm, addr)] - 1;
 }
 
 static void *oldnewmap_lookup_and_inc(OldNewMap *onm, const void *addr, bool increase_users)
@@ -392,6 +387,7 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, const void *addr, bool inc
 	
 	if (addr == NULL) return NULL;
 	
+	/* the data is written in-order, so the entry after lasthit saves the hash lookup in the common case */
 	if (onm->lasthit < onm->nentries-1) {
 		OldNew *entry = &onm->entries[++onm->lasthit];
 		
@@ -402,7 +398,7 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, const void *addr, bool inc
 		}
 	}
 	
-	i = oldnewmap_lookup_entry_full(onm, addr, onm->lasthit);
+	i = oldnewmap_lookup_entry(onm, addr);
 	if (i != -1) {
 		OldNew *entry = &onm->entries[i];
 		BLI_assert(entry->old == addr);
@@ -418,32 +414,19 @@ static void *oldnewmap_lookup_and_inc(OldNewMap *onm, const void *addr, bool inc
 /* for libdata, nr has ID code, no increment */
 static void *oldnewmap_liblookup(OldNewMap *onm, const void *addr, const void *lib)
 {
+	int i;
+
 	if (addr == NULL) {
 		return NULL;
 	}
 
-	/* lasthit works fine for non-libdata, linking there is done in same sequence as writing */
-	if (onm->sorted) {
-		const OldNew entry_s = {.old = addr};
-		OldNew *entry = bsearch(&entry_s, onm->entries, onm->nentries, sizeof(OldNew), verg_oldnewmap);
-		if (entry) {
-			ID *id = entry->newp;
-
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
-		}
-	}
-	else {
-		/* note, this can be a bottle neck when loading some files */
-		const int i = oldnewmap_lookup_entry_full(onm, addr, -1);
-		if (i != -1) {
-			OldNew *entry = &onm->entries[i];
-			ID *id = entry->newp;
-			BLI_assert(entry->old == addr);
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
+	i = oldnewmap_lookup_entry(onm, addr);
+	if (i != -1) {
+		OldNew *entry = &onm->entries[i];
+		ID *id = entry->newp;
+		BLI_assert(entry->old == addr);
+		if (id && (!lib || id->lib)) {
+			return id;
 		}
 	}
 
@@ -467,11 +450,20 @@ static void oldnewmap_clear(OldNewMap *onm)
 {
 	onm->nentries = 0;
 	onm->lasthit = 0;
+
+	/* datamap is cleared after every ID, don't keep clearing a map grown by a big one */
+	if (onm->mapsize > OLDNEWMAP_MAPSIZE_DEFAULT) {
+		oldnewmap_map_resize(onm, OLDNEWMAP_MAPSIZE_DEFAULT);
+	}
+	else {
+		memset(onm->map, 0, sizeof(*onm->map) * onm->mapsize);
+	}
 }
 
 static void oldnewmap_free(OldNewMap *onm) 
 {
 	MEM_freeN(onm->entries);
+	MEM_freeN(onm->map);
 	MEM_freeN(onm);
 }
 
@@ -799,10 +791,26 @@ static BHeadN *get_bhead(FileData *fd)
 			/* bhead now contains the (converted) bhead structure. Now read
 			 * the associated data and put everything in a BHeadN (creative naming !)
 			 */
-			if (!fd->eof) {
+			if (!fd->eof && fd->mmap_data && bhead.code == DATA && !(fd->flags & FD_FLAGS_SWITCH_ENDIAN)) {
+				/* Leave the contents in the mapped file, read_struct() only copies
+				 * the blocks that are needed (a single asset linked from a library). */
+				if ((size_t)bhead.len <= fd->mmap_size - fd->mmap_seek) {
+					new_bhead = MEM_mallocN(sizeof(BHeadN), "new_bhead");
+					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = fd->mmap_data + fd->mmap_seek;
+					new_bhead->bhead = bhead;
+					
+					fd->mmap_seek += bhead.len;
+				}
+				else {
+					fd->eof = 1;
+				}
+			}
+			else if (!fd->eof) {
 				new_bhead = MEM_mallocN(sizeof(BHeadN) + bhead.len, "new_bhead");
 				if (new_bhead) {
 					new_bhead->next = new_bhead->prev = NULL;
+					new_bhead->data = new_bhead + 1;
 					new_bhead->bhead = bhead;
 					
 					readsize = fd->read(fd, new_bhead + 1, bhead.len);
@@ -890,6 +898,14 @@ const char *bhead_id_name(const FileData *fd, const BHead *bhead)
 	return (const char *)POINTER_OFFSET(bhead, sizeof(*bhead) + fd->id_name_offs);
 }
 
+/* Contents of the block, only (bhead + 1) for blocks that aren't read in place from a mapped file. */
+const void *blo_bhead_data(const BHead *bhead)
+{
+	const BHeadN *bheadn = (const BHeadN *)POINTER_OFFSET(bhead, -offsetof(BHeadN, bhead));
+	
+	return bheadn->data;
+}
+
 static void decode_blender_header(FileData *fd)
 {
 	char header[SIZEOFBLENDERHEADER], num[4];
@@ -1045,6 +1061,17 @@ static int fd_read_from_memory(FileData *filedata, void *buffer, unsigned int si
 	return (readsize);
 }
 
+static int fd_read_from_mmap(FileData *filedata, void *buffer, unsigned int size)
+{
+	/* don't read more bytes then there are available in the mapping */
+	size_t readsize = MIN2((size_t)size, filedata->mmap_size - filedata->mmap_seek);
+	
+	memcpy(buffer, filedata->mmap_data + filedata->mmap_seek, readsize);
+	filedata->mmap_seek += readsize;
+	
+	return (int)readsize;
+}
+
 static int fd_read_from_memfile(FileData *filedata, void *buffer, unsigned int size)
 {
 	static unsigned int seek = (1<<30);	/* the current position */
@@ -1143,11 +1170,197 @@ static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
 	return fd;
 }
 
+typedef struct GzipBlock {
+	const unsigned char *in;
+	unsigned int in_len;
+	char *out;
+	unsigned int out_len;
+	bool error;
+} GzipBlock;
+
+static unsigned int gzip_block_uint(const unsigned char *data)
+{
+	return (unsigned int)data[0] | ((unsigned int)data[1] << 8) | ((unsigned int)data[2] << 16) | ((unsigned int)data[3] << 24);
+}
+
+/* read the sizes from the header of a gzip member written by ww_write_zlib_parallel */
+static bool gzip_block_header(const unsigned char *member, size_t len, unsigned int *r_in_len, unsigned int *r_out_len)
+{
+	if (len < BLEND_GZIP_BLOCK_HEADER_LEN ||
+	    member[0] != 0x1f || member[1] != 0x8b || member[2] != Z_DEFLATED ||
+	    member[3] != 0x04 ||  /* only FEXTRA */
+	    member[10] != BLEND_GZIP_BLOCK_EXTRA_LEN || member[11] != 0 ||
+	    member[12] != BLEND_GZIP_BLOCK_SI1 || member[13] != BLEND_GZIP_BLOCK_SI2 ||
+	    member[14] != 8 || member[15] != 0)
+	{
+		return false;
+	}
+
+	*r_in_len = gzip_block_uint(member + 16);
+	*r_out_len = gzip_block_uint(member + 20);
+
+	return *r_in_len > BLEND_GZIP_BLOCK_HEADER_LEN && *r_in_len <= len;
+}
+
+static void gzip_block_inflate_cb(void *__restrict userdata, const int index, const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	GzipBlock *block = (GzipBlock *)userdata + index;
+	z_stream strm = {NULL};
+
+	block->error = true;
+
+	/* 16 added to the window bits reads the gzip wrapper and checks the crc */
+	if (inflateInit2(&strm, MAX_WBITS + 16) == Z_OK) {
+		strm.next_in = (Bytef *)block->in;
+		strm.avail_in = block->in_len;
+		strm.next_out = (Bytef *)block->out;
+		strm.avail_out = block->out_len;
+		if (inflate(&strm, Z_FINISH) == Z_STREAM_END && strm.avail_in == 0 && strm.avail_out == 0) {
+			block->error = false;
+		}
+		inflateEnd(&strm);
+	}
+}
+
+/**
+ * Inflate a file written by ww_write_zlib_parallel, all of its blocks at once on all threads.
+ * \return NULL when \a data isn't made of such blocks (files compressed with gzip) or can't be inflated in memory.
+ */
+static char *blo_gzip_blocks_inflate(const char *data, size_t size, size_t *r_size)
+{
+	const unsigned char *member;
+	const unsigned char *end = (const unsigned char *)data + size;
+	unsigned int in_len, out_len;
+	GzipBlock *blocks;
+	char *out;
+	size_t out_size = 0;
+	int blocks_num = 0, i;
+	bool error = false;
+
+	for (member = (const unsigned char *)data; member != end; member += in_len) {
+		if (!gzip_block_header(member, (size_t)(end - member), &in_len, &out_len)) {
+			return NULL;
+		}
+		out_size += out_len;
+		blocks_num++;
+	}
+
+	if (out_size < SIZEOFBLENDERHEADER) {
+		return NULL;
+	}
+
+	out = MEM_mallocN(out_size, __func__);
+	blocks = MEM_malloc_arrayN(blocks_num, sizeof(*blocks), __func__);
+	if (out == NULL || blocks == NULL) {
+		MEM_SAFE_FREE(out);
+		MEM_SAFE_FREE(blocks);
+		return NULL;
+	}
+
+	out_size = 0;
+	for (member = (const unsigned char *)data, i = 0; member != end; member += in_len, i++) {
+		gzip_block_header(member, (size_t)(end - member), &in_len, &out_len);
+		blocks[i].in = member;
+		blocks[i].in_len = in_len;
+		blocks[i].out = out + out_size;
+		blocks[i].out_len = out_len;
+		out_size += out_len;
+	}
+
+	{
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.use_threading = (blocks_num > 1);
+		settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+		BLI_task_parallel_range(0, blocks_num, blocks, gzip_block_inflate_cb, &settings);
+	}
+
+	for (i = 0; i < blocks_num; i++) {
+		error |= blocks[i].error;
+	}
+	MEM_freeN(blocks);
+
+	if (error) {
+		MEM_freeN(out);
+		return NULL;
+	}
+
+	*r_size = out_size;
+	return out;
+}
+
+/**
+ * Map an uncompressed file in memory, so blocks are only paged in when they are used.
+ * Files compressed on several threads are inflated in parallel and read from memory the same way.
+ * \return NULL for other compressed files or when the file can't be mapped, read them with gzip then.
+ */
+static FileData *blo_openblenderfile_mmap(const char *filepath)
+{
+	FileData *fd;
+	const char *mem;
+	size_t size;
+	int file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+	
+	if (file == -1) {
+		return NULL;
+	}
+	
+	size = BLI_file_descriptor_size(file);
+	if (size == (size_t)-1 || size < SIZEOFBLENDERHEADER) {
+		close(file);
+		return NULL;
+	}
+	
+	mem = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+	if (mem == (const char *)MAP_FAILED) {
+		close(file);
+		return NULL;
+	}
+	
+	/* test if gzip */
+	if (mem[0] == 0x1f && (unsigned char)mem[1] == 0x8b) {
+		size_t inflated_size = 0;
+		char *inflated = blo_gzip_blocks_inflate(mem, size, &inflated_size);
+		
+		munmap((void *)mem, size);
+		close(file);
+		
+		if (inflated == NULL) {
+			return NULL;
+		}
+		
+		fd = filedata_new();
+		fd->flags |= FD_FLAGS_MMAP_INFLATED;
+		fd->mmap_data = inflated;
+		fd->mmap_size = inflated_size;
+		fd->read = fd_read_from_mmap;
+		
+		return fd;
+	}
+	
+	fd = filedata_new();
+	fd->filedes = file;
+	fd->mmap_data = mem;
+	fd->mmap_size = size;
+	fd->read = fd_read_from_mmap;
+	
+	return fd;
+}
+
 /* cannot be called with relative paths anymore! */
 /* on each new library added, it now checks for the current FileData and expands relativeness */
 FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
 {
 	gzFile gzfile;
+	FileData *fd = blo_openblenderfile_mmap(filepath);
+	
+	if (fd) {
+		/* needed for library_append and read_libraries */
+		BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+		
+		return blo_decode_and_check(fd, reports);
+	}
+	
 	errno = 0;
 	gzfile = BLI_gzopen(filepath, "rb");
 	
@@ -1293,6 +1506,15 @@ void blo_freefiledata(FileData *fd)
 			gzclose(fd->gzfiledes);
 		}
 		
+		if (fd->mmap_data) {
+			if (fd->flags & FD_FLAGS_MMAP_INFLATED) {
+				MEM_freeN((void *)fd->mmap_data);
+			}
+			else {
+				munmap((void *)fd->mmap_data, fd->mmap_size);
+			}
+		}
+		
 		if (fd->strm.next_in) {
 			if (inflateEnd(&fd->strm) != Z_OK) {
 				printf("close gzip stream error\n");
@@ -1567,9 +1789,7 @@ static void change_idid_adr_fd(FileData *fd, const void *old, void *new)
 {
 	int i;
 	
-	/* use a binary search if we have a sorted libmap, for now it's not needed. */
-	BLI_assert(fd->libmap->sorted == false);
-
+	/* the map is keyed by old address, so look through all entries */
 	for (i = 0; i < fd->libmap->nentries; i++) {
 		OldNew *entry = &fd->libmap->entries[i];
 		
@@ -1905,18 +2125,29 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 	void *temp = NULL;
 	
 	if (bh->len) {
+		const void *data = blo_bhead_data(bh);
+		
 		/* switch is based on file dna */
 		if (bh->SDNAnr && (fd->flags & FD_FLAGS_SWITCH_ENDIAN))
 			switch_endian_structs(fd->filesdna, bh);
 		
 		if (fd->compflags[bh->SDNAnr] != SDNA_CMP_REMOVED) {
 			if (fd->compflags[bh->SDNAnr] == SDNA_CMP_NOT_EQUAL) {
-				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh+1));
+				/* blocks in the mapped file are only 4 byte aligned, reconstruct reads doubles and pointers */
+				if ((uintptr_t)data & 7) {
+					void *aligned = MEM_mallocN(bh->len, "read_struct aligned");
+					memcpy(aligned, data, bh->len);
+					temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, aligned);
+					MEM_freeN(aligned);
+				}
+				else {
+					temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, data);
+				}
 			}
 			else {
 				/* SDNA_CMP_EQUAL */
 				temp = MEM_mallocN(bh->len, blockname);
-				memcpy(temp, (bh+1), bh->len);
+				memcpy(temp, data, bh->len);
 			}
 		}
 	}
@@ -8561,8 +8792,6 @@ static void lib_link_all(FileData *fd, Main *main)
 	ListBase *lbarray[MAX_LIBARRAY];
 	int i;
 
-	oldnewmap_sort(fd);
-
 	i = set_listbasepointers(main, lbarray);
 	while (i--) {
 		ID *loop = lbarray[i]->first;
@@ -62,6 +62,10 @@ typedef struct FileData {
 	int filedes;
 	gzFile gzfiledes;
 
+	// variables needed for reading from a memory mapped file (or one inflated in memory)
+	const char *mmap_data;
+	size_t mmap_size, mmap_seek;
+
 	// now only in use for library appending
 	char relabase[FILE_MAX];
 	
@@ -109,6 +113,8 @@ typedef struct FileData {
 
 typedef struct BHeadN {
 	struct BHeadN *next, *prev;
+	/* Block contents, directly after bhead or in place in the mapped file (see blo_bhead_data) */
+	const void *data;
 	struct BHead bhead;
 } BHeadN;
 
@@ -120,10 +126,19 @@ enum {
 	FD_FLAGS_FILE_OK               = 1 << 3,
 	FD_FLAGS_NOT_MY_BUFFER         = 1 << 4,
 	FD_FLAGS_NOT_MY_LIBMAP         = 1 << 5,  /* XXX Unused in practice (checked once but never set). */
+	FD_FLAGS_MMAP_INFLATED         = 1 << 6,  /* mmap_data isn't mapped but inflated in memory */
 };
 
 #define SIZEOFBLENDERHEADER 12
 
+/* Compressed files written on several threads are gzip members with an extra field that holds
+ * the size of the member and of its uncompressed data, so they can be inflated on all threads.
+ * Header: gzip header (10), extra length (2), SI1, SI2, subfield length (2), member size (4), data size (4). */
+#define BLEND_GZIP_BLOCK_SI1          'B'
+#define BLEND_GZIP_BLOCK_SI2          'L'
+#define BLEND_GZIP_BLOCK_EXTRA_LEN    12
+#define BLEND_GZIP_BLOCK_HEADER_LEN   (12 + BLEND_GZIP_BLOCK_EXTRA_LEN)
+
 /***/
 struct Main;
 void blo_join_main(ListBase *mainlist);
@@ -153,6 +168,7 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock);
 BHead *blo_prevbhead(FileData *fd, BHead *thisblock);
 
 const char *bhead_id_name(const FileData *fd, const BHead *bhead);
+const void *blo_bhead_data(const BHead *bhead);
 
 /* do versions stuff */
 
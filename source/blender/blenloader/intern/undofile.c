@@ -40,46 +40,93 @@
 #include "DNA_listBase.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_ghash.h"
+#include "BLI_hash_mm2a.h"
 
 #include "BLO_undofile.h"
 
 /* **************** support for memory-write, for undo buffers *************** */
 
+/* Data of the chunks is kept in a store shared by all undo steps, so identical data is
+ * stored only once, also when it moved to another position in the file or another step. */
+typedef struct MemFileBuffer {
+	char *buf;
+	unsigned int size;
+	unsigned int hash;
+	unsigned int users;
+} MemFileBuffer;
+
+static GSet *memfile_store = NULL;
+static size_t memfile_store_size = 0;
+
+static unsigned int memfile_buffer_hash(const void *key)
+{
+	return ((const MemFileBuffer *)key)->hash;
+}
+
+static bool memfile_buffer_cmp(const void *a, const void *b)
+{
+	const MemFileBuffer *buffer_a = a, *buffer_b = b;
+	return ((buffer_a->hash != buffer_b->hash) ||
+	        (buffer_a->size != buffer_b->size) ||
+	        (memcmp(buffer_a->buf, buffer_b->buf, buffer_a->size) != 0));
+}
+
+static void memfile_buffer_release(MemFileBuffer *buffer)
+{
+	if (--buffer->users == 0) {
+		BLI_gset_remove(memfile_store, buffer, NULL);
+		memfile_store_size -= buffer->size;
+		MEM_freeN(buffer->buf);
+		MEM_freeN(buffer);
+
+		/* don't keep the empty store around, it would show up as a leak on exit */
+		if (BLI_gset_size(memfile_store) == 0) {
+			BLI_gset_free(memfile_store, NULL);
+			memfile_store = NULL;
+		}
+	}
+}
+
+static void memfile_chunk_share(MemFileChunk *chunk, MemFileBuffer *buffer)
+{
+	buffer->users++;
+	chunk->buffer = buffer;
+	chunk->buf = buffer->buf;
+	chunk->ident = 1;
+}
+
 /* not memfile itself */
 void BLO_memfile_free(MemFile *memfile)
 {
 	MemFileChunk *chunk;
 	
 	while ((chunk = BLI_pophead(&memfile->chunks))) {
-		if (chunk->ident == 0)
-			MEM_freeN(chunk->buf);
+		memfile_buffer_release(chunk->buffer);
 		MEM_freeN(chunk);
 	}
 	memfile->size = 0;
+	memfile->size_total = 0;
+	memfile->chunks_num = memfile->chunks_ident = memfile->chunks_moved = 0;
 }
 
 /* to keep list of memfiles consistent, 'first' is always first in list */
 /* result is that 'first' is being freed */
 void BLO_memfile_merge(MemFile *first, MemFile *second)
 {
-	MemFileChunk *fc, *sc;
-	
-	fc = first->chunks.first;
-	sc = second->chunks.first;
-	while (fc || sc) {
-		if (fc && sc) {
-			if (sc->ident) {
-				sc->ident = 0;
-				fc->ident = 1;
-			}
-		}
-		if (fc) fc = fc->next;
-		if (sc) sc = sc->next;
-	}
-	
+	/* chunks of 'second' keep their own reference to the shared data */
+	UNUSED_VARS(second);
+
 	BLO_memfile_free(first);
 }
 
+/* size and number of the buffers in the store, used by all undo steps together */
+void BLO_memfile_store_stats(size_t *r_size, unsigned int *r_buffers_num)
+{
+	*r_size = memfile_store_size;
+	*r_buffers_num = memfile_store ? BLI_gset_size(memfile_store) : 0;
+}
+
 void memfile_chunk_add(MemFile *compare, MemFile *current, const char *buf, unsigned int size)
 {
 	static MemFileChunk *compchunk = NULL;
@@ -99,24 +146,53 @@ void memfile_chunk_add(MemFile *compare, MemFile *current, const char *buf, unsi
 	curchunk->size = size;
 	curchunk->buf = NULL;
 	curchunk->ident = 0;
+	curchunk->buffer = NULL;
 	BLI_addtail(&current->chunks, curchunk);
 	
-	/* we compare compchunk with buf */
+	/* we compare compchunk with buf, the common case of unchanged data */
 	if (compchunk) {
 		if (compchunk->size == curchunk->size) {
 			if (memcmp(compchunk->buf, buf, size) == 0) {
-				curchunk->buf = compchunk->buf;
-				curchunk->ident = 1;
+				memfile_chunk_share(curchunk, compchunk->buffer);
 			}
 		}
 		compchunk = compchunk->next;
 	}
 	
-	/* not equal... */
+	/* not equal, look the data up by content */
 	if (curchunk->buf == NULL) {
-		curchunk->buf = MEM_mallocN(size, "Chunk buffer");
-		memcpy(curchunk->buf, buf, size);
-		current->size += size;
+		MemFileBuffer key, *buffer;
+
+		key.buf = (char *)buf;
+		key.size = size;
+		key.hash = BLI_hash_mm2((const unsigned char *)buf, size, 0);
+
+		if (memfile_store == NULL) {
+			memfile_store = BLI_gset_new(memfile_buffer_hash, memfile_buffer_cmp, __func__);
+		}
+
+		buffer = BLI_gset_lookup(memfile_store, &key);
+		if (buffer) {
+			memfile_chunk_share(curchunk, buffer);
+			current->chunks_moved++;
+		}
+		else {
+			buffer = MEM_mallocN(sizeof(MemFileBuffer), "MemFileBuffer");
+			buffer->buf = MEM_mallocN(size, "Chunk buffer");
+			memcpy(buffer->buf, buf, size);
+			buffer->size = size;
+			buffer->hash = key.hash;
+			buffer->users = 1;
+			BLI_gset_insert(memfile_store, buffer);
+			memfile_store_size += size;
+
+			curchunk->buffer = buffer;
+			curchunk->buf = buffer->buf;
+			current->size += size;
+		}
 	}
-}
 
+	current->size_total += size;
+	current->chunks_num++;
+	current->chunks_ident += curchunk->ident;
+}
@@ -154,6 +154,8 @@
 #include "BLI_blenlib.h"
 #include "BLI_linklist.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
 
 #include "BKE_action.h"
 #include "BKE_blender_version.h"
@@ -206,6 +208,8 @@ typedef enum {
 	WW_WRAP_ZLIB,
 } eWriteWrapType;
 
+typedef struct ZlibWriter ZlibWriter;
+
 typedef struct WriteWrap WriteWrap;
 struct WriteWrap {
 	/* callbacks */
@@ -217,6 +221,7 @@ struct WriteWrap {
 	union {
 		int file_handle;
 		gzFile gz_handle;
+		ZlibWriter *zlib_writer;
 	} _user_data;
 };
 
@@ -276,6 +281,239 @@ static size_t ww_write_zlib(WriteWrap *ww, const char *buf, size_t buf_len)
 }
 #undef FILE_HANDLE
 
+/* zlib, compressing on all threads
+ *
+ * The data is split in blocks which are compressed as separate gzip members in a task pool
+ * and written in order by the thread that writes the file. gzread reads concatenated members
+ * as a single stream, so these files open the same as the ones written by ww_write_zlib.
+ * The header of each member has the sizes of the block (see BLEND_GZIP_BLOCK_HEADER_LEN),
+ * so readfile.c can find all of them and inflate them in parallel too.
+ * At most two blocks for each thread are kept in memory, when all of them are in use
+ * writing waits for the oldest one to be compressed. */
+
+#define ZLIB_BLOCK_SIZE      (1 << 20)  /* 1mb */
+/* more than deflateBound() of a full block with the gzip header and trailer */
+#define ZLIB_BLOCK_OUT_SIZE  (ZLIB_BLOCK_SIZE + (ZLIB_BLOCK_SIZE >> 8) + 64)
+
+typedef struct ZlibBlock {
+	ZlibWriter *zw;
+	char  *in;
+	size_t in_len;
+	char  *out;
+	size_t out_len;
+	/* protected by ZlibWriter.mutex, started is only cleared while the block is queued,
+	 * so a task still pending from an earlier use of the block can't take it while it's filled */
+	bool   started;
+	bool   done;
+	bool   error;
+} ZlibBlock;
+
+struct ZlibWriter {
+	int file_handle;
+	TaskPool *pool;
+	ZlibBlock *blocks;
+	int blocks_num;
+	/* blocks_queued blocks starting at block_first are compressed,
+	 * the block after them is filled by ww_write_zlib_parallel */
+	int block_first;
+	int blocks_queued;
+	ThreadMutex mutex;
+	ThreadCondition cond;
+	bool error;
+};
+
+#define ZLIB_WRITER(ww) \
+	(ww)->_user_data.zlib_writer
+
+static void zlib_block_compress(ZlibBlock *block)
+{
+	ZlibWriter *zw = block->zw;
+	z_stream strm = {NULL};
+	/* the sizes in the extra field are filled in once the block is compressed */
+	unsigned char extra[BLEND_GZIP_BLOCK_EXTRA_LEN] = {BLEND_GZIP_BLOCK_SI1, BLEND_GZIP_BLOCK_SI2, 8, 0};
+	gz_header header = {0};
+	bool ok = false;
+
+	header.extra = extra;
+	header.extra_len = sizeof(extra);
+	header.os = 255;  /* unknown */
+
+	/* same compression level as ww_open_zlib, 16 added to the window bits writes a gzip wrapper */
+	if (deflateInit2(&strm, 1, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+		strm.next_in = (Bytef *)block->in;
+		strm.avail_in = (uInt)block->in_len;
+		strm.next_out = (Bytef *)block->out;
+		strm.avail_out = ZLIB_BLOCK_OUT_SIZE;
+		ok = (deflateSetHeader(&strm, &header) == Z_OK) && (deflate(&strm, Z_FINISH) == Z_STREAM_END);
+		block->out_len = strm.total_out;
+		deflateEnd(&strm);
+	}
+
+	if (ok) {
+		unsigned char *sizes = (unsigned char *)block->out + BLEND_GZIP_BLOCK_HEADER_LEN - 8;
+		for (int i = 0; i < 4; i++) {
+			sizes[i] = (unsigned char)(block->out_len >> (8 * i));
+			sizes[4 + i] = (unsigned char)(block->in_len >> (8 * i));
+		}
+	}
+
+	BLI_mutex_lock(&zw->mutex);
+	block->error = !ok;
+	block->done = true;
+	BLI_condition_notify_all(&zw->cond);
+	BLI_mutex_unlock(&zw->mutex);
+}
+
+/* claim the block, it may already be compressed by the writing thread */
+static bool zlib_block_start(ZlibBlock *block)
+{
+	ZlibWriter *zw = block->zw;
+	bool start;
+
+	BLI_mutex_lock(&zw->mutex);
+	start = !block->started;
+	block->started = true;
+	BLI_mutex_unlock(&zw->mutex);
+
+	return start;
+}
+
+static void zlib_block_compress_task(TaskPool *__restrict UNUSED(pool), void *taskdata, int UNUSED(threadid))
+{
+	ZlibBlock *block = taskdata;
+
+	if (zlib_block_start(block)) {
+		zlib_block_compress(block);
+	}
+}
+
+/* wait for the oldest queued block and write it to the file */
+static void zlib_writer_write_oldest(ZlibWriter *zw)
+{
+	ZlibBlock *block = &zw->blocks[zw->block_first];
+
+	/* compress it here when no thread took it yet, there might be none that can */
+	if (zlib_block_start(block)) {
+		zlib_block_compress(block);
+	}
+
+	BLI_mutex_lock(&zw->mutex);
+	while (!block->done) {
+		BLI_condition_wait(&zw->cond, &zw->mutex);
+	}
+	BLI_mutex_unlock(&zw->mutex);
+
+	if (block->error) {
+		zw->error = true;
+	}
+	else if (!zw->error && (size_t)write(zw->file_handle, block->out, block->out_len) != block->out_len) {
+		zw->error = true;
+	}
+
+	block->in_len = 0;
+	block->started = true;
+	block->done = false;
+	zw->block_first = (zw->block_first + 1) % zw->blocks_num;
+	zw->blocks_queued--;
+}
+
+/* queue the block being filled for compression */
+static void zlib_writer_queue_block(ZlibWriter *zw)
+{
+	ZlibBlock *block = &zw->blocks[(zw->block_first + zw->blocks_queued) % zw->blocks_num];
+
+	if (block->in_len == 0) {
+		return;
+	}
+
+	BLI_mutex_lock(&zw->mutex);
+	block->started = false;
+	BLI_mutex_unlock(&zw->mutex);
+
+	zw->blocks_queued++;
+	BLI_task_pool_push(zw->pool, zlib_block_compress_task, block, false, TASK_PRIORITY_HIGH);
+
+	/* the next block to fill must not be in use */
+	if (zw->blocks_queued == zw->blocks_num) {
+		zlib_writer_write_oldest(zw);
+	}
+}
+
+static bool ww_open_zlib_parallel(WriteWrap *ww, const char *filepath)
+{
+	const int file = BLI_open(filepath, O_BINARY + O_WRONLY + O_CREAT + O_TRUNC, 0666);
+
+	if (file == -1) {
+		return false;
+	}
+
+	TaskScheduler *scheduler = BLI_task_scheduler_get();
+	ZlibWriter *zw = MEM_callocN(sizeof(*zw), __func__);
+
+	zw->file_handle = file;
+	zw->pool = BLI_task_pool_create(scheduler, zw);
+	zw->blocks_num = 2 * BLI_task_scheduler_num_threads(scheduler);
+	zw->blocks = MEM_callocN(sizeof(*zw->blocks) * zw->blocks_num, __func__);
+	for (int i = 0; i < zw->blocks_num; i++) {
+		zw->blocks[i].zw = zw;
+		zw->blocks[i].started = true;
+		zw->blocks[i].in = MEM_mallocN(ZLIB_BLOCK_SIZE, __func__);
+		zw->blocks[i].out = MEM_mallocN(ZLIB_BLOCK_OUT_SIZE, __func__);
+	}
+	BLI_mutex_init(&zw->mutex);
+	BLI_condition_init(&zw->cond);
+
+	ZLIB_WRITER(ww) = zw;
+	return true;
+}
+static bool ww_close_zlib_parallel(WriteWrap *ww)
+{
+	ZlibWriter *zw = ZLIB_WRITER(ww);
+
+	zlib_writer_queue_block(zw);
+	while (zw->blocks_queued) {
+		zlib_writer_write_oldest(zw);
+	}
+
+	BLI_task_pool_work_and_wait(zw->pool);
+	BLI_task_pool_free(zw->pool);
+	BLI_condition_end(&zw->cond);
+	BLI_mutex_end(&zw->mutex);
+
+	for (int i = 0; i < zw->blocks_num; i++) {
+		MEM_freeN(zw->blocks[i].in);
+		MEM_freeN(zw->blocks[i].out);
+	}
+	MEM_freeN(zw->blocks);
+
+	const bool ok = (close(zw->file_handle) != -1) && !zw->error;
+	MEM_freeN(zw);
+	ZLIB_WRITER(ww) = NULL;
+
+	return ok;
+}
+static size_t ww_write_zlib_parallel(WriteWrap *ww, const char *buf, size_t buf_len)
+{
+	ZlibWriter *zw = ZLIB_WRITER(ww);
+	size_t written = 0;
+
+	while (written < buf_len && !zw->error) {
+		ZlibBlock *block = &zw->blocks[(zw->block_first + zw->blocks_queued) % zw->blocks_num];
+		const size_t len = MIN2(buf_len - written, ZLIB_BLOCK_SIZE - block->in_len);
+
+		memcpy(block->in + block->in_len, buf + written, len);
+		block->in_len += len;
+		written += len;
+
+		if (block->in_len == ZLIB_BLOCK_SIZE) {
+			zlib_writer_queue_block(zw);
+		}
+	}
+
+	return zw->error ? 0 : buf_len;
+}
+#undef ZLIB_WRITER
+
 /* --- end compression types --- */
 
 static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
@@ -285,9 +523,17 @@ static void ww_handle_init(eWriteWrapType ww_type, WriteWrap *r_ww)
 	switch (ww_type) {
 		case WW_WRAP_ZLIB:
 		{
-			r_ww->open  = ww_open_zlib;
-			r_ww->close = ww_close_zlib;
-			r_ww->write = ww_write_zlib;
+			/* the scheduler always has a worker, but with a single thread it only runs background pools */
+			if (BLI_system_thread_count() > 1) {
+				r_ww->open  = ww_open_zlib_parallel;
+				r_ww->close = ww_close_zlib_parallel;
+				r_ww->write = ww_write_zlib_parallel;
+			}
+			else {
+				r_ww->open  = ww_open_zlib;
+				r_ww->close = ww_close_zlib;
+				r_ww->write = ww_write_zlib;
+			}
 			break;
 		}
 		default:
@@ -3953,6 +4199,12 @@ static bool write_file_handle(
 					BLI_assert(0);
 					break;
 			}
+
+			/* For undo each data-block gets its own chunks, so adding, removing or reordering
+			 * data-blocks doesn't change the chunks of the ones after it. */
+			if (wd->current) {
+				mywrite_flush(wd);
+			}
 		}
 
 		mywrite_flush(wd);
@@ -4109,10 +4361,12 @@ bool BLO_write_file(
 		BKE_bpath_relative_convert(mainvar, filepath, NULL);
 	}
 
-	/* actual file writing */
-	const bool err = write_file_handle(mainvar, &ww, NULL, NULL, write_flags, thumb);
+	/* actual file writing, compressed data is only complete once the file is closed */
+	bool err = write_file_handle(mainvar, &ww, NULL, NULL, write_flags, thumb);
 
-	ww.close(&ww);
+	if (ww.close(&ww) == false) {
+		err = true;
+	}
 
 	if (UNLIKELY(path_list_backup)) {
 		BKE_bpath_list_restore(mainvar, path_list_flag, path_list_backup);
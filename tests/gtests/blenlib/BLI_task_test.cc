@@ -13,6 +13,10 @@ extern "C" {
 
 #define NUM_ITEMS 10000
 
+/* Depth and number of children of the task tree, pushed by the tasks themselves. */
+#define TREE_DEPTH 6
+#define TREE_CHILDREN 5
+
 static void task_mempool_iter_func(void *userdata, MempoolIterData *item) {
 	int *data = (int *)item;
 	int *count = (int *)userdata;
@@ -74,3 +78,83 @@ TEST(task, MempoolIter)
 
 	BLI_mempool_destroy(mempool);
 }
+
+static void task_tree_func(TaskPool *__restrict pool, void *taskdata, int threadid)
+{
+	int *count = (int *)BLI_task_pool_userdata(pool);
+	const int depth = GET_INT_FROM_POINTER(taskdata);
+
+	atomic_add_and_fetch_uint32((uint32_t *)count, 1);
+
+	if (depth < TREE_DEPTH) {
+		for (int i = 0; i < TREE_CHILDREN; i++) {
+			BLI_task_pool_push_from_thread(
+			        pool, task_tree_func, SET_INT_IN_POINTER(depth + 1), false,
+			        (i % 2) ? TASK_PRIORITY_HIGH : TASK_PRIORITY_LOW, threadid);
+		}
+	}
+}
+
+TEST(task, SchedulerTree)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_create(4);
+	TaskSchedulerStats stats;
+	int expected = 0, count = 0;
+
+	for (int i = 0, num = 1; i <= TREE_DEPTH; i++, num *= TREE_CHILDREN) {
+		expected += num;
+	}
+
+	/* Run the tree a few times, so threads find their queues both empty and full. */
+	for (int iter = 0; iter < 10; iter++) {
+		TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+		count = 0;
+		BLI_task_pool_push(pool, task_tree_func, SET_INT_IN_POINTER(0), false, TASK_PRIORITY_HIGH);
+		BLI_task_pool_work_and_wait(pool);
+		EXPECT_EQ(count, expected);
+
+		BLI_task_pool_free(pool);
+	}
+
+	/* Every task was taken once, either by the thread that pushed it or by another one. */
+	BLI_task_scheduler_stats(scheduler, &stats);
+	EXPECT_EQ(stats.num_pushed, (size_t)(expected * 10));
+	EXPECT_EQ(stats.num_popped + stats.num_stolen, stats.num_pushed);
+
+	BLI_task_scheduler_free(scheduler);
+}
+
+static void task_cancel_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int threadid)
+{
+	int *count = (int *)BLI_task_pool_userdata(pool);
+
+	atomic_add_and_fetch_uint32((uint32_t *)count, 1);
+
+	if (!BLI_task_pool_canceled(pool)) {
+		BLI_task_pool_push_from_thread(pool, task_cancel_func, NULL, false, TASK_PRIORITY_LOW, threadid);
+	}
+}
+
+TEST(task, SchedulerCancel)
+{
+	TaskScheduler *scheduler = BLI_task_scheduler_create(4);
+	int count = 0;
+
+	TaskPool *pool = BLI_task_pool_create(scheduler, &count);
+
+	/* Tasks keep pushing new ones until canceled, cancel has to remove the queued ones. */
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		BLI_task_pool_push(pool, task_cancel_func, NULL, false, TASK_PRIORITY_LOW);
+	}
+	BLI_task_pool_cancel(pool);
+
+	/* The pool is usable again after cancel. */
+	count = 0;
+	BLI_task_pool_push(pool, task_tree_func, SET_INT_IN_POINTER(TREE_DEPTH), false, TASK_PRIORITY_HIGH);
+	BLI_task_pool_work_and_wait(pool);
+	EXPECT_EQ(count, 1);
+
+	BLI_task_pool_free(pool);
+	BLI_task_scheduler_free(scheduler);
+}
@@ -0,0 +1,172 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_binary_sidecar.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayForBlender::BinarySidecar;
+
+struct TestVector {
+	float x, y, z;
+};
+
+static std::string sidecar_test_path(const char *name)
+{
+	return std::string(P_tmpdir) + "/" + name;
+}
+
+TEST(vfb_binary_sidecar, RoundTrip)
+{
+	const std::string path = sidecar_test_path("vfb_sidecar_roundtrip.vrbin");
+
+	std::vector<float> vertices(3 * 1000);
+	for (int c = 0; c < vertices.size(); ++c) {
+		vertices[c] = c * 0.5f;
+	}
+	std::vector<int> faces(3 * 333);
+	for (int c = 0; c < faces.size(); ++c) {
+		faces[c] = c % 1000;
+	}
+
+	Entry vertEntry, faceEntry, emptyEntry;
+	{
+		BinarySidecarWriter writer(path);
+		ASSERT_TRUE(writer.good());
+		EXPECT_TRUE(writer.write(vertices.data(), vertices.size() * sizeof(float), ElementTypeVector, vertEntry));
+		EXPECT_TRUE(writer.write(faces.data(), faces.size() * sizeof(int), ElementTypeInt, faceEntry));
+		EXPECT_TRUE(writer.write(nullptr, 0, ElementTypeFloat, emptyEntry));
+	}
+
+	EXPECT_EQ(vertEntry.offset % PageSize, 0);
+	EXPECT_EQ(faceEntry.offset % PageSize, 0);
+	EXPECT_EQ(vertEntry.length, vertices.size() * sizeof(float));
+
+	BinarySidecarReader reader;
+	ASSERT_TRUE(reader.open(path));
+	EXPECT_EQ(reader.getCount(), 3);
+
+	const float *readVertices = reader.getArray<float>(vertEntry.offset, vertEntry.length);
+	ASSERT_NE(readVertices, nullptr);
+	EXPECT_EQ(memcmp(readVertices, vertices.data(), vertEntry.length), 0);
+
+	const int *readFaces = reader.getArray<int>(faceEntry.offset, faceEntry.length);
+	ASSERT_NE(readFaces, nullptr);
+	EXPECT_EQ(memcmp(readFaces, faces.data(), faceEntry.length), 0);
+
+	EXPECT_TRUE(reader.validate(emptyEntry.offset, 0));
+
+	reader.close();
+	remove(path.c_str());
+}
+
+TEST(vfb_binary_sidecar, ReadableAfterFlush)
+{
+	const std::string path = sidecar_test_path("vfb_sidecar_flush.vrbin");
+
+	std::vector<float> first(5000, 1.0f), second(100, 2.0f);
+
+	BinarySidecarWriter writer(path);
+	ASSERT_TRUE(writer.good());
+
+	Entry firstEntry, secondEntry;
+	EXPECT_TRUE(writer.write(first.data(), first.size() * sizeof(float), ElementTypeFloat, firstEntry));
+	EXPECT_TRUE(writer.flush());
+	{
+		// the writer is still open, as during an export after the .vrscene was synced
+		BinarySidecarReader reader;
+		ASSERT_TRUE(reader.open(path));
+		EXPECT_EQ(reader.getCount(), 1);
+		const float *data = reader.getArray<float>(firstEntry.offset, firstEntry.length);
+		ASSERT_NE(data, nullptr);
+		EXPECT_EQ(memcmp(data, first.data(), firstEntry.length), 0);
+	}
+
+	// more payloads replace the table of contents, which is written again after them
+	EXPECT_TRUE(writer.write(second.data(), second.size() * sizeof(float), ElementTypeFloat, secondEntry));
+	writer.close();
+
+	BinarySidecarReader reader;
+	ASSERT_TRUE(reader.open(path));
+	EXPECT_EQ(reader.getCount(), 2);
+	const float *data = reader.getArray<float>(firstEntry.offset, firstEntry.length);
+	ASSERT_NE(data, nullptr);
+	EXPECT_EQ(memcmp(data, first.data(), firstEntry.length), 0);
+	data = reader.getArray<float>(secondEntry.offset, secondEntry.length);
+	ASSERT_NE(data, nullptr);
+	EXPECT_EQ(memcmp(data, second.data(), secondEntry.length), 0);
+
+	reader.close();
+	remove(path.c_str());
+}
+
+TEST(vfb_binary_sidecar, InvalidReferences)
+{
+	const std::string path = sidecar_test_path("vfb_sidecar_invalid.vrbin");
+
+	std::vector<float> data(100, 1.0f);
+	Entry entry;
+	{
+		BinarySidecarWriter writer(path);
+		ASSERT_TRUE(writer.write(data.data(), data.size() * sizeof(float), ElementTypeFloat, entry));
+	}
+
+	BinarySidecarReader reader;
+	ASSERT_TRUE(reader.open(path));
+
+	/* offsets and lengths not in the table of contents */
+	EXPECT_EQ(reader.get(entry.offset + 4, entry.length - 4), nullptr);
+	EXPECT_EQ(reader.get(entry.offset, entry.length + 4), nullptr);
+	EXPECT_EQ(reader.get(0, PageSize), nullptr);
+	EXPECT_EQ(reader.get(uint64_t(-PageSize), PageSize), nullptr);
+	/* length not multiple of element size */
+	EXPECT_EQ(reader.getArray<TestVector>(entry.offset, entry.length), nullptr);
+	reader.close();
+
+	remove(path.c_str());
+}
+
+TEST(vfb_binary_sidecar, CorruptFile)
+{
+	const std::string path = sidecar_test_path("vfb_sidecar_corrupt.vrbin");
+
+	std::vector<float> data(100, 1.0f);
+	Entry entry;
+	{
+		BinarySidecarWriter writer(path);
+		ASSERT_TRUE(writer.write(data.data(), data.size() * sizeof(float), ElementTypeFloat, entry));
+	}
+
+	/* point the payload past the end of the file */
+	{
+		FILE *file = fopen(path.c_str(), "r+b");
+		ASSERT_NE(file, nullptr);
+		fseek(file, 0, SEEK_END);
+		const long tocOffset = ftell(file) - sizeof(Entry);
+		Entry bad = entry;
+		bad.length = 1 << 30;
+		fseek(file, tocOffset, SEEK_SET);
+		fwrite(&bad, sizeof(bad), 1, file);
+		fclose(file);
+	}
+
+	BinarySidecarReader reader;
+	EXPECT_FALSE(reader.open(path));
+	EXPECT_FALSE(reader.good());
+
+	/* not a sidecar at all */
+	{
+		FILE *file = fopen(path.c_str(), "wb");
+		ASSERT_NE(file, nullptr);
+		fputs("Node node1 {}", file);
+		fclose(file);
+	}
+	EXPECT_FALSE(reader.open(path));
+
+	remove(path.c_str());
+}
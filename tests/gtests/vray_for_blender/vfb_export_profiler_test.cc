@@ -0,0 +1,72 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_export_profiler.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace VRayForBlender;
+
+TEST(vfb_export_profiler, DisabledRecordsNothing)
+{
+	ExportProfiler profiler;
+	profiler.setEnabled(false);
+	{
+		ExportProfiler::Scope scope(profiler, "data", "exportGeomStaticMesh");
+	}
+	profiler.addBytes("ASCII", 100);
+
+	const std::string json = profiler.toJSON();
+	EXPECT_EQ(json.find("exportGeomStaticMesh"), std::string::npos);
+	EXPECT_EQ(json.find("ASCII"), std::string::npos);
+}
+
+TEST(vfb_export_profiler, CountsCallsAndBytes)
+{
+	ExportProfiler profiler;
+	profiler.setEnabled(true);
+	profiler.reset();
+
+	for (int c = 0; c < 3; ++c) {
+		ExportProfiler::Scope scope(profiler, "plugin", "GeomStaticMesh");
+	}
+	profiler.addBytes("ZIP", 10);
+	profiler.addBytes("ZIP", 32);
+
+	const std::string json = profiler.toJSON();
+	EXPECT_NE(json.find("\"name\": \"GeomStaticMesh\", \"calls\": 3"), std::string::npos);
+	EXPECT_NE(json.find("\"ZIP\": 42"), std::string::npos);
+
+	profiler.reset();
+	EXPECT_EQ(profiler.toJSON().find("GeomStaticMesh"), std::string::npos);
+}
+
+TEST(vfb_export_profiler, ChromeTraceHasEventPerScopeAndThread)
+{
+	ExportProfiler profiler;
+	profiler.setEnabled(true);
+	profiler.reset();
+
+	std::vector<std::thread> threads;
+	for (int c = 0; c < 4; ++c) {
+		threads.emplace_back([&profiler]() {
+			ExportProfiler::Scope outer(profiler, "scene", "sync_object");
+			ExportProfiler::Scope inner(profiler, "data", "exportObject \"quoted\"");
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	const std::string trace = profiler.toChromeTrace();
+	int events = 0;
+	for (size_t pos = trace.find("\"ph\": \"X\""); pos != std::string::npos; pos = trace.find("\"ph\": \"X\"", pos + 1)) {
+		++events;
+	}
+	EXPECT_EQ(events, 8);
+	EXPECT_NE(trace.find("exportObject \\\"quoted\\\""), std::string::npos);
+	EXPECT_NE(trace.find("Export thread 3"), std::string::npos);
+}
@@ -0,0 +1,211 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "BLI_compiler_attrs.h"
+
+#include "vfb_image_kernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace VRayForBlender;
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_RUNS 10
+
+static const ImageKernels::InstructionSet instruction_sets[] = {
+	ImageKernels::Scalar,
+	ImageKernels::SSE2,
+	ImageKernels::AVX2,
+};
+
+/* Values around the clamp limit, including NaN and infinity which must pass through unchanged. */
+static std::vector<float> make_pixels(int count)
+{
+	std::vector<float> pixels(count);
+	for (int c = 0; c < count; ++c) {
+		switch (c % 11) {
+			case 3:  pixels[c] = std::numeric_limits<float>::quiet_NaN(); break;
+			case 7:  pixels[c] = std::numeric_limits<float>::infinity(); break;
+			default: pixels[c] = (c % 13) * 0.17f - 0.3f; break;
+		}
+	}
+	return pixels;
+}
+
+/* Reference: the functions used by RenderImage and ZmqRenderImage::update before the kernels. */
+static void ref_reset_alpha(float *data, int w, int h, int channels)
+{
+	if (channels == 4) {
+		for (int c = 3; c < w * h * channels; c += 4) {
+			data[c] = 1.0f;
+		}
+	}
+}
+
+static void ref_clamp(float *data, int w, int h, int channels, float max, float val)
+{
+	const int pixelCount = w * h;
+	for (int p = 0; p < pixelCount; ++p) {
+		float *pixel = data + (p * channels);
+		switch (channels) {
+			case 4:
+			case 3: pixel[2] = pixel[2] > max ? val : pixel[2]; ATTR_FALLTHROUGH;
+			case 2: pixel[1] = pixel[1] > max ? val : pixel[1]; ATTR_FALLTHROUGH;
+			case 1: pixel[0] = pixel[0] > max ? val : pixel[0];
+		}
+	}
+}
+
+static void ref_flip(float *pixels, int w, int h, int channels)
+{
+	const int row_items = w * channels;
+	std::vector<float> buf(row_items);
+	for (int i = 0; i < h / 2; ++i) {
+		float *to_row = pixels + (i * row_items);
+		float *from_row = pixels + ((h - i - 1) * row_items);
+		memcpy(buf.data(), to_row, row_items * sizeof(float));
+		memcpy(to_row, from_row, row_items * sizeof(float));
+		memcpy(from_row, buf.data(), row_items * sizeof(float));
+	}
+}
+
+/* Take @channels from RGBA @source, then flip, reset alpha and clamp in separate passes. */
+static void ref_convert(float *dest, int channels, const float *source, int w, int h, int flags)
+{
+	for (int c = 0; c < w * h; ++c) {
+		for (int k = 0; k < channels; ++k) {
+			dest[c * channels + k] = source[c * 4 + k];
+		}
+	}
+	if (flags & ImageKernels::Flip) {
+		ref_flip(dest, w, h, channels);
+	}
+	if (flags & ImageKernels::ResetAlpha) {
+		ref_reset_alpha(dest, w, h, channels);
+	}
+	if (flags & ImageKernels::Clamp) {
+		ref_clamp(dest, w, h, channels, 1.0f, 1.0f);
+	}
+}
+
+template <typename T>
+static double time_ms(T func)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	for (int c = 0; c < BENCH_RUNS; ++c) {
+		func();
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / BENCH_RUNS;
+}
+
+TEST(vfb_image_kernels, MatchesReference)
+{
+	const int height = 5;
+	const int channelCounts[] = {4, 3, 1};
+	const int flagSets[] = {
+		ImageKernels::None,
+		ImageKernels::Clamp,
+		ImageKernels::ResetAlpha,
+		ImageKernels::Flip | ImageKernels::Clamp | ImageKernels::ResetAlpha,
+	};
+
+	for (const ImageKernels::InstructionSet requested : instruction_sets) {
+		const ImageKernels::InstructionSet used = ImageKernels::setInstructionSet(requested);
+		if (used != requested) {
+			continue;
+		}
+
+		for (int width = 1; width < 40; ++width) {
+			const std::vector<float> source = make_pixels(width * height * 4);
+
+			for (const int channels : channelCounts) {
+				for (const int flags : flagSets) {
+					std::vector<float> expected(width * height * channels);
+					std::vector<float> actual(expected.size());
+					ref_convert(expected.data(), channels, source.data(), width, height, flags);
+					ImageKernels::convert(actual.data(), width * channels, channels, source.data(), width * 4, 4, width, height, flags);
+
+					ASSERT_EQ(memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)), 0)
+					    << ImageKernels::getInstructionSetName(used) << " width " << width
+					    << " channels " << channels << " flags " << flags;
+
+					/* Same channels, in place. */
+					if (!(flags & ImageKernels::Flip)) {
+						std::vector<float> inPlace;
+						for (int c = 0; c < width * height; ++c) {
+							inPlace.insert(inPlace.end(), source.begin() + c * 4, source.begin() + c * 4 + channels);
+						}
+						ImageKernels::convert(inPlace.data(), width * channels, channels, inPlace.data(), width * channels, channels, width, height, flags);
+						ASSERT_EQ(memcmp(expected.data(), inPlace.data(), expected.size() * sizeof(float)), 0)
+						    << ImageKernels::getInstructionSetName(used) << " in place, width " << width
+						    << " channels " << channels << " flags " << flags;
+					}
+				}
+			}
+		}
+	}
+
+	ImageKernels::setInstructionSet(ImageKernels::AVX2);
+}
+
+TEST(vfb_image_kernels, FlipRows)
+{
+	const int w = 7, h = 5;
+	std::vector<float> expected = make_pixels(w * h * 4);
+	std::vector<float> actual = expected;
+	ref_flip(expected.data(), w, h, 4);
+	ImageKernels::flipRows(actual.data(), w * 4, h);
+	EXPECT_EQ(memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)), 0);
+}
+
+TEST(vfb_image_kernels, Performance)
+{
+	const int w = BENCH_WIDTH, h = BENCH_HEIGHT;
+	const std::vector<float> source = make_pixels(w * h * 4);
+	std::vector<float> dest(source.size());
+	const int fix = ImageKernels::Flip | ImageKernels::Clamp | ImageKernels::ResetAlpha;
+
+	printf("%dx%d RGBA image, average of %d runs\n", w, h, BENCH_RUNS);
+
+	/* Bucket merge as done by updateImageRegion before: flipped memcpy then clamp and alpha passes per line. */
+	const double refRegion = time_ms([&]() {
+		for (int r = 0; r < h; ++r) {
+			float *line = dest.data() + (h - 1 - r) * w * 4;
+			memcpy(line, source.data() + r * w * 4, w * 4 * sizeof(float));
+			ref_clamp(line, w, 1, 4, 1.0f, 1.0f);
+			ref_reset_alpha(line, w, 1, 4);
+		}
+	});
+	const double refRGB = time_ms([&]() {
+		ref_convert(dest.data(), 3, source.data(), w, h, fix);
+	});
+	const double refFix = time_ms([&]() {
+		ref_convert(dest.data(), 4, source.data(), w, h, fix);
+	});
+	printf("  reference:  region %7.2f ms, RGBA->RGB fixed %7.2f ms, RGBA fixed %7.2f ms\n", refRegion, refRGB, refFix);
+
+	for (const ImageKernels::InstructionSet requested : instruction_sets) {
+		const ImageKernels::InstructionSet used = ImageKernels::setInstructionSet(requested);
+		if (used != requested) {
+			continue;
+		}
+
+		const double region = time_ms([&]() {
+			ImageKernels::convert(dest.data(), w * 4, 4, source.data(), w * 4, 4, w, h, fix);
+		});
+		const double rgb = time_ms([&]() {
+			ImageKernels::convert(dest.data(), w * 3, 3, source.data(), w * 4, 4, w, h, fix);
+		});
+		printf("  %-10s: region %7.2f ms, RGBA->RGB fixed %7.2f ms\n", ImageKernels::getInstructionSetName(used), region, rgb);
+	}
+
+	ImageKernels::setInstructionSet(ImageKernels::AVX2);
+}
@@ -0,0 +1,198 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_jpeg_decoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "jpeglib.h"
+
+using namespace VRayForBlender;
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_RUNS 10
+
+struct EncodeOptions {
+	int components;     /* 3 for YCbCr, 1 for grayscale */
+	int hSampling;      /* luma sampling factors, 2x2 is 4:2:0 */
+	int vSampling;
+	int restartInRows;  /* restart marker every this many MCU rows */
+	int restartMCUs;    /* restart marker every this many MCUs, used if restartInRows is 0 */
+};
+
+/* Smooth gradients with some detail, so all blocks have AC coefficients. */
+static std::vector<unsigned char> make_pixels(int width, int height, int components)
+{
+	std::vector<unsigned char> pixels(width * height * components);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			unsigned char *pixel = &pixels[(y * width + x) * components];
+			for (int c = 0; c < components; ++c) {
+				pixel[c] = static_cast<unsigned char>((x * (c + 1) + y * (3 - c) + ((x * y) % 23) * 3) & 0xFF);
+			}
+		}
+	}
+	return pixels;
+}
+
+static std::vector<unsigned char> encode(int width, int height, const EncodeOptions &options)
+{
+	const std::vector<unsigned char> pixels = make_pixels(width, height, options.components);
+
+	jpeg_compress_struct cinfo;
+	jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+
+	unsigned char *buffer = nullptr;
+	unsigned long size = 0;
+	jpeg_mem_dest(&cinfo, &buffer, &size);
+
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = options.components;
+	cinfo.in_color_space = options.components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 90, TRUE);
+	cinfo.comp_info[0].h_samp_factor = options.hSampling;
+	cinfo.comp_info[0].v_samp_factor = options.vSampling;
+	cinfo.restart_in_rows = options.restartInRows;
+	cinfo.restart_interval = options.restartMCUs;
+
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = const_cast<unsigned char *>(&pixels[cinfo.next_scanline * width * options.components]);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	std::vector<unsigned char> result(buffer, buffer + size);
+	free(buffer);
+	return result;
+}
+
+/* Decode on @threadManager and compare with the serial decoding of the whole image. */
+static void expect_same_as_serial(const std::vector<unsigned char> &jpeg, ThreadManager::Ptr threadManager, bool splittable)
+{
+	JpegLayout layout;
+	ASSERT_TRUE(parseJpegLayout(jpeg.data(), jpeg.size(), layout));
+	EXPECT_EQ(layout.isSplittable(), splittable);
+
+	int channels = 0;
+	float *expected = jpegToPixelData(const_cast<unsigned char *>(jpeg.data()), jpeg.size(), channels);
+	ASSERT_NE(expected, nullptr);
+	ASSERT_EQ(channels, 4);
+
+	std::vector<float> actual(layout.width * layout.height * 4, -1.f);
+	EXPECT_TRUE(decodeJpeg(jpeg.data(), jpeg.size(), layout, actual.data(), threadManager));
+	EXPECT_EQ(memcmp(expected, actual.data(), actual.size() * sizeof(float)), 0)
+	    << layout.width << "x" << layout.height << " mcu " << layout.mcuWidth << "x" << layout.mcuHeight
+	    << " restart interval " << layout.restartInterval;
+
+	delete[] expected;
+}
+
+TEST(vfb_jpeg_decoder, ParseLayout)
+{
+	const std::vector<unsigned char> jpeg = encode(250, 183, {3, 2, 2, 1, 0});
+
+	JpegLayout layout;
+	ASSERT_TRUE(parseJpegLayout(jpeg.data(), jpeg.size(), layout));
+	EXPECT_EQ(layout.width, 250);
+	EXPECT_EQ(layout.height, 183);
+	EXPECT_EQ(layout.mcuWidth, 16);
+	EXPECT_EQ(layout.mcuHeight, 16);
+	EXPECT_EQ(layout.mcusPerRow(), 16);
+	EXPECT_EQ(layout.mcuRows(), 12);
+	EXPECT_EQ(layout.restartInterval, 16);
+	EXPECT_EQ(layout.restarts.size(), 11u);
+	EXPECT_TRUE(layout.baseline);
+	EXPECT_TRUE(layout.singleScan);
+	EXPECT_TRUE(layout.isSplittable());
+
+	const unsigned char notJpeg[] = {0x89, 'P', 'N', 'G', 0, 0, 0, 0};
+	EXPECT_FALSE(parseJpegLayout(notJpeg, sizeof(notJpeg), layout));
+	EXPECT_FALSE(parseJpegLayout(jpeg.data(), jpeg.size() / 2, layout));
+}
+
+TEST(vfb_jpeg_decoder, ParallelMatchesSerial)
+{
+	ThreadManager::Ptr threadManager = ThreadManager::make(4);
+
+	const int sizes[][2] = {{256, 256}, {250, 183}, {17, 300}, {640, 8}};
+	for (const auto &size : sizes) {
+		/* 4:2:0, 4:4:4 and grayscale, restart markers on MCU row boundaries */
+		expect_same_as_serial(encode(size[0], size[1], {3, 2, 2, 1, 0}), threadManager, true);
+		expect_same_as_serial(encode(size[0], size[1], {3, 2, 2, 3, 0}), threadManager, true);
+		expect_same_as_serial(encode(size[0], size[1], {3, 1, 1, 1, 0}), threadManager, true);
+		expect_same_as_serial(encode(size[0], size[1], {1, 1, 1, 2, 0}), threadManager, true);
+	}
+
+	/* Several restart intervals per MCU row. */
+	expect_same_as_serial(encode(256, 256, {3, 2, 2, 0, 4}), threadManager, true);
+
+	/* Intervals not aligned to rows and no restart markers at all are decoded serially. */
+	expect_same_as_serial(encode(256, 256, {3, 2, 2, 0, 5}), threadManager, false);
+	expect_same_as_serial(encode(256, 256, {3, 2, 2, 0, 0}), threadManager, false);
+
+	threadManager->stop();
+}
+
+TEST(vfb_jpeg_decoder, DamagedData)
+{
+	ThreadManager::Ptr threadManager = ThreadManager::make(4);
+	std::vector<unsigned char> jpeg = encode(256, 256, {3, 2, 2, 1, 0});
+
+	JpegLayout layout;
+	ASSERT_TRUE(parseJpegLayout(jpeg.data(), jpeg.size(), layout));
+
+	/* Corrupt the huffman tables, every strip fails. */
+	for (size_t c = 2; c + 1 < layout.scanOffset; ++c) {
+		if (jpeg[c] == 0xFF && jpeg[c + 1] == 0xC4) {
+			std::fill(jpeg.begin() + c + 5, jpeg.begin() + c + 21, 0xFF);
+		}
+	}
+	std::vector<float> pixels(layout.width * layout.height * 4);
+	EXPECT_FALSE(decodeJpeg(jpeg.data(), jpeg.size(), layout, pixels.data(), threadManager));
+
+	int channels = 0;
+	EXPECT_EQ(jpegToPixelData(jpeg.data(), jpeg.size(), channels), nullptr);
+
+	threadManager->stop();
+}
+
+TEST(vfb_jpeg_decoder, Performance)
+{
+	const int threads = std::max(2u, std::thread::hardware_concurrency());
+	ThreadManager::Ptr threadManager = ThreadManager::make(threads);
+
+	const std::vector<unsigned char> jpeg = encode(BENCH_WIDTH, BENCH_HEIGHT, {3, 2, 2, 1, 0});
+	JpegLayout layout;
+	ASSERT_TRUE(parseJpegLayout(jpeg.data(), jpeg.size(), layout));
+	std::vector<float> pixels(layout.width * layout.height * 4);
+
+	auto timeMs = [&](ThreadManager::Ptr tm) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int c = 0; c < BENCH_RUNS; ++c) {
+			decodeJpeg(jpeg.data(), jpeg.size(), layout, pixels.data(), tm);
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count() / BENCH_RUNS;
+	};
+
+	const double serial = timeMs(nullptr);
+	const double parallel = timeMs(threadManager);
+	printf("%dx%d 4:2:0 JPEG (%.1f KB), average of %d runs: serial %.2f ms, %d threads %.2f ms\n",
+	       BENCH_WIDTH, BENCH_HEIGHT, jpeg.size() / 1024.0, BENCH_RUNS, serial, threads, parallel);
+
+	threadManager->stop();
+}
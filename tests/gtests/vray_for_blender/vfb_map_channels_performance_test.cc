@@ -0,0 +1,263 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_utils_map_channels.h"
+
+#include "DNA_meshdata_types.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+/* Grid of quads with shared UVs on the grid points, so merging removes most of the corners. */
+#define GRID_SIZE 512
+#define UV_LAYERS 4
+#define COLOR_LAYERS 2
+
+struct TestMesh {
+	std::vector<MFace> faces;
+	std::vector<std::vector<MTFace>> uvs;
+	std::vector<std::vector<MCol>> colors;
+	std::vector<Mesh::MapChannelLayer> layers;
+};
+
+static void make_grid(TestMesh &mesh, int size)
+{
+	mesh.faces.resize(size * size);
+	memset(mesh.faces.data(), 0, mesh.faces.size() * sizeof(MFace));
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			MFace &face = mesh.faces[y * size + x];
+			face.v1 = y * (size + 1) + x;
+			face.v2 = face.v1 + 1;
+			face.v3 = face.v2 + size + 1;
+			/* every 8th face is a triangle */
+			face.v4 = (x % 8 == 7) ? 0 : face.v3 - 1;
+		}
+	}
+
+	const int corner[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+	mesh.uvs.resize(UV_LAYERS);
+	for (int l = 0; l < UV_LAYERS; ++l) {
+		mesh.uvs[l].resize(mesh.faces.size());
+		for (int f = 0; f < mesh.faces.size(); ++f) {
+			const int x = f % size, y = f / size;
+			for (int c = 0; c < 4; ++c) {
+				mesh.uvs[l][f].uv[c][0] = float(x + corner[c][0]) / size * (l + 1);
+				mesh.uvs[l][f].uv[c][1] = float(y + corner[c][1]) / size;
+			}
+		}
+		mesh.layers.emplace_back("UVMap" + std::to_string(l), mesh.uvs[l].data(), nullptr);
+	}
+
+	mesh.colors.resize(COLOR_LAYERS);
+	for (int l = 0; l < COLOR_LAYERS; ++l) {
+		mesh.colors[l].resize(mesh.faces.size() * 4);
+		for (int f = 0; f < mesh.faces.size(); ++f) {
+			for (int c = 0; c < 4; ++c) {
+				MCol &col = mesh.colors[l][f * 4 + c];
+				col.a = 255;
+				col.r = (f + c) % 7 * 30;
+				col.g = l * 50;
+				col.b = (f / size) % 5 * 40;
+			}
+		}
+		mesh.layers.emplace_back("Col" + std::to_string(l), nullptr, mesh.colors[l].data());
+	}
+}
+
+/* Reference: the builder FillMeshData used before, a HashSet of vertices per channel
+ * looked up by layer name for every face. */
+struct RefVertex {
+	AttrVector v;
+	mutable int index;
+
+	bool operator==(const RefVertex &other) const {
+		return v.x == other.v.x && v.y == other.v.y && v.z == other.v.z;
+	}
+};
+
+struct RefVertexHash {
+	size_t operator()(const RefVertex &rv) const {
+		return std::hash<float>()(rv.v.x) ^ (std::hash<float>()(rv.v.y) << 1) ^ (std::hash<float>()(rv.v.z) << 2);
+	}
+};
+
+static RefVertex ref_value(const Mesh::MapChannelLayer &layer, int face, int corner)
+{
+	RefVertex rv;
+	rv.index = 0;
+	if (layer.uv) {
+		rv.v.x = layer.uv[face].uv[corner][0];
+		rv.v.y = layer.uv[face].uv[corner][1];
+		rv.v.z = 0.f;
+	}
+	else {
+		const MCol &col = layer.color[face * 4 + corner];
+		rv.v.x = col.b / 255.f;
+		rv.v.y = col.g / 255.f;
+		rv.v.z = col.r / 255.f;
+	}
+	return rv;
+}
+
+static void ref_fill_merged(const TestMesh &mesh, AttrMapChannels &channels)
+{
+	typedef std::unordered_set<RefVertex, RefVertexHash> RefSet;
+	std::unordered_map<std::string, RefSet> sets;
+
+	const int numFaces = mesh.faces.size();
+	for (int f = 0; f < numFaces; ++f) {
+		for (const auto &layer : mesh.layers) {
+			RefSet &set = sets[layer.name];
+			for (int c = 0; c < (mesh.faces[f].v4 ? 4 : 3); ++c) {
+				set.insert(ref_value(layer, f, c));
+			}
+		}
+	}
+
+	int numCorners = 0;
+	for (int f = 0; f < numFaces; ++f) {
+		numCorners += mesh.faces[f].v4 ? 6 : 3;
+	}
+
+	for (auto &item : sets) {
+		AttrMapChannels::AttrMapChannel &channel = channels.data[item.first];
+		channel.name = item.first;
+		channel.vertices.resize(item.second.size());
+		channel.faces.resize(numCorners);
+		int i = 0;
+		for (const RefVertex &rv : item.second) {
+			rv.index = i;
+			(*channel.vertices)[i++] = rv.v;
+		}
+	}
+
+	int corner = 0;
+	for (int f = 0; f < numFaces; ++f) {
+		for (const auto &layer : mesh.layers) {
+			RefSet &set = sets[layer.name];
+			int *faces = *channels.data[layer.name].faces;
+			const int v0 = set.find(ref_value(layer, f, 0))->index;
+			const int v1 = set.find(ref_value(layer, f, 1))->index;
+			const int v2 = set.find(ref_value(layer, f, 2))->index;
+			faces[corner + 0] = v0;
+			faces[corner + 1] = v1;
+			faces[corner + 2] = v2;
+			if (mesh.faces[f].v4) {
+				faces[corner + 3] = v0;
+				faces[corner + 4] = v2;
+				faces[corner + 5] = set.find(ref_value(layer, f, 3))->index;
+			}
+		}
+		corner += mesh.faces[f].v4 ? 6 : 3;
+	}
+}
+
+/* Both builders must give the same value for each face corner, vertex order may differ. */
+static void expect_same_corners(const AttrMapChannels &expected, const AttrMapChannels &actual)
+{
+	ASSERT_EQ(expected.data.size(), actual.data.size());
+	for (const auto &item : expected.data) {
+		auto iter = actual.data.find(item.first);
+		ASSERT_TRUE(iter != actual.data.end());
+		const auto &exp = item.second;
+		const auto &act = iter->second;
+		ASSERT_EQ(exp.faces.getData()->size(), act.faces.getData()->size());
+		EXPECT_EQ(exp.vertices.getData()->size(), act.vertices.getData()->size());
+		for (int c = 0; c < exp.faces.getData()->size(); ++c) {
+			const AttrVector &ev = (*exp.vertices.getData())[(*exp.faces.getData())[c]];
+			const AttrVector &av = (*act.vertices.getData())[(*act.faces.getData())[c]];
+			ASSERT_TRUE(ev.x == av.x && ev.y == av.y && ev.z == av.z);
+		}
+	}
+}
+
+template <typename T>
+static double time_ms(T func)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	func();
+	const auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+TEST(vfb_map_channels, MergedPerformance)
+{
+	TestMesh mesh;
+	make_grid(mesh, GRID_SIZE);
+
+	AttrMapChannels reference;
+	const double refTime = time_ms([&]() {
+		ref_fill_merged(mesh, reference);
+	});
+
+	AttrMapChannels serial;
+	AttrListString serialNames;
+	const double serialTime = time_ms([&]() {
+		Mesh::FillMapChannels(mesh.faces.data(), mesh.faces.size(), mesh.layers, true, 1, serialNames, serial);
+	});
+
+	AttrMapChannels parallel;
+	AttrListString parallelNames;
+	const int threads = std::max(1u, std::thread::hardware_concurrency());
+	const double parallelTime = time_ms([&]() {
+		Mesh::FillMapChannels(mesh.faces.data(), mesh.faces.size(), mesh.layers, true, threads, parallelNames, parallel);
+	});
+
+	printf("%d faces, %d layers, merged vertices\n", (int)mesh.faces.size(), (int)mesh.layers.size());
+	printf("  HashSet<ChanVertex> per layer name: %8.2f ms\n", refTime);
+	printf("  flat arrays, 1 thread:              %8.2f ms\n", serialTime);
+	printf("  flat arrays, %2d threads:            %8.2f ms\n", threads, parallelTime);
+
+	expect_same_corners(reference, serial);
+	expect_same_corners(reference, parallel);
+	EXPECT_EQ(serialNames.getData()->size(), mesh.layers.size());
+}
+
+TEST(vfb_map_channels, RawPerformance)
+{
+	TestMesh mesh;
+	make_grid(mesh, GRID_SIZE);
+
+	AttrMapChannels channels;
+	AttrListString names;
+	const double time = time_ms([&]() {
+		Mesh::FillMapChannels(mesh.faces.data(), mesh.faces.size(), mesh.layers, false,
+		                      std::thread::hardware_concurrency(), names, channels);
+	});
+	printf("%d faces, %d layers, raw vertices: %8.2f ms\n", (int)mesh.faces.size(), (int)mesh.layers.size(), time);
+
+	for (const auto &item : channels.data) {
+		EXPECT_EQ(item.second.vertices.getData()->size(), item.second.faces.getData()->size());
+	}
+}
+
+TEST(vfb_map_channels, MergeVertices)
+{
+	std::vector<AttrVector> vertices(6);
+	const float values[6][3] = {{0, 0, 0}, {1, 0, 0}, {-0.0f, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 0}};
+	for (int c = 0; c < 6; ++c) {
+		vertices[c].x = values[c][0];
+		vertices[c].y = values[c][1];
+		vertices[c].z = values[c][2];
+	}
+	std::vector<int> indices(6);
+	EXPECT_EQ(Mesh::MergeChannelVertices(vertices.data(), vertices.size(), indices.data()), 3);
+
+	const int expected[6] = {0, 1, 0, 1, 2, 0};
+	for (int c = 0; c < 6; ++c) {
+		EXPECT_EQ(indices[c], expected[c]);
+	}
+	EXPECT_EQ(vertices[2].y, 1.f);
+}
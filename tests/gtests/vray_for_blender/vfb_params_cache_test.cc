@@ -0,0 +1,175 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_params_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayForBlender::ParamDesc;
+
+#define BENCH_PLUGINS 400
+#define BENCH_ATTRIBUTES 60
+
+static std::string temp_file_name(const char *name)
+{
+	return std::string(P_tmpdir) + "/" + name;
+}
+
+static PluginDescList make_descriptions(int pluginCount, int attrCount)
+{
+	PluginDescList descriptions(pluginCount);
+	for (int p = 0; p < pluginCount; ++p) {
+		PluginDesc &desc = descriptions[p];
+		desc.pluginID = "Plugin" + std::to_string(p);
+		desc.pluginType = static_cast<PluginType>(p % (PluginUvwgen + 1));
+
+		for (int a = 0; a < attrCount; ++a) {
+			AttrDesc attr;
+			attr.name = "attribute_" + std::to_string(a);
+			attr.type = static_cast<AttrType>(a % AttrTypeListEnd);
+			attr.options = a % 3 ? AttrOptionNone : AttrOptionExportAsColor;
+			if (a == 1) {
+				attr.descRamp.colors = "ramp_colors";
+				attr.descRamp.positions = "ramp_positions";
+				attr.descRamp.interpolations = "ramp_interpolations";
+			}
+			if (a == 2) {
+				attr.descCurve.positions = "curve_positions";
+				attr.descCurve.values = "curve_values";
+				attr.descCurve.interpolations = "curve_interpolations";
+			}
+			desc.attributes[attr.name] = attr;
+		}
+	}
+	return descriptions;
+}
+
+static void expect_same(const PluginDescList &expected, const PluginDescList &actual)
+{
+	ASSERT_EQ(expected.size(), actual.size());
+	for (size_t p = 0; p < expected.size(); ++p) {
+		EXPECT_EQ(expected[p].pluginID, actual[p].pluginID);
+		EXPECT_EQ(expected[p].pluginType, actual[p].pluginType);
+		ASSERT_EQ(expected[p].attributes.size(), actual[p].attributes.size());
+
+		auto actualIt = actual[p].attributes.begin();
+		for (const auto &expectedIt : expected[p].attributes) {
+			const AttrDesc &a = expectedIt.second;
+			const AttrDesc &b = actualIt->second;
+			EXPECT_EQ(expectedIt.first, actualIt->first);
+			EXPECT_EQ(a.name, b.name);
+			EXPECT_EQ(a.type, b.type);
+			EXPECT_EQ(a.options.optionData, b.options.optionData);
+			EXPECT_EQ(a.descRamp.colors, b.descRamp.colors);
+			EXPECT_EQ(a.descRamp.positions, b.descRamp.positions);
+			EXPECT_EQ(a.descRamp.interpolations, b.descRamp.interpolations);
+			EXPECT_EQ(a.descCurve.positions, b.descCurve.positions);
+			EXPECT_EQ(a.descCurve.values, b.descCurve.values);
+			EXPECT_EQ(a.descCurve.interpolations, b.descCurve.interpolations);
+			++actualIt;
+		}
+	}
+}
+
+TEST(vfb_params_cache, Stamp)
+{
+	const std::vector<DescriptionFile> files = {{"b/BRDFVRayMtl.json", 100, 5}, {"a/Node.json", 20, 7}};
+	const std::vector<DescriptionFile> reordered = {files[1], files[0]};
+	EXPECT_TRUE(GetDescriptionsStamp(files) == GetDescriptionsStamp(reordered));
+
+	std::vector<DescriptionFile> touched = files;
+	touched[1].mtime++;
+	EXPECT_FALSE(GetDescriptionsStamp(files) == GetDescriptionsStamp(touched));
+
+	std::vector<DescriptionFile> added = files;
+	added.push_back({"c/TexBitmap.json", 1, 1});
+	EXPECT_FALSE(GetDescriptionsStamp(files) == GetDescriptionsStamp(added));
+}
+
+TEST(vfb_params_cache, RoundTrip)
+{
+	const std::string fileName = temp_file_name("vfb_params_cache_test.bin");
+	const PluginDescList descriptions = make_descriptions(25, 12);
+	const DescriptionsStamp stamp = GetDescriptionsStamp({{"Plugin0.json", 10, 20}});
+
+	ASSERT_TRUE(SavePluginDescriptionsCache(fileName, stamp, descriptions));
+
+	PluginDescList loaded;
+	ASSERT_TRUE(LoadPluginDescriptionsCache(fileName, stamp, loaded));
+	expect_same(descriptions, loaded);
+
+	/* Cache of other files is not used and does not change the output. */
+	const DescriptionsStamp otherStamp = GetDescriptionsStamp({{"Plugin0.json", 10, 21}});
+	PluginDescList untouched = make_descriptions(1, 1);
+	EXPECT_FALSE(LoadPluginDescriptionsCache(fileName, otherStamp, untouched));
+	EXPECT_EQ(untouched.size(), 1u);
+
+	/* Empty list is valid too. */
+	ASSERT_TRUE(SavePluginDescriptionsCache(fileName, stamp, PluginDescList()));
+	EXPECT_TRUE(LoadPluginDescriptionsCache(fileName, stamp, loaded));
+	EXPECT_TRUE(loaded.empty());
+
+	remove(fileName.c_str());
+	EXPECT_FALSE(LoadPluginDescriptionsCache(fileName, stamp, loaded));
+}
+
+TEST(vfb_params_cache, DamagedFile)
+{
+	const std::string fileName = temp_file_name("vfb_params_cache_damaged.bin");
+	const PluginDescList descriptions = make_descriptions(10, 8);
+	const DescriptionsStamp stamp = GetDescriptionsStamp({});
+	ASSERT_TRUE(SavePluginDescriptionsCache(fileName, stamp, descriptions));
+
+	std::vector<char> data;
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	/* Truncated file. */
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), data.size() / 2);
+	}
+	PluginDescList loaded;
+	EXPECT_FALSE(LoadPluginDescriptionsCache(fileName, stamp, loaded));
+
+	/* Huge string length in the middle of the payload. */
+	std::vector<char> damaged = data;
+	for (size_t c = 4096 + 40; c < 4096 + 44; ++c) {
+		damaged[c] = '\xff';
+	}
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		file.write(damaged.data(), damaged.size());
+	}
+	EXPECT_FALSE(LoadPluginDescriptionsCache(fileName, stamp, loaded));
+	EXPECT_TRUE(loaded.empty());
+
+	remove(fileName.c_str());
+}
+
+TEST(vfb_params_cache, Performance)
+{
+	const std::string fileName = temp_file_name("vfb_params_cache_bench.bin");
+	const PluginDescList descriptions = make_descriptions(BENCH_PLUGINS, BENCH_ATTRIBUTES);
+	const DescriptionsStamp stamp = GetDescriptionsStamp({});
+
+	auto start = std::chrono::high_resolution_clock::now();
+	ASSERT_TRUE(SavePluginDescriptionsCache(fileName, stamp, descriptions));
+	const double saveMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	PluginDescList loaded;
+	ASSERT_TRUE(LoadPluginDescriptionsCache(fileName, stamp, loaded));
+	const double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	printf("%d plugins with %d attributes: save %.2f ms, load %.2f ms\n", BENCH_PLUGINS, BENCH_ATTRIBUTES, saveMs, loadMs);
+	remove(fileName.c_str());
+}
@@ -0,0 +1,239 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_plugin_batch.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+#define BENCH_PLUGINS 5000
+#define BENCH_ATTRIBUTES 20
+#define BENCH_UPDATES 3
+
+typedef PluginBatch::OpType OpType;
+
+static void expect_op(const PluginBatch::Op &op, OpType type, const std::string &plugin, const std::string &name)
+{
+	EXPECT_EQ(static_cast<int>(op.type), static_cast<int>(type));
+	EXPECT_EQ(op.plugin, plugin);
+	EXPECT_EQ(op.name, name);
+	EXPECT_FALSE(op.dropped);
+}
+
+TEST(vfb_plugin_batch, Collapse)
+{
+	PluginBatch batch;
+	batch.create("A", "TexBitmap");
+	batch.set("A", "x", AttrValue(1));
+	batch.set("A", "y", AttrValue(2));
+	batch.set("A", "x", AttrValue(3));
+	batch.create("A", "TexBitmap");
+	batch.create("B", "Node");
+	batch.set("B", "z", AttrValue(4));
+	batch.remove("B");
+	batch.create("B", "Node");
+	batch.set("B", "z", AttrValue(5));
+	batch.replace("A", "C");
+	EXPECT_EQ(batch.getCollapsedCount(), 3u);
+
+	std::vector<PluginBatch::Op> ops;
+	batch.take(ops);
+	EXPECT_TRUE(batch.empty());
+	ASSERT_EQ(ops.size(), 8u);
+
+	/* Only the last value of "x" is sent, where the last one was. */
+	expect_op(ops[0], OpType::Create, "A", "TexBitmap");
+	expect_op(ops[1], OpType::Set, "A", "y");
+	EXPECT_EQ(ops[1].value.as<int>(), 2);
+	expect_op(ops[2], OpType::Set, "A", "x");
+	EXPECT_EQ(ops[2].value.as<int>(), 3);
+
+	/* Value set before the remove is dropped, the plugin created after it is kept. */
+	expect_op(ops[3], OpType::Create, "B", "Node");
+	expect_op(ops[4], OpType::Remove, "B", "");
+	expect_op(ops[5], OpType::Create, "B", "Node");
+	expect_op(ops[6], OpType::Set, "B", "z");
+	EXPECT_EQ(ops[6].value.as<int>(), 5);
+	expect_op(ops[7], OpType::Replace, "A", "C");
+
+	/* Nothing is collapsed with changes of a batch that was already taken. */
+	batch.set("A", "x", AttrValue(6));
+	batch.take(ops);
+	ASSERT_EQ(ops.size(), 1u);
+	EXPECT_EQ(ops[0].value.as<int>(), 6);
+}
+
+TEST(vfb_plugin_batch, SetAfterCreateOfReferencedPlugin)
+{
+	/* The second value references a plugin created after the first value was set,
+	 * it must not be sent before that plugin is created. */
+	PluginBatch batch;
+	batch.create("M", "BRDFVRayMtl");
+	batch.set("M", "brdf", AttrValue(AttrPlugin("T1")));
+	batch.create("T2", "TexBitmap");
+	batch.set("M", "brdf", AttrValue(AttrPlugin("T2")));
+	EXPECT_EQ(batch.getCollapsedCount(), 1u);
+
+	std::vector<PluginBatch::Op> ops;
+	batch.take(ops);
+	ASSERT_EQ(ops.size(), 3u);
+	expect_op(ops[0], OpType::Create, "M", "BRDFVRayMtl");
+	expect_op(ops[1], OpType::Create, "T2", "TexBitmap");
+	expect_op(ops[2], OpType::Set, "M", "brdf");
+	EXPECT_EQ(ops[2].value.as<AttrPlugin>().plugin, "T2");
+}
+
+/* Stand-in for the server: receives messages from a locked queue on its own thread, like the socket would,
+ * and writes each one in a frame buffer as it's serialization. */
+class LoopbackServer {
+public:
+	LoopbackServer()
+	    : m_received(0)
+	    , m_stop(false)
+	    , m_thread([this] { run(); })
+	{}
+
+	~LoopbackServer() {
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+		m_thread.join();
+	}
+
+	void send(const PluginBatch::Op &op) {
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_queue.push_back(op);
+		m_cond.notify_all();
+	}
+
+	void send(std::vector<PluginBatch::Op> &ops) {
+		std::lock_guard<std::mutex> lock(m_mtx);
+		for (PluginBatch::Op &op : ops) {
+			m_queue.push_back(std::move(op));
+		}
+		m_cond.notify_all();
+	}
+
+	void waitFor(size_t count) {
+		std::unique_lock<std::mutex> lock(m_mtx);
+		m_cond.wait(lock, [this, count] { return m_received >= count; });
+	}
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(m_mtx);
+		while (true) {
+			m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_stop) {
+				return;
+			}
+			std::deque<PluginBatch::Op> received;
+			received.swap(m_queue);
+			const size_t count = received.size();
+			lock.unlock();
+			for (const PluginBatch::Op &op : received) {
+				m_frame.clear();
+				m_frame.insert(m_frame.end(), op.plugin.begin(), op.plugin.end());
+				m_frame.insert(m_frame.end(), op.name.begin(), op.name.end());
+				const int value = op.value.as<int>();
+				m_frame.insert(m_frame.end(), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value + 1));
+			}
+			received.clear();
+			lock.lock();
+			m_received += count;
+			m_cond.notify_all();
+		}
+	}
+
+	std::mutex                  m_mtx;
+	std::condition_variable     m_cond;
+	std::deque<PluginBatch::Op> m_queue;
+	std::vector<char>           m_frame;
+	size_t                      m_received;
+	bool                        m_stop;
+	std::thread                 m_thread;
+};
+
+static std::string plugin_name(int p)
+{
+	return "Plugin" + std::to_string(p);
+}
+
+TEST(vfb_plugin_batch, Performance)
+{
+	std::vector<std::string> attributes;
+	for (int a = 0; a < BENCH_ATTRIBUTES; ++a) {
+		attributes.push_back("attribute_" + std::to_string(a));
+	}
+
+	/* Every plugin is exported BENCH_UPDATES times in one sync, as when many objects share it. */
+	double directMs = 0.0;
+	size_t directMessages = 0;
+	{
+		LoopbackServer server;
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int u = 0; u < BENCH_UPDATES; ++u) {
+			for (int p = 0; p < BENCH_PLUGINS; ++p) {
+				server.send({OpType::Create, plugin_name(p), "Node", AttrValue(), false});
+				for (const std::string &attr : attributes) {
+					server.send({OpType::Set, plugin_name(p), attr, AttrValue(u), false});
+				}
+			}
+		}
+		directMessages = BENCH_UPDATES * BENCH_PLUGINS * (BENCH_ATTRIBUTES + 1);
+		server.waitFor(directMessages);
+		directMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	double batchMs = 0.0;
+	size_t batchMessages = 0;
+	{
+		LoopbackServer server;
+		PluginBatch batch;
+		std::mutex batchMtx;
+		std::vector<PluginBatch::Op> ops;
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int u = 0; u < BENCH_UPDATES; ++u) {
+			for (int p = 0; p < BENCH_PLUGINS; ++p) {
+				std::lock_guard<std::mutex> lock(batchMtx);
+				batch.create(plugin_name(p), "Node");
+				for (const std::string &attr : attributes) {
+					batch.set(plugin_name(p), attr, AttrValue(u));
+				}
+			}
+		}
+		batch.take(ops);
+		batchMessages = ops.size();
+		/* Plugins are created once and only the values of the last update are sent, after all creates. */
+		ASSERT_EQ(batchMessages, static_cast<size_t>(BENCH_PLUGINS * (BENCH_ATTRIBUTES + 1)));
+		for (size_t c = 0; c < ops.size(); ++c) {
+			if (c < BENCH_PLUGINS) {
+				ASSERT_EQ(static_cast<int>(ops[c].type), static_cast<int>(OpType::Create));
+			} else {
+				ASSERT_EQ(ops[c].value.as<int>(), BENCH_UPDATES - 1);
+			}
+		}
+		server.send(ops);
+		server.waitFor(batchMessages);
+		batchMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	/* Latency is from the first change until the server has received all of them. */
+	const size_t changes = BENCH_UPDATES * BENCH_PLUGINS * (BENCH_ATTRIBUTES + 1);
+	printf("%zu plugin changes: direct %zu messages in %.2f ms (%.0f changes/s), batched %zu messages in %.2f ms (%.0f changes/s)\n",
+	       changes,
+	       directMessages, directMs, changes / directMs * 1000.0,
+	       batchMessages, batchMs, changes / batchMs * 1000.0);
+}
@@ -0,0 +1,199 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_render_image_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace VRayForBlender;
+
+#define IMAGE_SIZE 256
+#define BUCKET_SIZE 32
+#define CHANNELS 4
+
+static const ImageSize image_size = {IMAGE_SIZE, IMAGE_SIZE, CHANNELS};
+static const uint64_t bucket_bytes = BUCKET_SIZE * BUCKET_SIZE * CHANNELS * sizeof(float);
+
+/* Bucket filled with a value in [0, 1), unique for the bucket position and frame. */
+static std::vector<float> make_bucket(int bx, int by, int frame)
+{
+	const float value = ((frame * 64 + by * 8 + bx) % 1000) / 1000.0f;
+	return std::vector<float>(BUCKET_SIZE * BUCKET_SIZE * CHANNELS, value);
+}
+
+/* Apply the bucket to a reference image the same way RenderImage::updateRegion would. */
+static void apply_bucket(std::vector<float> &reference, const std::vector<float> &bucket, int bx, int by)
+{
+	const ImageRegion region(bx * BUCKET_SIZE, by * BUCKET_SIZE, BUCKET_SIZE, BUCKET_SIZE);
+	const ImageSize bucketSize = {BUCKET_SIZE, BUCKET_SIZE, CHANNELS};
+	updateImageRegion(reference.data(), image_size, region, bucket.data(), bucketSize, bucketSize, ImageRegion::Options::NONE);
+}
+
+static void write_bucket(RenderImageRing &ring, std::vector<float> &reference, int bx, int by, int frame)
+{
+	const std::vector<float> bucket = make_bucket(bx, by, frame);
+	ring.updateRegion(bucket.data(), ImageRegion(bx * BUCKET_SIZE, by * BUCKET_SIZE, BUCKET_SIZE, BUCKET_SIZE), ImageRegion::Options::NONE);
+	apply_bucket(reference, bucket, bx, by);
+}
+
+static bool equals_reference(const RenderImage &image, const std::vector<float> &reference)
+{
+	if (image.w != IMAGE_SIZE || image.h != IMAGE_SIZE || image.channels != CHANNELS) {
+		return false;
+	}
+	return memcmp(image.pixels, reference.data(), reference.size() * sizeof(float)) == 0;
+}
+
+TEST(vfb_render_image_ring, ConsumerCopiesOnlyDirtyRegions)
+{
+	RenderImageRing ring;
+	std::vector<float> reference(IMAGE_SIZE * IMAGE_SIZE * CHANNELS, 0.f);
+	RenderImage image;
+	std::vector<ImageRegion> dirty;
+
+	ring.resize(image_size);
+	ring.publish();
+	EXPECT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	ASSERT_EQ(dirty.size(), 1);
+	EXPECT_TRUE(equals_reference(image, reference));
+
+	const int buckets = IMAGE_SIZE / BUCKET_SIZE;
+	for (int frame = 1; frame <= 16; ++frame) {
+		const RenderImageRing::Stats before = ring.getStats();
+		for (int c = 0; c < 4; ++c) {
+			write_bucket(ring, reference, (frame + c) % buckets, (frame * 3 + c) % buckets, frame);
+		}
+		ring.publish();
+
+		ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+		EXPECT_EQ(dirty.size(), 4);
+		EXPECT_EQ(ring.getStats().consumerBytes - before.consumerBytes, 4 * bucket_bytes);
+		EXPECT_TRUE(equals_reference(image, reference));
+	}
+
+	/* Nothing new was published. */
+	EXPECT_FALSE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	EXPECT_TRUE(dirty.empty());
+}
+
+TEST(vfb_render_image_ring, SkippedFramesAreMerged)
+{
+	RenderImageRing ring;
+	std::vector<float> reference(IMAGE_SIZE * IMAGE_SIZE * CHANNELS, 0.f);
+	RenderImage image;
+	std::vector<ImageRegion> dirty;
+
+	ring.resize(image_size);
+	ring.publish();
+	ring.consume(image, dirty, ImageRegion::Options::NONE);
+
+	for (int frame = 1; frame <= 5; ++frame) {
+		write_bucket(ring, reference, frame, frame, frame);
+		ring.publish();
+	}
+
+	ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	EXPECT_EQ(dirty.size(), 5);
+	EXPECT_TRUE(equals_reference(image, reference));
+
+	/* Full image update and resize make the whole image dirty. */
+	std::vector<float> full(reference.size(), 0.5f);
+	ring.updateImage(full.data(), image_size);
+	ring.publish();
+	ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	ASSERT_EQ(dirty.size(), 1);
+	EXPECT_EQ(dirty[0].w, IMAGE_SIZE);
+	EXPECT_TRUE(equals_reference(image, full));
+
+	ring.resize({IMAGE_SIZE / 2, IMAGE_SIZE / 2, CHANNELS});
+	ring.publish();
+	ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	EXPECT_EQ(image.w, IMAGE_SIZE / 2);
+	EXPECT_EQ(dirty[0].w, IMAGE_SIZE / 2);
+}
+
+TEST(vfb_render_image_ring, DiscardedUpdatesAreNotPublished)
+{
+	RenderImageRing ring;
+	std::vector<float> reference(IMAGE_SIZE * IMAGE_SIZE * CHANNELS, 0.f);
+	RenderImage image;
+	std::vector<ImageRegion> dirty;
+
+	ring.resize(image_size);
+	write_bucket(ring, reference, 1, 1, 1);
+	ring.publish();
+	ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	EXPECT_TRUE(equals_reference(image, reference));
+
+	/* Dropped bucket and full image, then a good bucket in the same back buffer. */
+	std::vector<float> dropped = reference;
+	write_bucket(ring, dropped, 2, 2, 2);
+	ring.discard();
+	EXPECT_FALSE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+
+	std::vector<float> full(reference.size(), 0.5f);
+	ring.updateImage(full.data(), {IMAGE_SIZE / 2, IMAGE_SIZE / 2, CHANNELS});
+	ring.discard();
+	EXPECT_EQ(ring.getSize().w, IMAGE_SIZE);
+
+	write_bucket(ring, reference, 3, 3, 3);
+	ring.publish();
+	ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+	EXPECT_TRUE(equals_reference(image, reference));
+
+	/* Every buffer of the ring is written again. */
+	for (int frame = 4; frame < 4 + RenderImageRing::BufferCount; ++frame) {
+		write_bucket(ring, dropped, frame, frame, frame);
+		ring.discard();
+		write_bucket(ring, reference, frame, 0, frame);
+		ring.publish();
+		ASSERT_TRUE(ring.consume(image, dirty, ImageRegion::Options::NONE));
+		EXPECT_TRUE(equals_reference(image, reference));
+	}
+}
+
+TEST(vfb_render_image_ring, ConcurrentProducerAndConsumer)
+{
+	RenderImageRing ring;
+	std::vector<float> reference(IMAGE_SIZE * IMAGE_SIZE * CHANNELS, 0.f);
+	const int buckets = IMAGE_SIZE / BUCKET_SIZE;
+	const int frames = 2000;
+
+	ring.resize(image_size);
+	ring.publish();
+
+	std::thread producer([&]() {
+		for (int frame = 1; frame <= frames; ++frame) {
+			write_bucket(ring, reference, frame % buckets, (frame / buckets) % buckets, frame);
+			ring.publish();
+			/* buckets arrive over the network, not in a tight loop */
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	});
+
+	RenderImage image;
+	std::vector<ImageRegion> dirty;
+	int consumed = 0;
+	while (ring.getStats().publishedFrames < frames + 1) {
+		consumed += ring.consume(image, dirty, ImageRegion::Options::NONE);
+	}
+	producer.join();
+	ring.consume(image, dirty, ImageRegion::Options::NONE);
+
+	EXPECT_TRUE(equals_reference(image, reference));
+
+	const RenderImageRing::Stats stats = ring.getStats();
+	const uint64_t fullImageBytes = reference.size() * sizeof(float);
+	printf("consumed %d of %d frames, %.1f KB copied per consumed frame, full image is %.1f KB\n",
+	       consumed, frames, stats.consumerBytes / 1024.0 / std::max<uint64_t>(stats.consumedFrames, 1), fullImageBytes / 1024.0);
+
+	/* A full copy per frame would be frames * fullImageBytes. */
+	EXPECT_LT(stats.consumerBytes, fullImageBytes * 2 + static_cast<uint64_t>(frames) * bucket_bytes * 4);
+	EXPECT_LT(stats.producerBytes, fullImageBytes * 3 + static_cast<uint64_t>(frames) * bucket_bytes * 4);
+}
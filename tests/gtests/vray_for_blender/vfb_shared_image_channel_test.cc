@@ -0,0 +1,253 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_shared_image_channel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+using namespace VRayForBlender;
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 200
+
+static std::string channel_name(const char *name)
+{
+	return SharedImageChannel::GetChannelName(0) + "_" + name + "_" + std::to_string(getpid());
+}
+
+/* Pixels of image @index, every byte depends on the index so a torn image is noticed. */
+static void fill_image(std::vector<uint8_t> &pixels, uint64_t index)
+{
+	for (size_t c = 0; c < pixels.size(); ++c) {
+		pixels[c] = static_cast<uint8_t>(index * 31 + c);
+	}
+}
+
+static bool check_image(const uint8_t *pixels, size_t size, uint64_t index)
+{
+	for (size_t c = 0; c < size; ++c) {
+		if (pixels[c] != static_cast<uint8_t>(index * 31 + c)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void ignore_image(const SharedImageChannel::ImageInfo &, const void *)
+{
+}
+
+static SharedImageChannel::ImageInfo image_info(uint64_t index, uint64_t size)
+{
+	SharedImageChannel::ImageInfo info;
+	memset(&info, 0, sizeof(info));
+	info.channel = static_cast<int32_t>(index % 3);
+	info.x = static_cast<int32_t>(index);
+	info.width = 16;
+	info.height = 8;
+	info.flags = index % 2 ? SharedImageChannel::ImageLast : SharedImageChannel::ImageBucket;
+	info.size = size;
+	return info;
+}
+
+TEST(vfb_shared_image_channel, ReadInOrder)
+{
+	const std::string name = channel_name("order");
+	SharedImageChannel producer;
+	ASSERT_TRUE(producer.create(name, 4, 1000));
+
+	SharedImageChannel consumer;
+	ASSERT_TRUE(consumer.open(name));
+	EXPECT_EQ(consumer.read(ignore_image), 0);
+
+	std::vector<uint8_t> pixels(600);
+	for (uint64_t c = 0; c < 3; ++c) {
+		fill_image(pixels, c);
+		ASSERT_TRUE(producer.write(image_info(c, pixels.size() - c), pixels.data()));
+	}
+
+	/* Does not fit in a slot. */
+	std::vector<uint8_t> big(1001);
+	EXPECT_FALSE(producer.write(image_info(3, big.size()), big.data()));
+
+	uint64_t expected = 0;
+	const int count = consumer.read([&](const SharedImageChannel::ImageInfo &info, const void *data) {
+		EXPECT_EQ(info.x, static_cast<int32_t>(expected));
+		EXPECT_EQ(info.channel, static_cast<int32_t>(expected % 3));
+		EXPECT_EQ(info.size, pixels.size() - expected);
+		EXPECT_TRUE(check_image(reinterpret_cast<const uint8_t *>(data), info.size, expected));
+		++expected;
+	});
+	EXPECT_EQ(count, 3);
+	EXPECT_EQ(consumer.getReadCount(), 3u);
+	EXPECT_EQ(consumer.getTornCount(), 0u);
+
+	/* Images overwritten before they are read are skipped. */
+	for (uint64_t c = 3; c < 13; ++c) {
+		fill_image(pixels, c);
+		ASSERT_TRUE(producer.write(image_info(c, pixels.size()), pixels.data()));
+	}
+	expected = 10;
+	const int lateCount = consumer.read([&](const SharedImageChannel::ImageInfo &info, const void *data) {
+		EXPECT_EQ(info.x, static_cast<int32_t>(expected));
+		EXPECT_TRUE(check_image(reinterpret_cast<const uint8_t *>(data), info.size, expected));
+		++expected;
+	});
+	EXPECT_EQ(lateCount, 3);
+	EXPECT_EQ(consumer.getTornCount(), 7u);
+
+	/* A late consumer only sees new images. */
+	SharedImageChannel late;
+	ASSERT_TRUE(late.open(name));
+	EXPECT_EQ(late.read(ignore_image), 0);
+
+	producer.close();
+	EXPECT_FALSE(late.open(name));
+	EXPECT_FALSE(consumer.open(SharedImageChannel::GetChannelName(0) + "_missing"));
+}
+
+#ifndef _WIN32
+
+/* Stand-in for the render server: a separate process writing @count images as fast as it can,
+ * with @fill the pixels of each image are different, otherwise only the first image is filled. */
+static pid_t start_producer(const std::string &name, uint32_t slotCount, uint64_t imageSize, uint64_t count, bool fill)
+{
+	const pid_t pid = fork();
+	if (pid != 0) {
+		return pid;
+	}
+
+	SharedImageChannel producer;
+	if (!producer.create(name, slotCount, imageSize)) {
+		_exit(1);
+	}
+	/* Give the consumer time to open the channel before the first image. */
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	std::vector<uint8_t> pixels(imageSize);
+	for (uint64_t c = 0; c < count; ++c) {
+		if (fill || c == 0) {
+			fill_image(pixels, c);
+		}
+		producer.write(image_info(c, pixels.size()), pixels.data());
+	}
+	SharedImageChannel::ImageInfo last = image_info(count, 0);
+	last.flags = SharedImageChannel::ImageReady;
+	producer.write(last, nullptr);
+
+	/* The consumer keeps it's mapping after the name is removed. */
+	producer.close();
+	_exit(0);
+}
+
+static bool open_channel(SharedImageChannel &channel, const std::string &name)
+{
+	for (int c = 0; c < 100 && !channel.open(name); ++c) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return channel.good();
+}
+
+TEST(vfb_shared_image_channel, SeparateProcess)
+{
+	const std::string name = channel_name("process");
+	const uint64_t imageSize = 64 * 1024;
+	const pid_t pid = start_producer(name, 8, imageSize, 5000, true);
+	ASSERT_GT(pid, 0);
+
+	SharedImageChannel consumer;
+	ASSERT_TRUE(open_channel(consumer, name));
+
+	/* Every image that is not reported as torn has the pixels written for it. */
+	bool done = false;
+	int64_t previous = -1;
+	uint64_t tornImages = 0;
+	const auto start = std::chrono::steady_clock::now();
+	while (!done && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+		const uint64_t tornBefore = consumer.getTornCount();
+		uint64_t corrupted = 0;
+		bool imageCorrupted = false;
+		consumer.read([&](const SharedImageChannel::ImageInfo &info, const void *data) {
+			imageCorrupted = false;
+			if (info.flags & SharedImageChannel::ImageReady) {
+				return;
+			}
+			EXPECT_GT(info.x, previous);
+			previous = info.x;
+			if (info.size != imageSize || !check_image(reinterpret_cast<const uint8_t *>(data), info.size, info.x)) {
+				imageCorrupted = true;
+				++corrupted;
+			}
+		}, [&](const SharedImageChannel::ImageInfo &info, bool torn) {
+			/* A bad image is only acceptable if the channel noticed it was overwritten. */
+			EXPECT_TRUE(torn || !imageCorrupted);
+			tornImages += torn;
+			done = done || (!torn && (info.flags & SharedImageChannel::ImageReady));
+		});
+		EXPECT_LE(corrupted, consumer.getTornCount() - tornBefore);
+	}
+	EXPECT_LE(tornImages, consumer.getTornCount());
+	EXPECT_TRUE(done);
+	EXPECT_EQ(consumer.getReadCount() + consumer.getTornCount(), 5001u);
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST(vfb_shared_image_channel, Performance)
+{
+	const std::string name = channel_name("bench");
+	const uint64_t imageSize = BENCH_WIDTH * BENCH_HEIGHT * 4;
+	const pid_t pid = start_producer(name, 4, imageSize, BENCH_FRAMES, false);
+	ASSERT_GT(pid, 0);
+
+	SharedImageChannel consumer;
+	ASSERT_TRUE(open_channel(consumer, name));
+
+	/* Consumer copies each image once, like the viewport does into it's back buffer. */
+	std::vector<uint8_t> target(imageSize);
+	bool done = false;
+	double copyMs = 0.0;
+	const auto start = std::chrono::steady_clock::now();
+	while (!done) {
+		consumer.read([&](const SharedImageChannel::ImageInfo &info, const void *data) {
+			if (info.flags & SharedImageChannel::ImageReady) {
+				done = true;
+				return;
+			}
+			const auto copyStart = std::chrono::steady_clock::now();
+			memcpy(target.data(), data, info.size);
+			copyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count();
+		});
+	}
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	const uint64_t read = consumer.getReadCount() - 1;
+	printf("%dx%d RGBA images: read %llu, skipped %llu in %.2f ms, %.1f images/s, %.3f ms to copy one image\n",
+	       BENCH_WIDTH, BENCH_HEIGHT,
+	       static_cast<unsigned long long>(read),
+	       static_cast<unsigned long long>(consumer.getTornCount()),
+	       ms, read * 1000.0 / ms, read ? copyMs / read : 0.0);
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+#endif
@@ -0,0 +1,193 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_utils_hair.h"
+
+extern "C" {
+#include "BKE_particle.h"
+#include "BLI_math.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+#define BENCH_STRANDS 500000
+#define BENCH_SEGMENTS 16
+
+static const float hair_tm[4][4] = {
+	{0.5f, 0.1f, 0.0f, 0.0f},
+	{-0.1f, 0.5f, 0.2f, 0.0f},
+	{0.0f, -0.2f, 2.0f, 0.0f},
+	{1.0f, 2.0f, 3.0f, 1.0f},
+};
+
+/* Child cache with one array of keys per strand, some strands are virtual (segments == -1). */
+struct StrandCache {
+	StrandCache(int count, int maxSegments)
+	{
+		keys.resize(count);
+		for (int p = 0; p < count; ++p) {
+			const int segments = (p % 37 == 5) ? -1 : (p % maxSegments) + 1;
+			keys[p].resize(std::max(1, segments + 1));
+			for (size_t k = 0; k < keys[p].size(); ++k) {
+				ParticleCacheKey &key = keys[p][k];
+				memset(&key, 0, sizeof(key));
+				key.co[0] = p * 0.01f + k;
+				key.co[1] = k * 0.5f - p * 0.002f;
+				key.co[2] = (p % 7) * 0.3f;
+				key.segments = segments;
+			}
+			pointers.push_back(keys[p].data());
+		}
+	}
+
+	std::vector<std::vector<ParticleCacheKey>> keys;
+	std::vector<ParticleCacheKey*> pointers;
+};
+
+static void strand_uv(int p, float uv[3])
+{
+	uv[0] = p * 0.25f;
+	uv[1] = p * -0.5f;
+	uv[2] = 0.0f;
+}
+
+/* Reference: the serial loop exportGeomMayaHair used before FillChildStrands. */
+static void fill_reference(const StrandCache &cache, float width, bool widthFade, std::vector<int> &numVertices,
+                           std::vector<AttrVector> &vertices, std::vector<float> &widths, std::vector<AttrVector> &uvw)
+{
+	for (const ParticleCacheKey *strand : cache.pointers) {
+		const int steps = std::max(0, strand->segments);
+		numVertices.push_back(steps);
+
+		float fadeWidth = width;
+		const float fadeStep = width / (steps + 1);
+		for (int s = 0; s < steps; ++s) {
+			float co[3];
+			copy_v3_v3(co, strand[s].co);
+			mul_m4_v3(const_cast<float (*)[4]>(hair_tm), co);
+			vertices.push_back({co[0], co[1], co[2]});
+			widths.push_back(widthFade ? std::max(1e-6f, fadeWidth) : width);
+			fadeWidth -= fadeStep;
+		}
+
+		AttrVector uv = {0.0f, 0.0f, 0.0f};
+		if (steps > 0) {
+			strand_uv(numVertices.size() - 1, &uv.x);
+		}
+		uvw.push_back(uv);
+	}
+}
+
+template <typename T>
+static bool same_data(const AttrList<T> &list, const std::vector<T> &expected)
+{
+	return list.getCount() == static_cast<int>(expected.size()) &&
+	       memcmp(*list, expected.data(), expected.size() * sizeof(T)) == 0;
+}
+
+struct Filled {
+	AttrListInt numVertices;
+	AttrListVector vertices;
+	AttrListFloat widths;
+	AttrListVector uvw;
+	Hair::StrandsHash hash;
+};
+
+static Filled fill(const StrandCache &cache, bool withUV, ThreadManager::Ptr threadManager, bool widthFade = true)
+{
+	Filled result;
+	result.hash = Hair::FillChildStrands(cache.pointers.data(), cache.pointers.size(), hair_tm, 0.01f, widthFade,
+	                                     withUV ? Hair::StrandUVFn(strand_uv) : Hair::StrandUVFn(), threadManager,
+	                                     result.numVertices, result.vertices, result.widths, result.uvw);
+	return result;
+}
+
+TEST(vfb_utils_hair, MatchesReference)
+{
+	/* Below and above the parallel threshold, with partial last chunk. */
+	const int counts[] = {0, 1, 1000, Hair::HairParallelStrands + Hair::HairChunkStrands / 3};
+	ThreadManager::Ptr threadManager = ThreadManager::make(3);
+
+	for (const int count : counts) {
+		const StrandCache cache(count, 9);
+		for (const bool widthFade : {false, true}) {
+			std::vector<int> numVertices;
+			std::vector<AttrVector> vertices, uvw;
+			std::vector<float> widths;
+			fill_reference(cache, 0.01f, widthFade, numVertices, vertices, widths, uvw);
+
+			for (const ThreadManager::Ptr &manager : {ThreadManager::Ptr(), threadManager}) {
+				const Filled filled = fill(cache, true, manager, widthFade);
+				EXPECT_TRUE(same_data(filled.numVertices, numVertices)) << count << " strands, workers: " << bool(manager);
+				EXPECT_TRUE(same_data(filled.vertices, vertices)) << count << " strands, workers: " << bool(manager);
+				EXPECT_TRUE(same_data(filled.widths, widths)) << count << " strands, workers: " << bool(manager);
+				EXPECT_TRUE(same_data(filled.uvw, uvw)) << count << " strands, workers: " << bool(manager);
+			}
+		}
+	}
+	threadManager->stop();
+}
+
+TEST(vfb_utils_hair, HashTracksContent)
+{
+	StrandCache cache(Hair::HairParallelStrands * 2, 5);
+
+	ThreadManager::Ptr threadManager = ThreadManager::make(7);
+	ThreadManager::Ptr twoWorkers = ThreadManager::make(2);
+
+	const Filled serial = fill(cache, true, nullptr);
+	const Filled parallel = fill(cache, true, threadManager);
+	EXPECT_EQ(serial.hash, parallel.hash);
+	EXPECT_EQ(fill(cache, true, twoWorkers).hash, serial.hash);
+
+	/* UVs are part of the hash. */
+	const Filled noUV = fill(cache, false, threadManager);
+	EXPECT_NE(noUV.hash, serial.hash);
+	EXPECT_EQ(noUV.uvw.getCount(), 0);
+
+	/* Tasks discarded by a stopped manager leave all of the work to the calling thread. */
+	twoWorkers->stop();
+	EXPECT_EQ(fill(cache, true, twoWorkers).hash, serial.hash);
+
+	/* Moving one point in the last chunk changes the hash. */
+	cache.keys.back()[0].co[2] += 0.5f;
+	EXPECT_NE(fill(cache, true, threadManager).hash, serial.hash);
+	threadManager->stop();
+}
+
+TEST(vfb_utils_hair, Performance)
+{
+	const StrandCache cache(BENCH_STRANDS, BENCH_SEGMENTS);
+	const int threads = std::max(1u, std::thread::hardware_concurrency());
+
+	ThreadManager::Ptr threadManager = ThreadManager::make(threads);
+
+	auto time_ms = [&](ThreadManager::Ptr manager) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		fill(cache, true, manager);
+		const auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	};
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	{
+		std::vector<int> numVertices;
+		std::vector<AttrVector> vertices, uvw;
+		std::vector<float> widths;
+		fill_reference(cache, 0.01f, true, numVertices, vertices, widths, uvw);
+	}
+	const double reference = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	printf("%d strands: reference %.2f ms (no hash), filled and hashed on 1 thread %.2f ms, on %d threads %.2f ms\n",
+	       BENCH_STRANDS, reference, time_ms(nullptr), threads, time_ms(threadManager));
+	threadManager->stop();
+}
@@ -0,0 +1,161 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_utils_mesh_topology.h"
+
+#include "DNA_meshdata_types.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+#define BENCH_GRID_SIZE 1024
+
+struct TestMesh {
+	std::vector<MFace> faces;
+	std::vector<MTFace> uvs;
+	std::vector<MCol> colors;
+	std::vector<Mesh::MapChannelLayer> layers;
+	int vertexCount;
+};
+
+/* Grid of quads with one UV and one color layer. */
+static void make_grid(TestMesh &mesh, int size)
+{
+	mesh.vertexCount = (size + 1) * (size + 1);
+	mesh.faces.resize(size * size);
+	mesh.uvs.resize(mesh.faces.size());
+	mesh.colors.resize(mesh.faces.size() * 4);
+	memset(mesh.faces.data(), 0, mesh.faces.size() * sizeof(MFace));
+	memset(mesh.colors.data(), 0, mesh.colors.size() * sizeof(MCol));
+
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			const int f = y * size + x;
+			MFace &face = mesh.faces[f];
+			face.v1 = y * (size + 1) + x;
+			face.v2 = face.v1 + 1;
+			face.v3 = face.v2 + size + 1;
+			face.v4 = face.v3 - 1;
+			face.mat_nr = x % 3;
+
+			const int corner[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+			for (int c = 0; c < 4; ++c) {
+				mesh.uvs[f].uv[c][0] = float(x + corner[c][0]) / size;
+				mesh.uvs[f].uv[c][1] = float(y + corner[c][1]) / size;
+				mesh.colors[f * 4 + c].r = static_cast<char>(x);
+			}
+		}
+	}
+
+	mesh.layers.clear();
+	mesh.layers.emplace_back("UVMap", mesh.uvs.data(), nullptr);
+	mesh.layers.emplace_back("Col", nullptr, mesh.colors.data());
+}
+
+static Mesh::TopologyKey get_key(const TestMesh &mesh, bool merge = false)
+{
+	return Mesh::GetTopologyKey(mesh.vertexCount, mesh.faces.data(), mesh.faces.size(), mesh.layers, merge);
+}
+
+TEST(vfb_utils_mesh_topology, Key)
+{
+	TestMesh mesh;
+	make_grid(mesh, 16);
+	const Mesh::TopologyKey key = get_key(mesh);
+
+	TestMesh same;
+	make_grid(same, 16);
+	EXPECT_TRUE(key == get_key(same));
+	EXPECT_TRUE(key != get_key(same, true));
+
+	TestMesh changed;
+	make_grid(changed, 16);
+	changed.faces[7].v4 = 0;
+	EXPECT_TRUE(key != get_key(changed));
+
+	make_grid(changed, 16);
+	changed.faces[100].mat_nr = 5;
+	EXPECT_TRUE(key != get_key(changed));
+
+	make_grid(changed, 16);
+	changed.uvs[31].uv[2][1] += 0.5f;
+	EXPECT_TRUE(key != get_key(changed));
+
+	make_grid(changed, 16);
+	changed.colors[255 * 4 + 3].b = 1;
+	EXPECT_TRUE(key != get_key(changed));
+
+	make_grid(changed, 16);
+	changed.layers[0].name = "UVMap.001";
+	EXPECT_TRUE(key != get_key(changed));
+
+	make_grid(changed, 16);
+	changed.layers.pop_back();
+	EXPECT_TRUE(key != get_key(changed));
+
+	make_grid(changed, 16);
+	changed.vertexCount++;
+	EXPECT_TRUE(key != get_key(changed));
+}
+
+TEST(vfb_utils_mesh_topology, Cache)
+{
+	TestMesh mesh;
+	make_grid(mesh, 8);
+
+	Mesh::MeshTopology topology;
+	topology.key = get_key(mesh);
+	topology.faces = AttrListInt(mesh.faces.size() * 6);
+	topology.map_channels.data["UVMap"].name = "UVMap";
+
+	Mesh::TopologyCache cache;
+	Mesh::MeshTopology found;
+	EXPECT_FALSE(cache.find("Geom@Cube", topology.key, found));
+	cache.store("Geom@Cube", topology);
+
+	/* Lists are shared with the stored ones, not copied. */
+	ASSERT_TRUE(cache.find("Geom@Cube", topology.key, found));
+	EXPECT_EQ(found.faces.getData().get(), topology.faces.getData().get());
+	EXPECT_EQ(found.map_channels.data.size(), 1u);
+
+	mesh.faces[0].v1 = 5;
+	EXPECT_FALSE(cache.find("Geom@Cube", get_key(mesh), found));
+	EXPECT_FALSE(cache.find("Geom@Sphere", topology.key, found));
+
+	Mesh::TopologyCache::Stats stats = cache.getStats();
+	EXPECT_EQ(stats.hits, 1);
+	EXPECT_EQ(stats.misses, 3);
+
+	cache.clear();
+	EXPECT_FALSE(cache.find("Geom@Cube", topology.key, found));
+	stats = cache.getStats();
+	EXPECT_EQ(stats.hits, 0);
+	EXPECT_EQ(stats.misses, 1);
+}
+
+TEST(vfb_utils_mesh_topology, Performance)
+{
+	TestMesh mesh;
+	make_grid(mesh, BENCH_GRID_SIZE);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	const Mesh::TopologyKey key = get_key(mesh);
+	const double keyMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const auto fillStart = std::chrono::high_resolution_clock::now();
+	AttrListString names;
+	AttrMapChannels channels;
+	Mesh::FillMapChannels(mesh.faces.data(), mesh.faces.size(), mesh.layers, true, 1, names, channels);
+	const double fillMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - fillStart).count();
+
+	printf("%d quads with 2 map channels: topology key %.2f ms, filling the map channels %.2f ms\n",
+	       BENCH_GRID_SIZE * BENCH_GRID_SIZE, keyMs, fillMs);
+	EXPECT_NE(key.hash[0], 0u);
+}
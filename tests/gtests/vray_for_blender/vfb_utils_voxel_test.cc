@@ -0,0 +1,184 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+#include "vfb_utils_voxel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace VRayForBlender;
+using namespace VRayBaseTypes;
+
+#define BENCH_RES 256
+
+static size_t voxel_index(const int res[3], int x, int y, int z)
+{
+	return (static_cast<size_t>(z) * res[1] + y) * res[0] + x;
+}
+
+/* Grid with a ball of density around @center, zero everywhere else. */
+static std::vector<float> make_ball(const int res[3], const float center[3], float radius)
+{
+	std::vector<float> grid(static_cast<size_t>(res[0]) * res[1] * res[2], 0.0f);
+	for (int z = 0; z < res[2]; ++z) {
+		for (int y = 0; y < res[1]; ++y) {
+			for (int x = 0; x < res[0]; ++x) {
+				const float dx = x - center[0], dy = y - center[1], dz = z - center[2];
+				const float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+				if (dist < radius) {
+					grid[voxel_index(res, x, y, z)] = 1.0f - dist / radius + 1e-3f * x;
+				}
+			}
+		}
+	}
+	return grid;
+}
+
+/* Exact voxel bounds of the non-zero voxels. */
+static Voxel::VoxelBox exact_bounds(const std::vector<float> &grid, const int res[3])
+{
+	Voxel::VoxelBox box;
+	for (int c = 0; c < 3; ++c) {
+		box.min[c] = res[c];
+		box.max[c] = 0;
+	}
+	for (int z = 0; z < res[2]; ++z) {
+		for (int y = 0; y < res[1]; ++y) {
+			for (int x = 0; x < res[0]; ++x) {
+				if (grid[voxel_index(res, x, y, z)] != 0.0f) {
+					const int coords[3] = {x, y, z};
+					for (int c = 0; c < 3; ++c) {
+						box.min[c] = std::min(box.min[c], coords[c]);
+						box.max[c] = std::max(box.max[c], coords[c] + 1);
+					}
+				}
+			}
+		}
+	}
+	return box;
+}
+
+TEST(vfb_utils_voxel, OccupiedBricks)
+{
+	/* Above the parallel threshold, with partial bricks. */
+	const int res[3] = {70, 45, 90};
+	const float center[3] = {40.0f, 20.0f, 12.0f};
+	const std::vector<float> ball = make_ball(res, center, 9.5f);
+	const std::vector<float> empty(ball.size(), 0.0f);
+	const Voxel::VoxelBox exact = exact_bounds(ball, res);
+	ThreadManager::Ptr threadManager = ThreadManager::make(3);
+
+	for (const ThreadManager::Ptr &manager : {ThreadManager::Ptr(), threadManager}) {
+		const Voxel::OccupiedBricks bricks = Voxel::FindOccupiedBricks({empty.data(), nullptr, ball.data()}, res, 0.0f, manager);
+		EXPECT_EQ(bricks.bricks[0], 9);
+		EXPECT_EQ(bricks.bricks[1], 6);
+		EXPECT_EQ(bricks.bricks[2], 12);
+		EXPECT_GT(bricks.occupiedCount, 0);
+		EXPECT_LT(bricks.occupiedCount, 9 * 6 * 12);
+
+		for (int c = 0; c < 3; ++c) {
+			EXPECT_EQ(bricks.bounds.min[c], exact.min[c] / Voxel::VoxelBrickSize * Voxel::VoxelBrickSize);
+			EXPECT_EQ(bricks.bounds.max[c], std::min(res[c], (exact.max[c] + Voxel::VoxelBrickSize - 1) / Voxel::VoxelBrickSize * Voxel::VoxelBrickSize));
+		}
+
+		/* Every non-zero voxel is in an occupied brick. */
+		for (int z = 0; z < res[2]; ++z) {
+			for (int y = 0; y < res[1]; ++y) {
+				for (int x = 0; x < res[0]; ++x) {
+					if (ball[voxel_index(res, x, y, z)] != 0.0f) {
+						const int bx = x / Voxel::VoxelBrickSize, by = y / Voxel::VoxelBrickSize, bz = z / Voxel::VoxelBrickSize;
+						ASSERT_TRUE(bricks.occupied[(bz * bricks.bricks[1] + by) * bricks.bricks[0] + bx]);
+					}
+				}
+			}
+		}
+	}
+
+	const Voxel::OccupiedBricks none = Voxel::FindOccupiedBricks({empty.data()}, res, 0.0f, threadManager);
+	EXPECT_EQ(none.occupiedCount, 0);
+	const Voxel::VoxelBox box = Voxel::GetExportBox(none, res);
+	EXPECT_EQ(box.count(), 1u);
+	threadManager->stop();
+}
+
+TEST(vfb_utils_voxel, CropKeepsSampling)
+{
+	const int res[3] = {64, 40, 48};
+	const float center[3] = {10.0f, 30.0f, 40.0f};
+	const std::vector<float> ball = make_ball(res, center, 12.0f);
+
+	const Voxel::OccupiedBricks bricks = Voxel::FindOccupiedBricks({ball.data()}, res, 0.0f, nullptr);
+	const Voxel::VoxelBox box = Voxel::GetExportBox(bricks, res);
+	EXPECT_LT(box.count(), ball.size());
+
+	AttrListFloat crop;
+	Voxel::CropGrid(ball.data(), res, box, false, crop);
+	ASSERT_EQ(crop.getCount(), static_cast<int>(box.count()));
+
+	float tm[4][4];
+	Voxel::GetBoxUVWTransform(res, box, tm);
+
+	/* Sampling the crop at the transformed UVW of each voxel center gives the same value as the whole grid,
+	 * voxels outside of the box are zero and the sides of the box are zero too. */
+	const int cropRes[3] = {box.size(0), box.size(1), box.size(2)};
+	for (int z = 0; z < res[2]; ++z) {
+		for (int y = 0; y < res[1]; ++y) {
+			for (int x = 0; x < res[0]; ++x) {
+				const float uvw[3] = {(x + 0.5f) / res[0], (y + 0.5f) / res[1], (z + 0.5f) / res[2]};
+				int voxel[3];
+				for (int c = 0; c < 3; ++c) {
+					const float boxUVW = uvw[c] * tm[c][c] + tm[3][c];
+					voxel[c] = std::max(0, std::min(cropRes[c] - 1, static_cast<int>(floorf(boxUVW * cropRes[c]))));
+				}
+				ASSERT_EQ((*crop)[voxel_index(cropRes, voxel[0], voxel[1], voxel[2])], ball[voxel_index(res, x, y, z)])
+				    << x << " " << y << " " << z;
+			}
+		}
+	}
+}
+
+TEST(vfb_utils_voxel, QuantizeHalf)
+{
+	EXPECT_EQ(Voxel::QuantizeHalf(0.0f), 0.0f);
+	EXPECT_EQ(Voxel::QuantizeHalf(1.0f), 1.0f);
+	EXPECT_EQ(Voxel::QuantizeHalf(-0.5f), -0.5f);
+	EXPECT_TRUE(std::isinf(Voxel::QuantizeHalf(INFINITY)));
+
+	/* Largest float below 2 rounds up to 2, carrying into the exponent. */
+	EXPECT_EQ(Voxel::QuantizeHalf(nextafterf(2.0f, 0.0f)), 2.0f);
+
+	for (float value = 1e-4f; value < 1e4f; value *= 1.37f) {
+		const float quantized = Voxel::QuantizeHalf(value);
+		EXPECT_LE(fabsf(quantized - value), value / 2048.0f) << value;
+		EXPECT_EQ(Voxel::QuantizeHalf(quantized), quantized);
+	}
+}
+
+TEST(vfb_utils_voxel, Performance)
+{
+	const int res[3] = {BENCH_RES, BENCH_RES, BENCH_RES};
+	const float center[3] = {BENCH_RES * 0.5f, BENCH_RES * 0.4f, BENCH_RES * 0.3f};
+	const std::vector<float> ball = make_ball(res, center, BENCH_RES * 0.2f);
+	const int threads = std::max(1u, std::thread::hardware_concurrency());
+
+	ThreadManager::Ptr threadManager = ThreadManager::make(threads);
+
+	auto time_ms = [&](ThreadManager::Ptr manager) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		const Voxel::OccupiedBricks bricks = Voxel::FindOccupiedBricks({ball.data()}, res, 0.0f, manager);
+		AttrListFloat crop;
+		Voxel::CropGrid(ball.data(), res, Voxel::GetExportBox(bricks, res), false, crop);
+		const auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	};
+
+	const Voxel::VoxelBox box = Voxel::GetExportBox(Voxel::FindOccupiedBricks({ball.data()}, res, 0.0f, threadManager), res);
+	printf("%d^3 grid: exported %.1f%% of the voxels, 1 thread %.2f ms, %d threads %.2f ms\n",
+	       BENCH_RES, 100.0 * box.count() / ball.size(), time_ms(nullptr), threads, time_ms(threadManager));
+	threadManager->stop();
+}
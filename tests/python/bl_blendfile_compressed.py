@@ -0,0 +1,84 @@
+# ##### BEGIN GPL LICENSE BLOCK #####
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software Foundation,
+#  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+#
+# ##### END GPL LICENSE BLOCK #####
+
+# <pep8 compliant>
+
+# Saves a compressed .blend file large enough to be split in several
+# compressed blocks, then opens it again and compares the data.
+# Also run with '-t 1', where the blocks are compressed by the saving thread.
+#
+#   ./blender.bin --background -noaudio --factory-startup -t 1 \
+#       --python tests/python/bl_blendfile_compressed.py -- /tmp/compressed.blend
+
+import bpy
+
+import os
+import sys
+import tempfile
+
+VERTS_NUM = 200000
+
+
+def test_path():
+    argv = sys.argv[sys.argv.index("--") + 1:] if "--" in sys.argv else []
+    if argv:
+        return argv[0]
+    return os.path.join(tempfile.gettempdir(), "bl_blendfile_compressed.blend")
+
+
+def mesh_create():
+    me = bpy.data.meshes.new("CompressedMesh")
+    me.vertices.add(VERTS_NUM)
+    # not too regular, so the blocks don't compress to almost nothing
+    me.vertices.foreach_set("co", [((i * 7919) % 10007) * 0.001 for i in range(VERTS_NUM * 3)])
+    me.use_fake_user = True
+    return me
+
+
+def mesh_coords(me):
+    co = [0.0] * (len(me.vertices) * 3)
+    me.vertices.foreach_get("co", co)
+    return co
+
+
+def main():
+    filepath = test_path()
+    coords = mesh_coords(mesh_create())
+
+    bpy.ops.wm.save_as_mainfile(filepath=filepath, compress=True)
+    bpy.ops.wm.open_mainfile(filepath=filepath)
+
+    me = bpy.data.meshes.get("CompressedMesh")
+    assert(me is not None)
+    assert(len(me.vertices) == VERTS_NUM)
+    assert(mesh_coords(me) == coords)
+
+    with open(filepath, "rb") as f:
+        # gzip magic, the file must not have been saved uncompressed
+        assert(f.read(2) == b"\x1f\x8b")
+
+    os.remove(filepath)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except:
+        import traceback
+        traceback.print_exc()
+        sys.exit(1)
@@ -0,0 +1,146 @@
+# ##### BEGIN GPL LICENSE BLOCK #####
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software Foundation,
+#  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+#
+# ##### END GPL LICENSE BLOCK #####
+
+# <pep8 compliant>
+
+# Benchmark of global undo, pushes undo steps that change, add and reorder
+# data-blocks in a scene with many objects, then undoes and redoes all of them.
+#
+# Run with '--debug-wm' to print the memory statistics of each undo step:
+#
+#   ./blender.bin --background -noaudio --factory-startup --debug-wm \
+#       --python tests/python/bl_undo_memfile.py -- --objects 2000
+
+import bpy
+
+import sys
+import time
+
+try:
+    import resource
+except ImportError:
+    resource = None
+
+
+def parse_args():
+    import argparse
+
+    argv = sys.argv[sys.argv.index("--") + 1:] if "--" in sys.argv else []
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--objects", type=int, default=500)
+    parser.add_argument("--steps", type=int, default=30)
+    return parser.parse_args(argv)
+
+
+def max_rss_mb():
+    if resource is None:
+        return 0.0
+    rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # kilobytes on Linux, bytes on macOS
+    return rss / (1024.0 * 1024.0 if sys.platform == "darwin" else 1024.0)
+
+
+def scene_create(objects):
+    scene = bpy.context.scene
+    verts = [(x, y, z) for x in (-1.0, 1.0) for y in (-1.0, 1.0) for z in (-1.0, 1.0)]
+    faces = [(0, 1, 3, 2), (4, 6, 7, 5), (0, 4, 5, 1), (2, 3, 7, 6), (0, 2, 6, 4), (1, 5, 7, 3)]
+
+    for i in range(objects):
+        me = bpy.data.meshes.new("Mesh_%05d" % i)
+        me.from_pydata(verts, [], faces)
+        ob = bpy.data.objects.new("Object_%05d" % i, me)
+        ob.location = (i % 50, i // 50, 0.0)
+        scene.objects.link(ob)
+
+
+def step_apply(step):
+    """Change the scene for undo step 'step', returns the name of the step."""
+    scene = bpy.context.scene
+    kind = step % 3
+
+    if kind == 0:
+        # change data in place
+        ob = bpy.data.objects[step % len(bpy.data.objects)]
+        ob.location.z += 1.0
+        return "Move"
+    elif kind == 1:
+        # add a data-block at the front of the sorted list, moving all others
+        me = bpy.data.meshes.new("AMesh_%05d" % step)
+        ob = bpy.data.objects.new("AObject_%05d" % step, me)
+        scene.objects.link(ob)
+        return "Add"
+    else:
+        # rename, so the data-block moves to another position in the list
+        ob = bpy.data.objects[(step * 7) % len(bpy.data.objects)]
+        ob.name = "ZObject_%05d" % step
+        return "Rename"
+
+
+def undo_context():
+    window = bpy.context.window_manager.windows[0]
+    return {"window": window, "screen": window.screen}
+
+
+def main():
+    args = parse_args()
+
+    bpy.context.user_preferences.edit.undo_steps = args.steps + 2
+    bpy.context.user_preferences.edit.undo_memory_limit = 0
+
+    scene_create(args.objects)
+    bpy.ops.ed.undo_push(message="Initial")
+    rss_initial = max_rss_mb()
+
+    counts = [len(bpy.data.objects)]
+    time_push = 0.0
+    for step in range(args.steps):
+        name = step_apply(step)
+        t = time.time()
+        bpy.ops.ed.undo_push(message=name)
+        time_push += time.time() - t
+        counts.append(len(bpy.data.objects))
+
+    override = undo_context()
+
+    t = time.time()
+    for step in range(args.steps):
+        bpy.ops.ed.undo(override)
+        assert(len(bpy.data.objects) == counts[-2 - step])
+    time_undo = time.time() - t
+
+    t = time.time()
+    for step in range(args.steps):
+        bpy.ops.ed.redo(override)
+        assert(len(bpy.data.objects) == counts[1 + step])
+    time_redo = time.time() - t
+
+    print("%d objects, %d undo steps:" % (args.objects, args.steps))
+    print("  push %.2f ms, undo %.2f ms, redo %.2f ms per step" %
+          (time_push * 1000.0 / args.steps,
+           time_undo * 1000.0 / args.steps,
+           time_redo * 1000.0 / args.steps))
+    print("  max resident memory %.2f MB, %.2f MB after the first step" % (max_rss_mb(), rss_initial))
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except:
+        import traceback
+        traceback.print_exc()
+        sys.exit(1)